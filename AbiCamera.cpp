@@ -1,8 +1,11 @@
 #include "AbiCamera.h"
 #include "ModuleInterface.h"
 
+#include <algorithm>
+#include <cmath>
 #include <format>
 #include <array>
+#include <thread>
 
 using namespace std;
 
@@ -10,6 +13,25 @@ const char* g_CameraName = "AbiCam";
 
 const char* g_PixelType_8bit = "8bit";
 
+const char* g_SaveFormat_BigTiff = "BigTIFF";
+const char* g_SaveFormat_OmeTiff = "OME-TIFF";
+
+const char* g_Compression_None = "None";
+const char* g_Compression_Rice = "Rice";
+const char* g_Compression_Deflate = "Deflate";
+
+const char* g_BinningMode_Device = "Device";
+const char* g_BinningMode_Host = "Host";
+const char* g_BinningMode_Auto = "Auto";
+
+const char* g_HostBinning_Sum = "Sum";
+const char* g_HostBinning_Average = "Average";
+
+const char* g_Trigger_Internal = "Internal";
+const char* g_Trigger_Edge = "External Edge";
+const char* g_Trigger_Gate = "External Gate";
+const char* g_Trigger_Burst = "Software Burst";
+
 ///////////////////////////////////////////////////////////////////////////////
 // Exported MMDevice API
 ///////////////////////////////////////////////////////////////////////////////
@@ -57,18 +79,65 @@ MODULE_API void DeleteDevice(MM::Device* pDevice)
 * perform most of the initialization in the Initialize() method.
 */
 AbiCamera::AbiCamera() :
+    m_initialized(false),
+    m_thread(0),
     m_binning(1),
+    m_hostBinning(1),
+    m_binningMode(g_BinningMode_Device),
+    m_hostBinningMode(HostBinning::Mode::Sum),
     m_bytesPerPixel(1),
     m_bitDepth(8),
-    m_initialized(false),
+    m_transferBitDepth(8),
+    m_adaptiveBitDepth(0),
+    m_recentNoise{},
+    m_recentNoiseCount(0),
+    m_subtractBackground(1),
+    m_cold(0),
+    m_capsCachePath("AbiCameraCapabilities.txt"),
+    m_skippedCommands(0),
+    m_ccdT(42.42),
+    m_lastTempRead(std::chrono::high_resolution_clock::now()),
+    m_tempThread(0),
+    m_tempSampleMs(1000.0),
+    m_tempStable(false),
     m_exposureMs(1000.0),
+    m_imgWidth(0),
+    m_imgHeight(0),
+    m_readWidth(0),
+    m_readHeight(0),
+    m_hugePages(0),
+    m_previewThread(0),
+    m_progressive(0),
+    m_progressiveRefreshMs(250.0),
+    m_frameInProgress(false),
+    m_previewRows(0),
     m_roiStartX(0),
     m_roiStartY(0),
-    m_thread(0),
-    m_subtractBackground(1),
-    m_ccdT(42.42),
-    m_cold(0),
-    m_lastTempRead(std::chrono::high_resolution_clock::now())
+    m_saveFrames(0),
+    m_saveFormat(g_SaveFormat_OmeTiff),
+    m_compression(g_Compression_None),
+    m_triggerMode(g_Trigger_Internal),
+    m_triggerTimeoutMs(10000.0),
+    m_armedFrames(0),
+    m_triggerBackgroundRefreshS(0.0),
+    m_autoReconnect(1),
+    m_reconnectTimeoutS(30.0),
+    m_reconnects(0),
+    m_lastOutageMs(0.0),
+    m_resumeGapMs(0.0),
+    m_processingPolicyRefused(false),
+    m_metricsEnabled(0),
+    m_metricsTarget("AbiCameraMetrics.prom"),
+    m_metricsIntervalS(5.0),
+    m_metricsLastFrames(0),
+    m_metricsLastBytes(0),
+    m_sharedRingEnabled(0),
+    m_sharedRingName("AbiCamFrames"),
+    m_sharedRingSlots(8),
+    m_streamEnabled(0),
+    m_streamEndpoint("127.0.0.1:5555"),
+    m_streamDownsample(1),
+    m_streamCompression(g_Compression_None)
 {
     // call the base class method to set-up default error codes/messages
     InitializeDefaultErrorMessages();
@@ -76,6 +145,14 @@ AbiCamera::AbiCamera() :
     SetErrorText(ERR_LIBRARY_INIT, "Abicamera Library initialisation failed. Make sure the device is connected and you selected the correct COM port.");
     SetErrorText(ERR_IMAGE_READ, "Couldn't read all image bytes");
     SetErrorText(ERR_COM_RESPONSE, "Error with response from com port, maybe try again");
+    SetErrorText(ERR_FILE_OPEN, "Couldn't open the file for saving frames, check the save path");
+    SetErrorText(ERR_SHARED_MEMORY, "Couldn't create the shared memory frame ring");
+    SetErrorText(ERR_STREAM_SERVER, "Couldn't start the frame stream server, check the stream endpoint");
+    SetErrorText(ERR_TRIGGER_TIMEOUT, "No triggered frame arrived before the trigger timeout");
+    SetErrorText(ERR_PORT_LOST, "The camera stopped answering on the serial port and didn't come back before the reconnect timeout; if the port itself went away, reload the configuration to reopen it");
+    SetErrorText(ERR_DEVICE_CHANGED, "A different camera answered on the port after a dropout");
+    SetErrorText(ERR_METRICS_EXPORT, "Couldn't start the metrics exporter, check the metrics target");
+    SetErrorText(ERR_POLICY_CONFLICT, "Another camera holds the policy of the shared compression threads, set its processing policy back to the default first");
 
     // Description property
     int ret = CreateProperty(MM::g_Keyword_Description, "AbiCamera development adapter", MM::String, true);
@@ -85,6 +162,13 @@ AbiCamera::AbiCamera() :
 
     CPropertyAction* pAct = new CPropertyAction(this, &AbiCamera::OnPort);
     CreateProperty(MM::g_Keyword_Port, "Undefined", MM::String, false, pAct, true);
+
+    // File caching the capabilities reported by each firmware version
+    pAct = new CPropertyAction(this, &AbiCamera::OnCapabilityCache);
+    CreateProperty("Capability Cache", m_capsCachePath.c_str(), MM::String, false, pAct, true);
+
+    m_thread = new SequenceThread(this);
+    m_tempThread = new TemperatureThread(this);
 }
 
 /**
@@ -100,6 +184,8 @@ AbiCamera::~AbiCamera()
         Shutdown();
 
     delete m_thread;
+    delete m_previewThread;
+    delete m_tempThread;
 }
 
 /**
@@ -126,24 +212,45 @@ int AbiCamera::Initialize()
         return DEVICE_OK;
     }
 
+    int ret = DiscoverCapabilities();
+    if (ret != DEVICE_OK)
+        return ret;
+
     // set property list
     // -----------------
 
     // binning
     CPropertyAction* pAct = new CPropertyAction(this, &AbiCamera::OnBinning);
-    int ret = CreateProperty(MM::g_Keyword_Binning, "1", MM::Integer, false, pAct);
+    ret = CreateProperty(MM::g_Keyword_Binning, "1", MM::Integer, false, pAct);
     assert(ret == DEVICE_OK);
 
-    vector<string> binningValues;
-    binningValues.push_back("1");
-    binningValues.push_back("2");
-    binningValues.push_back("4");
-    binningValues.push_back("8");
-    binningValues.push_back("16");
-    binningValues.push_back("32");
-    binningValues.push_back("64");
+    ret = UpdateBinningValues();
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnBinningMode);
+    ret = CreateStringProperty("Binning Mode", g_BinningMode_Device, false, pAct);
+    assert(ret == DEVICE_OK);
+
+    vector<string> binningModes{ g_BinningMode_Device, g_BinningMode_Host, g_BinningMode_Auto };
+    ret = SetAllowedValues("Binning Mode", binningModes);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnHostBinningMode);
+    ret = CreateStringProperty("Host Binning", g_HostBinning_Sum, false, pAct);
+    assert(ret == DEVICE_OK);
+
+    vector<string> hostBinningModes{ g_HostBinning_Sum, g_HostBinning_Average };
+    ret = SetAllowedValues("Host Binning", hostBinningModes);
+    if (ret != DEVICE_OK)
+        return ret;
 
-    ret = SetAllowedValues(MM::g_Keyword_Binning, binningValues);
+    pAct = new CPropertyAction(this, &AbiCamera::OnDeviceBinningFactor);
+    ret = CreateIntegerProperty("Device Binning Factor", 1, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnHostBinningFactor);
+    ret = CreateIntegerProperty("Host Binning Factor", 1, true, pAct);
     assert(ret == DEVICE_OK);
 
     // pixel type
@@ -158,19 +265,36 @@ int AbiCamera::Initialize()
     assert(ret == DEVICE_OK);
 
     // Bit depth
+    if (!m_caps.SupportsBitDepth(m_bitDepth))
+        m_bitDepth = m_caps.bitDepths.back();
+    m_transferBitDepth = m_bitDepth;
     pAct = new CPropertyAction(this, &AbiCamera::OnBitDepth);
-    ret = CreateIntegerProperty("BitDepth", 8, false, pAct);
+    ret = CreateIntegerProperty("BitDepth", m_bitDepth, false, pAct);
     assert(ret == DEVICE_OK);
 
     vector<string> bitDepths;
-    bitDepths.push_back("6");
-    bitDepths.push_back("8");
-    bitDepths.push_back("10");
-    bitDepths.push_back("12");
+    for (int bitDepth : m_caps.bitDepths)
+        bitDepths.push_back(std::to_string(bitDepth));
     ret = SetAllowedValues("BitDepth", bitDepths);
     if (ret != DEVICE_OK)
         return ret;
 
+    // fewer bits only make the transfer shorter when the camera packs them
+    pAct = new CPropertyAction(this, &AbiCamera::OnAdaptiveBitDepth);
+    ret = CreateIntegerProperty("Adaptive Bit Depth", 0, false, pAct);
+    assert(ret == DEVICE_OK);
+
+    vector<string> adaptiveOptions{ "0" };
+    if (m_caps.packed)
+        adaptiveOptions.push_back("1");
+    ret = SetAllowedValues("Adaptive Bit Depth", adaptiveOptions);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnTransferBitDepth);
+    ret = CreateIntegerProperty("Transfer Bit Depth", m_bitDepth, true, pAct);
+    assert(ret == DEVICE_OK);
+
     // Subtract background
     pAct = new CPropertyAction(this, &AbiCamera::OnBackground);
     ret = CreateIntegerProperty("Subtract Background", 1, false, pAct);
@@ -182,6 +306,20 @@ int AbiCamera::Initialize()
         return ret;
 
 
+    // What the firmware reported it supports
+    ret = CreateStringProperty("Firmware Version", m_caps.firmware.empty() ? "Unknown" : m_caps.firmware.c_str(), true);
+    assert(ret == DEVICE_OK);
+    ret = CreateIntegerProperty("Device ROI Readout", m_caps.roi, true);
+    assert(ret == DEVICE_OK);
+    ret = CreateIntegerProperty("Device Burst Mode", m_caps.burst, true);
+    assert(ret == DEVICE_OK);
+    ret = CreateIntegerProperty("Packed Transfer", m_caps.packed, true);
+    assert(ret == DEVICE_OK);
+    ret = CreateIntegerProperty("Compressed Transfer", m_caps.compressed, true);
+    assert(ret == DEVICE_OK);
+    ret = CreateIntegerProperty("Max Baud Rate", m_caps.maxBaud, true);
+    assert(ret == DEVICE_OK);
+
     // camera temperature
     pAct = new CPropertyAction(this, &AbiCamera::OnCCDTemp);
     ret = CreateFloatProperty(MM::g_Keyword_CCDTemperature, 42.42, true, pAct);
@@ -189,6 +327,34 @@ int AbiCamera::Initialize()
         return ret;
     SetPropertyLimits(MM::g_Keyword_CCDTemperature, -100.0, 100.0);
 
+    // Cooling stabilization, tracked in the background
+    pAct = new CPropertyAction(this, &AbiCamera::OnTempStable);
+    ret = CreateIntegerProperty("Temperature Stable", 0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnTempRate);
+    ret = CreateFloatProperty("Temperature Rate C/min", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnTempHistory);
+    ret = CreateStringProperty("Temperature History", "", true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnTempTolerance);
+    ret = CreateFloatProperty("Temperature Tolerance C", m_tempTracker.GetToleranceC(), false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Temperature Tolerance C", 0.01, 10.0);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnTempWindow);
+    ret = CreateFloatProperty("Temperature Window s", m_tempTracker.GetWindowS(), false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Temperature Window s", 5.0, 3600.0);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnTempSampleInterval);
+    ret = CreateFloatProperty("Temperature Sample ms", m_tempSampleMs, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Temperature Sample ms", 200.0, 60000.0);
+
     // Subtract background
     pAct = new CPropertyAction(this, &AbiCamera::OnCold);
     ret = CreateIntegerProperty("Cool camera", 1, false, pAct);
@@ -199,672 +365,3610 @@ int AbiCamera::Initialize()
     if (ret != DEVICE_OK)
         return ret;
 
-    // synchronize all properties
-    // --------------------------
-    ret = UpdateStatus();
+    // Saving frames to disk
+    pAct = new CPropertyAction(this, &AbiCamera::OnSavePath);
+    ret = CreateStringProperty("Save Path", "", false, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnSaveFormat);
+    ret = CreateStringProperty("Save Format", g_SaveFormat_OmeTiff, false, pAct);
+    assert(ret == DEVICE_OK);
+
+    vector<string> saveFormats{ g_SaveFormat_BigTiff, g_SaveFormat_OmeTiff };
+    ret = SetAllowedValues("Save Format", saveFormats);
     if (ret != DEVICE_OK)
         return ret;
 
-    // setup the buffer
-    // ----------------
-    ret = ResizeImageBuffer();
+    pAct = new CPropertyAction(this, &AbiCamera::OnCompression);
+    ret = CreateStringProperty("Compression", g_Compression_None, false, pAct);
+    assert(ret == DEVICE_OK);
+
+    vector<string> compressionOptions{ g_Compression_None, g_Compression_Deflate };
+    ret = SetAllowedValues("Compression", compressionOptions);
     if (ret != DEVICE_OK)
         return ret;
 
-    m_initialized = true;
-    return DEVICE_OK;
-}
+    pAct = new CPropertyAction(this, &AbiCamera::OnCompressionRatio);
+    ret = CreateFloatProperty("Compression Ratio", 1.0, true, pAct);
+    assert(ret == DEVICE_OK);
 
-/**
-* Shuts down (unloads) the device.
-* Ideally this method will completely unload the device and release all resources.
-* Shutdown() may be called multiple times in a row.
-* Required by the MM::Device API.
-*/
-int AbiCamera::Shutdown()
-{
-    m_initialized = false;
-    return DEVICE_OK;
-}
+    pAct = new CPropertyAction(this, &AbiCamera::OnSaveFrames);
+    ret = CreateIntegerProperty("Save Frames", 0, false, pAct);
+    assert(ret == DEVICE_OK);
 
-/**
-* Performs exposure and grabs a single image.
-* This function should block during the actual exposure and return immediately afterwards
-* (i.e., before readout).  This behavior is needed for proper synchronization with the shutter.
-* Required by the MM::Camera API.
-*/
-int AbiCamera::SnapImage()
-{
-    PurgeComPort(m_port.c_str());
+    vector<string> saveOptions{ "0", "1" };
+    ret = SetAllowedValues("Save Frames", saveOptions);
+    if (ret != DEVICE_OK)
+        return ret;
 
-    if (m_subtractBackground)
-    {
-        auto ret = ShotAndResponse(0);
-        if (ret != DEVICE_OK)
-        {
-            LogMessageCode(ret, true);
-            return ret;
-        }
+    pAct = new CPropertyAction(this, &AbiCamera::OnWriterBacklog);
+    ret = CreateIntegerProperty("Writer Backlog", 0, true, pAct);
+    assert(ret == DEVICE_OK);
 
-        ret = ReadImage(m_bkgBuf);
-        if (ret != DEVICE_OK)
-        {
-            LogMessageCode(ret, true);
-            return ret;
-        }
-    }
+    pAct = new CPropertyAction(this, &AbiCamera::OnWriterDropped);
+    ret = CreateIntegerProperty("Writer Dropped Frames", 0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    // Shared memory ring for external consumers
+    pAct = new CPropertyAction(this, &AbiCamera::OnSharedRingName);
+    ret = CreateStringProperty("Shared Memory Name", m_sharedRingName.c_str(), false, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnSharedRingSlots);
+    ret = CreateIntegerProperty("Shared Memory Slots", m_sharedRingSlots, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Shared Memory Slots", 2, 256);
 
-    auto ret = ShotAndResponse(m_exposureMs);
+    pAct = new CPropertyAction(this, &AbiCamera::OnSharedRing);
+    ret = CreateIntegerProperty("Shared Memory Ring", 0, false, pAct);
+    assert(ret == DEVICE_OK);
 
-    ret = ReadImage(m_imgBuf);
+    vector<string> ringOptions{ "0", "1" };
+    ret = SetAllowedValues("Shared Memory Ring", ringOptions);
     if (ret != DEVICE_OK)
-    {
-        LogMessageCode(ret, true);
         return ret;
-    }
 
-    if (m_subtractBackground)
-    {
-        std::transform((uint8_t*)m_imgBuf.GetPixels(), (uint8_t*)m_imgBuf.GetPixels() + GetImageBufferSize(),
-            (uint8_t*)m_bkgBuf.GetPixels(), (uint8_t*)m_imgBuf.GetPixels(), [](auto a, auto b) { return a - b; });
-    }
-    
-    return DEVICE_OK;
-}
+    // Frame streaming to viewers, on loopback unless the endpoint names an address
+    pAct = new CPropertyAction(this, &AbiCamera::OnStreamEndpoint);
+    ret = CreateStringProperty("Stream Endpoint", m_streamEndpoint.c_str(), false, pAct);
+    assert(ret == DEVICE_OK);
 
-/**
-* Returns pixel data.
-* Required by the MM::Camera API.
-* The calling program will assume the size of the buffer based on the values
-* obtained from GetImageBufferSize(), which in turn should be consistent with
-* values returned by GetImageWidth(), GetImageHight() and GetImageBytesPerPixel().
-* The calling program allso assumes that camera never changes the size of
-* the pixel buffer on its own. In other words, the buffer can change only if
-* appropriate properties are set (such as binning, pixel type, etc.)
-*/
-const unsigned char* AbiCamera::GetImageBuffer()
-{
-    return const_cast<unsigned char*>(m_imgBuf.GetPixels());
-}
+    pAct = new CPropertyAction(this, &AbiCamera::OnStreamDownsample);
+    ret = CreateIntegerProperty("Stream Downsample", 1, false, pAct);
+    assert(ret == DEVICE_OK);
 
-/**
-* Returns image buffer X-size in pixels.
-* Required by the MM::Camera API.
-*/
-unsigned AbiCamera::GetImageWidth() const
-{
-    return m_imgBuf.Width();
-}
+    vector<string> downsampleValues{ "1", "2", "4", "8" };
+    ret = SetAllowedValues("Stream Downsample", downsampleValues);
+    if (ret != DEVICE_OK)
+        return ret;
 
-/**
-* Returns image buffer Y-size in pixels.
-* Required by the MM::Camera API.
-*/
-unsigned AbiCamera::GetImageHeight() const
-{
-    return m_imgBuf.Height();
-}
+    pAct = new CPropertyAction(this, &AbiCamera::OnStreamCompression);
+    ret = CreateStringProperty("Stream Compression", g_Compression_None, false, pAct);
+    assert(ret == DEVICE_OK);
 
-/**
-* Returns image buffer pixel depth in bytes.
-* Required by the MM::Camera API.
-*/
-unsigned AbiCamera::GetImageBytesPerPixel() const
-{
-    return m_imgBuf.Depth();
-}
+    vector<string> streamCompressionOptions{ g_Compression_None, g_Compression_Rice };
+    ret = SetAllowedValues("Stream Compression", streamCompressionOptions);
+    if (ret != DEVICE_OK)
+        return ret;
 
-/**
-* Returns the bit depth (dynamic range) of the pixel.
-* This does not affect the buffer size, it just gives the client application
-* a guideline on how to interpret pixel values.
-* Required by the MM::Camera API.
-*/
-unsigned AbiCamera::GetBitDepth() const
-{
-    return m_bitDepth;
-}
+    pAct = new CPropertyAction(this, &AbiCamera::OnStreamServer);
+    ret = CreateIntegerProperty("Stream Server", 0, false, pAct);
+    assert(ret == DEVICE_OK);
 
-/**
-* Returns the size in bytes of the image buffer.
-* Required by the MM::Camera API.
-*/
-long AbiCamera::GetImageBufferSize() const
-{
-    return m_imgBuf.Width() * m_imgBuf.Height() * GetImageBytesPerPixel();
-}
+    vector<string> streamOptions{ "0", "1" };
+    ret = SetAllowedValues("Stream Server", streamOptions);
+    if (ret != DEVICE_OK)
+        return ret;
 
-/**
-* Sets the camera Region Of Interest.
-* Required by the MM::Camera API.
-* This command will change the dimensions of the image.
-* Depending on the hardware capabilities the camera may not be able to configure the
-* exact dimensions requested - but should try do as close as possible.
-* If the hardware does not have this capability the software should simulate the ROI by
-* appropriately cropping each frame.
-* This demo implementation ignores the position coordinates and just crops the buffer.
-* @param x - top-left corner coordinate
-* @param y - top-left corner coordinate
-* @param xSize - width
-* @param ySize - height
-*/
-int AbiCamera::SetROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize)
-{
-    if (xSize == 0 && ySize == 0)
-    {
-        // effectively clear ROI
-        ResizeImageBuffer();
-        m_roiStartX = 0;
-        m_roiStartY = 0;
-    }
-    else
-    {
-        // apply ROI
-        m_imgBuf.Resize(xSize, ySize);
-        m_roiStartX = x;
-        m_roiStartY = y;
-    }
-    return DEVICE_OK;
-}
+    pAct = new CPropertyAction(this, &AbiCamera::OnStreamClients);
+    ret = CreateIntegerProperty("Stream Clients", 0, true, pAct);
+    assert(ret == DEVICE_OK);
 
-/**
-* Returns the actual dimensions of the current ROI.
-* Required by the MM::Camera API.
-*/
-int AbiCamera::GetROI(unsigned& x, unsigned& y, unsigned& xSize, unsigned& ySize)
-{
-    x = m_roiStartX;
-    y = m_roiStartY;
+    pAct = new CPropertyAction(this, &AbiCamera::OnStreamDropped);
+    ret = CreateIntegerProperty("Stream Dropped Frames", 0, true, pAct);
+    assert(ret == DEVICE_OK);
 
-    xSize = m_imgBuf.Width();
-    ySize = m_imgBuf.Height();
+    // Frame buffer pool
+    pAct = new CPropertyAction(this, &AbiCamera::OnHugePages);
+    ret = CreateIntegerProperty("Huge Pages", 0, false, pAct);
+    assert(ret == DEVICE_OK);
 
-    return DEVICE_OK;
-}
+    vector<string> hugePageOptions{ "0", "1" };
+    ret = SetAllowedValues("Huge Pages", hugePageOptions);
+    if (ret != DEVICE_OK)
+        return ret;
 
-/**
-* Resets the Region of Interest to full frame.
-* Required by the MM::Camera API.
-*/
-int AbiCamera::ClearROI()
-{
-    ResizeImageBuffer();
-    m_roiStartX = 0;
-    m_roiStartY = 0;
+    pAct = new CPropertyAction(this, &AbiCamera::OnFramePoolReconfigurations);
+    ret = CreateIntegerProperty("Frame Pool Reconfigurations", 0, true, pAct);
+    assert(ret == DEVICE_OK);
 
-    return DEVICE_OK;
-}
+    // Statistics of the last frame
+    pAct = new CPropertyAction(this, &AbiCamera::OnFrameMean);
+    ret = CreateFloatProperty("Frame Mean", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
 
-/**
-* Returns the current exposure setting in milliseconds.
-* Required by the MM::Camera API.
-*/
-double AbiCamera::GetExposure() const
-{
-    return m_exposureMs;
-}
+    pAct = new CPropertyAction(this, &AbiCamera::OnFrameMin);
+    ret = CreateIntegerProperty("Frame Min", 0, true, pAct);
+    assert(ret == DEVICE_OK);
 
-/**
-* Sets exposure in milliseconds.
-* Required by the MM::Camera API.
-*/
+    pAct = new CPropertyAction(this, &AbiCamera::OnFrameMax);
+    ret = CreateIntegerProperty("Frame Max", 0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    // Progressive live view
+    pAct = new CPropertyAction(this, &AbiCamera::OnProgressiveRefresh);
+    ret = CreateFloatProperty("Progressive Refresh ms", m_progressiveRefreshMs, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Progressive Refresh ms", 20.0, 5000.0);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnProgressive);
+    ret = CreateIntegerProperty("Progressive Live View", 0, false, pAct);
+    assert(ret == DEVICE_OK);
+
+    vector<string> progressiveOptions{ "0", "1" };
+    ret = SetAllowedValues("Progressive Live View", progressiveOptions);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    // Serial link characterization
+    pAct = new CPropertyAction(this, &AbiCamera::OnCalibrateLink);
+    ret = CreateIntegerProperty("Calibrate Link", 0, false, pAct);
+    assert(ret == DEVICE_OK);
+
+    vector<string> calibrateOptions{ "0", "1" };
+    ret = SetAllowedValues("Calibrate Link", calibrateOptions);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnLinkLatency);
+    ret = CreateFloatProperty("Link Latency ms", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnLinkThroughput);
+    ret = CreateFloatProperty("Link Throughput kB/s", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnExposureOverhead);
+    ret = CreateFloatProperty("Exposure Overhead ms", m_link.exposureOverheadMs, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnTransferChunk);
+    ret = CreateIntegerProperty("Transfer Chunk Bytes", m_link.chunkBytes, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnIdlePoll);
+    ret = CreateIntegerProperty("Idle Poll ms", m_link.idlePollMs, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    // Trigger modes, the external ones only if the firmware has "trg"
+    pAct = new CPropertyAction(this, &AbiCamera::OnTriggerMode);
+    ret = CreateStringProperty(MM::g_Keyword_Trigger, g_Trigger_Internal, false, pAct);
+    assert(ret == DEVICE_OK);
+
+    vector<string> triggerModes{ g_Trigger_Internal };
+    if (m_caps.HasCommand("trg"))
+    {
+        triggerModes.push_back(g_Trigger_Edge);
+        triggerModes.push_back(g_Trigger_Gate);
+        if (m_caps.burst)
+            triggerModes.push_back(g_Trigger_Burst);
+    }
+    ret = SetAllowedValues(MM::g_Keyword_Trigger, triggerModes);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnTriggerTimeout);
+    ret = CreateFloatProperty("Trigger Timeout ms", m_triggerTimeoutMs, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Trigger Timeout ms", 100.0, 600000.0);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnTriggerBackgroundRefresh);
+    ret = CreateFloatProperty("Trigger Background Refresh s", m_triggerBackgroundRefreshS, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Trigger Background Refresh s", 0.0, 3600.0);
+
+    // Shot synchronization with other cameras
+    pAct = new CPropertyAction(this, &AbiCamera::OnSyncGroup);
+    ret = CreateStringProperty("Sync Group", "", false, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnSyncSkew);
+    ret = CreateFloatProperty("Sync Skew ms", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnSyncTimeouts);
+    ret = CreateIntegerProperty("Sync Timeouts", 0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    // Recovery from serial dropouts
+    pAct = new CPropertyAction(this, &AbiCamera::OnAutoReconnect);
+    ret = CreateIntegerProperty("Auto Reconnect", m_autoReconnect, false, pAct);
+    assert(ret == DEVICE_OK);
+
+    vector<string> reconnectOptions{ "0", "1" };
+    ret = SetAllowedValues("Auto Reconnect", reconnectOptions);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnReconnectTimeout);
+    ret = CreateFloatProperty("Reconnect Timeout s", m_reconnectTimeoutS, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Reconnect Timeout s", 1.0, 600.0);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnReconnects);
+    ret = CreateIntegerProperty("Reconnects", 0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnLastOutage);
+    ret = CreateFloatProperty("Last Outage ms", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    // Thread scheduling, needs real-time privileges (CAP_SYS_NICE on Linux)
+    // for anything above Normal; refused settings are shown in the status
+    vector<string> schedulingClasses;
+    for (auto schedClass : { ThreadPolicy::Class::Normal, ThreadPolicy::Class::High, ThreadPolicy::Class::RealTime })
+        schedulingClasses.push_back(ThreadPolicy::ClassName(schedClass));
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnReaderScheduling);
+    ret = CreateStringProperty("Reader Scheduling", ThreadPolicy::ClassName(m_readerPolicy.schedClass), false, pAct);
+    assert(ret == DEVICE_OK);
+    ret = SetAllowedValues("Reader Scheduling", schedulingClasses);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnReaderPriority);
+    ret = CreateIntegerProperty("Reader Priority", m_readerPolicy.priority, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Reader Priority", 1, 99);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnReaderCpus);
+    ret = CreateStringProperty("Reader CPUs", "", false, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnProcessingScheduling);
+    ret = CreateStringProperty("Processing Scheduling", ThreadPolicy::ClassName(m_processingPolicy.schedClass), false, pAct);
+    assert(ret == DEVICE_OK);
+    ret = SetAllowedValues("Processing Scheduling", schedulingClasses);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnProcessingPriority);
+    ret = CreateIntegerProperty("Processing Priority", m_processingPolicy.priority, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Processing Priority", 1, 99);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnProcessingCpus);
+    ret = CreateStringProperty("Processing CPUs", "", false, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnThreadPolicyStatus);
+    ret = CreateStringProperty("Thread Policy Status", "", true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnWakeupLateMean);
+    ret = CreateFloatProperty("Wakeup Late Mean ms", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnWakeupJitter);
+    ret = CreateFloatProperty("Wakeup Jitter ms", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnWakeupLateMax);
+    ret = CreateFloatProperty("Wakeup Late Max ms", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    // Long-run health of the current or last sequence
+    pAct = new CPropertyAction(this, &AbiCamera::OnLatencyP99);
+    ret = CreateFloatProperty("Frame Latency p99 ms", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnLatencyP999);
+    ret = CreateFloatProperty("Frame Latency p99.9 ms", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnLatencyMax);
+    ret = CreateFloatProperty("Frame Latency Max ms", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnProcessRss);
+    ret = CreateFloatProperty("Process RSS MB", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnRssTrend);
+    ret = CreateFloatProperty("RSS Trend MB/h", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnProcessThreads);
+    ret = CreateIntegerProperty("Process Threads", 0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnSoakSummary);
+    ret = CreateStringProperty("Soak Summary", "", true, pAct);
+    assert(ret == DEVICE_OK);
+
+    // Fault injection into the serial traffic, for testing recovery
+    pAct = new CPropertyAction(this, &AbiCamera::OnFaultInjection);
+    ret = CreateIntegerProperty("Fault Injection", 0, false, pAct);
+    assert(ret == DEVICE_OK);
+
+    vector<string> faultOptions{ "0", "1" };
+    ret = SetAllowedValues("Fault Injection", faultOptions);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnFaultDropProbability);
+    ret = CreateFloatProperty("Fault Drop Probability", 0.0, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Fault Drop Probability", 0.0, 1.0);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnFaultDelayProbability);
+    ret = CreateFloatProperty("Fault Delay Probability", 0.0, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Fault Delay Probability", 0.0, 1.0);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnFaultCorruptProbability);
+    ret = CreateFloatProperty("Fault Corrupt Probability", 0.0, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Fault Corrupt Probability", 0.0, 1.0);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnFaultTruncateProbability);
+    ret = CreateFloatProperty("Fault Truncate Probability", 0.0, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Fault Truncate Probability", 0.0, 1.0);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnFaultDelay);
+    ret = CreateFloatProperty("Fault Delay ms", m_faults.GetDelayMs(), false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Fault Delay ms", 0.0, 30000.0);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnFaultRecovery);
+    ret = CreateStringProperty("Fault Recovery", "", true, pAct);
+    assert(ret == DEVICE_OK);
+
+    // Prometheus metrics for central monitoring
+    pAct = new CPropertyAction(this, &AbiCamera::OnMetricsExport);
+    ret = CreateIntegerProperty("Metrics Export", 0, false, pAct);
+    assert(ret == DEVICE_OK);
+
+    vector<string> metricsOptions{ "0", "1" };
+    ret = SetAllowedValues("Metrics Export", metricsOptions);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnMetricsTarget);
+    ret = CreateStringProperty("Metrics Target", m_metricsTarget.c_str(), false, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnMetricsInterval);
+    ret = CreateFloatProperty("Metrics Interval s", m_metricsIntervalS, false, pAct);
+    assert(ret == DEVICE_OK);
+    SetPropertyLimits("Metrics Interval s", 0.1, 3600.0);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnMetricsExports);
+    ret = CreateIntegerProperty("Metrics Exports", 0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    // Frame time predicted for the current settings
+    pAct = new CPropertyAction(this, &AbiCamera::OnPredictedReadout);
+    ret = CreateFloatProperty("Predicted Readout ms", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    pAct = new CPropertyAction(this, &AbiCamera::OnPredictedFrameRate);
+    ret = CreateFloatProperty("Predicted Max Frame Rate", 0.0, true, pAct);
+    assert(ret == DEVICE_OK);
+
+    // synchronize all properties
+    // --------------------------
+    ret = UpdateStatus();
+    if (ret != DEVICE_OK)
+        return ret;
+
+    // setup the buffer
+    // ----------------
+    ret = ResizeImageBuffer();
+    if (ret != DEVICE_OK)
+        return ret;
+
+    // a camera that can't be measured keeps working with the old defaults
+    if (CharacterizeLink() != DEVICE_OK)
+        LogMessage("Link calibration failed, using default transfer settings", false);
+
+    m_tempThread->Start(m_tempSampleMs);
+
+    m_initialized = true;
+    return DEVICE_OK;
+}
+
+/**
+* Shuts down (unloads) the device.
+* Ideally this method will completely unload the device and release all resources.
+* Shutdown() may be called multiple times in a row.
+* Required by the MM::Device API.
+*/
+int AbiCamera::Shutdown()
+{
+    StopSequenceAcquisition();
+    if (m_previewThread && !m_previewThread->IsStopped())
+    {
+        m_previewThread->Stop();
+        m_previewThread->wait();
+    }
+    if (m_tempThread && !m_tempThread->IsStopped())
+    {
+        m_tempThread->Stop();
+        m_tempThread->wait();
+    }
+    m_progressive = 0;
+
+    m_writer.Close();
+    m_saveFrames = 0;
+    m_sharedRing.Destroy();
+    m_sharedRingEnabled = 0;
+    m_streamServer.Stop();
+    m_streamEnabled = 0;
+    m_metricsExporter.Stop();
+    m_metricsEnabled = 0;
+
+    if (m_syncGroup)
+    {
+        m_syncGroup->Quit();
+        m_syncGroup.reset();
+    }
+
+    // leave the camera untriggered for whoever opens it next
+    if (m_initialized && m_armedFrames > 0)
+        DisarmTrigger();
+    m_armedFrames = 0;
+    m_deviceCold.reset();
+    if (m_compressionPool)
+        m_compressionPool->ReleaseThreadPolicy(this);
+    m_compressionPool.reset();
+
+    m_initialized = false;
+    return DEVICE_OK;
+}
+
+/**
+* Performs exposure and grabs a single image.
+* This function should block during the actual exposure and return immediately afterwards
+* (i.e., before readout).  This behavior is needed for proper synchronization with the shutter.
+* Required by the MM::Camera API.
+*/
+int AbiCamera::SnapImage()
+{
+    int ret = ExposeAndRead();
+    if (ret != DEVICE_OK && m_autoReconnect && IsLinkError(ret))
+    {
+        // the frame is taken again once the link is back, a sequence carries
+        // on with the outage recorded in the next frame's metadata
+        ret = Reconnect();
+        if (ret == DEVICE_OK)
+            ret = ExposeAndRead();
+    }
+
+    if (ret == DEVICE_OK)
+        m_faults.FrameCompleted(std::chrono::steady_clock::now());
+    else
+        m_counters.frameErrors.fetch_add(1, std::memory_order_relaxed);
+    return ret;
+}
+
+/**
+* Takes one frame, background included, into the image buffer.
+*/
+int AbiCamera::ExposeAndRead()
+{
+    using Clock = std::chrono::steady_clock;
+    using Ms = std::chrono::duration<double, std::milli>;
+
+    // keeps the temperature thread off the port for the whole exchange
+    MMThreadGuard portGuard(m_portLock);
+
+    const bool triggered = m_triggerMode != g_Trigger_Internal;
+
+    // the dark level follows the sensor temperature, so a long armed
+    // sequence re-arms now and then to take a fresh background. Triggers
+    // that come while it is taken are missed.
+    if (triggered && m_armedFrames > 0 && m_subtractBackground && m_triggerBackgroundRefreshS > 0.0 &&
+        std::chrono::steady_clock::now() - m_backgroundTaken >= std::chrono::duration<double>(m_triggerBackgroundRefreshS))
+    {
+        LogMessage(std::format("Background older than {} s, re-arming the trigger", m_triggerBackgroundRefreshS), true);
+        auto ret = DisarmTrigger();
+        if (ret != DEVICE_OK)
+            return ret;
+    }
+
+    // the background and the frame are read at the same depth, so the
+    // subtraction happens before scaling to the output depth. An armed
+    // trigger keeps the depth its background was taken at.
+    if (!triggered || m_armedFrames == 0)
+        m_transferBitDepth = ChooseTransferBitDepth();
+    if (triggered)
+    {
+        // arming also takes the background, a sequence arms once for many frames
+        if (m_armedFrames == 0)
+        {
+            long frames = 1;
+            if (IsCapturing())
+                frames = std::min(m_thread->GetLength() - m_thread->GetImageCounter(), MAX_BURST_FRAMES);
+            auto ret = ArmTrigger(frames);
+            if (ret != DEVICE_OK)
+                return ret;
+        }
+    }
+    else
+    {
+        PurgeComPort(m_port.c_str());
+    }
+
+    if (m_subtractBackground && !triggered)
+    {
+        auto ret = ShotAndResponse(0);
+        if (ret != DEVICE_OK)
+        {
+            LogMessageCode(ret, true);
+            return ret;
+        }
+
+        ret = ReadImage(m_bkgBuf.Data());
+        if (ret != DEVICE_OK)
+        {
+            LogMessageCode(ret, true);
+            return ret;
+        }
+    }
+
+    int ret = DEVICE_OK;
+    if (triggered)
+    {
+        ret = WaitForTriggeredFrame(&m_backTiming);
+        if (ret != DEVICE_OK)
+            return ret;
+    }
+    else
+    {
+        // in a sync group the sequence threads of all cameras send their
+        // shots together
+        unsigned long long syncGeneration = 0;
+        const bool synced = m_syncGroup && IsCapturing();
+        if (synced && !m_syncGroup->Arrive(SYNC_TIMEOUT_MS, syncGeneration))
+            LogMessage(std::format("Sync group {} timed out waiting for the other cameras", m_syncGroup->GetName()));
+
+        // every stage is timed, for the frame metadata and to keep the frame
+        // time model current
+        ret = ShotAndResponse(m_exposureMs, &m_backTiming);
+        if (ret != DEVICE_OK)
+        {
+            LogMessageCode(ret, true);
+            return ret;
+        }
+        if (synced)
+            m_syncGroup->RecordShot(syncGeneration, m_backTiming.shotSent);
+        m_frameTimeModel.RecordShot(m_exposureMs, Ms(m_backTiming.shotAcked - m_backTiming.shotSent).count());
+        m_shotLatency.Add(Ms(m_backTiming.shotAcked - m_backTiming.shotSent).count());
+    }
+    const auto transferStart = m_backTiming.shotAcked;
+
+    // the frame is assembled in the back buffer without holding the pixel
+    // lock, readers keep seeing the previous frame until the swap. Rows are
+    // background subtracted and measured as soon as they arrive.
+    m_rowProcessor.Begin(m_backBuf.Data(), m_subtractBackground ? m_bkgBuf.Data() : nullptr,
+        m_readWidth, m_readHeight, m_bytesPerPixel, m_bitDepth, m_bitDepth - m_transferBitDepth);
+    {
+        MMThreadGuard g(m_imgPixelsLock);
+        m_previewRows = 0;
+        m_frameInProgress = true;
+    }
+    ret = ReadImage(m_backBuf.Data(), &m_rowProcessor);
+    if (ret != DEVICE_OK)
+    {
+        m_frameInProgress = false;
+        LogMessageCode(ret, true);
+        return ret;
+    }
+    const auto processingStart = Clock::now();
+    m_backTiming.readoutComplete = processingStart;
+    m_backTiming.mmTimeOffsetMs = GetCurrentMMTime().getMsec() - Ms(processingStart.time_since_epoch()).count();
+    m_frameTimeModel.RecordTransfer(GetTransferBytes(), Ms(processingStart - transferStart).count());
+    m_transferLatency.Add(Ms(processingStart - transferStart).count());
+    m_frameStats = m_rowProcessor.GetStats();
+    double noise;
+    if (m_adaptiveBitDepth && m_temporalNoise.Add(m_backBuf.Data(), m_readWidth, m_readHeight, m_bytesPerPixel, noise))
+        m_recentNoise[m_recentNoiseCount++ % ADAPTIVE_DEPTH_FRAMES] = noise;
+    m_backTiming.transferBitDepth = m_transferBitDepth;
+    m_backTiming.resumeGapMs = m_resumeGapMs;
+    m_resumeGapMs = 0.0;
+
+    // binning and cropping rearrange the back buffer in place, the preview
+    // must not copy rows from it any more
+    {
+        MMThreadGuard g(m_imgPixelsLock);
+        m_frameInProgress = false;
+    }
+
+    if (m_hostBinning > 1)
+    {
+        HostBinning::Bin(m_backBuf.Data(), m_readWidth, m_readHeight, m_bytesPerPixel, m_bitDepth,
+            m_hostBinning, m_hostBinningMode, m_binScratch);
+        m_frameTimeModel.RecordHostBinning(static_cast<unsigned long>(m_readWidth) * m_readHeight,
+            Ms(Clock::now() - processingStart).count());
+    }
+    CropToROI(m_backBuf.Data());
+
+    SwapImageBuffers();
+    DistributeFrame();
+    m_frameTimeModel.RecordProcessing(Ms(Clock::now() - processingStart).count());
+    m_processingLatency.Add(Ms(Clock::now() - processingStart).count());
+    m_counters.frames.fetch_add(1, std::memory_order_relaxed);
+    m_counters.bytes.fetch_add(GetTransferBytes(), std::memory_order_relaxed);
+
+    return DEVICE_OK;
+}
+
+/**
+* Returns pixel data.
+* Required by the MM::Camera API.
+* The calling program will assume the size of the buffer based on the values
+* obtained from GetImageBufferSize(), which in turn should be consistent with
+* values returned by GetImageWidth(), GetImageHight() and GetImageBytesPerPixel().
+* The calling program allso assumes that camera never changes the size of
+* the pixel buffer on its own. In other words, the buffer can change only if
+* appropriate properties are set (such as binning, pixel type, etc.)
+*/
+const unsigned char* AbiCamera::GetImageBuffer()
+{
+    return m_imgBuf.Data();
+}
+
+/**
+* Returns image buffer X-size in pixels.
+* Required by the MM::Camera API.
+*/
+unsigned AbiCamera::GetImageWidth() const
+{
+    return m_imgWidth;
+}
+
+/**
+* Returns image buffer Y-size in pixels.
+* Required by the MM::Camera API.
+*/
+unsigned AbiCamera::GetImageHeight() const
+{
+    return m_imgHeight;
+}
+
+/**
+* Returns image buffer pixel depth in bytes.
+* Required by the MM::Camera API.
+*/
+unsigned AbiCamera::GetImageBytesPerPixel() const
+{
+    return m_bytesPerPixel;
+}
+
+/**
+* Returns the bit depth (dynamic range) of the pixel.
+* This does not affect the buffer size, it just gives the client application
+* a guideline on how to interpret pixel values.
+* Required by the MM::Camera API.
+*/
+unsigned AbiCamera::GetBitDepth() const
+{
+    return m_bitDepth;
+}
+
+/**
+* Returns the size in bytes of the image buffer.
+* Required by the MM::Camera API.
+*/
+long AbiCamera::GetImageBufferSize() const
+{
+    return m_imgWidth * m_imgHeight * GetImageBytesPerPixel();
+}
+
+/**
+* Bytes the camera sends per frame at the next rid's depth; more than the
+* image buffer when host binning reduces the frame afterwards.
+*/
+unsigned long AbiCamera::GetTransferBytes() const
+{
+    return GetTransferBytes(m_transferBitDepth);
+}
+
+unsigned long AbiCamera::GetTransferBytes(int bitDepth) const
+{
+    return static_cast<unsigned long>(GetTransferRowBytes(bitDepth)) * m_readHeight;
+}
+
+/**
+* Bytes per row of a frame read at bitDepth. A camera with packed transfer
+* sends depths below the pixel size packed, see UnpackRow.
+*/
+size_t AbiCamera::GetTransferRowBytes(int bitDepth) const
+{
+    const unsigned bits = GetPackedBits(bitDepth);
+    return bits ? (static_cast<size_t>(m_readWidth) * bits + 7) / 8
+        : static_cast<size_t>(m_readWidth) * GetImageBytesPerPixel();
+}
+
+/**
+* Bits per sample on the wire at bitDepth, 0 when samples aren't packed.
+*/
+unsigned AbiCamera::GetPackedBits(int bitDepth) const
+{
+    return m_caps.packed && bitDepth < 8 * static_cast<int>(GetImageBytesPerPixel()) ? bitDepth : 0;
+}
+
+/**
+* Sets the camera Region Of Interest.
+* Required by the MM::Camera API.
+* This command will change the dimensions of the image.
+* Depending on the hardware capabilities the camera may not be able to configure the
+* exact dimensions requested - but should try do as close as possible.
+* If the hardware does not have this capability the software should simulate the ROI by
+* appropriately cropping each frame.
+* The camera has no ROI command, so every frame is read whole and the ROI
+* is cropped out of it on the host (see CropToROI).
+* @param x - top-left corner coordinate
+* @param y - top-left corner coordinate
+* @param xSize - width
+* @param ySize - height
+*/
+int AbiCamera::SetROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize)
+{
+    if (IsCapturing())
+    {
+        MMThreadGuard g(m_pendingLock);
+        m_pending.roi = std::array<unsigned, 4>{ x, y, xSize, ySize };
+        return DEVICE_OK;
+    }
+    return ApplyROI(x, y, xSize, ySize);
+}
+
+int AbiCamera::ApplyROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize)
+{
+    if (xSize == 0 && ySize == 0)
+    {
+        // effectively clear ROI
+        return ResizeImageBuffer();
+    }
+
+    // the camera always sends the whole frame, the ROI is cut out of it
+    // once it is in, so only the image size changes
+    const unsigned fullWidth = m_readWidth / m_hostBinning;
+    const unsigned fullHeight = m_readHeight / m_hostBinning;
+    if (x >= fullWidth || y >= fullHeight)
+        return DEVICE_INVALID_INPUT_PARAM;
+
+    {
+        MMThreadGuard g(m_imgPixelsLock);
+        m_roiStartX = x;
+        m_roiStartY = y;
+        m_imgWidth = std::min(xSize, fullWidth - x);
+        m_imgHeight = std::min(ySize, fullHeight - y);
+    }
+    UpdatePredictions();
+    return DEVICE_OK;
+}
+
+/**
+* Moves the ROI of a complete (host binned) frame to the start of the
+* buffer. Rows only move towards the start, so this works in place.
+*/
+void AbiCamera::CropToROI(uint8_t* frame) const
+{
+    const unsigned fullWidth = m_readWidth / m_hostBinning;
+    if (m_imgWidth == fullWidth && m_roiStartY == 0)
+        return;
+
+    const size_t rowBytes = static_cast<size_t>(m_imgWidth) * m_bytesPerPixel;
+    for (unsigned y = 0; y < m_imgHeight; ++y)
+    {
+        const size_t src = (static_cast<size_t>(m_roiStartY + y) * fullWidth + m_roiStartX) * m_bytesPerPixel;
+        memmove(frame + y * rowBytes, frame + src, rowBytes);
+    }
+}
+
+/**
+* Returns the actual dimensions of the current ROI.
+* Required by the MM::Camera API.
+*/
+int AbiCamera::GetROI(unsigned& x, unsigned& y, unsigned& xSize, unsigned& ySize)
+{
+    x = m_roiStartX;
+    y = m_roiStartY;
+
+    xSize = m_imgWidth;
+    ySize = m_imgHeight;
+
+    return DEVICE_OK;
+}
+
+/**
+* Resets the Region of Interest to full frame.
+* Required by the MM::Camera API.
+*/
+int AbiCamera::ClearROI()
+{
+    return SetROI(0, 0, 0, 0);
+}
+
+/**
+* Returns the current exposure setting in milliseconds.
+* Required by the MM::Camera API.
+*/
+double AbiCamera::GetExposure() const
+{
+    return m_exposureMs;
+}
+
+/**
+* Sets exposure in milliseconds.
+* Required by the MM::Camera API.
+*/
 void AbiCamera::SetExposure(double exp)
 {
-    m_exposureMs = exp;
+    if (IsCapturing())
+    {
+        MMThreadGuard g(m_pendingLock);
+        m_pending.exposureMs = exp;
+        return;
+    }
+    m_exposureMs = exp;
+    UpdatePredictions();
+}
+
+/**
+* Returns the current binning factor.
+* Required by the MM::Camera API.
+*/
+int AbiCamera::GetBinning() const
+{
+    return m_binning * m_hostBinning;
+}
+
+/**
+* Sets binning factor.
+* Required by the MM::Camera API.
+*/
+int AbiCamera::SetBinning(int binF)
+{
+    return SetProperty(MM::g_Keyword_Binning, CDeviceUtils::ConvertToString(binF));
+}
+
+int AbiCamera::PrepareSequenceAcqusition()
+{
+    if (IsCapturing())
+        return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+    int ret = GetCoreCallback()->PrepareForAcq(this);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    return DEVICE_OK;
+}
+
+
+/**
+ * Required by the MM::Camera API
+ * Please implement this yourself and do not rely on the base class implementation
+ * The Base class implementation is deprecated and will be removed shortly
+ */
+int AbiCamera::StartSequenceAcquisition(double interval) {
+
+    return StartSequenceAcquisition(LONG_MAX, interval, false);
+}
+
+/**
+* Stop and wait for the Sequence thread finished
+*/
+int AbiCamera::StopSequenceAcquisition()
+{
+    if (!m_thread->IsStopped()) {
+        m_thread->Stop();
+        m_thread->wait();
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+* Simple implementation of Sequence Acquisition
+* A sequence acquisition should run on its own thread and transport new images
+* coming of the camera into the MMCore circular buffer.
+*/
+int AbiCamera::StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow)
+{
+    if (IsCapturing())
+        return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+    int ret = GetCoreCallback()->PrepareForAcq(this);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    if (m_syncGroup)
+        m_syncGroup->BeginSequence();
+    m_wakeupJitter.Reset();
+    m_soak.Reset();
+    m_thread->Start(numImages, interval_ms, stopOnOverflow);
+    return DEVICE_OK;
+}
+
+/**
+* Applies the settings changed since the last frame.
+* Called by the sequence thread between frames, so exposure, binning, bit
+* depth and ROI changes take effect on the next frame without restarting
+* the sequence. Resizing only reallocates the frame pool if frames grow.
+*/
+int AbiCamera::ApplyPendingSettings()
+{
+    PendingSettings pending;
+    {
+        MMThreadGuard g(m_pendingLock);
+        if (m_pending.Empty())
+            return DEVICE_OK;
+        std::swap(pending, m_pending);
+    }
+
+    if (pending.exposureMs)
+    {
+        m_exposureMs = *pending.exposureMs;
+        OnExposureChanged(m_exposureMs);
+    }
+
+    if (pending.bitDepth)
+    {
+        m_bitDepth = *pending.bitDepth;
+        m_transferBitDepth = m_bitDepth;
+        m_recentNoiseCount = 0;
+        m_temporalNoise.Reset();
+        OnPropertyChanged("BitDepth", CDeviceUtils::ConvertToString((long)m_bitDepth));
+    }
+
+    if (pending.binning || pending.bytesPerPixel)
+    {
+        if (pending.binning)
+        {
+            int ret = SplitBinning(*pending.binning, m_binning, m_hostBinning);
+            if (ret != DEVICE_OK)
+                return ret;
+        }
+        if (pending.bytesPerPixel)
+            m_bytesPerPixel = *pending.bytesPerPixel;
+
+        int ret = ResizeImageBuffer();
+        if (ret != DEVICE_OK)
+            return ret;
+        OnPropertyChanged(MM::g_Keyword_Binning, CDeviceUtils::ConvertToString((long)GetBinning()));
+    }
+
+    if (pending.roi)
+    {
+        const auto& roi = *pending.roi;
+        int ret = ApplyROI(roi[0], roi[1], roi[2], roi[3]);
+        if (ret != DEVICE_OK)
+            return ret;
+    }
+
+    if (pending.cold)
+    {
+        m_cold = *pending.cold;
+        int ret = SendCold();
+        if (ret != DEVICE_OK)
+            return ret;
+        OnPropertyChanged("Cool camera", CDeviceUtils::ConvertToString((long)m_cold));
+    }
+
+    UpdatePredictions();
+    LogMessage(std::format("Applied new settings between frames: exposure {} ms, binning {}, bit depth {}, image {}x{}",
+        m_exposureMs, GetBinning(), m_bitDepth, m_imgWidth, m_imgHeight), true);
+    return DEVICE_OK;
+}
+
+/**
+* Ends the sequence: statusCode is what ended it, passed on to the core
+* with AcqFinished.
+*/
+void AbiCamera::OnThreadExiting(int statusCode) throw()
+{
+    try
+    {
+        LogMessage("Sequence thread exiting", true);
+        LogMessage(std::format("Sequence health: {}, {} frame pool reconfigurations",
+            m_soak.GetSummary(), m_framePool.GetConfigureCount()), false);
+        if (m_syncGroup)
+            m_syncGroup->EndSequence();
+        if (m_armedFrames > 0 || m_triggerMode != g_Trigger_Internal)
+            DisarmTrigger();
+        GetCoreCallback() ? GetCoreCallback()->AcqFinished(this, statusCode) : DEVICE_OK;
+    }
+    catch (...)
+    {
+        LogMessage("Exception in AbiCamera::OnThreadExiting", false);
+    }
+}
+
+/**
+* Called by the sequence thread once a frame is in the core buffer.
+* The latency runs from sending the shot to delivery, so stalls anywhere
+* in the exchange, processing or insertion land in the tail.
+*/
+void AbiCamera::RecordDelivery()
+{
+    const auto now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point shotSent;
+    {
+        MMThreadGuard g(m_imgPixelsLock);
+        shotSent = m_imgTiming.shotSent;
+    }
+    m_soak.RecordFrame(std::chrono::duration<double, std::milli>(now - shotSent).count());
+}
+
+/**
+* Called by the temperature thread: samples the process during a sequence
+* and logs the health summary now and then, away from the frame path.
+*/
+void AbiCamera::SampleHealth()
+{
+    if (!IsCapturing())
+        return;
+
+    const auto now = std::chrono::steady_clock::now();
+    m_soak.SampleProcess(now);
+    if (m_soak.ReportDue(now, SOAK_REPORT_S))
+    {
+        LogMessage(std::format("Sequence health: {}, {} frame pool reconfigurations",
+            m_soak.GetSummary(), m_framePool.GetConfigureCount()), false);
+        if (m_faults.IsEnabled())
+            LogMessage(std::format("Fault recovery: {}", m_faults.GetSummary()), false);
+    }
+}
+
+/*
+ * Inserts Image and MetaData into MMCore circular Buffer
+ */
+int AbiCamera::InsertImage()
+{
+    char label[MM::MaxStrLength];
+    this->GetLabel(label);
+
+    FrameTiming timing;
+    {
+        MMThreadGuard g(m_imgPixelsLock);
+        timing = m_imgTiming;
+    }
+
+    // Important:  metadata about the image are generated here:
+    // times are host clock estimates of when the sensor was exposing, in MM
+    // time. The exposure starts half a round trip after sht was sent.
+    Metadata md;
+    md.put("Camera", label);
+    md.put(MM::g_Keyword_Metadata_StartTime, CDeviceUtils::ConvertToString(timing.ToMMTimeMs(timing.ExposureStart())));
+    md.put("ExposureStart-ms", CDeviceUtils::ConvertToString(timing.ToMMTimeMs(timing.ExposureStart())));
+    md.put("ExposureEnd-ms", CDeviceUtils::ConvertToString(timing.ToMMTimeMs(timing.ExposureEnd())));
+    md.put("ShotAcknowledged-ms", CDeviceUtils::ConvertToString(timing.ToMMTimeMs(timing.shotAcked)));
+    md.put("ReadoutComplete-ms", CDeviceUtils::ConvertToString(timing.ToMMTimeMs(timing.readoutComplete)));
+    md.put(MM::g_Keyword_Metadata_ROI_X, CDeviceUtils::ConvertToString((long)m_roiStartX));
+    md.put(MM::g_Keyword_Metadata_ROI_Y, CDeviceUtils::ConvertToString((long)m_roiStartY));
+
+    char buf[MM::MaxStrLength];
+    GetProperty(MM::g_Keyword_Binning, buf);
+    md.put(MM::g_Keyword_Binning, buf);
+    md.put("DeviceBinning", CDeviceUtils::ConvertToString((long)m_binning));
+    md.put("TransferBitDepth", CDeviceUtils::ConvertToString((long)timing.transferBitDepth));
+    md.put("HostBinning", CDeviceUtils::ConvertToString((long)m_hostBinning));
+
+    if (timing.resumeGapMs > 0.0)
+    {
+        md.put("ResumeGap-ms", CDeviceUtils::ConvertToString(timing.resumeGapMs));
+        md.put("Reconnects", CDeviceUtils::ConvertToString(m_reconnects.load()));
+    }
+
+    MMThreadGuard g(m_imgPixelsLock);
+
+    const unsigned char* pI;
+    pI = GetImageBuffer();
+
+    unsigned int w = GetImageWidth();
+    unsigned int h = GetImageHeight();
+    unsigned int b = GetImageBytesPerPixel();
+
+    int ret = GetCoreCallback()->InsertImage(this, pI, w, h, b, 1, md.Serialize().c_str());
+    if (ret == DEVICE_BUFFER_OVERFLOW)
+    {
+        // the core buffer is full: end the sequence if it asked to stop on
+        // overflow, else drop what the buffer holds and go on
+        if (m_thread->GetStopOnOverflow())
+        {
+            LogMessage("Core image buffer overflowed, stopping the sequence", false);
+            return ret;
+        }
+        LogMessage("Core image buffer overflowed, clearing it", false);
+        GetCoreCallback()->ClearImageBuffer(this);
+        // don't process this same image again...
+        return GetCoreCallback()->InsertImage(this, pI, w, h, b, 1, md.Serialize().c_str(), false);
+    }
+    else
+    {
+        return ret;
+    }
+}
+
+
+std::chrono::steady_clock::time_point AbiCamera::FrameTiming::ExposureStart() const
+{
+    return shotSent + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double, std::milli>(latencyMs / 2.0));
+}
+
+std::chrono::steady_clock::time_point AbiCamera::FrameTiming::ExposureEnd() const
+{
+    return ExposureStart() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double, std::milli>(exposureMs));
+}
+
+/**
+* Converts a steady clock time to MM time, using the offset between the
+* two clocks sampled when the frame was read out.
+*/
+double AbiCamera::FrameTiming::ToMMTimeMs(std::chrono::steady_clock::time_point t) const
+{
+    return std::chrono::duration<double, std::milli>(t.time_since_epoch()).count() + mmTimeOffsetMs;
+}
+
+bool AbiCamera::IsCapturing() {
+    return m_thread && !m_thread->IsStopped();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AbiCamera Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+* Handles "Binning" property.
+*/
+int AbiCamera::OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::AfterSet)
+    {
+        long binSize;
+        pProp->Get(binSize);
+        if (IsCapturing())
+        {
+            MMThreadGuard g(m_pendingLock);
+            m_pending.binning = (int)binSize;
+            return DEVICE_OK;
+        }
+        int ret = SplitBinning((int)binSize, m_binning, m_hostBinning);
+        if (ret != DEVICE_OK)
+            return ret;
+        return ResizeImageBuffer();
+    }
+    else if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)GetBinning());
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+* Picks the bit depth to read the next frame at.
+* Reading at a lower depth drops low bits; that is harmless while a step
+* of the coarser scale stays below half the temporal noise of recent
+* frames (the smallest frame-to-frame estimate of the last few, after
+* background subtraction). The smallest supported depth meeting that is
+* used, never more than BitDepth.
+*/
+int AbiCamera::ChooseTransferBitDepth() const
+{
+    if (!m_adaptiveBitDepth || m_recentNoiseCount < ADAPTIVE_DEPTH_FRAMES)
+        return m_bitDepth;
+
+    const double noise = *std::min_element(m_recentNoise.begin(), m_recentNoise.end());
+    int dropBits = 0;
+    while (std::ldexp(1.0, dropBits + 1) <= noise / 2.0)
+        ++dropBits;
+
+    int depth = m_bitDepth;
+    for (int candidate : m_caps.bitDepths)
+    {
+        if (candidate >= m_bitDepth - dropBits && candidate < depth)
+            depth = candidate;
+    }
+    return depth;
+}
+
+int AbiCamera::OnAdaptiveBitDepth(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_adaptiveBitDepth);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long adaptive;
+        pProp->Get(adaptive);
+        m_adaptiveBitDepth = adaptive;
+        m_recentNoiseCount = 0;
+        m_temporalNoise.Reset();
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnTransferBitDepth(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_transferBitDepth);
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Splits a binning factor into device and host binning.
+* Device mode bins as much as possible on the camera, Host mode only on
+* the host. Auto picks the split with the shortest predicted readout plus
+* host binning time, so it follows the measured link and CPU cost.
+*/
+int AbiCamera::SplitBinning(int binning, int& device, int& host) const
+{
+    int bestDevice = 0;
+    double bestCost = 0.0;
+    for (int d : m_caps.binnings)
+    {
+        if (binning % d != 0 || binning / d > MAX_HOST_BINNING)
+            continue;
+        if (m_binningMode == g_BinningMode_Host && d != 1)
+            continue;
+
+        const unsigned long pixels = static_cast<unsigned long>(IMAGE_WIDTH / d) * (IMAGE_HEIGHT / d);
+        double cost = -d;
+        if (m_binningMode == g_BinningMode_Auto)
+        {
+            cost = m_frameTimeModel.PredictReadoutMs(pixels * m_bytesPerPixel);
+            if (binning / d > 1)
+                cost += m_frameTimeModel.PredictHostBinningMs(pixels);
+        }
+        if (bestDevice == 0 || cost < bestCost)
+        {
+            bestDevice = d;
+            bestCost = cost;
+        }
+    }
+
+    if (bestDevice == 0)
+        return DEVICE_INVALID_PROPERTY_VALUE;
+
+    device = bestDevice;
+    host = binning / bestDevice;
+    return DEVICE_OK;
+}
+
+/**
+* Offers the binning factors the current binning mode can split: the
+* device factors and the small ones host binning adds, or only the host
+* factors up to MAX_HOST_BINNING in Host mode.
+*/
+int AbiCamera::UpdateBinningValues()
+{
+    vector<int> candidates = m_caps.binnings;
+    for (int host = 1; host <= MAX_HOST_BINNING; ++host)
+        candidates.push_back(host);
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    vector<string> binningValues;
+    for (int binning : candidates)
+    {
+        int device, host;
+        if (SplitBinning(binning, device, host) == DEVICE_OK)
+            binningValues.push_back(std::to_string(binning));
+    }
+
+    ClearAllowedValues(MM::g_Keyword_Binning);
+    return SetAllowedValues(MM::g_Keyword_Binning, binningValues);
+}
+
+int AbiCamera::OnBinningMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_binningMode.c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        if (IsCapturing())
+            return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+        const std::string previous = m_binningMode;
+        pProp->Get(m_binningMode);
+        int ret = SplitBinning(GetBinning(), m_binning, m_hostBinning);
+        if (ret != DEVICE_OK)
+        {
+            LogMessage(std::format("Binning {} isn't possible in {} binning mode, staying in {}",
+                GetBinning(), m_binningMode, previous));
+            m_binningMode = previous;
+            return ret;
+        }
+
+        ret = UpdateBinningValues();
+        if (ret != DEVICE_OK)
+            return ret;
+        OnPropertiesChanged();
+        return ResizeImageBuffer();
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnHostBinningMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_hostBinningMode == HostBinning::Mode::Sum ? g_HostBinning_Sum : g_HostBinning_Average);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        std::string mode;
+        pProp->Get(mode);
+        m_hostBinningMode = mode == g_HostBinning_Average ? HostBinning::Mode::Average : HostBinning::Mode::Sum;
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnDeviceBinningFactor(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_binning);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnHostBinningFactor(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_hostBinning);
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "PixelType" property.
+*/
+int AbiCamera::OnPixelType(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    int ret = DEVICE_ERR;
+    if (eAct == MM::AfterSet)
+    {
+        string val;
+        pProp->Get(val);
+        int bytesPerPixel = m_bytesPerPixel;
+        if (val.compare(g_PixelType_8bit) == 0)
+        {
+            bytesPerPixel = 1;
+            ret = DEVICE_OK;
+        }
+        else
+        {
+            ret = ERR_UNKNOWN_MODE;
+        }
+
+        if (IsCapturing())
+        {
+            MMThreadGuard g(m_pendingLock);
+            m_pending.bytesPerPixel = bytesPerPixel;
+            return ret;
+        }
+
+        m_bytesPerPixel = bytesPerPixel;
+        ResizeImageBuffer();
+    }
+    else if (eAct == MM::BeforeGet)
+    {
+        if (m_bytesPerPixel == 1)
+            pProp->Set(g_PixelType_8bit);
+        else
+            assert(false); // this should never happen
+        ret = DEVICE_OK;
+    }
+
+    return ret;
+}
+
+int AbiCamera::OnBitDepth(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    int ret = DEVICE_ERR;
+    switch (eAct)
+    {
+    case MM::AfterSet:
+    {
+        long bitDepth;
+        pProp->Get(bitDepth);
+        if (IsCapturing())
+        {
+            MMThreadGuard g(m_pendingLock);
+            m_pending.bitDepth = bitDepth;
+        }
+        else
+        {
+            m_bitDepth = bitDepth;
+            m_transferBitDepth = m_bitDepth;
+            m_recentNoiseCount = 0;
+            m_temporalNoise.Reset();
+        }
+        ret = DEVICE_OK;
+    } break;
+    case MM::BeforeGet:
+    {
+        pProp->Set((long)m_bitDepth);
+        ret = DEVICE_OK;
+    } break;
+    default:
+        break;
+    }
+    return ret;
+}
+
+int AbiCamera::OnPort(MM::PropertyBase* Prop, MM::ActionType Act)
+{
+    if (Act == MM::BeforeGet)
+    {
+        Prop->Set(m_port.c_str());
+    }
+    else if (Act == MM::AfterSet)
+    {
+        Prop->Get(m_port);
+        m_deviceCold.reset();
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Calibrate Link" property.
+* Setting it to 1 measures the link again and resets it to 0.
+*/
+int AbiCamera::OnCalibrateLink(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(0L);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long calibrate;
+        pProp->Get(calibrate);
+        if (!calibrate)
+            return DEVICE_OK;
+        if (IsCapturing())
+            return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+        pProp->Set(0L);
+        return CharacterizeLink();
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnLinkLatency(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_link.latencyMs);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnLinkThroughput(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_link.throughputBytesPerSec / 1000.0);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnExposureOverhead(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_link.exposureOverheadMs);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnTransferChunk(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(static_cast<long>(m_link.chunkBytes));
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnIdlePoll(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_link.idlePollMs);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnPredictedReadout(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_frameTimeModel.PredictReadoutMs(GetTransferBytes()));
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnPredictedFrameRate(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_frameTimeModel.PredictFrameRate(m_exposureMs, GetTransferBytes(), m_subtractBackground != 0));
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Trigger" property.
+* Switching back to internal disarms the camera.
+*/
+int AbiCamera::OnTriggerMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_triggerMode.c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        if (IsCapturing())
+            return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+        std::string mode;
+        pProp->Get(mode);
+        if (mode == m_triggerMode)
+            return DEVICE_OK;
+
+        const bool wasArmed = m_armedFrames > 0;
+        m_triggerMode = mode;
+        if (wasArmed)
+            return DisarmTrigger();
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnTriggerTimeout(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_triggerTimeoutMs);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        pProp->Get(m_triggerTimeoutMs);
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Trigger Background Refresh s" property.
+* Takes effect at the next triggered frame, 0 keeps the background of the
+* arming.
+*/
+int AbiCamera::OnTriggerBackgroundRefresh(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_triggerBackgroundRefreshS);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        pProp->Get(m_triggerBackgroundRefreshS);
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Sync Group" property.
+* Cameras in this process with the same non-empty group name send their
+* shots together during sequence acquisition.
+*/
+int AbiCamera::OnSyncGroup(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_syncGroupName.c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        if (IsCapturing())
+            return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+        std::string name;
+        pProp->Get(name);
+        if (name == m_syncGroupName)
+            return DEVICE_OK;
+
+        if (m_syncGroup)
+        {
+            m_syncGroup->Quit();
+            m_syncGroup.reset();
+        }
+        m_syncGroupName = name;
+        if (!name.empty())
+        {
+            m_syncGroup = CameraSyncGroup::Join(name);
+            LogMessage(std::format("Joined sync group {} with {} cameras", name, m_syncGroup->GetMemberCount()), true);
+        }
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnSyncSkew(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_syncGroup ? m_syncGroup->GetLastSkewMs() : 0.0);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnSyncTimeouts(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_syncGroup ? static_cast<long>(m_syncGroup->GetTimeouts()) : 0L);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnAutoReconnect(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_autoReconnect);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long autoReconnect;
+        pProp->Get(autoReconnect);
+        m_autoReconnect = autoReconnect;
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnReconnectTimeout(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_reconnectTimeoutS);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        pProp->Get(m_reconnectTimeoutS);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnReconnects(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_reconnects.load());
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnLastOutage(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_lastOutageMs);
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Sleeps until the given time and records how much later than that the
+* calling thread got the CPU back.
+*/
+void AbiCamera::SleepUntil(std::chrono::steady_clock::time_point until)
+{
+    std::this_thread::sleep_until(until);
+    const double lateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - until).count();
+    m_wakeupJitter.Add(std::max(lateMs, 0.0));
+}
+
+/**
+* Waits out an idle poll of the port, the timed wait reads spend most of
+* their waiting in.
+*/
+void AbiCamera::IdlePoll()
+{
+    SleepUntil(std::chrono::steady_clock::now() + std::chrono::milliseconds(m_link.idlePollMs));
+}
+
+/**
+* Called by the sequence thread on itself before the first frame.
+*/
+void AbiCamera::ApplyReaderPolicy()
+{
+    if (!ApplyThreadPolicy(m_readerPolicy, m_readerPolicyError))
+        LogMessage(std::format("Reader thread policy not fully applied: {}", m_readerPolicyError), false);
+}
+
+/**
+* Makes policy the processing policy if the shared compression workers
+* take it; they refuse while another camera holds a policy of its own.
+*/
+int AbiCamera::ApplyProcessingPolicy(const ThreadPolicy& policy)
+{
+    if (m_compressionPool && !m_compressionPool->SetThreadPolicy(policy, this))
+        return ERR_POLICY_CONFLICT;
+    m_processingPolicy = policy;
+    m_processingPolicyRefused = false;
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnReaderScheduling(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(ThreadPolicy::ClassName(m_readerPolicy.schedClass));
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        std::string name;
+        pProp->Get(name);
+        if (!ThreadPolicy::ParseClass(name, m_readerPolicy.schedClass))
+            return ERR_UNKNOWN_MODE;
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnReaderPriority(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_readerPolicy.priority);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long priority;
+        pProp->Get(priority);
+        m_readerPolicy.priority = priority;
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Reader CPUs" property, a list like "2" or "0,4-7".
+* Empty lets the thread run on any CPU.
+*/
+int AbiCamera::OnReaderCpus(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(ThreadPolicy::FormatCpuList(m_readerPolicy.cpuMask).c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        std::string list;
+        pProp->Get(list);
+        if (!ThreadPolicy::ParseCpuList(list, m_readerPolicy.cpuMask))
+            return DEVICE_INVALID_PROPERTY_VALUE;
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnProcessingScheduling(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(ThreadPolicy::ClassName(m_processingPolicy.schedClass));
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        std::string name;
+        pProp->Get(name);
+        ThreadPolicy policy = m_processingPolicy;
+        if (!ThreadPolicy::ParseClass(name, policy.schedClass))
+            return ERR_UNKNOWN_MODE;
+        return ApplyProcessingPolicy(policy);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnProcessingPriority(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_processingPolicy.priority);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long priority;
+        pProp->Get(priority);
+        ThreadPolicy policy = m_processingPolicy;
+        policy.priority = priority;
+        return ApplyProcessingPolicy(policy);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnProcessingCpus(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(ThreadPolicy::FormatCpuList(m_processingPolicy.cpuMask).c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        std::string list;
+        pProp->Get(list);
+        ThreadPolicy policy = m_processingPolicy;
+        if (!ThreadPolicy::ParseCpuList(list, policy.cpuMask))
+            return DEVICE_INVALID_PROPERTY_VALUE;
+        return ApplyProcessingPolicy(policy);
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Thread Policy Status" property: what the OS refused the last
+* time the policies were applied, or OK.
+*/
+int AbiCamera::OnThreadPolicyStatus(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        std::string processingError = m_compressionPool ? m_compressionPool->GetPolicyError() : "";
+        if (m_processingPolicyRefused)
+            processingError = "another camera holds the policy of the shared compression threads";
+        std::string status;
+        if (!m_readerPolicyError.empty())
+            status = "reader: " + m_readerPolicyError;
+        if (!processingError.empty())
+            status += (status.empty() ? "" : "; ") + ("processing: " + processingError);
+        pProp->Set(status.empty() ? "OK" : status.c_str());
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnWakeupLateMean(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_wakeupJitter.GetMeanMs());
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnWakeupJitter(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_wakeupJitter.GetStdDevMs());
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnWakeupLateMax(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_wakeupJitter.GetMaxMs());
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnLatencyP99(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_soak.GetLatencyPercentileMs(99.0));
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnLatencyP999(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_soak.GetLatencyPercentileMs(99.9));
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnLatencyMax(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_soak.GetLatencyMaxMs());
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnProcessRss(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_soak.GetRssMB());
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnRssTrend(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_soak.GetRssTrendMBPerHour());
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnProcessThreads(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(static_cast<long>(m_soak.GetThreads()));
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnSoakSummary(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(std::format("{}, {} frame pool reconfigurations",
+            m_soak.GetSummary(), m_framePool.GetConfigureCount()).c_str());
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Fault Injection" property. Switching it on starts a new set of
+* recovery statistics.
+*/
+int AbiCamera::OnFaultInjection(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_faults.IsEnabled() ? 1L : 0L);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long enabled;
+        pProp->Get(enabled);
+        if (enabled && !m_faults.IsEnabled())
+            m_faults.ResetStats();
+        m_faults.SetEnabled(enabled != 0);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnFaultProbability(FaultInjector::Fault fault, MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_faults.GetProbability(fault));
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        double probability;
+        pProp->Get(probability);
+        m_faults.SetProbability(fault, probability);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnFaultDropProbability(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    return OnFaultProbability(FaultInjector::Drop, pProp, eAct);
+}
+
+int AbiCamera::OnFaultDelayProbability(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    return OnFaultProbability(FaultInjector::Delay, pProp, eAct);
+}
+
+int AbiCamera::OnFaultCorruptProbability(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    return OnFaultProbability(FaultInjector::Corrupt, pProp, eAct);
+}
+
+int AbiCamera::OnFaultTruncateProbability(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    return OnFaultProbability(FaultInjector::Truncate, pProp, eAct);
+}
+
+int AbiCamera::OnFaultDelay(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_faults.GetDelayMs());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        double delayMs;
+        pProp->Get(delayMs);
+        m_faults.SetDelayMs(delayMs);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnFaultRecovery(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_faults.GetSummary().c_str());
+    }
+    return DEVICE_OK;
+}
+
+/**
+* (Re)starts the exporter with the current target and interval. It's
+* stopped first, so its thread isn't collecting while the rate state is
+* reset.
+*/
+int AbiCamera::StartMetricsExport()
+{
+    m_metricsExporter.Stop();
+
+    char label[MM::MaxStrLength];
+    GetLabel(label);
+    m_metricsLabel = label;
+    m_metricsLastFrames = m_counters.frames;
+    m_metricsLastBytes = m_counters.bytes;
+    m_metricsLastTime = std::chrono::steady_clock::now();
+
+    if (!m_metricsExporter.Start(m_metricsTarget, m_metricsIntervalS, [this] { return CollectMetrics(); }))
+    {
+        LogMessage(std::format("Couldn't export metrics to {}", m_metricsTarget), false);
+        return ERR_METRICS_EXPORT;
+    }
+    LogMessage(std::format("Exporting metrics to {} every {} s", m_metricsTarget, m_metricsIntervalS), true);
+    return DEVICE_OK;
+}
+
+/**
+* Builds the metrics snapshot on the exporter thread. Reads only atomics
+* and lock-free histograms, so it never holds up the frame path. Rates are
+* averaged over the time since the previous snapshot.
+*/
+std::string AbiCamera::CollectMetrics()
+{
+    const auto now = std::chrono::steady_clock::now();
+    const uint64_t frames = m_counters.frames.load(std::memory_order_relaxed);
+    const uint64_t bytes = m_counters.bytes.load(std::memory_order_relaxed);
+    const double elapsedS = std::chrono::duration<double>(now - m_metricsLastTime).count();
+    const double frameRate = elapsedS > 0.0 ? (frames - m_metricsLastFrames) / elapsedS : 0.0;
+    const double byteRate = elapsedS > 0.0 ? (bytes - m_metricsLastBytes) / elapsedS : 0.0;
+    m_metricsLastFrames = frames;
+    m_metricsLastBytes = bytes;
+    m_metricsLastTime = now;
+
+    PrometheusText text(PrometheusText::Label("camera", m_metricsLabel));
+    text.Gauge("abicam_capturing", "1 while a sequence acquisition runs", IsCapturing() ? 1.0 : 0.0);
+    text.Counter("abicam_frames_total", "Frames read from the camera", static_cast<double>(frames));
+    text.Counter("abicam_transfer_bytes_total", "Bytes read over the serial link", static_cast<double>(bytes));
+    text.Gauge("abicam_frames_per_second", "Frame rate since the previous snapshot", frameRate);
+    text.Gauge("abicam_transfer_bytes_per_second", "Link throughput since the previous snapshot", byteRate);
+
+    const char* stageHelp = "Per-stage frame latency in milliseconds";
+    text.Summary("abicam_stage_latency_ms", stageHelp, m_shotLatency, PrometheusText::Label("stage", "shot"));
+    text.Summary("abicam_stage_latency_ms", stageHelp, m_transferLatency, PrometheusText::Label("stage", "transfer"));
+    text.Summary("abicam_stage_latency_ms", stageHelp, m_processingLatency, PrometheusText::Label("stage", "processing"));
+    // shot to delivery into the core, over the current or last sequence
+    text.Summary("abicam_stage_latency_ms", stageHelp, m_soak.GetLatency(), PrometheusText::Label("stage", "delivery"));
+
+    text.Counter("abicam_reconnects_total", "Serial link reconnects", static_cast<double>(m_reconnects.load()));
+    text.Counter("abicam_frame_errors_total", "Frames that failed after any retry",
+        static_cast<double>(m_counters.frameErrors.load(std::memory_order_relaxed)));
+    const char* droppedHelp = "Frames lost, by where they were lost";
+    text.Counter("abicam_dropped_frames_total", droppedHelp,
+        static_cast<double>(m_counters.reconnectDroppedFrames.load(std::memory_order_relaxed)),
+        PrometheusText::Label("reason", "reconnect"));
+    text.Counter("abicam_dropped_frames_total", droppedHelp,
+        static_cast<double>(m_writer.GetDroppedFrames()), PrometheusText::Label("reason", "writer"));
+    text.Counter("abicam_dropped_frames_total", droppedHelp,
+        static_cast<double>(m_streamServer.GetDroppedFrames()), PrometheusText::Label("reason", "stream"));
+
+    text.Gauge("abicam_queue_depth", "Frames waiting in a queue",
+        static_cast<double>(m_writer.GetBacklog()), PrometheusText::Label("queue", "writer"));
+    text.Gauge("abicam_stream_clients", "Connected frame stream clients", m_streamServer.GetClientCount());
+    text.Gauge("abicam_sensor_temperature_celsius", "Last sensor temperature reading",
+        m_counters.temperatureC.load(std::memory_order_relaxed));
+    return text.Text();
+}
+
+int AbiCamera::OnMetricsExport(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_metricsEnabled);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long enabled;
+        pProp->Get(enabled);
+        if (enabled == m_metricsEnabled)
+            return DEVICE_OK;
+
+        if (enabled)
+        {
+            int ret = StartMetricsExport();
+            if (ret != DEVICE_OK)
+                return ret;
+        }
+        else
+        {
+            m_metricsExporter.Stop();
+        }
+        m_metricsEnabled = enabled;
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Metrics Target" property: a file path, or "unix:/path" for a
+* Unix domain socket on POSIX. A running exporter moves to the new target.
+*/
+int AbiCamera::OnMetricsTarget(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_metricsTarget.c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        pProp->Get(m_metricsTarget);
+        if (m_metricsEnabled && StartMetricsExport() != DEVICE_OK)
+        {
+            m_metricsEnabled = 0;
+            return ERR_METRICS_EXPORT;
+        }
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnMetricsInterval(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_metricsIntervalS);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        pProp->Get(m_metricsIntervalS);
+        if (m_metricsEnabled && StartMetricsExport() != DEVICE_OK)
+        {
+            m_metricsEnabled = 0;
+            return ERR_METRICS_EXPORT;
+        }
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnMetricsExports(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(static_cast<long>(m_metricsExporter.GetExports()));
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnCapabilityCache(MM::PropertyBase* Prop, MM::ActionType Act)
+{
+    if (Act == MM::BeforeGet)
+    {
+        Prop->Set(m_capsCachePath.c_str());
+    }
+    else if (Act == MM::AfterSet)
+    {
+        Prop->Get(m_capsCachePath);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnBackground(MM::PropertyBase* Prop, MM::ActionType Act)
+{
+    if (Act == MM::BeforeGet)
+    {
+        Prop->Set((long)m_subtractBackground);
+    }
+    else if (Act == MM::AfterSet)
+    {
+        long subtract;
+        Prop->Get(subtract);
+        m_subtractBackground = subtract;
+        UpdatePredictions();
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnCCDTemp(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        // The sequence thread owns the port while capturing, report the last reading
+        if (!IsCapturing() && std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - m_lastTempRead).count()
+            > TEMP_READ_DELAY_MS)
+        {
+            auto ret = ReadTemperature();
+            if (ret != DEVICE_OK)
+                return ret;
+        }
+        MMThreadGuard g(m_portLock);
+        pProp->Set(m_ccdT);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnTempStable(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_tempTracker.IsStable() ? 1L : 0L);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnTempRate(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_tempTracker.GetRatePerMin());
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Temperature History" property.
+* The newest samples as "seconds:temperature" pairs, see TemperatureTracker.
+*/
+int AbiCamera::OnTempHistory(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_tempTracker.GetHistory(TEMP_HISTORY_PROPERTY_SAMPLES).c_str());
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnTempTolerance(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_tempTracker.GetToleranceC());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        double tolerance;
+        pProp->Get(tolerance);
+        m_tempTracker.Configure(tolerance, m_tempTracker.GetWindowS());
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnTempWindow(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_tempTracker.GetWindowS());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        double window;
+        pProp->Get(window);
+        m_tempTracker.Configure(m_tempTracker.GetToleranceC(), window);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnTempSampleInterval(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_tempSampleMs);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        pProp->Get(m_tempSampleMs);
+        m_tempThread->SetIntervalMs(m_tempSampleMs);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnCold(MM::PropertyBase* Prop, MM::ActionType Act)
+{
+    if (Act == MM::BeforeGet)
+    {
+        Prop->Set((long)m_cold);
+    }
+    else if (Act == MM::AfterSet)
+    {
+        long cold;
+        Prop->Get(cold);
+
+        if (IsCapturing())
+        {
+            MMThreadGuard g(m_pendingLock);
+            m_pending.cold = cold;
+            return DEVICE_OK;
+        }
+
+        m_cold = cold;
+        return SendCold();
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Save Frames" property.
+* Opening the stack starts the background writer, closing it waits for the
+* queued frames to reach the disk.
+*/
+int AbiCamera::OnSaveFrames(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_saveFrames);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long save;
+        pProp->Get(save);
+
+        if (save && !m_writer.IsOpen())
+        {
+            if (!m_writer.Open(m_savePath, m_saveFormat == g_SaveFormat_OmeTiff))
+            {
+                LogMessage(std::format("Couldn't open {} for saving", m_savePath));
+                return ERR_FILE_OPEN;
+            }
+            LogMessage(std::format("Saving frames to {}", m_savePath), true);
+        }
+        else if (!save && m_writer.IsOpen())
+        {
+            m_writer.Close();
+            LogMessage(std::format("Saved {} frames to {} ({} files), dropped {}, compression ratio {:.2f}",
+                m_writer.GetWrittenFrames(), m_savePath, m_writer.GetFileCount(), m_writer.GetDroppedFrames(),
+                m_writer.GetCompressionRatio()), true);
+        }
+        m_saveFrames = save;
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnSavePath(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_savePath.c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        if (m_writer.IsOpen())
+            return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+        pProp->Get(m_savePath);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnSaveFormat(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_saveFormat.c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        if (m_writer.IsOpen())
+            return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+        pProp->Get(m_saveFormat);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnWriterBacklog(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_writer.GetBacklog());
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnWriterDropped(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_writer.GetDroppedFrames());
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Compression" property.
+* Saved stacks are deflated (TIFF Compression 8 with the horizontal
+* predictor), which any TIFF reader decodes. The strips are coded on a
+* small worker pool that is created the first time compression is switched
+* on.
+*/
+int AbiCamera::OnCompression(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_compression.c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        if (m_writer.IsOpen())
+            return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+        pProp->Get(m_compression);
+        if (m_compression == g_Compression_Deflate)
+        {
+            if (!m_compressionPool)
+            {
+                m_compressionPool = WorkerPool::Shared();
+                if (ApplyProcessingPolicy(m_processingPolicy) != DEVICE_OK)
+                {
+                    m_processingPolicyRefused = true;
+                    LogMessage("Processing thread policy not applied, another camera holds the policy of the shared compression threads");
+                }
+            }
+            m_writer.SetCompression(m_compressionPool.get());
+        }
+        else
+        {
+            m_writer.SetCompression(nullptr);
+        }
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnCompressionRatio(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_writer.GetCompressionRatio());
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Shared Memory Ring" property.
+* Slots are sized for the full unbinned frame so the ring survives binning
+* and ROI changes.
+*/
+int AbiCamera::OnSharedRing(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_sharedRingEnabled);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long enable;
+        pProp->Get(enable);
+
+        if (enable && !m_sharedRing.IsOpen())
+        {
+            const size_t maxFrameBytes = static_cast<size_t>(IMAGE_WIDTH) * IMAGE_HEIGHT * sizeof(uint16_t);
+            if (!m_sharedRing.Create(m_sharedRingName, m_sharedRingSlots, maxFrameBytes))
+            {
+                LogMessage(std::format("Couldn't create shared memory ring {}", m_sharedRingName));
+                return ERR_SHARED_MEMORY;
+            }
+            LogMessage(std::format("Publishing frames to shared memory ring {}", m_sharedRing.GetName()), true);
+        }
+        else if (!enable)
+        {
+            m_sharedRing.Destroy();
+        }
+        m_sharedRingEnabled = enable;
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnSharedRingName(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_sharedRingName.c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        if (m_sharedRing.IsOpen())
+            return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+        pProp->Get(m_sharedRingName);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnSharedRingSlots(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_sharedRingSlots);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        if (m_sharedRing.IsOpen())
+            return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+        pProp->Get(m_sharedRingSlots);
+    }
+    return DEVICE_OK;
+}
+
+/**
+* Handles "Stream Server" property.
+* The endpoint is a TCP port, an address:port pair, or a Unix socket path.
+*/
+int AbiCamera::OnStreamServer(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_streamEnabled);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long enable;
+        pProp->Get(enable);
+
+        if (enable && !m_streamServer.IsRunning())
+        {
+            if (!m_streamServer.Start(m_streamEndpoint))
+            {
+                LogMessage(std::format("Couldn't start stream server on {}", m_streamEndpoint));
+                return ERR_STREAM_SERVER;
+            }
+            LogMessage(std::format("Streaming frames on {}", m_streamEndpoint), true);
+        }
+        else if (!enable)
+        {
+            m_streamServer.Stop();
+        }
+        m_streamEnabled = enable;
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnStreamEndpoint(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_streamEndpoint.c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        if (m_streamServer.IsRunning())
+            return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+        pProp->Get(m_streamEndpoint);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnStreamDownsample(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_streamDownsample);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        pProp->Get(m_streamDownsample);
+        m_streamServer.SetDownsample(static_cast<unsigned>(m_streamDownsample));
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnStreamCompression(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_streamCompression.c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        pProp->Get(m_streamCompression);
+        m_streamServer.SetCompression(m_streamCompression == g_Compression_Rice);
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnStreamClients(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_streamServer.GetClientCount());
+    }
+    return DEVICE_OK;
 }
 
-/**
-* Returns the current binning factor.
-* Required by the MM::Camera API.
-*/
-int AbiCamera::GetBinning() const
+int AbiCamera::OnStreamDropped(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-    return m_binning;
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_streamServer.GetDroppedFrames());
+    }
+    return DEVICE_OK;
 }
 
 /**
-* Sets binning factor.
-* Required by the MM::Camera API.
+* Handles "Huge Pages" property.
+* Remaps the frame pool; whether huge pages were actually granted is logged.
 */
-int AbiCamera::SetBinning(int binF)
+int AbiCamera::OnHugePages(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-    return SetProperty(MM::g_Keyword_Binning, CDeviceUtils::ConvertToString(binF));
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_hugePages);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        if (IsCapturing())
+            return DEVICE_CAMERA_BUSY_ACQUIRING;
+
+        long huge;
+        pProp->Get(huge);
+        if (huge != m_hugePages)
+        {
+            m_hugePages = huge;
+            if (m_imgBuf)
+                return ConfigureFramePool(m_framePool.GetSlabBytes());
+        }
+    }
+    return DEVICE_OK;
 }
 
-int AbiCamera::PrepareSequenceAcqusition()
+int AbiCamera::OnFramePoolReconfigurations(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-    if (IsCapturing())
-        return DEVICE_CAMERA_BUSY_ACQUIRING;
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_framePool.GetConfigureCount());
+    }
+    return DEVICE_OK;
+}
 
-    int ret = GetCoreCallback()->PrepareForAcq(this);
-    if (ret != DEVICE_OK)
-        return ret;
+int AbiCamera::OnFrameMean(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_frameStats.Mean());
+    }
+    return DEVICE_OK;
+}
 
+int AbiCamera::OnFrameMin(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_frameStats.count ? (long)m_frameStats.min : 0L);
+    }
     return DEVICE_OK;
 }
 
+int AbiCamera::OnFrameMax(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_frameStats.max);
+    }
+    return DEVICE_OK;
+}
 
 /**
- * Required by the MM::Camera API
- * Please implement this yourself and do not rely on the base class implementation
- * The Base class implementation is deprecated and will be removed shortly
- */
-int AbiCamera::StartSequenceAcquisition(double interval) {
+* Handles "Progressive Live View" property.
+* Starts or stops the thread that publishes partially received frames.
+* They are only shown through GetImageBuffer(), the core's sequence buffer
+* only ever gets complete frames.
+*/
+int AbiCamera::OnProgressive(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)m_progressive);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long progressive;
+        pProp->Get(progressive);
 
-    return StartSequenceAcquisition(LONG_MAX, interval, false);
+        if (!m_previewThread)
+            m_previewThread = new PreviewThread(this);
+
+        if (progressive && m_previewThread->IsStopped())
+        {
+            m_previewThread->Start(m_progressiveRefreshMs);
+        }
+        else if (!progressive && !m_previewThread->IsStopped())
+        {
+            m_previewThread->Stop();
+            m_previewThread->wait();
+        }
+        m_progressive = progressive;
+    }
+    return DEVICE_OK;
+}
+
+int AbiCamera::OnProgressiveRefresh(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(m_progressiveRefreshMs);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        pProp->Get(m_progressiveRefreshMs);
+        if (m_previewThread)
+            m_previewThread->SetRefreshMs(m_progressiveRefreshMs);
+    }
+    return DEVICE_OK;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Private AbiCamera methods
+///////////////////////////////////////////////////////////////////////////////
+
 /**
-* Stop and wait for the Sequence thread finished
+* Sync internal image buffer size to the chosen property values.
 */
-int AbiCamera::StopSequenceAcquisition()
+int AbiCamera::ResizeImageBuffer()
 {
-    if (!m_thread->IsStopped()) {
-        m_thread->Stop();
-        m_thread->wait();
+    {
+        // the preview reads the geometry under the pixel lock
+        MMThreadGuard g(m_imgPixelsLock);
+        m_readWidth = IMAGE_WIDTH / m_binning;
+        m_readHeight = IMAGE_HEIGHT / m_binning;
+        // columns and rows left over by host binning are read and dropped
+        m_imgWidth = m_readWidth / m_hostBinning;
+        m_imgHeight = m_readHeight / m_hostBinning;
+        m_roiStartX = 0;
+        m_roiStartY = 0;
+    }
+
+    // slabs hold a full unbinned frame, so binning and ROI changes never reallocate
+    const size_t slabBytes = static_cast<size_t>(IMAGE_WIDTH) * IMAGE_HEIGHT * m_bytesPerPixel;
+    if (!m_imgBuf || m_framePool.GetSlabBytes() < slabBytes)
+    {
+        int ret = ConfigureFramePool(slabBytes);
+        if (ret != DEVICE_OK)
+            return ret;
     }
 
+    UpdatePredictions();
     return DEVICE_OK;
 }
 
 /**
-* Simple implementation of Sequence Acquisition
-* A sequence acquisition should run on its own thread and transport new images
-* coming of the camera into the MMCore circular buffer.
+* Reallocates the frame pool and takes the image and background slabs from
+* it. Only happens when the pixel size grows or huge pages are toggled.
 */
-int AbiCamera::StartSequenceAcquisition(long numImages, double interval_ms, bool stopOnOverflow)
+int AbiCamera::ConfigureFramePool(size_t slabBytes)
 {
-    if (IsCapturing())
-        return DEVICE_CAMERA_BUSY_ACQUIRING;
+    MMThreadGuard g(m_imgPixelsLock);
 
-    int ret = GetCoreCallback()->PrepareForAcq(this);
-    if (ret != DEVICE_OK)
-        return ret;
+    m_imgBuf.Reset();
+    m_backBuf.Reset();
+    m_bkgBuf.Reset();
+    if (!m_framePool.Configure(slabBytes, FRAME_POOL_SLABS, m_hugePages != 0))
+    {
+        LogMessage(std::format("Couldn't allocate {} frame buffers of {} bytes", FRAME_POOL_SLABS, slabBytes));
+        return DEVICE_OUT_OF_MEMORY;
+    }
 
+    m_imgBuf = m_framePool.Acquire();
+    m_backBuf = m_framePool.Acquire();
+    m_bkgBuf = m_framePool.Acquire();
+    memset(m_imgBuf.Data(), 0, slabBytes);
+    memset(m_backBuf.Data(), 0, slabBytes);
+    memset(m_bkgBuf.Data(), 0, slabBytes);
+
+    LogMessage(std::format("Frame pool: {} slabs of {} bytes, huge pages {}",
+        FRAME_POOL_SLABS, slabBytes, m_framePool.IsHugePageBacked() ? "on" : "off"), true);
     return DEVICE_OK;
 }
 
-/*
- * Inserts Image and MetaData into MMCore circular Buffer
+/**
+ * Generate an image with fixed value for all pixels
  */
-int AbiCamera::InsertImage()
+void AbiCamera::GenerateImage()
 {
-    MM::MMTime timeStamp = this->GetCurrentMMTime();
-    char label[MM::MaxStrLength];
-    this->GetLabel(label);
-
-    // Important:  metadata about the image are generated here:
-    Metadata md;
-    md.put("Camera", label);
-    md.put(MM::g_Keyword_Metadata_StartTime, CDeviceUtils::ConvertToString(timeStamp.getMsec()));
-    md.put(MM::g_Keyword_Metadata_ROI_X, CDeviceUtils::ConvertToString((long)m_roiStartX));
-    md.put(MM::g_Keyword_Metadata_ROI_Y, CDeviceUtils::ConvertToString((long)m_roiStartY));
+    MMThreadGuard g(m_imgPixelsLock);
 
-    char buf[MM::MaxStrLength];
-    GetProperty(MM::g_Keyword_Binning, buf);
-    md.put(MM::g_Keyword_Binning, buf);
+    const int maxValue = (1 << MAX_BIT_DEPTH) - 1; // max for the 12 bit camera
+    const double maxExp = 1000;
+    double step = maxValue / maxExp;
+    memset(m_imgBuf.Data(), 128, GetImageBufferSize());
+}
 
+/**
+* Publishes the completed back buffer as the current image.
+* Only the buffer handles are exchanged, so the pixel lock is held for a
+* pointer swap instead of the whole serial transfer.
+*/
+void AbiCamera::SwapImageBuffers()
+{
     MMThreadGuard g(m_imgPixelsLock);
+    std::swap(m_imgBuf, m_backBuf);
+    std::swap(m_imgTiming, m_backTiming);
+    m_frameInProgress = false;
+}
 
-    const unsigned char* pI;
-    pI = GetImageBuffer();
-
-    unsigned int w = GetImageWidth();
-    unsigned int h = GetImageHeight();
-    unsigned int b = GetImageBytesPerPixel();
+/**
+* Called by the preview thread during a readout in progressive mode.
+* Copies the rows completed since the last refresh into the front buffer,
+* so GetImageBuffer() shows the new frame down to the last received row and
+* the previous frame below it. Composites are never inserted into the core:
+* they have no timing of their own, and the sequence buffer only gets
+* complete frames. Everything happens under the pixel lock, which the
+* readout thread takes to start and end a frame and the property handlers
+* take to change the geometry, so the rows copied always belong to the
+* frame being read. The readout thread only writes rows the preview hasn't
+* copied yet, so it is never blocked by the copy itself.
+*/
+void AbiCamera::PublishPartialFrame()
+{
+    if (!m_frameInProgress)
+        return;
 
-    int ret = GetCoreCallback()->InsertImage(this, pI, w, h, b, 1, md.Serialize().c_str());
-    if (ret == DEVICE_BUFFER_OVERFLOW)
-    {
-        // do not stop on overflow - just reset the buffer
-        GetCoreCallback()->ClearImageBuffer(this);
-        // don't process this same image again...
-        return GetCoreCallback()->InsertImage(this, pI, w, h, b, 1, md.Serialize().c_str(), false);
-    }
-    else
+    MMThreadGuard g(m_imgPixelsLock);
+    // rows of a host binned frame only exist once the whole frame is in
+    if (!m_frameInProgress || m_hostBinning > 1)
+        return;
+
+    // the back buffer holds the whole frame, the front buffer only the ROI
+    const unsigned readRows = m_rowProcessor.GetRowsDone();
+    const unsigned rows = readRows > static_cast<unsigned>(m_roiStartY)
+        ? std::min(readRows - m_roiStartY, m_imgHeight) : 0;
+    if (rows <= m_previewRows || rows >= m_imgHeight)
+        return;
+
+    const size_t rowBytes = static_cast<size_t>(m_imgWidth) * m_bytesPerPixel;
+    for (unsigned y = m_previewRows; y < rows; ++y)
     {
-        return ret;
+        const size_t src = (static_cast<size_t>(m_roiStartY + y) * m_readWidth + m_roiStartX) * m_bytesPerPixel;
+        memcpy(m_imgBuf.Data() + y * rowBytes, m_backBuf.Data() + src, rowBytes);
     }
+    m_previewRows = rows;
 }
 
-
-bool AbiCamera::IsCapturing() {
-    return !m_thread->IsStopped();
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// AbiCamera Action handlers
-///////////////////////////////////////////////////////////////////////////////
-
 /**
-* Handles "Binning" property.
+* Reads one frame from the port straight into dst.
+* Each read asks for at most the remaining byte count, so no staging buffer
+* is needed and nothing is allocated per frame. dst must not be the buffer
+* returned by GetImageBuffer(), no lock is held while reading.
+* Packed samples are received at the end of dst and every complete row is
+* unpacked to its place at once; a row never reaches past the packed rows
+* still to come, as they are shorter.
+* If rows is given, every row is processed as soon as it is complete, so the
+* processing overlaps with the rest of the transfer.
 */
-int AbiCamera::OnBinning(MM::PropertyBase* pProp, MM::ActionType eAct)
+int AbiCamera::ReadImage(uint8_t* dst, RowProcessor* rows)
 {
-    if (eAct == MM::AfterSet)
+    const unsigned long numBytesToReceive = GetTransferBytes();
+    const unsigned packedBits = GetPackedBits(m_transferBitDepth);
+    const size_t rowBytes = static_cast<size_t>(m_readWidth) * GetImageBytesPerPixel();
+    const size_t packedRowBytes = GetTransferRowBytes(m_transferBitDepth);
+    uint8_t* const received = packedBits ? dst + rowBytes * m_readHeight - numBytesToReceive : dst;
+    unsigned unpackedRows = 0;
+    if (packedBits)
+        m_unpackRow.resize(rowBytes);
+
+    const unsigned long chunkSize = m_link.chunkBytes;
+    const auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::duration<double, std::milli>(GetReadTimeoutMs(numBytesToReceive));
+
+    unsigned long totalRead = 0;
+    unsigned long read = 0;
+    do
     {
-        long binSize;
-        pProp->Get(binSize);
-        m_binning = (int)binSize;
-        return ResizeImageBuffer();
-    }
-    else if (eAct == MM::BeforeGet)
+        const unsigned long toRead = std::min(chunkSize, numBytesToReceive - totalRead);
+        auto ret = ReadPort(received + totalRead, toRead, read);
+        if (ret != DEVICE_OK)
+        {
+            LogMessageCode(ret, true);
+            return ret;
+        }
+        totalRead += read;
+        if (packedBits)
+        {
+            // through a row of scratch, as the last rows overlap their own packed bytes
+            const unsigned complete = static_cast<unsigned>(totalRead / packedRowBytes);
+            for (; unpackedRows < complete; ++unpackedRows)
+            {
+                UnpackRow(received + unpackedRows * packedRowBytes, m_readWidth, packedBits, GetImageBytesPerPixel(),
+                    m_unpackRow.data());
+                memcpy(dst + unpackedRows * rowBytes, m_unpackRow.data(), rowBytes);
+            }
+        }
+        if (rows)
+            rows->Advance(packedBits ? unpackedRows * rowBytes : totalRead);
+
+        if (read == 0)
+        {
+            IdlePoll();
+        }
+
+    } while (totalRead < numBytesToReceive && std::chrono::steady_clock::now() < deadline);
+
+    if (totalRead != numBytesToReceive)
     {
-        pProp->Set((long)m_binning);
+        LogMessage(std::format("Failed to read image data from port : read {} bytes", totalRead), false);
+        return ERR_IMAGE_READ;
     }
 
+    if (rows)
+        rows->Finish();
+
     return DEVICE_OK;
 }
 
 /**
-* Handles "PixelType" property.
+* Hands the processed frame in m_imgBuf to the enabled frame sinks.
+* None of them block: the writer drops frames when its queue is full, the
+* shared ring overwrites the oldest slot and the stream server keeps only
+* the newest frame.
 */
-int AbiCamera::OnPixelType(MM::PropertyBase* pProp, MM::ActionType eAct)
+void AbiCamera::DistributeFrame()
 {
-    int ret = DEVICE_ERR;
-    if (eAct == MM::AfterSet)
+    if (m_writer.IsOpen())
     {
-        if (IsCapturing())
-            return DEVICE_CAMERA_BUSY_ACQUIRING;
-
-        string val;
-        pProp->Get(val);
-        if (val.compare(g_PixelType_8bit) == 0)
-        {
-            m_bytesPerPixel = 1;
-            ret = DEVICE_OK;
-        }
-        else
-        {
-            ret = ERR_UNKNOWN_MODE;
-        }
-
-        ResizeImageBuffer();
+        const unsigned files = m_writer.GetFileCount();
+        m_writer.Push(m_imgBuf.Data(), m_imgWidth, m_imgHeight, m_bytesPerPixel, m_bitDepth);
+        if (m_writer.GetFileCount() != files)
+            LogMessage(std::format("Frame size or pixel type changed while saving, continuing in {}",
+                m_writer.GetPath()), false);
     }
-    else if (eAct == MM::BeforeGet)
+
+    if (m_sharedRing.IsOpen())
     {
-        if (m_bytesPerPixel == 1)
-            pProp->Set(g_PixelType_8bit);
-        else
-            assert(false); // this should never happen
-        ret = DEVICE_OK;
+        const auto start = m_imgTiming.ExposureStart().time_since_epoch();
+        m_sharedRing.Publish(m_imgBuf.Data(), m_imgWidth, m_imgHeight, m_bytesPerPixel, m_bitDepth,
+            std::chrono::duration_cast<std::chrono::microseconds>(start).count());
     }
 
-    return ret;
+    if (m_streamServer.IsRunning())
+    {
+        m_streamServer.Publish(m_imgBuf.Data(), m_imgWidth, m_imgHeight, m_bytesPerPixel, m_bitDepth);
+    }
 }
 
-int AbiCamera::OnBitDepth(MM::PropertyBase* pProp, MM::ActionType eAct)
+/**
+* Sends the cooler setting with "cld" unless the camera already
+* acknowledged that value, so reapplying a configuration group doesn't
+* touch the port.
+*/
+int AbiCamera::SendCold()
 {
-    int ret = DEVICE_ERR;
-    switch (eAct)
+    MMThreadGuard portGuard(m_portLock);
+
+    if (m_deviceCold == m_cold)
     {
-    case MM::AfterSet:
+        ++m_skippedCommands;
+        LogMessage(std::format("Cooler already {}, {} commands skipped so far", m_cold, m_skippedCommands), true);
+        return DEVICE_OK;
+    }
+
+    PurgeComPort(m_port.c_str());
+
+    auto ret = WritePort(std::format("cld {}", m_cold).c_str(), "\n");
+    if (ret != DEVICE_OK)
     {
-        if (IsCapturing())
-            return DEVICE_CAMERA_BUSY_ACQUIRING;
+        LogMessageCode(ret, true);
+        return ret;
+    }
 
-        long bitDepth;
-        pProp->Get(bitDepth);
-        m_bitDepth = bitDepth;
-        ret = DEVICE_OK;
-    } break;
-    case MM::BeforeGet:
+    uint8_t ans = 0;
+    ret = ReadResponse(&ans, 1, m_link.responseTimeoutMs);
+    if (ret != DEVICE_OK)
     {
-        pProp->Set((long)m_bitDepth);
-        ret = DEVICE_OK;
-    } break;
-    default:
-        break;
+        LogMessage("Couldn't read cld response");
+        return ret;
     }
-    return ret;
+
+    m_deviceCold = m_cold;
+    return DEVICE_OK;
 }
 
-int AbiCamera::OnPort(MM::PropertyBase* Prop, MM::ActionType Act)
+/**
+* Reads the sensor temperature with "chp" and adds it to the tracker.
+*/
+int AbiCamera::ReadTemperature()
 {
-    if (Act == MM::BeforeGet)
+    MMThreadGuard portGuard(m_portLock);
+    m_lastTempRead = std::chrono::high_resolution_clock::now();
+
+    PurgeComPort(m_port.c_str());
+
+    // Send chp command
+    std::string command = std::format("chp");
+    auto ret = WritePort(command.c_str(), "\n");
+    if (ret != DEVICE_OK)
     {
-        Prop->Set(m_port.c_str());
+        LogMessageCode(ret, true);
+        return ret;
     }
-    else if (Act == MM::AfterSet)
+
+    std::array<uint8_t, 4> ansBuf{};
+    ret = ReadResponse(ansBuf.data(), 4, m_link.responseTimeoutMs);
+    if (ret != DEVICE_OK)
     {
-        Prop->Get(m_port);
+        LogMessage("Couldn't read temp response");
+        return ret;
     }
+
+    const auto tempAdc = ansBuf[1] * 256 + ansBuf[0];
+    const auto tempK = tempAdc * ADC_V / 4096.0;
+    m_ccdT = tempK - 273.15;
+    m_counters.temperatureC.store(m_ccdT, std::memory_order_relaxed);
+    m_tempTracker.Add(TemperatureTracker::Clock::now(), m_ccdT);
+    LogMessage(std::format("Got temp response : {}", m_ccdT), true);
     return DEVICE_OK;
 }
 
-int AbiCamera::OnBackground(MM::PropertyBase* Prop, MM::ActionType Act)
+/**
+* Called by the temperature thread every sample interval.
+* Skipped during sequences, whose thread owns the port; between snaps the
+* port lock makes it wait for the exchange in progress. MMCore is told when
+* the sensor becomes stable or leaves stability.
+*/
+void AbiCamera::SampleTemperature()
 {
-    if (Act == MM::BeforeGet)
+    if (IsCapturing())
+        return;
+
+    const int ret = ReadTemperature();
+    if (ret != DEVICE_OK)
     {
-        Prop->Set((long)m_subtractBackground);
+        if (m_autoReconnect && IsLinkError(ret))
+            Reconnect();
+        return;
     }
-    else if (Act == MM::AfterSet)
+
+    const bool stable = m_tempTracker.IsStable();
+    if (stable != m_tempStable)
     {
-        long subtract;
-        Prop->Get(subtract);
-        m_subtractBackground = subtract;
+        m_tempStable = stable;
+        OnPropertyChanged("Temperature Stable", stable ? "1" : "0");
+        LogMessage(std::format("Sensor temperature {} at {:.2f} C", stable ? "stable" : "drifting", m_ccdT), true);
     }
-    return DEVICE_OK;
 }
 
-int AbiCamera::OnCCDTemp(MM::PropertyBase* pProp, MM::ActionType eAct)
+/**
+* Arms the camera for hardware or burst triggered frames.
+* Assumed firmware protocol, acknowledged with one byte:
+*   trg 0                         back to internal (sht) triggering
+*   trg 1 <exposure ms>           expose for the exposure on every edge
+*   trg 2                         expose while the gate input is high
+*   trg 3 <exposure ms> <frames>  take frames back to back right away
+* Once armed, the camera sends the usual two byte confirmation whenever a
+* frame is ready and waits for rid, so the host only streams data.
+* The background for subtraction is taken once per arming, which lasts for
+* up to MAX_BURST_FRAMES frames of a sequence. It goes stale as the sensor
+* temperature drifts unless "Trigger Background Refresh s" re-arms earlier.
+*/
+int AbiCamera::ArmTrigger(long frames)
 {
-    if (eAct == MM::BeforeGet)
+    PurgeComPort(m_port.c_str());
+    if (m_subtractBackground)
     {
-		if (std::chrono::duration<double, std::milli>(
-			std::chrono::high_resolution_clock::now() - m_lastTempRead).count()
-			 > TEMP_READ_DELAY_MS)
-		{
-            m_lastTempRead = std::chrono::high_resolution_clock::now();
-
-            PurgeComPort(m_port.c_str());
-
-            // Send chp command
-            std::string command = std::format("chp");
-            auto ret = SendSerialCommand(m_port.c_str(), command.c_str(), "\n");
-            if (ret != DEVICE_OK)
-            {
-                LogMessageCode(ret, true);
-                return ret;
-            }
-
-            CDeviceUtils::SleepMs(100);
+        auto ret = ShotAndResponse(0);
+        if (ret == DEVICE_OK)
+            ret = ReadImage(m_bkgBuf.Data());
+        if (ret != DEVICE_OK)
+        {
+            LogMessageCode(ret, true);
+            return ret;
+        }
+        m_backgroundTaken = std::chrono::steady_clock::now();
+    }
 
-            std::array<uint8_t, 4> ansBuf{};
-            unsigned long read = 0;
-            ret = ReadFromComPort(m_port.c_str(), ansBuf.data(), 4, read);
-            if (ret != DEVICE_OK)
-            {
-                LogMessageCode(ret, true);
-                return ret;
-            }
-            if (read != 4)
-            {
-                LogMessage("Couldn't read temp response");
-                return ERR_COM_RESPONSE;
-            }
+    std::string command;
+    if (m_triggerMode == g_Trigger_Edge)
+        command = std::format("trg 1 {}", static_cast<int>(m_exposureMs));
+    else if (m_triggerMode == g_Trigger_Gate)
+        command = "trg 2";
+    else
+        command = std::format("trg 3 {} {}", static_cast<int>(m_exposureMs), frames);
 
-            const auto tempAdc = ansBuf[1] * 256 + ansBuf[0];
-            const auto tempK = tempAdc * ADC_V / 4096.0;
-            m_ccdT = tempK - 273.15;
-            LogMessage(std::format("Got temp response : {}", m_ccdT), true);
-		}
-		pProp->Set(m_ccdT);
+    auto ret = WritePort(command.c_str(), "");
+    if (ret != DEVICE_OK)
+    {
+        LogMessageCode(ret, true);
+        return ret;
     }
-    else
+
+    uint8_t ack = 0;
+    ret = ReadResponse(&ack, 1, m_link.responseTimeoutMs);
+    if (ret != DEVICE_OK)
     {
+        LogMessage("Couldn't read trigger arm response");
+        return ret;
     }
+
+    m_armedFrames = frames;
+    LogMessage(std::format("Armed {} trigger for {} frames", m_triggerMode, frames), true);
     return DEVICE_OK;
 }
 
-int AbiCamera::OnCold(MM::PropertyBase* Prop, MM::ActionType Act)
+int AbiCamera::DisarmTrigger()
 {
-    if (Act == MM::BeforeGet)
+    m_armedFrames = 0;
+    auto ret = WritePort("trg 0", "");
+    if (ret != DEVICE_OK)
     {
-        Prop->Set((long)m_cold);
+        LogMessageCode(ret, true);
+        return ret;
     }
-    else if (Act == MM::AfterSet)
-    {
-        long cold;
-        Prop->Get(cold);
 
-        PurgeComPort(m_port.c_str());
+    uint8_t ack = 0;
+    ret = ReadResponse(&ack, 1, m_link.responseTimeoutMs);
+    PurgeComPort(m_port.c_str());
+    return ret;
+}
+
+/**
+* Waits for the armed camera to report a frame, then requests it.
+* Polls in short slices so a sequence stop isn't held up by a trigger that
+* never comes. The exposure isn't seen by the host, so its start is placed
+* an exposure plus the measured overhead before the confirmation.
+*/
+int AbiCamera::WaitForTriggeredFrame(FrameTiming* timing)
+{
+    using Clock = std::chrono::steady_clock;
+
+    const bool inSequence = IsCapturing();
+    const auto deadline = Clock::now() + std::chrono::duration<double, std::milli>(m_triggerTimeoutMs);
 
-        // Send cold command to chip
-        std::string command = std::format("cld {}", cold);
-        auto ret = SendSerialCommand(m_port.c_str(), command.c_str(), "\n");
+    std::array<uint8_t, 2> buf{};
+    unsigned long totalRead = 0;
+    while (totalRead < buf.size())
+    {
+        unsigned long read = 0;
+        auto ret = ReadPort(buf.data() + totalRead, buf.size() - totalRead, read);
         if (ret != DEVICE_OK)
         {
             LogMessageCode(ret, true);
             return ret;
         }
+        totalRead += read;
+        if (totalRead == buf.size())
+            break;
+
+        if ((inSequence && !IsCapturing()) || Clock::now() >= deadline)
+        {
+            LogMessage(std::format("No triggered frame within {} ms", m_triggerTimeoutMs), true);
+            return ERR_TRIGGER_TIMEOUT;
+        }
+        if (read == 0)
+            IdlePoll();
+    }
+
+    const auto acked = Clock::now();
+    if (timing)
+    {
+        timing->shotAcked = acked;
+        timing->shotSent = acked - std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::milli>(m_exposureMs + m_link.exposureOverheadMs));
+        timing->exposureMs = m_exposureMs;
+        timing->latencyMs = 0.0;
+    }
+    if (m_armedFrames > 0)
+        --m_armedFrames;
 
-        CDeviceUtils::SleepMs(100);
+    auto ret = WritePort(std::format("rid {} {}", m_binning, m_transferBitDepth).c_str(), "");
+    if (ret != DEVICE_OK)
+    {
+        LogMessageCode(ret, true);
+        return ret;
+    }
+    return DEVICE_OK;
+}
 
-        uint8_t ans = 0;
+/**
+* Polls the port until bytes have arrived or timeoutMs has passed.
+* Reports when the first byte was seen through firstByte, if given.
+*/
+int AbiCamera::ReadResponse(uint8_t* dst, unsigned long bytes, double timeoutMs,
+    std::chrono::steady_clock::time_point* firstByte)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(timeoutMs);
+    unsigned long totalRead = 0;
+    while (true)
+    {
         unsigned long read = 0;
-        ret = ReadFromComPort(m_port.c_str(), &ans, 1, read);
+        auto ret = ReadPort(dst + totalRead, bytes - totalRead, read);
         if (ret != DEVICE_OK)
         {
             LogMessageCode(ret, true);
             return ret;
         }
-        if (read != 1)
-        {
-            LogMessage("Couldn't read cold response");
-            return ERR_COM_RESPONSE;
-        }
-        LogMessage(std::format("Got cold response : {}", ans), true);
-        m_cold = cold;
+        if (read > 0 && totalRead == 0 && firstByte)
+            *firstByte = std::chrono::steady_clock::now();
+        totalRead += read;
+
+        if (totalRead == bytes)
+            return DEVICE_OK;
+        if (std::chrono::steady_clock::now() >= deadline)
+            break;
+        if (read == 0)
+            IdlePoll();
+    }
+
+    LogMessage(std::format("Response timed out after {} ms, read {} of {} bytes", timeoutMs, totalRead, bytes), true);
+    return ERR_COM_RESPONSE;
+}
+
+/**
+* Time allowed for a transfer of the given size: twice the measured
+* transfer time plus some slack, or the old fixed budget before the link
+* has been measured.
+*/
+double AbiCamera::GetReadTimeoutMs(unsigned long bytes) const
+{
+    if (!m_link.calibrated || m_link.throughputBytesPerSec <= 0.0)
+        return 7500.0;
+    return 2000.0 * bytes / m_link.throughputBytesPerSec + 500.0 + m_link.latencyMs;
+}
+
+/**
+* Tells MMCore the predicted readout time and frame rate changed.
+*/
+void AbiCamera::UpdatePredictions()
+{
+    const unsigned long bytes = GetTransferBytes();
+    OnPropertyChanged("Predicted Readout ms",
+        CDeviceUtils::ConvertToString(m_frameTimeModel.PredictReadoutMs(bytes)));
+    OnPropertyChanged("Predicted Max Frame Rate",
+        CDeviceUtils::ConvertToString(m_frameTimeModel.PredictFrameRate(m_exposureMs, bytes, m_subtractBackground != 0)));
+}
+
+/**
+* Measures the serial link and tunes the transfer to it.
+* Round-trip latency is timed with "chp", then a few zero-length shots
+* give the fixed exposure overhead (time from the sht command to its
+* confirmation) and the sustained throughput of a full frame readout.
+* From these: the chunk size covers ~20 ms of data, the idle poll is short
+* enough to not stall a chunk and response timeouts are a few round trips.
+*/
+int AbiCamera::CharacterizeLink()
+{
+    MMThreadGuard portGuard(m_portLock);
+
+    using Clock = std::chrono::steady_clock;
+    using Ms = std::chrono::duration<double, std::milli>;
+
+    // Measure with fine polling; the old poll interval would dominate
+    LinkTuning link;
+    link.idlePollMs = 1;
+    link.responseTimeoutMs = 1000.0;
+    link.exposureOverheadMs = 2000.0;
+    const LinkTuning previous = m_link;
+    m_link = link;
+
+    std::vector<double> latencies, overheads, throughputs;
+    int ret = DEVICE_OK;
+    for (unsigned i = 0; i < LINK_CALIBRATION_ROUNDS && ret == DEVICE_OK; ++i)
+    {
+        PurgeComPort(m_port.c_str());
+        std::array<uint8_t, 4> temp{};
+        Clock::time_point start = Clock::now();
+        ret = WritePort("chp", "\n");
+        if (ret == DEVICE_OK)
+            ret = ReadResponse(temp.data(), 4, link.responseTimeoutMs);
+        if (ret != DEVICE_OK)
+            break;
+        latencies.push_back(Ms(Clock::now() - start).count());
+
+        start = Clock::now();
+        ret = WritePort("sht 0", "");
+        std::array<uint8_t, 2> ack{};
+        if (ret == DEVICE_OK)
+            ret = ReadResponse(ack.data(), 2, link.exposureOverheadMs);
+        if (ret != DEVICE_OK)
+            break;
+        overheads.push_back(Ms(Clock::now() - start).count());
+
+        const unsigned long frameBytes = GetTransferBytes(m_bitDepth);
+        ret = WritePort(std::format("rid {} {}", m_binning, m_bitDepth).c_str(), "");
+        Clock::time_point firstByte = Clock::now();
+        if (ret == DEVICE_OK)
+            ret = ReadResponse(m_backBuf.Data(), frameBytes, 10000.0, &firstByte);
+        if (ret != DEVICE_OK)
+            break;
+        const double transferMs = Ms(Clock::now() - firstByte).count();
+        if (transferMs > 0.0)
+            throughputs.push_back(1000.0 * frameBytes / transferMs);
+    }
+
+    if (ret != DEVICE_OK || latencies.empty() || overheads.empty() || throughputs.empty())
+    {
+        m_link = previous;
+        return ret != DEVICE_OK ? ret : ERR_COM_RESPONSE;
     }
+
+    std::sort(latencies.begin(), latencies.end());
+    link.latencyMs = latencies[latencies.size() / 2];
+    link.exposureOverheadMs = *std::max_element(overheads.begin(), overheads.end());
+    link.throughputBytesPerSec = *std::max_element(throughputs.begin(), throughputs.end());
+
+    const double chunk = link.throughputBytesPerSec * 0.020;
+    link.chunkBytes = std::clamp<unsigned long>(static_cast<unsigned long>(chunk) / 4096 * 4096, 4096, 262144);
+    link.idlePollMs = std::clamp<long>(static_cast<long>(250.0 * link.chunkBytes / link.throughputBytesPerSec), 1, 100);
+    link.responseTimeoutMs = std::max(20.0, 4.0 * link.latencyMs + 10.0);
+    link.calibrated = true;
+    m_link = link;
+    m_frameTimeModel.Calibrate(link.latencyMs, link.exposureOverheadMs, link.throughputBytesPerSec);
+    UpdatePredictions();
+
+    LogMessage(std::format("Link calibrated: latency {:.1f} ms, throughput {:.0f} B/s, exposure overhead {:.0f} ms, "
+        "chunk {} bytes, idle poll {} ms", link.latencyMs, link.throughputBytesPerSec, link.exposureOverheadMs,
+        link.chunkBytes, link.idlePollMs), true);
     return DEVICE_OK;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-// Private AbiCamera methods
-///////////////////////////////////////////////////////////////////////////////
+int AbiCamera::Help(std::string& answer)
+{
+    PurgeComPort(m_port.c_str());
+    auto ret = WritePort("hlp", "");
+    if (ret != DEVICE_OK)
+        return ret;
+
+    answer.clear();
+    ret = GetSerialAnswer(m_port.c_str(), "\r\n\r\n\r\n", answer);
+    if (ret != DEVICE_OK)
+    {
+        LogMessage(std::format("Failed to read confirmation from port : read {} bytes", answer.length()), true);
+        return ret;
+    }
+    LogMessage(answer.c_str(), false);
+
+    return DEVICE_OK;
+}
 
 /**
-* Sync internal image buffer size to the chosen property values.
+* All commands to the camera go through here, so fault injection sees them.
 */
-int AbiCamera::ResizeImageBuffer()
+int AbiCamera::WritePort(const char* command, const char* terminator)
+{
+    if (!m_faults.BeforeWrite())
+        return DEVICE_OK;
+    return SendSerialCommand(m_port.c_str(), command, terminator);
+}
+
+/**
+* All binary reads from the camera go through here, so fault injection
+* sees them.
+*/
+int AbiCamera::ReadPort(uint8_t* dst, unsigned long bytes, unsigned long& read)
+{
+    auto ret = ReadFromComPort(m_port.c_str(), dst, bytes, read);
+    if (ret == DEVICE_OK)
+        m_faults.AfterRead(dst, read);
+    return ret;
+}
+
+int AbiCamera::QueryFirmware(std::string& firmware)
 {
-    m_imgBuf.Resize(IMAGE_WIDTH / m_binning, IMAGE_HEIGHT / m_binning, m_bytesPerPixel);
-    m_bkgBuf.Resize(IMAGE_WIDTH / m_binning, IMAGE_HEIGHT / m_binning, m_bytesPerPixel);
+    PurgeComPort(m_port.c_str());
+    auto ret = WritePort("ver", "");
+    if (ret != DEVICE_OK)
+        return ret;
 
+    std::string answer;
+    ret = GetSerialAnswer(m_port.c_str(), "\r\n", answer);
+    if (ret != DEVICE_OK)
+        return ret;
+    firmware = DeviceCapabilities::ParseVersion(answer);
     return DEVICE_OK;
 }
 
 /**
- * Generate an image with fixed value for all pixels
- */
-void AbiCamera::GenerateImage()
+* Tells errors that may mean the port went away from ordinary ones.
+* A re-enumerating USB adapter shows up as failed writes, failed reads or
+* as the camera going silent in the middle of an exchange.
+*/
+bool AbiCamera::IsLinkError(int ret) const
 {
-    MMThreadGuard g(m_imgPixelsLock);
+    switch (ret)
+    {
+    case DEVICE_ERR:
+    case DEVICE_NOT_CONNECTED:
+    case DEVICE_SERIAL_COMMAND_FAILED:
+    case DEVICE_SERIAL_INVALID_RESPONSE:
+    case DEVICE_SERIAL_TIMEOUT:
+    case ERR_COM_RESPONSE:
+    case ERR_IMAGE_READ:
+        return true;
+    default:
+        return false;
+    }
+}
 
-    const int maxValue = (1 << MAX_BIT_DEPTH) - 1; // max for the 12 bit camera
-    const double maxExp = 1000;
-    double step = maxValue / maxExp;
-    unsigned char* pBuf = const_cast<unsigned char*>(m_imgBuf.GetPixels());
-    memset(pBuf, 128, m_imgBuf.Height() * m_imgBuf.Width() * m_imgBuf.Depth());
+/**
+* Asks whether the camera is there: "ver" first, for the firmware to check
+* against, then "chp" for cameras without a version query. Any valid reply
+* counts; firmware stays empty if only "chp" was answered.
+*/
+int AbiCamera::ProbeCamera(std::string& firmware)
+{
+    firmware.clear();
+    if (QueryFirmware(firmware) == DEVICE_OK && !firmware.empty())
+        return DEVICE_OK;
+
+    PurgeComPort(m_port.c_str());
+    auto ret = WritePort("chp", "\n");
+    if (ret != DEVICE_OK)
+        return ret;
+    std::array<uint8_t, 4> ansBuf{};
+    return ReadResponse(ansBuf.data(), 4, m_link.responseTimeoutMs);
 }
 
-int AbiCamera::ReadImage(ImgBuffer& buf)
+/**
+* Brings the link back after a dropout: probes the camera with
+* exponential backoff until it answers again or the reconnect timeout runs
+* out. The port device belongs to the core and is never closed or opened
+* from here; a port that went away for good keeps failing until the
+* timeout, and the loss is returned as ERR_PORT_LOST, which ends a
+* sequence. A camera with another firmware is refused. The device-side
+* state (cooling, an armed trigger) is then sent again. Bit depth and
+* binning go with every rid, and the camera always sends whole frames that
+* CropToROI cuts the ROI from, so those need no replay.
+*/
+int AbiCamera::Reconnect()
 {
-    MMThreadGuard g(m_imgPixelsLock);
+    using Clock = std::chrono::steady_clock;
+    using Ms = std::chrono::duration<double, std::milli>;
 
-    const auto numBytesToReceive = GetImageBufferSize();
-    std::vector<uint8_t> buffer(2 * numBytesToReceive);
+    MMThreadGuard portGuard(m_portLock);
 
-    const unsigned long chunkSize = 32768;
-    const size_t maxIters = 75;
+    const auto lost = Clock::now();
+    const auto deadline = lost + std::chrono::duration<double>(m_reconnectTimeoutS);
+    LogMessage(std::format("Lost the link on {}, reconnecting", m_port), false);
 
-    unsigned long totalRead = 0;
-    unsigned long read = 0;
-    size_t numIters = 0;
-    do
+    long delayMs = RECONNECT_INITIAL_DELAY_MS;
+    unsigned attempts = 0;
+    std::string firmware;
+    while (true)
     {
-        auto ret = ReadFromComPort(m_port.c_str(), buffer.data() + totalRead, chunkSize, read);
-        if (ret != DEVICE_OK)
-        {
-            LogMessageCode(ret, true);
-            return ret;
-        }
-        LogMessage(std::format("Read {} bytes this time", read), false);
-        totalRead += read;
+        ++attempts;
+        if (ProbeCamera(firmware) == DEVICE_OK)
+            break;
 
-        ++numIters;
-        if (read == 0)
+        if (Clock::now() + std::chrono::milliseconds(delayMs) > deadline)
         {
-            CDeviceUtils::SleepMs(100);
+            LogMessage(std::format("No answer on {} after {} attempts, giving up", m_port, attempts), false);
+            return ERR_PORT_LOST;
         }
+        CDeviceUtils::SleepMs(delayMs);
+        delayMs = std::min(delayMs * 2, RECONNECT_MAX_DELAY_MS);
+    }
 
-    } while (totalRead < numBytesToReceive && numIters < maxIters);
-
-    if (totalRead != numBytesToReceive)
+    if (!m_caps.firmware.empty() && !firmware.empty() && firmware != m_caps.firmware)
     {
-        LogMessage(std::format("Failed to read image data from port : read {} bytes", totalRead), false);
-        return ERR_IMAGE_READ;
+        LogMessage(std::format("Firmware {} answered on {}, expected {}", firmware, m_port, m_caps.firmware), false);
+        return ERR_DEVICE_CHANGED;
     }
 
-    buf.SetPixels(buffer.data());
+    // the camera may have lost power with the adapter, so nothing it was
+    // told before is trusted
+    m_deviceCold.reset();
+    auto ret = SendCold();
+    if (ret != DEVICE_OK)
+        return ret;
+    m_armedFrames = 0;
+
+    m_lastOutageMs = Ms(Clock::now() - lost).count();
+    ++m_reconnects;
+    if (IsCapturing())
+    {
+        // the frames the sequence would have taken meanwhile, at the period
+        // the frame time model expects
+        const double periodMs = std::max(m_thread->GetIntervalMs(),
+            m_frameTimeModel.PredictFrameMs(m_exposureMs, GetTransferBytes(), m_subtractBackground != 0));
+        m_resumeGapMs += m_lastOutageMs;
+        if (periodMs > 0.0)
+            m_counters.reconnectDroppedFrames.fetch_add(
+                static_cast<uint64_t>(m_lastOutageMs / periodMs), std::memory_order_relaxed);
+    }
 
+    LogMessage(std::format("Reconnected to {} after {:.0f} ms and {} attempts", m_port, m_lastOutageMs, attempts), false);
+    OnPropertyChanged("Reconnects", CDeviceUtils::ConvertToString(m_reconnects.load()));
+    OnPropertyChanged("Last Outage ms", CDeviceUtils::ConvertToString(m_lastOutageMs));
     return DEVICE_OK;
 }
 
-int AbiCamera::Help()
+/**
+* Fills m_caps at Initialize.
+* The firmware version is asked for first with a one line "ver" query; if
+* the capability cache has a section for it, the help listing is skipped.
+* Otherwise "hlp" is parsed and the result cached. A camera that doesn't
+* answer "ver" is never found in the cache and reads its help every time;
+* one that answers neither keeps the baseline capabilities.
+*/
+int AbiCamera::DiscoverCapabilities()
 {
-    SendSerialCommand(m_port.c_str(), "hlp", "");
-   
-    std::string answer = {};
-    auto ret = GetSerialAnswer(m_port.c_str(), "\r\n\r\n\r\n", answer);
-    if (ret != DEVICE_OK)
+    std::string firmware;
+    QueryFirmware(firmware);
+
+    if (DeviceCapabilities::LoadCached(m_capsCachePath, firmware, m_caps))
     {
-        LogMessage(std::format("Failed to read confirmation from port : read {} bytes", answer.length()), true);
+        LogMessage(std::format("Using cached capabilities for firmware {}", firmware), true);
+        return DEVICE_OK;
+    }
+
+    std::string help;
+    if (Help(help) != DEVICE_OK)
+    {
+        LogMessage("Device didn't answer hlp, assuming baseline capabilities", false);
+        m_caps = DeviceCapabilities();
+        return DEVICE_OK;
     }
-    LogMessage(answer.c_str(), false);
 
+    m_caps = DeviceCapabilities::FromHelp(help);
+    if (!firmware.empty())
+        m_caps.firmware = firmware;
+    if (!DeviceCapabilities::SaveCached(m_capsCachePath, m_caps))
+        LogMessage("Capabilities not cached, the firmware version is unknown or the cache file isn't writable", true);
+
+    LogMessage(std::format("Device capabilities: firmware {}, {} commands, binning {}-{}, bit depth {}-{}",
+        m_caps.firmware, m_caps.commands.size(), m_caps.binnings.front(), m_caps.binnings.back(),
+        m_caps.bitDepths.front(), m_caps.bitDepths.back()), true);
     return DEVICE_OK;
 }
 
-int AbiCamera::ShotAndResponse(double exposure)
+int AbiCamera::ShotAndResponse(double exposure, FrameTiming* timing)
 {
-    std::string command = std::format("sht {}", static_cast<int>(exposure));
-    auto ret = SendSerialCommand(m_port.c_str(), command.c_str(), "");
+    // formatted in place, std::format would allocate per frame
+    char command[32];
+    *std::format_to_n(command, sizeof(command) - 1, "sht {}", static_cast<int>(exposure)).out = '\0';
+    const auto sent = std::chrono::steady_clock::now();
+    auto ret = WritePort(command, "");
     if (ret != DEVICE_OK)
     {
         LogMessageCode(ret, true);
         return ret;
     }
 
-    // Wait for exposure time plus hardware delays
-    CDeviceUtils::SleepMs(exposure + 700);
+    // Sleep through the exposure, then poll for the confirmation, which
+    // arrives after the hardware overhead
+    CDeviceUtils::SleepMs(static_cast<long>(exposure));
 
     std::array<uint8_t, 2> buf{};
-    unsigned long read = 0;
-    unsigned long totalRead = 0;
-    size_t numIters = 0;
-    do
+    ret = ReadResponse(buf.data(), 2, m_link.exposureOverheadMs + m_link.responseTimeoutMs);
+    if (ret != DEVICE_OK)
     {
-        ret = ReadFromComPort(m_port.c_str(), buf.data() + totalRead, 2, read);
-        if (ret != DEVICE_OK)
-        {
-            LogMessageCode(ret, true);
-            return ret;
-        }
-        totalRead += read;
-
-    } while (totalRead < 2 && numIters++ < 10);
+        LogMessage("Couldn't read shot confirmation", true);
+        return ret;
+    }
 
-    if (totalRead != 2)
+    if (timing)
     {
-        LogMessage(std::format("Couldn't read shot confirmation, read {} bytes", read), true);
-        return ERR_COM_RESPONSE;
+        timing->shotSent = sent;
+        timing->shotAcked = std::chrono::steady_clock::now();
+        timing->exposureMs = exposure;
+        timing->latencyMs = m_link.latencyMs;
     }
 
-    command = std::format("rid {} {}", m_binning, m_bitDepth);
-    ret = SendSerialCommand(m_port.c_str(), command.c_str(), "");
+    *std::format_to_n(command, sizeof(command) - 1, "rid {} {}", m_binning, m_transferBitDepth).out = '\0';
+    ret = WritePort(command, "");
     if (ret != DEVICE_OK)
     {
         LogMessageCode(ret, true);
@@ -1,19 +1,47 @@
 #pragma once
 
 #include "DeviceBase.h"
-#include "ImgBuffer.h"
 #include "DeviceThreads.h"
-#include "ImgBuffer.h"
+#include "CameraSyncGroup.h"
+#include "DeviceCapabilities.h"
+#include "FaultInjector.h"
+#include "FrameBufferPool.h"
+#include "FrameProcessing.h"
+#include "FrameStreamServer.h"
+#include "FrameTimeModel.h"
+#include "HostBinning.h"
+#include "LatencyHistogram.h"
+#include "MetricsExporter.h"
+#include "SharedFrameRing.h"
+#include "SoakMonitor.h"
+#include "TemperatureTracker.h"
+#include "ThreadScheduling.h"
+#include "TiffStackWriter.h"
+#include "WorkerPool.h"
 
+#include <atomic>
+#include <array>
 #include <chrono>
+#include <memory>
+#include <optional>
 
 #define ERR_UNKNOWN_MODE         102
 #define ERR_LIBRARY_INIT 103
 #define ERR_IMAGE_READ 104
 #define ERR_COM_RESPONSE 120
 #define ERR_COMPORTPROPERTY_CREATION 119
+#define ERR_FILE_OPEN 121
+#define ERR_SHARED_MEMORY 122
+#define ERR_STREAM_SERVER 123
+#define ERR_TRIGGER_TIMEOUT 124
+#define ERR_PORT_LOST 125
+#define ERR_DEVICE_CHANGED 126
+#define ERR_METRICS_EXPORT 127
+#define ERR_POLICY_CONFLICT 128
 
 class SequenceThread;
+class PreviewThread;
+class TemperatureThread;
 
 class AbiCamera : public CCameraBase<AbiCamera>
 {
@@ -59,15 +87,109 @@ public:
     int OnPort(MM::PropertyBase* Prop, MM::ActionType Act);
     int OnBackground(MM::PropertyBase* Prop, MM::ActionType Act);
     int OnCCDTemp(MM::PropertyBase* pProp, MM::ActionType eAct);
-    int OnCold(MM::PropertyBase* Prop, MM::ActionType Act);
+    int OnTempStable(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnTempRate(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnTempHistory(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnTempTolerance(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnTempWindow(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnTempSampleInterval(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnCold(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnCapabilityCache(MM::PropertyBase* Prop, MM::ActionType Act);
+    int OnCalibrateLink(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnLinkLatency(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnLinkThroughput(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnExposureOverhead(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnTransferChunk(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnIdlePoll(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnPredictedReadout(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnPredictedFrameRate(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnSyncGroup(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnTriggerMode(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnBinningMode(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnHostBinningMode(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnDeviceBinningFactor(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnHostBinningFactor(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnAdaptiveBitDepth(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnTransferBitDepth(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnTriggerTimeout(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnTriggerBackgroundRefresh(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnSyncSkew(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnSyncTimeouts(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnAutoReconnect(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnReconnectTimeout(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnReconnects(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnLastOutage(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnReaderScheduling(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnReaderPriority(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnReaderCpus(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnProcessingScheduling(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnProcessingPriority(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnProcessingCpus(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnThreadPolicyStatus(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnWakeupLateMean(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnWakeupJitter(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnWakeupLateMax(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnLatencyP99(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnLatencyP999(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnLatencyMax(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnProcessRss(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnRssTrend(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnProcessThreads(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnSoakSummary(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnFaultInjection(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnFaultDropProbability(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnFaultDelayProbability(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnFaultCorruptProbability(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnFaultTruncateProbability(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnFaultDelay(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnFaultRecovery(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnMetricsExport(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnMetricsTarget(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnMetricsInterval(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnMetricsExports(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnSaveFrames(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnSavePath(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnSaveFormat(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnWriterBacklog(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnWriterDropped(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnCompression(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnCompressionRatio(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnSharedRing(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnSharedRingName(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnSharedRingSlots(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnStreamServer(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnStreamEndpoint(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnStreamDownsample(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnStreamCompression(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnStreamClients(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnStreamDropped(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnHugePages(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnFramePoolReconfigurations(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnFrameMean(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnFrameMin(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnFrameMax(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnProgressive(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnProgressiveRefresh(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 private:
     friend class SequenceThread;
+    friend class PreviewThread;
+    friend class TemperatureThread;
     static const int IMAGE_WIDTH = 512;
     static const int IMAGE_HEIGHT = 512;
     static const int MAX_BIT_DEPTH = 12;
     static const int TEMP_READ_DELAY_MS = 200;
+    static const size_t TEMP_HISTORY_PROPERTY_SAMPLES = 50;
     static const int ADC_V = 330;
+    static const int SYNC_TIMEOUT_MS = 5000;
+    static const int MAX_HOST_BINNING = 8;
+    static const size_t ADAPTIVE_DEPTH_FRAMES = 4;
+    static constexpr long MAX_BURST_FRAMES = 1000;
+    static constexpr unsigned FRAME_POOL_SLABS = 4;
+    static const unsigned LINK_CALIBRATION_ROUNDS = 3;
+    static constexpr long RECONNECT_INITIAL_DELAY_MS = 50;
+    static constexpr long RECONNECT_MAX_DELAY_MS = 2000;
+    static const int SOAK_REPORT_S = 600;
 
     std::string m_port;
     MMThreadLock m_portLock;
@@ -75,25 +197,237 @@ private:
 
     SequenceThread* m_thread;
     MMThreadLock m_imgPixelsLock;
+    // the Binning property is m_binning (on the device) times m_hostBinning
     int m_binning;
+    int m_hostBinning;
+    std::string m_binningMode;
+    HostBinning::Mode m_hostBinningMode;
+    std::vector<uint32_t> m_binScratch;
+    std::vector<uint8_t> m_unpackRow;
     int m_bytesPerPixel;
     int m_bitDepth;
+    // depth actually sent with rid, below m_bitDepth in adaptive mode
+    int m_transferBitDepth;
+    int m_adaptiveBitDepth;
+    std::array<double, ADAPTIVE_DEPTH_FRAMES> m_recentNoise;
+    size_t m_recentNoiseCount;
+    TemporalNoise m_temporalNoise;
     int m_subtractBackground;
     int m_cold;
+
+    // Cooler setting as last acknowledged by the camera, the only state it
+    // keeps between commands: exposure, binning and bit depth travel with
+    // every sht/rid. Empty until first sent and cleared whenever the port
+    // changes, so an unknown value is always sent.
+    std::optional<long> m_deviceCold;
+    DeviceCapabilities m_caps;
+
+    // Serial link timing, measured by CharacterizeLink. The defaults are the
+    // values the adapter used before it could measure them.
+    struct LinkTuning
+    {
+        unsigned long chunkBytes = 32768;
+        long idlePollMs = 100;
+        double responseTimeoutMs = 200.0;
+        double exposureOverheadMs = 700.0;
+        double latencyMs = 0.0;
+        double throughputBytesPerSec = 0.0;
+        bool calibrated = false;
+    };
+    LinkTuning m_link;
+    FrameTimeModel m_frameTimeModel;
+    std::string m_capsCachePath;
+    unsigned long m_skippedCommands;
     double m_ccdT;
     std::chrono::high_resolution_clock::time_point m_lastTempRead;
+    TemperatureTracker m_tempTracker;
+    TemperatureThread* m_tempThread;
+    double m_tempSampleMs;
+    bool m_tempStable;
 
     double m_exposureMs;
-    ImgBuffer m_imgBuf;
-    ImgBuffer m_bkgBuf;
+    FrameBufferPool m_framePool;
+    FrameBufferPool::Buffer m_imgBuf;
+    FrameBufferPool::Buffer m_backBuf;
+    FrameBufferPool::Buffer m_bkgBuf;
+    unsigned m_imgWidth, m_imgHeight;
+    unsigned m_readWidth, m_readHeight;
+    int m_hugePages;
+    RowProcessor m_rowProcessor;
+    FrameStats m_frameStats;
+
+    // Host-side timing of a frame on the steady clock, kept with the buffer
+    // it belongs to and swapped together with it
+    struct FrameTiming
+    {
+        std::chrono::steady_clock::time_point shotSent;
+        std::chrono::steady_clock::time_point shotAcked;
+        std::chrono::steady_clock::time_point readoutComplete;
+        double exposureMs = 0.0;
+        double latencyMs = 0.0;
+        double mmTimeOffsetMs = 0.0;
+        int transferBitDepth = 0;
+        // time lost to a reconnect right before this frame
+        double resumeGapMs = 0.0;
+
+        std::chrono::steady_clock::time_point ExposureStart() const;
+        std::chrono::steady_clock::time_point ExposureEnd() const;
+        double ToMMTimeMs(std::chrono::steady_clock::time_point t) const;
+    };
+    FrameTiming m_imgTiming;
+    FrameTiming m_backTiming;
+
+    PreviewThread* m_previewThread;
+    int m_progressive;
+    double m_progressiveRefreshMs;
+    std::atomic<bool> m_frameInProgress;
+    unsigned m_previewRows;
+
+    // Settings changed during a sequence, applied by the sequence thread
+    // between two frames
+    struct PendingSettings
+    {
+        std::optional<double> exposureMs;
+        std::optional<int> binning;
+        std::optional<int> bitDepth;
+        std::optional<int> bytesPerPixel;
+        std::optional<std::array<unsigned, 4>> roi;
+        std::optional<long> cold;
+
+        bool Empty() const { return !exposureMs && !binning && !bitDepth && !bytesPerPixel && !roi && !cold; }
+    };
+    MMThreadLock m_pendingLock;
+    PendingSettings m_pending;
     int m_roiStartX, m_roiStartY;
 
+    TiffStackWriter m_writer;
+    int m_saveFrames;
+    std::string m_savePath;
+    std::string m_saveFormat;
+    std::string m_compression;
+    std::shared_ptr<WorkerPool> m_compressionPool;
+
+    std::string m_triggerMode;
+    double m_triggerTimeoutMs;
+    long m_armedFrames;
+    // an armed sequence keeps the background of its arming, re-armed when
+    // it is older than this (0 keeps it for the whole arming)
+    double m_triggerBackgroundRefreshS;
+    std::chrono::steady_clock::time_point m_backgroundTaken;
+
+    // Reopening the port after the adapter dropped out
+    int m_autoReconnect;
+    double m_reconnectTimeoutS;
+    std::atomic<long> m_reconnects;
+    double m_lastOutageMs;
+    double m_resumeGapMs;
+
+    // Scheduling of the sequence (reader) thread, applied when a sequence
+    // starts, and of the compression workers. The idle polls of the reads
+    // and the interval sleep are timed to show the effect.
+    ThreadPolicy m_readerPolicy;
+    ThreadPolicy m_processingPolicy;
+    bool m_processingPolicyRefused;
+    std::string m_readerPolicyError;
+    JitterStats m_wakeupJitter;
+
+    // Frame latency tails and process growth over a sequence. Latencies are
+    // recorded by the sequence thread, the process is sampled and the
+    // summary logged every SOAK_REPORT_S by the temperature thread.
+    SoakMonitor m_soak;
+
+    // Test mode: faults injected into all traffic through WritePort and
+    // ReadPort, with the time until the next good frame recorded
+    FaultInjector m_faults;
+
+    // Health counters for the metrics exporter. The frame path only does
+    // relaxed atomic updates; the exporter thread reads them.
+    struct AcquisitionCounters
+    {
+        std::atomic<uint64_t> frames{ 0 };
+        std::atomic<uint64_t> bytes{ 0 };
+        std::atomic<uint64_t> frameErrors{ 0 };
+        std::atomic<uint64_t> reconnectDroppedFrames{ 0 };
+        std::atomic<double> temperatureC{ 0.0 };
+    };
+    AcquisitionCounters m_counters;
+    LatencyHistogram m_shotLatency;
+    LatencyHistogram m_transferLatency;
+    LatencyHistogram m_processingLatency;
+
+    MetricsExporter m_metricsExporter;
+    int m_metricsEnabled;
+    std::string m_metricsTarget;
+    double m_metricsIntervalS;
+    // exporter thread state, for the rates between two snapshots
+    std::string m_metricsLabel;
+    uint64_t m_metricsLastFrames;
+    uint64_t m_metricsLastBytes;
+    std::chrono::steady_clock::time_point m_metricsLastTime;
+
+    std::shared_ptr<CameraSyncGroup> m_syncGroup;
+    std::string m_syncGroupName;
+
+    SharedFrameRing m_sharedRing;
+    int m_sharedRingEnabled;
+    std::string m_sharedRingName;
+    long m_sharedRingSlots;
+
+    FrameStreamServer m_streamServer;
+    int m_streamEnabled;
+    std::string m_streamEndpoint;
+    long m_streamDownsample;
+    std::string m_streamCompression;
+
     int ResizeImageBuffer();
+    int SplitBinning(int binning, int& device, int& host) const;
+    int UpdateBinningValues();
+    unsigned long GetTransferBytes() const;
+    unsigned long GetTransferBytes(int bitDepth) const;
+    size_t GetTransferRowBytes(int bitDepth) const;
+    unsigned GetPackedBits(int bitDepth) const;
+    int ChooseTransferBitDepth() const;
+    int ConfigureFramePool(size_t slabBytes);
+    void ApplyReaderPolicy();
+    int ApplyProcessingPolicy(const ThreadPolicy& policy);
+    void SleepUntil(std::chrono::steady_clock::time_point until);
+    void IdlePoll();
     void GenerateImage();
-    int ShotAndResponse(double exposure);
-    int ReadImage(ImgBuffer& buf);
-    int Help();
+    int ExposeAndRead();
+    int ShotAndResponse(double exposure, FrameTiming* timing = nullptr);
+    int ReadTemperature();
+    void SampleTemperature();
+    int ArmTrigger(long frames);
+    int DisarmTrigger();
+    int WaitForTriggeredFrame(FrameTiming* timing);
+    int ReadImage(uint8_t* dst, RowProcessor* rows = nullptr);
+    void SwapImageBuffers();
+    int Help(std::string& answer);
+    int DiscoverCapabilities();
+    int CharacterizeLink();
+    int QueryFirmware(std::string& firmware);
+    int WritePort(const char* command, const char* terminator);
+    int ReadPort(uint8_t* dst, unsigned long bytes, unsigned long& read);
+    int OnFaultProbability(FaultInjector::Fault fault, MM::PropertyBase* pProp, MM::ActionType eAct);
+    bool IsLinkError(int ret) const;
+    int ProbeCamera(std::string& firmware);
+    int Reconnect();
+    int ReadResponse(uint8_t* dst, unsigned long bytes, double timeoutMs,
+        std::chrono::steady_clock::time_point* firstByte = nullptr);
+    double GetReadTimeoutMs(unsigned long bytes) const;
+    void UpdatePredictions();
+    int SendCold();
     int InsertImage();
+    int ApplyPendingSettings();
+    int ApplyROI(unsigned x, unsigned y, unsigned xSize, unsigned ySize);
+    void CropToROI(uint8_t* frame) const;
+    void OnThreadExiting(int statusCode) throw();
+    void RecordDelivery();
+    void SampleHealth();
+    int StartMetricsExport();
+    std::string CollectMetrics();
+    void PublishPartialFrame();
+    void DistributeFrame();
 };
 
 class SequenceThread : public MMDeviceThreadBase
@@ -102,9 +436,10 @@ public:
     SequenceThread(AbiCamera* pCam);
     ~SequenceThread();
     void Stop();
-    void Start(long numImages, double intervalMs);
+    void Start(long numImages, double intervalMs, bool stopOnOverflow);
     bool IsStopped();
     double GetIntervalMs() { return m_intervalMs; }
+    bool GetStopOnOverflow() const { return m_stopOnOverflow; }
     void SetLength(long images) { m_numImages = images; }
     long GetLength() const { return m_numImages; }
     long GetImageCounter() { return m_imageCounter; }
@@ -112,8 +447,47 @@ public:
 private:
     int svc(void) throw();
     AbiCamera* m_camera;
-    bool m_stop;
+    std::atomic<bool> m_stop;
+    bool m_stopOnOverflow;
     long m_numImages;
     long m_imageCounter;
     double m_intervalMs;
-};
\ No newline at end of file
+};
+
+class PreviewThread : public MMDeviceThreadBase
+{
+public:
+    PreviewThread(AbiCamera* pCam);
+    ~PreviewThread();
+    void Stop();
+    void Start(double refreshMs);
+    bool IsStopped();
+    void SetRefreshMs(double refreshMs) { m_refreshMs = refreshMs; }
+
+private:
+    static const int STOP_POLL_MS = 10;
+
+    int svc(void) throw();
+    AbiCamera* m_camera;
+    std::atomic<bool> m_stop;
+    std::atomic<double> m_refreshMs;
+};
+
+class TemperatureThread : public MMDeviceThreadBase
+{
+public:
+    TemperatureThread(AbiCamera* pCam);
+    ~TemperatureThread();
+    void Stop();
+    void Start(double intervalMs);
+    bool IsStopped();
+    void SetIntervalMs(double intervalMs) { m_intervalMs = intervalMs; }
+
+private:
+    static const int STOP_POLL_MS = 10;
+
+    int svc(void) throw();
+    AbiCamera* m_camera;
+    std::atomic<bool> m_stop;
+    std::atomic<double> m_intervalMs;
+};
@@ -0,0 +1,156 @@
+#include "CameraSyncGroup.h"
+
+#include <algorithm>
+
+std::mutex CameraSyncGroup::s_registryLock;
+std::map<std::string, std::weak_ptr<CameraSyncGroup>> CameraSyncGroup::s_registry;
+
+/**
+* Returns the group with the given name, creating it for the first member.
+* The group lives as long as one of its members holds it.
+*/
+std::shared_ptr<CameraSyncGroup> CameraSyncGroup::Join(const std::string& name)
+{
+    std::lock_guard<std::mutex> g(s_registryLock);
+    auto group = s_registry[name].lock();
+    if (!group)
+    {
+        group = std::shared_ptr<CameraSyncGroup>(new CameraSyncGroup(name));
+        s_registry[name] = group;
+    }
+
+    std::lock_guard<std::mutex> lg(group->m_lock);
+    ++group->m_members;
+    return group;
+}
+
+/**
+* The member leaves the group; the others stop waiting for it.
+*/
+void CameraSyncGroup::Quit()
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (m_members > 0)
+        --m_members;
+    if (m_arrived > 0 && Ready())
+        Release();
+}
+
+CameraSyncGroup::CameraSyncGroup(const std::string& name) :
+    m_name(name),
+    m_members(0),
+    m_active(0),
+    m_arrived(0),
+    m_allStarted(false),
+    m_generation(0),
+    m_timeouts(0),
+    m_skewGeneration(0),
+    m_lastSkewMs(0.0)
+{
+}
+
+CameraSyncGroup::~CameraSyncGroup()
+{
+    std::lock_guard<std::mutex> g(s_registryLock);
+    auto it = s_registry.find(m_name);
+    if (it != s_registry.end() && it->second.expired())
+        s_registry.erase(it);
+}
+
+unsigned CameraSyncGroup::GetMemberCount() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_members;
+}
+
+/**
+* A member started its sequence.
+*/
+void CameraSyncGroup::BeginSequence()
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    ++m_active;
+    if (m_active >= m_members)
+        m_allStarted = true;
+    m_cv.notify_all();
+}
+
+/**
+* A member stopped its sequence; the others stop waiting for it.
+*/
+void CameraSyncGroup::EndSequence()
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (m_active > 0)
+        --m_active;
+    if (m_active == 0)
+        m_allStarted = false;
+    if (m_arrived > 0 && Ready())
+        Release();
+}
+
+/**
+* Blocks until every running member has arrived. Returns false if it gave
+* up after timeoutMs, in which case the waiting members are released
+* anyway. generation identifies the release, for RecordShot.
+*/
+bool CameraSyncGroup::Arrive(double timeoutMs, unsigned long long& generation)
+{
+    std::unique_lock<std::mutex> g(m_lock);
+    const unsigned long long arrival = m_generation;
+    ++m_arrived;
+    if (Ready())
+    {
+        Release();
+        generation = arrival;
+        return true;
+    }
+
+    const bool released = m_cv.wait_for(g, std::chrono::duration<double, std::milli>(timeoutMs),
+        [&] { return m_generation != arrival; });
+    if (!released)
+    {
+        ++m_timeouts;
+        Release();
+    }
+    generation = arrival;
+    return released;
+}
+
+void CameraSyncGroup::RecordShot(unsigned long long generation, std::chrono::steady_clock::time_point sent)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (generation != m_skewGeneration)
+    {
+        m_skewGeneration = generation;
+        m_firstShot = sent;
+        m_lastShot = sent;
+    }
+    m_firstShot = std::min(m_firstShot, sent);
+    m_lastShot = std::max(m_lastShot, sent);
+    m_lastSkewMs = std::chrono::duration<double, std::milli>(m_lastShot - m_firstShot).count();
+}
+
+double CameraSyncGroup::GetLastSkewMs() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_lastSkewMs;
+}
+
+unsigned long CameraSyncGroup::GetTimeouts() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_timeouts;
+}
+
+bool CameraSyncGroup::Ready() const
+{
+    return m_arrived >= m_active && (m_allStarted || m_active >= m_members);
+}
+
+void CameraSyncGroup::Release()
+{
+    m_arrived = 0;
+    ++m_generation;
+    m_cv.notify_all();
+}
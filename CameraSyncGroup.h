@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+* Lines up the exposures of several cameras in the same process.
+* Cameras with the same sync group name share one instance, obtained with
+* Join() and given up with Quit(). Each sequence
+* thread calls Arrive() right before sending its shot; once every running
+* member has arrived all of them are released together, so the skew between
+* shots is the thread wake-up latency rather than the frame time.
+*
+* A sequence that starts before the others waits for every member to begin
+* (synchronized start). A member that stops no longer holds the others
+* back, and a member that doesn't arrive within the timeout is given up on
+* for that frame.
+*/
+class CameraSyncGroup
+{
+public:
+    static std::shared_ptr<CameraSyncGroup> Join(const std::string& name);
+    void Quit();
+    ~CameraSyncGroup();
+
+    const std::string& GetName() const { return m_name; }
+    unsigned GetMemberCount() const;
+
+    void BeginSequence();
+    void EndSequence();
+    bool Arrive(double timeoutMs, unsigned long long& generation);
+    void RecordShot(unsigned long long generation, std::chrono::steady_clock::time_point sent);
+
+    double GetLastSkewMs() const;
+    unsigned long GetTimeouts() const;
+
+private:
+    explicit CameraSyncGroup(const std::string& name);
+
+    bool Ready() const;
+    void Release();
+
+    static std::mutex s_registryLock;
+    static std::map<std::string, std::weak_ptr<CameraSyncGroup>> s_registry;
+
+    std::string m_name;
+    mutable std::mutex m_lock;
+    std::condition_variable m_cv;
+    unsigned m_members;
+    unsigned m_active;
+    unsigned m_arrived;
+    bool m_allStarted;
+    unsigned long long m_generation;
+    unsigned long m_timeouts;
+
+    unsigned long long m_skewGeneration;
+    std::chrono::steady_clock::time_point m_firstShot;
+    std::chrono::steady_clock::time_point m_lastShot;
+    double m_lastSkewMs;
+};
@@ -0,0 +1,483 @@
+#include "DeflateEncoder.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <queue>
+
+namespace
+{
+    const size_t WINDOW = 32768;
+    const unsigned MIN_MATCH = 3;
+    const unsigned MAX_MATCH = 258;
+    const size_t MAX_STORED = 65535;
+
+    const unsigned NUM_LITLEN = 286;
+    const unsigned NUM_DIST = 30;
+    const unsigned NUM_CODELEN = 19;
+    const unsigned END_OF_BLOCK = 256;
+
+    const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const uint8_t DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    const uint8_t CODELEN_ORDER[NUM_CODELEN] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    unsigned LengthCode(unsigned length)
+    {
+        unsigned code = 28;
+        while (LENGTH_BASE[code] > length)
+            --code;
+        return code;
+    }
+
+    unsigned DistCode(unsigned distance)
+    {
+        unsigned code = 29;
+        while (DIST_BASE[code] > distance)
+            --code;
+        return code;
+    }
+
+    uint32_t Hash(const uint8_t* p, unsigned bits)
+    {
+        const uint32_t v = p[0] | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16);
+        return (v * 2654435761u) >> (32 - bits);
+    }
+
+    /**
+    * Huffman code lengths for freq, none longer than maxBits. Frequencies
+    * are halved until the tree fits, which costs little on real data.
+    */
+    void BuildLengths(const uint32_t* freq, unsigned n, unsigned maxBits, uint8_t* lengths)
+    {
+        std::vector<uint32_t> f(freq, freq + n);
+        for (;;)
+        {
+            struct Node
+            {
+                uint64_t weight;
+                int left, right;
+            };
+            std::vector<Node> nodes;
+            using Entry = std::pair<uint64_t, int>;
+            std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+            for (unsigned s = 0; s < n; ++s)
+            {
+                lengths[s] = 0;
+                if (f[s])
+                {
+                    nodes.push_back({ f[s], -1, static_cast<int>(s) });
+                    heap.push({ f[s], static_cast<int>(nodes.size() - 1) });
+                }
+            }
+            if (nodes.size() == 1)
+            {
+                lengths[nodes[0].right] = 1;
+                return;
+            }
+            while (heap.size() > 1)
+            {
+                const Entry a = heap.top();
+                heap.pop();
+                const Entry b = heap.top();
+                heap.pop();
+                nodes.push_back({ a.first + b.first, a.second, b.second });
+                heap.push({ a.first + b.first, static_cast<int>(nodes.size() - 1) });
+            }
+
+            // depth first from the root, leaves carry their symbol in right
+            unsigned longest = 0;
+            std::vector<std::pair<int, unsigned>> stack{ { heap.top().second, 0u } };
+            while (!stack.empty())
+            {
+                const auto [node, depth] = stack.back();
+                stack.pop_back();
+                if (nodes[node].left < 0)
+                {
+                    lengths[nodes[node].right] = static_cast<uint8_t>(depth);
+                    longest = std::max(longest, depth);
+                    continue;
+                }
+                stack.push_back({ nodes[node].left, depth + 1 });
+                stack.push_back({ nodes[node].right, depth + 1 });
+            }
+            if (longest <= maxBits)
+                return;
+
+            for (auto& v : f)
+            {
+                if (v)
+                    v = std::max<uint32_t>(1, v >> 1);
+            }
+        }
+    }
+
+    /**
+    * Canonical codes for the lengths, bit reversed since deflate packs
+    * Huffman codes starting from their most significant bit.
+    */
+    void BuildCodes(const uint8_t* lengths, unsigned n, uint16_t* codes)
+    {
+        std::array<uint16_t, 16> count{};
+        for (unsigned s = 0; s < n; ++s)
+            ++count[lengths[s]];
+        count[0] = 0;
+
+        std::array<uint16_t, 16> next{};
+        uint16_t code = 0;
+        for (unsigned bits = 1; bits < 16; ++bits)
+        {
+            code = static_cast<uint16_t>((code + count[bits - 1]) << 1);
+            next[bits] = code;
+        }
+
+        for (unsigned s = 0; s < n; ++s)
+        {
+            const unsigned len = lengths[s];
+            if (!len)
+                continue;
+            uint16_t c = next[len]++;
+            uint16_t reversed = 0;
+            for (unsigned i = 0; i < len; ++i)
+            {
+                reversed = static_cast<uint16_t>((reversed << 1) | (c & 1));
+                c >>= 1;
+            }
+            codes[s] = reversed;
+        }
+    }
+
+    // a complete code needs two symbols at least
+    void EnsureTwoSymbols(uint32_t* freq, unsigned n)
+    {
+        unsigned used = 0;
+        for (unsigned s = 0; s < n; ++s)
+            used += freq[s] != 0;
+        for (unsigned s = 0; used < 2 && s < n; ++s)
+        {
+            if (!freq[s])
+            {
+                freq[s] = 1;
+                ++used;
+            }
+        }
+    }
+
+    uint32_t Adler32(const uint8_t* src, size_t bytes)
+    {
+        uint32_t a = 1, b = 0;
+        while (bytes)
+        {
+            // largest run before b can overflow
+            const size_t run = std::min<size_t>(bytes, 5552);
+            for (size_t i = 0; i < run; ++i)
+            {
+                a += src[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            src += run;
+            bytes -= run;
+        }
+        return (b << 16) | a;
+    }
+}
+
+/**
+* Writes bits least significant first, as deflate expects.
+*/
+class DeflateEncoder::BitSink
+{
+public:
+    explicit BitSink(uint8_t* out) : m_out(out), m_pos(0), m_acc(0), m_bits(0) {}
+
+    void Put(uint32_t value, unsigned n)
+    {
+        m_acc |= static_cast<uint64_t>(value) << m_bits;
+        m_bits += n;
+        while (m_bits >= 8)
+        {
+            m_out[m_pos++] = static_cast<uint8_t>(m_acc);
+            m_acc >>= 8;
+            m_bits -= 8;
+        }
+    }
+
+    void Align()
+    {
+        if (m_bits)
+            Put(0, 8 - m_bits);
+    }
+
+    void Bytes(const uint8_t* src, size_t n)
+    {
+        std::memcpy(m_out + m_pos, src, n);
+        m_pos += n;
+    }
+
+    size_t Pos() const { return m_pos; }
+
+private:
+    uint8_t* m_out;
+    size_t m_pos;
+    uint64_t m_acc;
+    unsigned m_bits;
+};
+
+/**
+* Worst case: every block stored, with its header, plus the zlib wrapper.
+*/
+size_t DeflateEncoder::MaxEncodedSize(size_t bytes)
+{
+    const size_t blocks = bytes / MAX_STORED + bytes / MAX_BLOCK_SYMBOLS + 2;
+    return 2 + bytes + 6 * blocks + 4;
+}
+
+/**
+* Encodes src into dst, which must hold MaxEncodedSize(bytes). Returns the
+* size of the zlib stream.
+*/
+size_t DeflateEncoder::Encode(const uint8_t* src, size_t bytes, uint8_t* dst)
+{
+    m_head.assign(size_t(1) << HASH_BITS, -1);
+    if (m_prev.size() < bytes)
+        m_prev.resize(bytes);
+    m_symbols.reserve(MAX_BLOCK_SYMBOLS);
+    m_symbols.clear();
+
+    BitSink out(dst);
+    // 32 kB window, default level, no dictionary
+    out.Put(0x78, 8);
+    out.Put(0x9c, 8);
+
+    size_t blockStart = 0;
+    size_t i = 0;
+    while (i < bytes)
+    {
+        unsigned bestLength = 0;
+        size_t bestDistance = 0;
+        if (i + MIN_MATCH <= bytes)
+        {
+            const uint32_t h = Hash(src + i, HASH_BITS);
+            const size_t maxLength = std::min<size_t>(MAX_MATCH, bytes - i);
+            int32_t candidate = m_head[h];
+            for (unsigned chain = MAX_CHAIN; candidate >= 0 && i - candidate <= WINDOW && chain > 0; --chain)
+            {
+                const uint8_t* a = src + candidate;
+                const uint8_t* b = src + i;
+                if (a[bestLength] == b[bestLength])
+                {
+                    unsigned length = 0;
+                    while (length < maxLength && a[length] == b[length])
+                        ++length;
+                    if (length > bestLength)
+                    {
+                        bestLength = length;
+                        bestDistance = i - candidate;
+                        if (length == maxLength)
+                            break;
+                    }
+                }
+                candidate = m_prev[candidate];
+            }
+            m_prev[i] = m_head[h];
+            m_head[h] = static_cast<int32_t>(i);
+        }
+
+        if (bestLength >= MIN_MATCH)
+        {
+            m_symbols.push_back({ static_cast<uint16_t>(bestLength), static_cast<uint16_t>(bestDistance) });
+            for (size_t k = i + 1; k < i + bestLength && k + MIN_MATCH <= bytes; ++k)
+            {
+                const uint32_t h = Hash(src + k, HASH_BITS);
+                m_prev[k] = m_head[h];
+                m_head[h] = static_cast<int32_t>(k);
+            }
+            i += bestLength;
+        }
+        else
+        {
+            m_symbols.push_back({ src[i], 0 });
+            ++i;
+        }
+
+        if (m_symbols.size() == MAX_BLOCK_SYMBOLS && i < bytes)
+        {
+            WriteBlock(out, src, blockStart, i, false);
+            blockStart = i;
+        }
+    }
+    WriteBlock(out, src, blockStart, bytes, true);
+
+    out.Align();
+    const uint32_t adler = Adler32(src, bytes);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.Put((adler >> shift) & 0xff, 8);
+    return out.Pos();
+}
+
+/**
+* Writes the symbols collected for src[start, end) as a dynamic Huffman
+* block, or as stored blocks if those are smaller, and clears them.
+*/
+void DeflateEncoder::WriteBlock(BitSink& out, const uint8_t* src, size_t start, size_t end, bool final)
+{
+    std::array<uint32_t, NUM_LITLEN> litFreq{};
+    std::array<uint32_t, NUM_DIST> distFreq{};
+    uint64_t extraBits = 0;
+    for (const Symbol& s : m_symbols)
+    {
+        if (!s.distance)
+        {
+            ++litFreq[s.value];
+            continue;
+        }
+        const unsigned lc = LengthCode(s.value);
+        const unsigned dc = DistCode(s.distance);
+        ++litFreq[257 + lc];
+        ++distFreq[dc];
+        extraBits += LENGTH_EXTRA[lc] + DIST_EXTRA[dc];
+    }
+    litFreq[END_OF_BLOCK] = 1;
+    EnsureTwoSymbols(litFreq.data(), NUM_LITLEN);
+    EnsureTwoSymbols(distFreq.data(), NUM_DIST);
+
+    std::array<uint8_t, NUM_LITLEN> litLen{};
+    std::array<uint8_t, NUM_DIST> distLen{};
+    BuildLengths(litFreq.data(), NUM_LITLEN, 15, litLen.data());
+    BuildLengths(distFreq.data(), NUM_DIST, 15, distLen.data());
+
+    unsigned hlit = NUM_LITLEN;
+    while (hlit > 257 && !litLen[hlit - 1])
+        --hlit;
+    unsigned hdist = NUM_DIST;
+    while (hdist > 1 && !distLen[hdist - 1])
+        --hdist;
+
+    // run length code the two length tables as one sequence
+    std::vector<uint8_t> lengths(litLen.begin(), litLen.begin() + hlit);
+    lengths.insert(lengths.end(), distLen.begin(), distLen.begin() + hdist);
+    std::vector<std::pair<uint8_t, uint8_t>> runs;
+    for (size_t k = 0; k < lengths.size();)
+    {
+        const uint8_t len = lengths[k];
+        size_t run = 1;
+        while (k + run < lengths.size() && lengths[k + run] == len)
+            ++run;
+        k += run;
+
+        if (len == 0)
+        {
+            while (run >= 11)
+            {
+                const size_t n = std::min<size_t>(run, 138);
+                runs.push_back({ 18, static_cast<uint8_t>(n - 11) });
+                run -= n;
+            }
+            if (run >= 3)
+            {
+                runs.push_back({ 17, static_cast<uint8_t>(run - 3) });
+                run = 0;
+            }
+        }
+        else
+        {
+            runs.push_back({ len, 0 });
+            --run;
+            while (run >= 3)
+            {
+                const size_t n = std::min<size_t>(run, 6);
+                runs.push_back({ 16, static_cast<uint8_t>(n - 3) });
+                run -= n;
+            }
+        }
+        for (; run > 0; --run)
+            runs.push_back({ len, 0 });
+    }
+
+    std::array<uint32_t, NUM_CODELEN> clFreq{};
+    for (const auto& r : runs)
+        ++clFreq[r.first];
+    EnsureTwoSymbols(clFreq.data(), NUM_CODELEN);
+    std::array<uint8_t, NUM_CODELEN> clLen{};
+    BuildLengths(clFreq.data(), NUM_CODELEN, 7, clLen.data());
+    unsigned hclen = NUM_CODELEN;
+    while (hclen > 4 && !clLen[CODELEN_ORDER[hclen - 1]])
+        --hclen;
+
+    uint64_t dynamicBits = 3 + 5 + 5 + 4 + 3 * hclen + extraBits;
+    for (const auto& r : runs)
+        dynamicBits += clLen[r.first] + (r.first == 16 ? 2 : r.first == 17 ? 3 : r.first == 18 ? 7 : 0);
+    for (unsigned s = 0; s < NUM_LITLEN; ++s)
+        dynamicBits += static_cast<uint64_t>(litFreq[s]) * litLen[s];
+    for (unsigned s = 0; s < NUM_DIST; ++s)
+        dynamicBits += static_cast<uint64_t>(distFreq[s]) * distLen[s];
+    const size_t rawBytes = end - start;
+    const uint64_t storedBits = 8 * (rawBytes + 5 * (rawBytes / MAX_STORED + 1)) + 8;
+
+    if (storedBits <= dynamicBits)
+    {
+        size_t pos = start;
+        do
+        {
+            const size_t n = std::min(end - pos, MAX_STORED);
+            out.Put(final && pos + n == end ? 1 : 0, 1);
+            out.Put(0, 2);
+            out.Align();
+            out.Put(static_cast<uint32_t>(n), 16);
+            out.Put(static_cast<uint32_t>(~n & 0xffff), 16);
+            out.Bytes(src + pos, n);
+            pos += n;
+        } while (pos < end);
+        m_symbols.clear();
+        return;
+    }
+
+    std::array<uint16_t, NUM_LITLEN> litCode{};
+    std::array<uint16_t, NUM_DIST> distCode{};
+    std::array<uint16_t, NUM_CODELEN> clCode{};
+    BuildCodes(litLen.data(), NUM_LITLEN, litCode.data());
+    BuildCodes(distLen.data(), NUM_DIST, distCode.data());
+    BuildCodes(clLen.data(), NUM_CODELEN, clCode.data());
+
+    out.Put(final ? 1 : 0, 1);
+    out.Put(2, 2);
+    out.Put(hlit - 257, 5);
+    out.Put(hdist - 1, 5);
+    out.Put(hclen - 4, 4);
+    for (unsigned k = 0; k < hclen; ++k)
+        out.Put(clLen[CODELEN_ORDER[k]], 3);
+    for (const auto& r : runs)
+    {
+        out.Put(clCode[r.first], clLen[r.first]);
+        if (r.first == 16)
+            out.Put(r.second, 2);
+        else if (r.first == 17)
+            out.Put(r.second, 3);
+        else if (r.first == 18)
+            out.Put(r.second, 7);
+    }
+
+    for (const Symbol& s : m_symbols)
+    {
+        if (!s.distance)
+        {
+            out.Put(litCode[s.value], litLen[s.value]);
+            continue;
+        }
+        const unsigned lc = LengthCode(s.value);
+        out.Put(litCode[257 + lc], litLen[257 + lc]);
+        out.Put(s.value - LENGTH_BASE[lc], LENGTH_EXTRA[lc]);
+        const unsigned dc = DistCode(s.distance);
+        out.Put(distCode[dc], distLen[dc]);
+        out.Put(s.distance - DIST_BASE[dc], DIST_EXTRA[dc]);
+    }
+    out.Put(litCode[END_OF_BLOCK], litLen[END_OF_BLOCK]);
+    m_symbols.clear();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* zlib stream encoder (RFC 1950/1951), as used for TIFF Deflate strips.
+* LZ77 with hash chains over the 32 kB window, then a dynamic Huffman
+* block per MAX_BLOCK_SYMBOLS symbols, or a stored block where that comes
+* out smaller. Any inflate implementation decodes the output.
+*
+* An encoder keeps its tables between calls, so one per worker task stops
+* allocating once it has seen the largest input.
+*/
+class DeflateEncoder
+{
+public:
+    static size_t MaxEncodedSize(size_t bytes);
+
+    size_t Encode(const uint8_t* src, size_t bytes, uint8_t* dst);
+
+private:
+    static const unsigned HASH_BITS = 15;
+    static const unsigned MAX_CHAIN = 32;
+    static const size_t MAX_BLOCK_SYMBOLS = 16384;
+
+    struct Symbol
+    {
+        uint16_t value;     // literal byte, or match length
+        uint16_t distance;  // 0 for a literal
+    };
+
+    class BitSink;
+
+    void WriteBlock(BitSink& out, const uint8_t* src, size_t start, size_t end, bool final);
+
+    std::vector<int32_t> m_head;
+    std::vector<int32_t> m_prev;
+    std::vector<Symbol> m_symbols;
+};
@@ -0,0 +1,356 @@
+#include "DeviceCapabilities.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    std::string Trim(const std::string& s)
+    {
+        const auto first = s.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos)
+            return {};
+        const auto last = s.find_last_not_of(" \t\r\n");
+        return s.substr(first, last - first + 1);
+    }
+
+    std::string ToLower(std::string s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return s;
+    }
+
+    bool IsCommandName(const std::string& token)
+    {
+        return token.size() >= 2 && token.size() <= 4 &&
+            std::all_of(token.begin(), token.end(), [](unsigned char c) { return std::islower(c); });
+    }
+
+    bool IsAlpha(const std::string& s, size_t pos)
+    {
+        return pos < s.size() && std::isalpha(static_cast<unsigned char>(s[pos]));
+    }
+
+    bool IsAlnum(const std::string& s, size_t pos)
+    {
+        return pos < s.size() && std::isalnum(static_cast<unsigned char>(s[pos]));
+    }
+
+    bool IsDigit(const std::string& s, size_t pos)
+    {
+        return pos < s.size() && std::isdigit(static_cast<unsigned char>(s[pos]));
+    }
+
+    /**
+    * Reads the integers listed after every word starting with a keyword,
+    * e.g. "binning: 1, 2, 4", "bits 8/10/12" or "bit depth 6, 8", each
+    * list ending at the next word.
+    */
+    std::vector<long> NumbersAfter(const std::string& line, const std::string& keyword)
+    {
+        std::vector<long> numbers;
+        auto pos = line.find(keyword);
+        while (pos != std::string::npos)
+        {
+            if (pos > 0 && IsAlpha(line, pos - 1))
+            {
+                pos = line.find(keyword, pos + 1);
+                continue;
+            }
+            pos += keyword.size();
+            while (IsAlpha(line, pos))
+                ++pos;
+
+            // one word may qualify the keyword, as in "bit depth" or "baud rate"
+            const auto next = line.find_first_not_of(" \t:", pos);
+            if (IsAlpha(line, next))
+            {
+                pos = next;
+                while (IsAlpha(line, pos))
+                    ++pos;
+            }
+
+            while (pos < line.size() && !std::isalpha(static_cast<unsigned char>(line[pos])))
+            {
+                if (std::isdigit(static_cast<unsigned char>(line[pos])))
+                {
+                    size_t used = 0;
+                    numbers.push_back(std::stol(line.substr(pos), &used));
+                    pos += used;
+                }
+                else
+                {
+                    ++pos;
+                }
+            }
+            pos = line.find(keyword, pos);
+        }
+        return numbers;
+    }
+
+    std::string Join(const std::vector<int>& values)
+    {
+        std::string out;
+        for (size_t i = 0; i < values.size(); ++i)
+            out += (i ? "," : "") + std::to_string(values[i]);
+        return out;
+    }
+
+    std::vector<std::string> Split(const std::string& s)
+    {
+        std::vector<std::string> out;
+        std::stringstream ss(s);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            item = Trim(item);
+            if (!item.empty())
+                out.push_back(item);
+        }
+        return out;
+    }
+}
+
+DeviceCapabilities::DeviceCapabilities() :
+    binnings{ 1, 2, 4, 8, 16, 32, 64 },
+    bitDepths{ 6, 8, 10, 12 },
+    roi(false),
+    burst(false),
+    packed(false),
+    compressed(false),
+    maxBaud(0)
+{
+}
+
+bool DeviceCapabilities::HasCommand(const std::string& name) const
+{
+    return std::find(commands.begin(), commands.end(), name) != commands.end();
+}
+
+bool DeviceCapabilities::SupportsBinning(int binning) const
+{
+    return std::find(binnings.begin(), binnings.end(), binning) != binnings.end();
+}
+
+bool DeviceCapabilities::SupportsBitDepth(int bitDepth) const
+{
+    return std::find(bitDepths.begin(), bitDepths.end(), bitDepth) != bitDepths.end();
+}
+
+/**
+* Parses a "hlp" listing. Every line starting with a short lower case word
+* followed by its usage is taken as a command; binnings, bit depths and the
+* baud rate are read from the numbers listed after their keywords.
+* Anything the listing doesn't mention keeps its baseline value.
+*/
+DeviceCapabilities DeviceCapabilities::FromHelp(const std::string& help)
+{
+    DeviceCapabilities caps;
+    std::vector<int> binnings, bitDepths;
+
+    std::stringstream ss(help);
+    std::string raw;
+    while (std::getline(ss, raw))
+    {
+        const std::string line = Trim(raw);
+        if (line.empty())
+            continue;
+
+        // the first line carrying a version is the version line, whatever
+        // its first word looks like
+        if (caps.firmware.empty())
+        {
+            caps.firmware = ParseVersion(line);
+            if (!caps.firmware.empty())
+                continue;
+        }
+
+        // "sht <ms> - ...", "cld 0|1 - ..." or a bare "chp"
+        const auto tokenEnd = std::min(line.find_first_of(" \t:"), line.size());
+        const std::string token = line.substr(0, tokenEnd);
+        const auto argStart = line.find_first_not_of(" \t", tokenEnd);
+        const bool looksLikeUsage = argStart == std::string::npos ||
+            std::string("<[-|:").find(line[argStart]) != std::string::npos ||
+            std::isdigit(static_cast<unsigned char>(line[argStart]));
+        if (IsCommandName(token) && looksLikeUsage && !caps.HasCommand(token))
+            caps.commands.push_back(token);
+
+        const std::string lower = ToLower(line);
+
+        for (long v : NumbersAfter(lower, "bin"))
+            if (v >= 1 && v <= 64)
+                binnings.push_back(static_cast<int>(v));
+        for (long v : NumbersAfter(lower, "bit"))
+            if (v >= 1 && v <= 16)
+                bitDepths.push_back(static_cast<int>(v));
+        for (long v : NumbersAfter(lower, "baud"))
+            caps.maxBaud = std::max(caps.maxBaud, v);
+
+        caps.roi = caps.roi || lower.find("roi") != std::string::npos;
+        caps.burst = caps.burst || lower.find("burst") != std::string::npos;
+        caps.packed = caps.packed || lower.find("pack") != std::string::npos;
+        caps.compressed = caps.compressed || lower.find("compress") != std::string::npos;
+    }
+
+    if (!binnings.empty())
+    {
+        std::sort(binnings.begin(), binnings.end());
+        binnings.erase(std::unique(binnings.begin(), binnings.end()), binnings.end());
+        caps.binnings = binnings;
+    }
+    if (!bitDepths.empty())
+    {
+        std::sort(bitDepths.begin(), bitDepths.end());
+        bitDepths.erase(std::unique(bitDepths.begin(), bitDepths.end()), bitDepths.end());
+        caps.bitDepths = bitDepths;
+    }
+    return caps;
+}
+
+/**
+* Extracts the version from a line like "fw 1.4.2", "Version: 1.4" or
+* "AbiCam firmware v1.2": a whole word keyword directly followed by the
+* number. Returns an empty string if the line doesn't carry one, as help
+* lines like "ver - firmware version" don't.
+*/
+std::string DeviceCapabilities::ParseVersion(const std::string& answer)
+{
+    const std::string lower = ToLower(answer);
+    for (const std::string keyword : { "version", "firmware", "fw", "ver" })
+    {
+        for (auto pos = lower.find(keyword); pos != std::string::npos; pos = lower.find(keyword, pos + 1))
+        {
+            const auto end = pos + keyword.size();
+            if ((pos > 0 && IsAlnum(lower, pos - 1)) || IsAlnum(lower, end))
+                continue;
+
+            auto number = lower.find_first_not_of(" \t:=", end);
+            if (number != std::string::npos && lower[number] == 'v' && IsDigit(lower, number + 1))
+                ++number;
+            if (!IsDigit(lower, number))
+                continue;
+            const auto numberEnd = lower.find_first_not_of("0123456789.", number);
+            return lower.substr(number, numberEnd == std::string::npos ? std::string::npos : numberEnd - number);
+        }
+    }
+    return {};
+}
+
+/**
+* Looks up the section of a firmware version. The cache is keyed on the
+* answer to "ver", so a camera that doesn't answer it is never found here
+* and always goes through the help listing.
+*/
+bool DeviceCapabilities::LoadCached(const std::string& path, const std::string& firmware, DeviceCapabilities& caps)
+{
+    if (path.empty() || firmware.empty())
+        return false;
+
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    DeviceCapabilities loaded;
+    bool inSection = false;
+    bool found = false;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = Trim(line);
+        if (line.size() > 2 && line.front() == '[' && line.back() == ']')
+        {
+            inSection = line.substr(1, line.size() - 2) == firmware;
+            found = found || inSection;
+            continue;
+        }
+        if (!inSection)
+            continue;
+
+        const auto eq = line.find('=');
+        if (eq == std::string::npos)
+            continue;
+        const std::string key = line.substr(0, eq);
+        const std::string value = line.substr(eq + 1);
+
+        try
+        {
+            if (key == "commands")
+                loaded.commands = Split(value);
+            else if (key == "binnings" || key == "bitDepths")
+            {
+                std::vector<int> numbers;
+                for (const auto& item : Split(value))
+                    numbers.push_back(std::stoi(item));
+                (key == "binnings" ? loaded.binnings : loaded.bitDepths) = numbers;
+            }
+            else if (key == "roi")
+                loaded.roi = value == "1";
+            else if (key == "burst")
+                loaded.burst = value == "1";
+            else if (key == "packed")
+                loaded.packed = value == "1";
+            else if (key == "compressed")
+                loaded.compressed = value == "1";
+            else if (key == "maxBaud")
+                loaded.maxBaud = std::stol(value);
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    if (!found || loaded.binnings.empty() || loaded.bitDepths.empty())
+        return false;
+
+    loaded.firmware = firmware;
+    caps = loaded;
+    return true;
+}
+
+/**
+* Writes caps into the cache, replacing an older section for the same
+* firmware and keeping the others.
+*/
+bool DeviceCapabilities::SaveCached(const std::string& path, const DeviceCapabilities& caps)
+{
+    if (path.empty() || caps.firmware.empty())
+        return false;
+
+    std::string kept;
+    {
+        std::ifstream in(path);
+        bool skip = false;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            const std::string trimmed = Trim(line);
+            if (trimmed.size() > 2 && trimmed.front() == '[' && trimmed.back() == ']')
+                skip = trimmed.substr(1, trimmed.size() - 2) == caps.firmware;
+            if (!skip)
+                kept += line + "\n";
+        }
+    }
+
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+        return false;
+
+    std::string commands;
+    for (size_t i = 0; i < caps.commands.size(); ++i)
+        commands += (i ? "," : "") + caps.commands[i];
+
+    out << kept
+        << "[" << caps.firmware << "]\n"
+        << "commands=" << commands << "\n"
+        << "binnings=" << Join(caps.binnings) << "\n"
+        << "bitDepths=" << Join(caps.bitDepths) << "\n"
+        << "roi=" << caps.roi << "\n"
+        << "burst=" << caps.burst << "\n"
+        << "packed=" << caps.packed << "\n"
+        << "compressed=" << caps.compressed << "\n"
+        << "maxBaud=" << caps.maxBaud << "\n";
+    return static_cast<bool>(out);
+}
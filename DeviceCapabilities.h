@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+* What the connected camera supports, as parsed from its "hlp" listing.
+* A default constructed instance describes the baseline firmware: binning
+* 1-64, bit depths 6-12 and none of the optional transfer modes.
+*
+* Parsed capabilities are cached in a small text file with one section per
+* firmware version, so later startups can skip the help handshake. Only
+* cameras that report their version to "ver" get to skip it.
+*/
+struct DeviceCapabilities
+{
+    std::string firmware;
+    std::vector<std::string> commands;
+    std::vector<int> binnings;
+    std::vector<int> bitDepths;
+    bool roi;
+    bool burst;
+    bool packed;
+    bool compressed;
+    long maxBaud;
+
+    DeviceCapabilities();
+
+    bool HasCommand(const std::string& name) const;
+    bool SupportsBinning(int binning) const;
+    bool SupportsBitDepth(int bitDepth) const;
+
+    static DeviceCapabilities FromHelp(const std::string& help);
+    static std::string ParseVersion(const std::string& answer);
+
+    static bool LoadCached(const std::string& path, const std::string& firmware, DeviceCapabilities& caps);
+    static bool SaveCached(const std::string& path, const DeviceCapabilities& caps);
+};
@@ -0,0 +1,178 @@
+#include "FaultInjector.h"
+
+#include <algorithm>
+#include <format>
+#include <thread>
+
+namespace
+{
+    const char* g_FaultNames[] = { "drop", "delay", "corrupt", "truncate" };
+}
+
+FaultInjector::FaultInjector() :
+    m_enabled(false),
+    m_probability{},
+    m_delayMs(1000.0),
+    m_random(std::random_device{}())
+{
+}
+
+const char* FaultInjector::FaultName(Fault fault)
+{
+    return g_FaultNames[fault];
+}
+
+void FaultInjector::SetEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    m_enabled = enabled;
+}
+
+bool FaultInjector::IsEnabled() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_enabled;
+}
+
+void FaultInjector::SetProbability(Fault fault, double probability)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    m_probability[fault] = std::clamp(probability, 0.0, 1.0);
+}
+
+double FaultInjector::GetProbability(Fault fault) const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_probability[fault];
+}
+
+void FaultInjector::SetDelayMs(double delayMs)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    m_delayMs = std::max(delayMs, 0.0);
+}
+
+double FaultInjector::GetDelayMs() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_delayMs;
+}
+
+/**
+* Decides whether fault hits this operation and counts it if so.
+* Called with the lock held.
+*/
+bool FaultInjector::Draw(Fault fault)
+{
+    if (m_probability[fault] <= 0.0 ||
+        std::uniform_real_distribution<double>(0.0, 1.0)(m_random) >= m_probability[fault])
+        return false;
+
+    auto& stats = m_stats[fault];
+    ++stats.injected;
+    if (!stats.pendingSince)
+        stats.pendingSince = Clock::now();
+    return true;
+}
+
+void FaultInjector::Stall(double delayMs)
+{
+    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(delayMs));
+}
+
+/**
+* Returns false when the command is to be dropped instead of sent.
+*/
+bool FaultInjector::BeforeWrite()
+{
+    std::unique_lock<std::mutex> g(m_lock);
+    if (!m_enabled)
+        return true;
+
+    if (Draw(Delay))
+    {
+        const double delayMs = m_delayMs;
+        g.unlock();
+        Stall(delayMs);
+        g.lock();
+    }
+    return !Draw(Drop);
+}
+
+/**
+* Applies at most one of drop, corrupt and truncate to the bytes just read,
+* after an optional delay.
+*/
+void FaultInjector::AfterRead(unsigned char* buf, unsigned long& read)
+{
+    std::unique_lock<std::mutex> g(m_lock);
+    if (!m_enabled || read == 0)
+        return;
+
+    if (Draw(Delay))
+    {
+        const double delayMs = m_delayMs;
+        g.unlock();
+        Stall(delayMs);
+        g.lock();
+    }
+
+    if (Draw(Drop))
+    {
+        read = 0;
+    }
+    else if (Draw(Corrupt))
+    {
+        const auto at = std::uniform_int_distribution<unsigned long>(0, read - 1)(m_random);
+        buf[at] ^= static_cast<unsigned char>(1u << std::uniform_int_distribution<int>(0, 7)(m_random));
+    }
+    else if (read > 1 && Draw(Truncate))
+    {
+        read = std::uniform_int_distribution<unsigned long>(1, read - 1)(m_random);
+    }
+}
+
+/**
+* A completed frame ends every outstanding fault: the adapter is back to
+* delivering data.
+*/
+void FaultInjector::FrameCompleted(Clock::time_point now)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    for (auto& stats : m_stats)
+    {
+        if (!stats.pendingSince)
+            continue;
+        const double recoveryMs = std::chrono::duration<double, std::milli>(now - *stats.pendingSince).count();
+        ++stats.recovered;
+        stats.totalRecoveryMs += recoveryMs;
+        stats.maxRecoveryMs = std::max(stats.maxRecoveryMs, recoveryMs);
+        stats.pendingSince.reset();
+    }
+}
+
+void FaultInjector::ResetStats()
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    m_stats = {};
+}
+
+/**
+* Per fault type: injections, recoveries and the mean and max time to
+* recover. Several injections before one good frame recover together.
+*/
+std::string FaultInjector::GetSummary() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    std::string summary;
+    for (int fault = 0; fault < FAULT_TYPES; ++fault)
+    {
+        const auto& stats = m_stats[fault];
+        if (!summary.empty())
+            summary += "; ";
+        summary += std::format("{}: {} injected, {} recovered, mean {:.1f} ms, max {:.1f} ms",
+            g_FaultNames[fault], stats.injected, stats.recovered,
+            stats.recovered ? stats.totalRecoveryMs / stats.recovered : 0.0, stats.maxRecoveryMs);
+    }
+    return summary;
+}
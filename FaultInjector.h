@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+
+/**
+* Injects transport faults into serial traffic to exercise recovery paths.
+* Every write and every read can independently suffer one fault, drawn
+* with its configured probability:
+*   Drop      a command isn't sent, or the bytes of a read are lost
+*   Delay     the operation stalls for the configured delay first
+*   Corrupt   one received byte is flipped
+*   Truncate  a read returns only part of the bytes it got
+* The time from the first injection of a type to the next frame that
+* completes is recorded as its recovery time.
+*/
+class FaultInjector
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum Fault { Drop, Delay, Corrupt, Truncate, FAULT_TYPES };
+
+    FaultInjector();
+
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const;
+    void SetProbability(Fault fault, double probability);
+    double GetProbability(Fault fault) const;
+    void SetDelayMs(double delayMs);
+    double GetDelayMs() const;
+
+    bool BeforeWrite();
+    void AfterRead(unsigned char* buf, unsigned long& read);
+    void FrameCompleted(Clock::time_point now);
+
+    void ResetStats();
+    std::string GetSummary() const;
+
+    static const char* FaultName(Fault fault);
+
+private:
+    struct FaultStats
+    {
+        unsigned long long injected = 0;
+        unsigned long long recovered = 0;
+        double totalRecoveryMs = 0.0;
+        double maxRecoveryMs = 0.0;
+        std::optional<Clock::time_point> pendingSince;
+    };
+
+    bool Draw(Fault fault);
+    static void Stall(double delayMs);
+
+    mutable std::mutex m_lock;
+    bool m_enabled;
+    std::array<double, FAULT_TYPES> m_probability;
+    double m_delayMs;
+    std::mt19937 m_random;
+    std::array<FaultStats, FAULT_TYPES> m_stats;
+};
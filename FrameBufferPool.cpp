@@ -0,0 +1,189 @@
+#include "FrameBufferPool.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    const size_t HUGE_PAGE_BYTES = 2 << 20;
+    const size_t PAGE_BYTES = 4096;
+
+    size_t AlignUp(size_t v, size_t a)
+    {
+        return (v + a - 1) / a * a;
+    }
+
+    /**
+    * Maps an anonymous region. With hugePages set it tries huge pages first
+    * and reports through hugePages whether it got them.
+    */
+    uint8_t* MapRegion(size_t& bytes, bool& hugePages)
+    {
+#ifdef _WIN32
+        if (hugePages)
+        {
+            // needs SeLockMemoryPrivilege, fall back silently if not granted
+            const size_t large = GetLargePageMinimum();
+            if (large > 0)
+            {
+                const size_t size = AlignUp(bytes, large);
+                void* mem = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+                if (mem)
+                {
+                    bytes = size;
+                    return static_cast<uint8_t*>(mem);
+                }
+            }
+            hugePages = false;
+        }
+        bytes = AlignUp(bytes, PAGE_BYTES);
+        return static_cast<uint8_t*>(VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+        bytes = AlignUp(bytes, hugePages ? HUGE_PAGE_BYTES : PAGE_BYTES);
+        void* mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            return nullptr;
+#ifdef MADV_HUGEPAGE
+        if (hugePages && madvise(mem, bytes, MADV_HUGEPAGE) != 0)
+            hugePages = false;
+#else
+        hugePages = false;
+#endif
+        return static_cast<uint8_t*>(mem);
+#endif
+    }
+
+    void UnmapRegion(uint8_t* region, size_t bytes)
+    {
+#ifdef _WIN32
+        (void)bytes;
+        VirtualFree(region, 0, MEM_RELEASE);
+#else
+        munmap(region, bytes);
+#endif
+    }
+}
+
+FrameBufferPool::Buffer& FrameBufferPool::Buffer::operator=(Buffer&& other) noexcept
+{
+    if (this != &other)
+    {
+        Reset();
+        m_pool = other.m_pool;
+        m_data = other.m_data;
+        other.m_pool = nullptr;
+        other.m_data = nullptr;
+    }
+    return *this;
+}
+
+size_t FrameBufferPool::Buffer::Capacity() const
+{
+    return m_pool ? m_pool->m_slabBytes : 0;
+}
+
+void FrameBufferPool::Buffer::Reset()
+{
+    if (m_pool)
+        m_pool->Release(m_data);
+    m_pool = nullptr;
+    m_data = nullptr;
+}
+
+FrameBufferPool::FrameBufferPool() :
+    m_region(nullptr),
+    m_regionBytes(0),
+    m_slabBytes(0),
+    m_slabStride(0),
+    m_slabCount(0),
+    m_hugePages(false),
+    m_configurations(0)
+{
+}
+
+FrameBufferPool::~FrameBufferPool()
+{
+    Free();
+}
+
+/**
+* (Re)allocates the pool. All buffers must have been returned; returns
+* false if some are still out or the region couldn't be mapped. Huge pages
+* are a request, check IsHugePageBacked() for what was granted.
+*/
+bool FrameBufferPool::Configure(size_t slabBytes, unsigned slabCount, bool hugePages)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (m_free.size() != m_slabCount)
+        return false;
+
+    if (m_region)
+    {
+        UnmapRegion(m_region, m_regionBytes);
+        m_region = nullptr;
+    }
+    m_free.clear();
+    m_slabBytes = 0;
+    m_slabCount = 0;
+
+    const size_t stride = AlignUp(slabBytes, ALIGNMENT);
+    size_t bytes = stride * slabCount;
+    bool huge = hugePages;
+    uint8_t* region = MapRegion(bytes, huge);
+    if (!region)
+        return false;
+
+    m_region = region;
+    m_regionBytes = bytes;
+    m_slabBytes = slabBytes;
+    m_slabStride = stride;
+    m_slabCount = slabCount;
+    m_hugePages = huge;
+    ++m_configurations;
+
+    m_free.reserve(slabCount);
+    for (unsigned i = slabCount; i-- > 0;)
+        m_free.push_back(m_region + i * stride);
+    return true;
+}
+
+/**
+* Takes a slab off the free list. Returns an empty Buffer if the pool is
+* exhausted.
+*/
+FrameBufferPool::Buffer FrameBufferPool::Acquire()
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (m_free.empty())
+        return Buffer();
+
+    uint8_t* data = m_free.back();
+    m_free.pop_back();
+    return Buffer(this, data);
+}
+
+unsigned FrameBufferPool::GetFreeCount() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return static_cast<unsigned>(m_free.size());
+}
+
+void FrameBufferPool::Release(uint8_t* data)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    m_free.push_back(data);
+}
+
+void FrameBufferPool::Free()
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (m_region)
+        UnmapRegion(m_region, m_regionBytes);
+    m_region = nullptr;
+    m_free.clear();
+    m_slabCount = 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+* Fixed set of equally sized, 64-byte aligned frame buffers carved out of
+* one page-aligned region, optionally backed by (transparent) huge pages.
+*
+* The pool is configured once per acquisition configuration; afterwards
+* Acquire/Release only move slabs on and off a preallocated free list, so
+* no frame buffer is allocated in steady state; the per-frame metadata the
+* core asks for is the only heap use left on the frame path. Buffers are handed
+* out as move-only Buffer handles that return their slab on destruction.
+*/
+class FrameBufferPool
+{
+public:
+    static const size_t ALIGNMENT = 64;
+
+    class Buffer
+    {
+    public:
+        Buffer() : m_pool(nullptr), m_data(nullptr) {}
+        Buffer(Buffer&& other) noexcept : m_pool(other.m_pool), m_data(other.m_data)
+        {
+            other.m_pool = nullptr;
+            other.m_data = nullptr;
+        }
+        Buffer& operator=(Buffer&& other) noexcept;
+        ~Buffer() { Reset(); }
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        uint8_t* Data() const { return m_data; }
+        size_t Capacity() const;
+        explicit operator bool() const { return m_data != nullptr; }
+        void Reset();
+
+    private:
+        friend class FrameBufferPool;
+        Buffer(FrameBufferPool* pool, uint8_t* data) : m_pool(pool), m_data(data) {}
+
+        FrameBufferPool* m_pool;
+        uint8_t* m_data;
+    };
+
+    FrameBufferPool();
+    ~FrameBufferPool();
+
+    bool Configure(size_t slabBytes, unsigned slabCount, bool hugePages);
+    Buffer Acquire();
+
+    size_t GetSlabBytes() const { return m_slabBytes; }
+    unsigned GetSlabCount() const { return m_slabCount; }
+    unsigned GetFreeCount() const;
+    bool IsHugePageBacked() const { return m_hugePages; }
+    // how often the region was mapped, one per Configure; not a count of heap allocations
+    unsigned long GetConfigureCount() const { return m_configurations; }
+
+private:
+    void Release(uint8_t* data);
+    void Free();
+
+    uint8_t* m_region;
+    size_t m_regionBytes;
+    size_t m_slabBytes;
+    size_t m_slabStride;
+    unsigned m_slabCount;
+    bool m_hugePages;
+    unsigned long m_configurations;
+
+    mutable std::mutex m_lock;
+    std::vector<uint8_t*> m_free;
+};
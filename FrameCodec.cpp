@@ -0,0 +1,247 @@
+#include "FrameCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const unsigned RICE_LIMIT = 20;
+    const unsigned CONTEXT_RESET = 64;
+
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(uint8_t* out) : m_out(out), m_pos(0), m_acc(0), m_bits(0) {}
+
+        void Put(uint32_t value, unsigned n)
+        {
+            m_acc = (m_acc << n) | value;
+            m_bits += n;
+            while (m_bits >= 8)
+            {
+                m_bits -= 8;
+                m_out[m_pos++] = static_cast<uint8_t>(m_acc >> m_bits);
+            }
+        }
+
+        size_t Finish()
+        {
+            if (m_bits > 0)
+                m_out[m_pos++] = static_cast<uint8_t>(m_acc << (8 - m_bits));
+            m_bits = 0;
+            return m_pos;
+        }
+
+        size_t Pos() const { return m_pos; }
+
+    private:
+        uint8_t* m_out;
+        size_t m_pos;
+        uint64_t m_acc;
+        unsigned m_bits;
+    };
+
+    class BitReader
+    {
+    public:
+        BitReader(const uint8_t* in, size_t size) : m_in(in), m_size(size), m_pos(0), m_acc(0), m_bits(0) {}
+
+        uint32_t Get(unsigned n)
+        {
+            while (m_bits < n)
+            {
+                m_acc = (m_acc << 8) | (m_pos < m_size ? m_in[m_pos] : 0);
+                ++m_pos;
+                m_bits += 8;
+            }
+            m_bits -= n;
+            return static_cast<uint32_t>((m_acc >> m_bits) & ((uint64_t(1) << n) - 1));
+        }
+
+        unsigned GetUnary(unsigned limit)
+        {
+            unsigned q = 0;
+            while (q < limit && Get(1))
+                ++q;
+            return q;
+        }
+
+        bool Overrun() const { return m_pos > m_size + 8; }
+
+    private:
+        const uint8_t* m_in;
+        size_t m_size;
+        size_t m_pos;
+        uint64_t m_acc;
+        unsigned m_bits;
+    };
+
+    // Running mean of the mapped residuals, picks the Rice parameter
+    struct RiceContext
+    {
+        uint32_t a = 4;
+        uint32_t n = 1;
+
+        unsigned K() const
+        {
+            unsigned k = 0;
+            while ((n << k) < a && k < 24)
+                ++k;
+            return k;
+        }
+
+        void Update(uint32_t m)
+        {
+            a += m;
+            if (++n == CONTEXT_RESET)
+            {
+                a >>= 1;
+                n >>= 1;
+            }
+        }
+    };
+
+    template <typename T>
+    inline T Predict(const T* row, const T* up, unsigned x)
+    {
+        if (!up)
+            return x ? row[x - 1] : 0;
+        if (x == 0)
+            return up[0];
+
+        const int a = row[x - 1], b = up[x], c = up[x - 1];
+        if (c >= std::max(a, b))
+            return static_cast<T>(std::min(a, b));
+        if (c <= std::min(a, b))
+            return static_cast<T>(std::max(a, b));
+        return static_cast<T>(a + b - c);
+    }
+
+    template <typename T>
+    size_t EncodeRice(const T* src, unsigned width, unsigned rows, uint8_t* dst, size_t limit)
+    {
+        const unsigned bits = sizeof(T) * 8;
+        const uint32_t mask = (uint32_t(1) << bits) - 1;
+        const uint32_t half = uint32_t(1) << (bits - 1);
+
+        BitWriter w(dst);
+        RiceContext ctx;
+        for (unsigned y = 0; y < rows; ++y)
+        {
+            const T* row = src + static_cast<size_t>(y) * width;
+            const T* up = y ? row - width : nullptr;
+            for (unsigned x = 0; x < width; ++x)
+            {
+                uint32_t r = (uint32_t(row[x]) - Predict(row, up, x)) & mask;
+                const int32_t s = r >= half ? int32_t(r) - int32_t(mask) - 1 : int32_t(r);
+                const uint32_t m = (uint32_t(s) << 1) ^ uint32_t(s >> 31);
+
+                const unsigned k = ctx.K();
+                const uint32_t q = m >> k;
+                if (q < RICE_LIMIT)
+                {
+                    w.Put((uint32_t(1) << (q + 1)) - 2, q + 1);
+                    if (k)
+                        w.Put(m & ((uint32_t(1) << k) - 1), k);
+                }
+                else
+                {
+                    w.Put((uint32_t(1) << RICE_LIMIT) - 1, RICE_LIMIT);
+                    w.Put(m, bits);
+                }
+                ctx.Update(m);
+
+                if (w.Pos() > limit)
+                    return 0;
+            }
+        }
+        return w.Finish();
+    }
+
+    template <typename T>
+    bool DecodeRice(const uint8_t* src, size_t srcSize, unsigned width, unsigned rows, T* dst)
+    {
+        const unsigned bits = sizeof(T) * 8;
+
+        BitReader r(src, srcSize);
+        RiceContext ctx;
+        for (unsigned y = 0; y < rows; ++y)
+        {
+            T* row = dst + static_cast<size_t>(y) * width;
+            const T* up = y ? row - width : nullptr;
+            for (unsigned x = 0; x < width; ++x)
+            {
+                const unsigned k = ctx.K();
+                const unsigned q = r.GetUnary(RICE_LIMIT);
+                uint32_t m;
+                if (q < RICE_LIMIT)
+                    m = (q << k) | (k ? r.Get(k) : 0);
+                else
+                    m = r.Get(bits);
+                ctx.Update(m);
+
+                const int32_t s = int32_t(m >> 1) ^ -int32_t(m & 1);
+                row[x] = static_cast<T>(Predict(row, up, x) + s);
+            }
+            if (r.Overrun())
+                return false;
+        }
+        return true;
+    }
+}
+
+size_t FrameCodec::MaxEncodedSize(unsigned width, unsigned rows, unsigned bytesPerPixel)
+{
+    // raw fallback plus the method byte, plus slack for the last symbol
+    // written before the encoder notices it is not winning
+    return 1 + static_cast<size_t>(width) * rows * bytesPerPixel + 16;
+}
+
+/**
+* Encodes rows x width pixels into dst, which must hold MaxEncodedSize bytes.
+* Returns the number of bytes written.
+*/
+size_t FrameCodec::Encode(const uint8_t* src, unsigned width, unsigned rows, unsigned bytesPerPixel, uint8_t* dst)
+{
+    const size_t rawSize = static_cast<size_t>(width) * rows * bytesPerPixel;
+
+    size_t size = 0;
+    if (bytesPerPixel == 1)
+        size = EncodeRice(src, width, rows, dst + 1, rawSize);
+    else if (bytesPerPixel == 2)
+        size = EncodeRice(reinterpret_cast<const uint16_t*>(src), width, rows, dst + 1, rawSize);
+
+    if (size == 0 || size >= rawSize)
+    {
+        dst[0] = METHOD_RAW;
+        std::memcpy(dst + 1, src, rawSize);
+        return 1 + rawSize;
+    }
+
+    dst[0] = METHOD_RICE;
+    return 1 + size;
+}
+
+bool FrameCodec::Decode(const uint8_t* src, size_t srcSize, unsigned width, unsigned rows, unsigned bytesPerPixel, uint8_t* dst)
+{
+    if (srcSize < 1)
+        return false;
+
+    const size_t rawSize = static_cast<size_t>(width) * rows * bytesPerPixel;
+    switch (src[0])
+    {
+    case METHOD_RAW:
+        if (srcSize - 1 != rawSize)
+            return false;
+        std::memcpy(dst, src + 1, rawSize);
+        return true;
+    case METHOD_RICE:
+        if (bytesPerPixel == 1)
+            return DecodeRice(src + 1, srcSize - 1, width, rows, dst);
+        if (bytesPerPixel == 2)
+            return DecodeRice(src + 1, srcSize - 1, width, rows, reinterpret_cast<uint16_t*>(dst));
+        return false;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+* Lossless codec for 8/16 bit monochrome frames.
+* Each pixel is predicted from its left, upper and upper-left neighbours
+* (LOCO-I median edge detector), the residual is zigzag mapped and written
+* with an adaptive Rice code. Every call codes an independent block of rows,
+* so a frame split into strips can be encoded and decoded in parallel and
+* any strip can be decoded on its own. Used for the frame stream, whose
+* clients decode it with Decode; saved stacks use standard TIFF Deflate.
+*
+* The first byte of an encoded block is the method: blocks that would not
+* shrink are stored raw.
+*/
+namespace FrameCodec
+{
+    enum Method : uint8_t
+    {
+        METHOD_RAW = 0,
+        METHOD_RICE = 1,
+    };
+
+    size_t MaxEncodedSize(unsigned width, unsigned rows, unsigned bytesPerPixel);
+
+    size_t Encode(const uint8_t* src, unsigned width, unsigned rows, unsigned bytesPerPixel, uint8_t* dst);
+
+    bool Decode(const uint8_t* src, size_t srcSize, unsigned width, unsigned rows, unsigned bytesPerPixel, uint8_t* dst);
+}
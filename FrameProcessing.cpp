@@ -0,0 +1,234 @@
+#include "FrameProcessing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+void FrameStats::Reset()
+{
+    min = UINT32_MAX;
+    max = 0;
+    sum = 0;
+    sumSq = 0;
+    count = 0;
+}
+
+double FrameStats::Mean() const
+{
+    return count ? static_cast<double>(sum) / count : 0.0;
+}
+
+double FrameStats::StdDev() const
+{
+    if (count < 2)
+        return 0.0;
+    const double mean = Mean();
+    return std::sqrt(std::max(0.0, static_cast<double>(sumSq) / count - mean * mean));
+}
+
+namespace
+{
+    // Per pixel stages. Each is a type so the row kernel is composed at
+    // compile time and the inner loop has no branches or indirect calls.
+
+    template <typename T>
+    struct KeepPixel
+    {
+        static uint32_t Apply(const T* row, const T*, unsigned x) { return row[x]; }
+    };
+
+    // saturates at zero
+    template <typename T>
+    struct SubtractBackground
+    {
+        static uint32_t Apply(const T* row, const T* bkg, unsigned x)
+        {
+            return row[x] > bkg[x] ? row[x] - bkg[x] : 0;
+        }
+    };
+
+    // scales samples read at a lower bit depth up to the output depth,
+    // saturating at the largest value of that depth
+    template <bool Enabled>
+    struct Rescale
+    {
+        static uint32_t Apply(uint32_t v, unsigned shift, uint32_t maxValue)
+        {
+            if constexpr (Enabled)
+                return std::min<uint32_t>(v << shift, maxValue);
+            else
+                return v;
+        }
+    };
+
+    template <typename T, typename Stage, bool Shift>
+    void RowKernel(uint8_t* rowBytes, const uint8_t* bkgBytes, unsigned width, unsigned shift, uint32_t maxValue,
+        FrameStats& stats)
+    {
+        T* row = reinterpret_cast<T*>(rowBytes);
+        const T* bkg = reinterpret_cast<const T*>(bkgBytes);
+
+        uint32_t lo = stats.min, hi = stats.max;
+        uint64_t sum = 0, sumSq = 0;
+        for (unsigned x = 0; x < width; ++x)
+        {
+            const uint32_t v = Rescale<Shift>::Apply(Stage::Apply(row, bkg, x), shift, maxValue);
+            if constexpr (Shift || !std::is_same_v<Stage, KeepPixel<T>>)
+                row[x] = static_cast<T>(v);
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+            sum += v;
+            sumSq += static_cast<uint64_t>(v) * v;
+        }
+        stats.min = lo;
+        stats.max = hi;
+        stats.sum += sum;
+        stats.sumSq += sumSq;
+        stats.count += width;
+    }
+
+    // The pixel data is right aligned at any bit depth, so kernels differ
+    // only by sample type, background subtraction and whether samples were
+    // read at a lower depth than the output
+    template <typename T>
+    RowProcessor::Kernel SelectKernel(bool subtract, bool shift)
+    {
+        if (subtract)
+            return shift ? &RowKernel<T, SubtractBackground<T>, true> : &RowKernel<T, SubtractBackground<T>, false>;
+        return shift ? &RowKernel<T, KeepPixel<T>, true> : &RowKernel<T, KeepPixel<T>, false>;
+    }
+}
+
+RowProcessor::RowProcessor() :
+    m_frame(nullptr),
+    m_background(nullptr),
+    m_width(0),
+    m_height(0),
+    m_bytesPerPixel(1),
+    m_rowBytes(0),
+    m_rowsDone(0),
+    m_shift(0),
+    m_maxValue(0),
+    m_kernel(nullptr)
+{
+}
+
+/**
+* Starts a new frame. background may be null when no subtraction is wanted.
+* shift scales samples up to the output bitDepth when the frame was read
+* at a lower one. The row kernel for this pixel size, subtraction and
+* scaling is picked here, once per frame.
+*/
+void RowProcessor::Begin(uint8_t* frame, const uint8_t* background, unsigned width, unsigned height,
+    unsigned bytesPerPixel, unsigned bitDepth, unsigned shift)
+{
+    m_frame = frame;
+    m_background = background;
+    m_width = width;
+    m_height = height;
+    m_bytesPerPixel = bytesPerPixel;
+    m_rowBytes = static_cast<size_t>(width) * bytesPerPixel;
+    m_rowsDone = 0;
+    m_shift = shift;
+    m_maxValue = (1u << bitDepth) - 1;
+    m_kernel = bytesPerPixel == 2 ? SelectKernel<uint16_t>(background != nullptr, shift > 0)
+        : SelectKernel<uint8_t>(background != nullptr, shift > 0);
+    m_stats.Reset();
+}
+
+void RowProcessor::Advance(size_t bytesReceived)
+{
+    if (m_rowBytes == 0)
+        return;
+
+    const unsigned complete = static_cast<unsigned>(std::min<size_t>(bytesReceived / m_rowBytes, m_height));
+    const unsigned done = m_rowsDone.load(std::memory_order_relaxed);
+    if (complete > done)
+    {
+        ProcessRows(done, complete);
+        m_rowsDone.store(complete, std::memory_order_release);
+    }
+}
+
+void RowProcessor::Finish()
+{
+    Advance(m_rowBytes * m_height);
+}
+
+void RowProcessor::ProcessRows(unsigned first, unsigned last)
+{
+    for (unsigned y = first; y < last; ++y)
+    {
+        const size_t offset = y * m_rowBytes;
+        m_kernel(m_frame + offset, m_background ? m_background + offset : nullptr, m_width, m_shift, m_maxValue, m_stats);
+    }
+}
+
+TemporalNoise::TemporalNoise() :
+    m_width(0),
+    m_height(0),
+    m_bytesPerPixel(0)
+{
+}
+
+bool TemporalNoise::Add(const uint8_t* frame, unsigned width, unsigned height, unsigned bytesPerPixel,
+    double& noise)
+{
+    m_current.clear();
+    for (unsigned y = GRID_STEP / 2; y < height; y += GRID_STEP)
+    {
+        const uint8_t* row = frame + static_cast<size_t>(y) * width * bytesPerPixel;
+        for (unsigned x = GRID_STEP / 2; x < width; x += GRID_STEP)
+            m_current.push_back(bytesPerPixel == 2 ? reinterpret_cast<const uint16_t*>(row)[x] : row[x]);
+    }
+
+    const bool comparable = width == m_width && height == m_height && bytesPerPixel == m_bytesPerPixel
+        && m_current.size() > 1;
+    if (comparable)
+    {
+        double sum = 0.0, sumSq = 0.0;
+        for (size_t i = 0; i < m_current.size(); ++i)
+        {
+            const double d = static_cast<double>(m_current[i]) - m_previous[i];
+            sum += d;
+            sumSq += d * d;
+        }
+        const double n = static_cast<double>(m_current.size());
+        const double mean = sum / n;
+        noise = std::sqrt(std::max(0.0, sumSq / n - mean * mean) / 2.0);
+    }
+
+    std::swap(m_previous, m_current);
+    m_width = width;
+    m_height = height;
+    m_bytesPerPixel = bytesPerPixel;
+    return comparable;
+}
+
+void TemporalNoise::Reset()
+{
+    m_width = 0;
+    m_height = 0;
+    m_bytesPerPixel = 0;
+}
+
+void UnpackRow(const uint8_t* packed, unsigned width, unsigned bits, unsigned bytesPerPixel, uint8_t* row)
+{
+    const uint32_t mask = (1u << bits) - 1;
+    uint32_t acc = 0;
+    unsigned accBits = 0;
+    for (unsigned x = 0; x < width; ++x)
+    {
+        while (accBits < bits)
+        {
+            acc = (acc << 8) | *packed++;
+            accBits += 8;
+        }
+        accBits -= bits;
+        const uint32_t value = (acc >> accBits) & mask;
+        if (bytesPerPixel == 2)
+            reinterpret_cast<uint16_t*>(row)[x] = static_cast<uint16_t>(value);
+        else
+            row[x] = static_cast<uint8_t>(value);
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* Pixel statistics accumulated while a frame is processed.
+*/
+struct FrameStats
+{
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint64_t sumSq;
+    uint64_t count;
+
+    FrameStats() { Reset(); }
+    void Reset();
+    double Mean() const;
+    double StdDev() const;
+};
+
+/**
+* Processes a frame row by row while it is still being received.
+* Begin() is called before the transfer, Advance() after every chunk with
+* the number of bytes received so far, and Finish() once the last byte has
+* arrived. Every row that is complete is background subtracted (saturating
+* at zero), scaled to the output bit depth and added to the statistics, so
+* when the final chunk lands only its own rows are left to do.
+*
+* GetRowsDone() may be read from another thread; rows below it are final.
+*/
+class RowProcessor
+{
+public:
+    using Kernel = void (*)(uint8_t* row, const uint8_t* background, unsigned width, unsigned shift,
+        uint32_t maxValue, FrameStats& stats);
+
+    RowProcessor();
+
+    void Begin(uint8_t* frame, const uint8_t* background, unsigned width, unsigned height,
+        unsigned bytesPerPixel, unsigned bitDepth, unsigned shift = 0);
+    void Advance(size_t bytesReceived);
+    void Finish();
+
+    unsigned GetRowsDone() const { return m_rowsDone; }
+    const FrameStats& GetStats() const { return m_stats; }
+
+private:
+    void ProcessRows(unsigned first, unsigned last);
+
+    uint8_t* m_frame;
+    const uint8_t* m_background;
+    unsigned m_width;
+    unsigned m_height;
+    unsigned m_bytesPerPixel;
+    size_t m_rowBytes;
+    std::atomic<unsigned> m_rowsDone;
+    FrameStats m_stats;
+    unsigned m_shift;
+    uint32_t m_maxValue;
+    Kernel m_kernel;
+};
+
+/**
+* Estimates the temporal noise of a frame sequence from the difference
+* between consecutive frames, sampled on a sparse grid. Scene structure,
+* which the spatial standard deviation of one frame counts as noise,
+* cancels out; the difference of two frames has sqrt(2) times the noise of
+* one, which is divided out. Motion only raises the estimate.
+*/
+class TemporalNoise
+{
+public:
+    TemporalNoise();
+
+    // Samples the frame. Returns false for the first frame and after a
+    // size change, when there is nothing to compare against yet.
+    bool Add(const uint8_t* frame, unsigned width, unsigned height, unsigned bytesPerPixel, double& noise);
+    void Reset();
+
+private:
+    static const unsigned GRID_STEP = 8;
+
+    std::vector<uint16_t> m_previous;
+    std::vector<uint16_t> m_current;
+    unsigned m_width;
+    unsigned m_height;
+    unsigned m_bytesPerPixel;
+};
+
+/**
+* Expands one row of samples packed at bits per sample, most significant
+* bit first with the row padded to a whole byte, into bytesPerPixel wide
+* samples. Packed rows are (width * bits + 7) / 8 bytes.
+*/
+void UnpackRow(const uint8_t* packed, unsigned width, unsigned bits, unsigned bytesPerPixel, uint8_t* row);
@@ -0,0 +1,463 @@
+#include "FrameStreamServer.h"
+#include "FrameCodec.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const intptr_t INVALID_SOCK = -1;
+
+#ifdef _WIN32
+    typedef SOCKET NativeSocket;
+    typedef WSAPOLLFD PollFd;
+
+    NativeSocket Native(intptr_t s)
+    {
+        return static_cast<NativeSocket>(s);
+    }
+
+    int Poll(PollFd* fds, size_t count, int timeoutMs)
+    {
+        return WSAPoll(fds, static_cast<ULONG>(count), timeoutMs);
+    }
+
+    void CloseSocket(intptr_t s)
+    {
+        closesocket(Native(s));
+    }
+
+    bool SetNonBlocking(intptr_t s)
+    {
+        u_long on = 1;
+        return ioctlsocket(Native(s), FIONBIO, &on) == 0;
+    }
+
+    bool WouldBlock()
+    {
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+    }
+
+    const int SEND_FLAGS = 0;
+#else
+    typedef int NativeSocket;
+    typedef pollfd PollFd;
+
+    NativeSocket Native(intptr_t s)
+    {
+        return static_cast<NativeSocket>(s);
+    }
+
+    int Poll(PollFd* fds, size_t count, int timeoutMs)
+    {
+        return poll(fds, static_cast<nfds_t>(count), timeoutMs);
+    }
+
+    void CloseSocket(intptr_t s)
+    {
+        close(Native(s));
+    }
+
+    bool SetNonBlocking(intptr_t s)
+    {
+        const int flags = fcntl(Native(s), F_GETFL, 0);
+        return flags >= 0 && fcntl(Native(s), F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    bool WouldBlock()
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+#ifdef MSG_NOSIGNAL
+    const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    const int SEND_FLAGS = 0;
+#endif
+#endif
+
+    template <typename T>
+    void Downsample(const T* src, unsigned width, unsigned factor, unsigned outWidth, unsigned outHeight, T* dst)
+    {
+        const unsigned area = factor * factor;
+        for (unsigned y = 0; y < outHeight; ++y)
+        {
+            for (unsigned x = 0; x < outWidth; ++x)
+            {
+                uint32_t sum = 0;
+                for (unsigned dy = 0; dy < factor; ++dy)
+                {
+                    const T* row = src + static_cast<size_t>(y * factor + dy) * width + x * factor;
+                    for (unsigned dx = 0; dx < factor; ++dx)
+                        sum += row[dx];
+                }
+                dst[static_cast<size_t>(y) * outWidth + x] = static_cast<T>(sum / area);
+            }
+        }
+    }
+}
+
+FrameStreamServer::FrameStreamServer() :
+    m_listenSocket(INVALID_SOCK),
+    m_running(false),
+    m_downsample(1),
+    m_compress(false),
+    m_hasNewFrame(false),
+    m_frameNumber(0),
+    m_clientCount(0),
+    m_dropped(0)
+{
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+}
+
+FrameStreamServer::~FrameStreamServer()
+{
+    Stop();
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+/**
+* Starts listening on endpoint and launches the server thread.
+* The endpoint is "port" (loopback only), "address:port" (IPv4, e.g.
+* "0.0.0.0:5555" to accept viewers on every interface), or on POSIX an
+* absolute path for a Unix domain socket.
+*/
+bool FrameStreamServer::Start(const std::string& endpoint)
+{
+    Stop();
+    if (endpoint.empty())
+        return false;
+
+    intptr_t s = INVALID_SOCK;
+    if (endpoint[0] == '/')
+    {
+#ifdef _WIN32
+        return false;
+#else
+        sockaddr_un addr{};
+        if (endpoint.size() >= sizeof(addr.sun_path))
+            return false;
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, endpoint.c_str());
+        unlink(endpoint.c_str());
+
+        s = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s == INVALID_SOCK || bind(Native(s), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+        {
+            if (s != INVALID_SOCK)
+                CloseSocket(s);
+            return false;
+        }
+        m_unixPath = endpoint;
+#endif
+    }
+    else
+    {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        std::string port = endpoint;
+        const auto colon = endpoint.rfind(':');
+        if (colon != std::string::npos)
+        {
+            port = endpoint.substr(colon + 1);
+            if (inet_pton(AF_INET, endpoint.substr(0, colon).c_str(), &addr.sin_addr) != 1)
+                return false;
+        }
+        char* end = nullptr;
+        const unsigned long portNumber = std::strtoul(port.c_str(), &end, 10);
+        if (port.empty() || *end != '\0' || portNumber == 0 || portNumber > 65535)
+            return false;
+        addr.sin_port = htons(static_cast<uint16_t>(portNumber));
+
+        s = static_cast<intptr_t>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+        if (s == INVALID_SOCK)
+            return false;
+
+        int on = 1;
+        setsockopt(Native(s), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+        if (bind(Native(s), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+        {
+            CloseSocket(s);
+            return false;
+        }
+    }
+
+    if (listen(Native(s), 8) != 0 || !SetNonBlocking(s))
+    {
+        CloseSocket(s);
+        return false;
+    }
+
+    m_listenSocket = s;
+    m_running = true;
+    m_thread = std::thread(&FrameStreamServer::ServerLoop, this);
+    return true;
+}
+
+void FrameStreamServer::Stop()
+{
+    if (!m_thread.joinable())
+        return;
+
+    m_running = false;
+    m_thread.join();
+
+    for (auto& client : m_clients)
+        CloseSocket(client.socket);
+    m_clients.clear();
+    m_clientCount = 0;
+
+    CloseSocket(m_listenSocket);
+    m_listenSocket = INVALID_SOCK;
+#ifndef _WIN32
+    if (!m_unixPath.empty())
+        unlink(m_unixPath.c_str());
+#endif
+    m_unixPath.clear();
+}
+
+/**
+* Offers a frame to the server thread. Only the newest frame is kept, and
+* nothing is copied while no client is connected.
+*/
+void FrameStreamServer::Publish(const uint8_t* pixels, unsigned width, unsigned height,
+    unsigned bytesPerPixel, unsigned bitDepth)
+{
+    if (!m_running || m_clientCount == 0)
+        return;
+
+    const size_t size = static_cast<size_t>(width) * height * bytesPerPixel;
+
+    std::lock_guard<std::mutex> g(m_frameLock);
+    m_latest.pixels.resize(size);
+    std::memcpy(m_latest.pixels.data(), pixels, size);
+    m_latest.width = width;
+    m_latest.height = height;
+    m_latest.bytesPerPixel = bytesPerPixel;
+    m_latest.bitDepth = bitDepth;
+    m_latest.frameNumber = m_frameNumber++;
+    if (m_hasNewFrame)
+        ++m_dropped;
+    m_hasNewFrame = true;
+}
+
+void FrameStreamServer::ServerLoop()
+{
+    std::vector<PollFd> fds;
+    while (m_running)
+    {
+        fds.resize(1 + m_clients.size());
+        fds[0].fd = Native(m_listenSocket);
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        for (size_t i = 0; i < m_clients.size(); ++i)
+        {
+            fds[i + 1].fd = Native(m_clients[i].socket);
+            fds[i + 1].events = POLLIN | (m_clients[i].current ? POLLOUT : 0);
+            fds[i + 1].revents = 0;
+        }
+
+        if (Poll(fds.data(), fds.size(), POLL_INTERVAL_MS) < 0)
+            continue;
+
+        // clients don't send anything, readable means closed or garbage
+        for (size_t i = m_clients.size(); i-- > 0;)
+        {
+            if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            char discard[256];
+            const auto n = recv(Native(m_clients[i].socket), discard, sizeof(discard), 0);
+            if (n == 0 || (n < 0 && !WouldBlock()))
+            {
+                CloseSocket(m_clients[i].socket);
+                m_clients.erase(m_clients.begin() + i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+            AcceptClients();
+        m_clientCount = static_cast<unsigned>(m_clients.size());
+
+        bool newFrame = false;
+        {
+            std::lock_guard<std::mutex> g(m_frameLock);
+            if (m_hasNewFrame)
+            {
+                std::swap(m_latest, m_encoding);
+                m_hasNewFrame = false;
+                newFrame = true;
+            }
+        }
+
+        if (newFrame && !m_clients.empty())
+        {
+            Message msg = EncodeFrame(m_encoding);
+            for (auto& client : m_clients)
+            {
+                if (!client.current)
+                {
+                    client.current = msg;
+                    client.sent = 0;
+                }
+                else
+                {
+                    if (client.next)
+                        ++m_dropped;
+                    client.next = msg;
+                }
+            }
+        }
+
+        for (size_t i = m_clients.size(); i-- > 0;)
+        {
+            if (!SendPending(m_clients[i]))
+            {
+                CloseSocket(m_clients[i].socket);
+                m_clients.erase(m_clients.begin() + i);
+            }
+        }
+        m_clientCount = static_cast<unsigned>(m_clients.size());
+    }
+}
+
+void FrameStreamServer::AcceptClients()
+{
+    for (;;)
+    {
+        const intptr_t s = static_cast<intptr_t>(accept(Native(m_listenSocket), nullptr, nullptr));
+        if (s == INVALID_SOCK)
+            return;
+
+        if (!SetNonBlocking(s))
+        {
+            CloseSocket(s);
+            continue;
+        }
+        if (m_unixPath.empty())
+        {
+            int on = 1;
+            setsockopt(Native(s), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+        }
+        m_clients.push_back(Client{ s, nullptr, 0, nullptr });
+    }
+}
+
+/**
+* Writes as much of the client's current message as the socket accepts.
+* Returns false if the connection failed.
+*/
+bool FrameStreamServer::SendPending(Client& client)
+{
+    while (client.current)
+    {
+        const auto& data = *client.current;
+        const auto n = send(Native(client.socket),
+            reinterpret_cast<const char*>(data.data()) + client.sent,
+            static_cast<int>(data.size() - client.sent), SEND_FLAGS);
+        if (n < 0)
+            return WouldBlock();
+
+        client.sent += n;
+        if (client.sent < data.size())
+            return true;
+
+        client.current = std::move(client.next);
+        client.next = nullptr;
+        client.sent = 0;
+    }
+    return true;
+}
+
+/**
+* Builds the wire message for a frame: optional downsampling by averaging,
+* optional per-strip Rice coding.
+*/
+FrameStreamServer::Message FrameStreamServer::EncodeFrame(const RawFrame& frame)
+{
+    const unsigned factor = std::max(1u, m_downsample.load());
+    const unsigned width = frame.width / factor;
+    const unsigned height = frame.height / factor;
+    const unsigned bpp = frame.bytesPerPixel;
+    const size_t rawSize = static_cast<size_t>(width) * height * bpp;
+
+    std::vector<uint8_t> pixels;
+    const uint8_t* src = frame.pixels.data();
+    if (factor > 1)
+    {
+        pixels.resize(rawSize);
+        if (bpp == 2)
+            Downsample(reinterpret_cast<const uint16_t*>(src), frame.width, factor, width, height,
+                reinterpret_cast<uint16_t*>(pixels.data()));
+        else
+            Downsample(src, frame.width, factor, width, height, pixels.data());
+        src = pixels.data();
+    }
+
+    FrameStreamHeader header{};
+    header.magic = MAGIC;
+    header.headerSize = sizeof(FrameStreamHeader);
+    header.frameNumber = frame.frameNumber;
+    header.width = width;
+    header.height = height;
+    header.bytesPerPixel = bpp;
+    header.bitDepth = frame.bitDepth;
+    header.stripRows = STRIP_ROWS;
+
+    auto msg = std::make_shared<std::vector<uint8_t>>(sizeof(header));
+    if (m_compress)
+    {
+        const uint32_t numStrips = (height + STRIP_ROWS - 1) / STRIP_ROWS;
+        const size_t stripBytes = static_cast<size_t>(width) * STRIP_ROWS * bpp;
+        msg->resize(sizeof(header) + 4 + 4 * numStrips
+            + numStrips * FrameCodec::MaxEncodedSize(width, STRIP_ROWS, bpp));
+
+        uint8_t* table = msg->data() + sizeof(header);
+        std::memcpy(table, &numStrips, 4);
+        size_t pos = sizeof(header) + 4 + 4 * numStrips;
+        for (uint32_t i = 0; i < numStrips; ++i)
+        {
+            const unsigned rows = std::min(STRIP_ROWS, height - i * STRIP_ROWS);
+            const uint32_t size = static_cast<uint32_t>(
+                FrameCodec::Encode(src + i * stripBytes, width, rows, bpp, msg->data() + pos));
+            std::memcpy(table + 4 + 4 * i, &size, 4);
+            pos += size;
+        }
+        msg->resize(pos);
+        header.encoding = ENCODING_RICE;
+    }
+    else
+    {
+        msg->insert(msg->end(), src, src + rawSize);
+        header.encoding = ENCODING_RAW;
+    }
+
+    header.payloadSize = msg->size() - sizeof(header);
+    std::memcpy(msg->data(), &header, sizeof(header));
+    return msg;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* Streams frames to viewers over TCP or, on POSIX, a Unix domain socket.
+*
+* Publish() only copies the frame into a "latest frame" slot; a server
+* thread downsamples/compresses it and sends it to every client with
+* non-blocking sockets. Each client has at most one frame in flight and one
+* waiting; a newer frame replaces the waiting one, so a slow client skips
+* frames instead of stalling acquisition or the other clients.
+*
+* Every message is a FrameStreamHeader followed by payloadSize bytes. For
+* ENCODING_RICE the payload is a uint32 strip count, the uint32 size of each
+* strip, then the FrameCodec strips of stripRows rows each.
+*/
+struct FrameStreamHeader
+{
+    uint32_t magic;
+    uint32_t headerSize;
+    uint64_t frameNumber;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerPixel;
+    uint32_t bitDepth;
+    uint32_t encoding;
+    uint32_t stripRows;
+    uint64_t payloadSize;
+};
+
+class FrameStreamServer
+{
+public:
+    static const uint32_t MAGIC = 0x46494241; // "ABIF"
+    static const uint32_t ENCODING_RAW = 0;
+    static const uint32_t ENCODING_RICE = 1;
+
+    FrameStreamServer();
+    ~FrameStreamServer();
+
+    bool Start(const std::string& endpoint);
+    void Stop();
+    bool IsRunning() const { return m_running; }
+
+    void SetDownsample(unsigned factor) { m_downsample = factor; }
+    void SetCompression(bool compress) { m_compress = compress; }
+
+    void Publish(const uint8_t* pixels, unsigned width, unsigned height,
+        unsigned bytesPerPixel, unsigned bitDepth);
+
+    unsigned GetClientCount() const { return m_clientCount; }
+    uint64_t GetDroppedFrames() const { return m_dropped; }
+
+private:
+    typedef std::shared_ptr<const std::vector<uint8_t>> Message;
+
+    struct Client
+    {
+        intptr_t socket;
+        Message current;
+        size_t sent;
+        Message next;
+    };
+
+    struct RawFrame
+    {
+        std::vector<uint8_t> pixels;
+        unsigned width = 0;
+        unsigned height = 0;
+        unsigned bytesPerPixel = 1;
+        unsigned bitDepth = 8;
+        uint64_t frameNumber = 0;
+    };
+
+    static const int POLL_INTERVAL_MS = 10;
+    static constexpr unsigned STRIP_ROWS = 32;
+
+    void ServerLoop();
+    void AcceptClients();
+    bool SendPending(Client& client);
+    Message EncodeFrame(const RawFrame& frame);
+
+    intptr_t m_listenSocket;
+    std::string m_unixPath;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+
+    std::atomic<unsigned> m_downsample;
+    std::atomic<bool> m_compress;
+
+    std::mutex m_frameLock;
+    RawFrame m_latest;
+    bool m_hasNewFrame;
+    uint64_t m_frameNumber;
+
+    // server thread state
+    RawFrame m_encoding;
+    std::vector<Client> m_clients;
+    std::atomic<unsigned> m_clientCount;
+    std::atomic<uint64_t> m_dropped;
+};
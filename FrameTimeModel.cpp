@@ -0,0 +1,92 @@
+#include "FrameTimeModel.h"
+
+#include <algorithm>
+
+namespace
+{
+    void Smooth(double& value, double sample, double weight)
+    {
+        value += weight * (sample - value);
+    }
+}
+
+// Until calibrated: the old 700 ms overhead guess and a 115200 baud link
+FrameTimeModel::FrameTimeModel() :
+    m_latencyMs(0.0),
+    m_overheadMs(700.0),
+    m_bytesPerMs(11.52),
+    m_processingMs(0.0),
+    m_binningNsPerPixel(1.0)
+{
+}
+
+void FrameTimeModel::Calibrate(double latencyMs, double overheadMs, double throughputBytesPerSec)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    m_latencyMs = latencyMs;
+    m_overheadMs = overheadMs;
+    if (throughputBytesPerSec > 0.0)
+        m_bytesPerMs = throughputBytesPerSec / 1000.0;
+}
+
+/**
+* shotMs runs from sending sht to its confirmation, so whatever exceeds the
+* exposure is the device's fixed overhead.
+*/
+void FrameTimeModel::RecordShot(double exposureMs, double shotMs)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    Smooth(m_overheadMs, std::max(0.0, shotMs - exposureMs), SMOOTHING);
+}
+
+void FrameTimeModel::RecordTransfer(unsigned long bytes, double transferMs)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (bytes == 0 || transferMs <= m_latencyMs)
+        return;
+    Smooth(m_bytesPerMs, bytes / (transferMs - m_latencyMs), SMOOTHING);
+}
+
+void FrameTimeModel::RecordProcessing(double processingMs)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    Smooth(m_processingMs, processingMs, SMOOTHING);
+}
+
+void FrameTimeModel::RecordHostBinning(unsigned long pixels, double binningMs)
+{
+    if (pixels == 0)
+        return;
+
+    std::lock_guard<std::mutex> g(m_lock);
+    Smooth(m_binningNsPerPixel, binningMs * 1e6 / pixels, SMOOTHING);
+}
+
+double FrameTimeModel::PredictHostBinningMs(unsigned long pixels) const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return pixels * m_binningNsPerPixel / 1e6;
+}
+
+double FrameTimeModel::PredictReadoutMs(unsigned long bytes) const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_overheadMs + m_latencyMs + bytes / m_bytesPerMs;
+}
+
+double FrameTimeModel::PredictFrameMs(double exposureMs, unsigned long bytes, bool background) const
+{
+    const double readoutMs = PredictReadoutMs(bytes);
+    double processingMs;
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        processingMs = m_processingMs;
+    }
+    return exposureMs + readoutMs + processingMs + (background ? readoutMs : 0.0);
+}
+
+double FrameTimeModel::PredictFrameRate(double exposureMs, unsigned long bytes, bool background) const
+{
+    const double frameMs = PredictFrameMs(exposureMs, bytes, background);
+    return frameMs > 0.0 ? 1000.0 / frameMs : 0.0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <mutex>
+
+/**
+* Predicts how long a frame takes from the settings that shape it.
+*
+*   readout = shot overhead + latency + bytes / throughput
+*   frame   = exposure + readout + host processing
+*             (+ a zero exposure shot and readout for the background)
+*
+* The link calibration seeds the parameters; every acquired frame then
+* refines them with an exponential moving average of its measured stages,
+* so the prediction follows the link as it actually behaves. Host binning
+* is tracked as a cost per input pixel, to weigh it against device binning.
+*/
+class FrameTimeModel
+{
+public:
+    FrameTimeModel();
+
+    void Calibrate(double latencyMs, double overheadMs, double throughputBytesPerSec);
+
+    void RecordShot(double exposureMs, double shotMs);
+    void RecordTransfer(unsigned long bytes, double transferMs);
+    void RecordProcessing(double processingMs);
+    void RecordHostBinning(unsigned long pixels, double binningMs);
+
+    double PredictReadoutMs(unsigned long bytes) const;
+    double PredictHostBinningMs(unsigned long pixels) const;
+    double PredictFrameMs(double exposureMs, unsigned long bytes, bool background) const;
+    double PredictFrameRate(double exposureMs, unsigned long bytes, bool background) const;
+
+private:
+    static constexpr double SMOOTHING = 0.2;
+
+    mutable std::mutex m_lock;
+    double m_latencyMs;
+    double m_overheadMs;
+    double m_bytesPerMs;
+    double m_processingMs;
+    double m_binningNsPerPixel;
+};
@@ -0,0 +1,92 @@
+#include "HostBinning.h"
+
+#include <algorithm>
+
+namespace
+{
+    template <typename T>
+    void AccumulateRow(uint32_t* acc, const T* row, unsigned width)
+    {
+        for (unsigned x = 0; x < width; ++x)
+            acc[x] += row[x];
+    }
+
+    // Factor is the binning factor when it is known at compile time, 0 when
+    // it is only known at run time
+    template <unsigned Factor>
+    uint32_t SumGroup(const uint32_t* group, unsigned factor)
+    {
+        uint32_t sum = 0;
+        for (unsigned c = 0; c < (Factor ? Factor : factor); ++c)
+            sum += group[c];
+        return sum;
+    }
+
+    template <typename T, unsigned Factor>
+    void BinFrame(uint8_t* frame, unsigned width, unsigned height, unsigned factor,
+        HostBinning::Mode mode, uint32_t maxValue, uint32_t* acc)
+    {
+        if (Factor)
+            factor = Factor;
+        const T* src = reinterpret_cast<const T*>(frame);
+        T* dst = reinterpret_cast<T*>(frame);
+        const unsigned outWidth = width / factor;
+        const unsigned outHeight = height / factor;
+        const uint32_t count = factor * factor;
+
+        for (unsigned y = 0; y < outHeight; ++y)
+        {
+            std::fill(acc, acc + width, 0u);
+            for (unsigned r = 0; r < factor; ++r)
+                AccumulateRow(acc, src + static_cast<size_t>(y * factor + r) * width, width);
+
+            T* out = dst + static_cast<size_t>(y) * outWidth;
+            if (mode == HostBinning::Mode::Sum)
+            {
+                for (unsigned x = 0; x < outWidth; ++x)
+                    out[x] = static_cast<T>(std::min(SumGroup<Factor>(acc + x * factor, factor), maxValue));
+            }
+            else
+            {
+                for (unsigned x = 0; x < outWidth; ++x)
+                    out[x] = static_cast<T>((SumGroup<Factor>(acc + x * factor, factor) + count / 2) / count);
+            }
+        }
+    }
+
+    template <typename T>
+    void BinFrame(uint8_t* frame, unsigned width, unsigned height, unsigned factor,
+        HostBinning::Mode mode, uint32_t maxValue, uint32_t* acc)
+    {
+        switch (factor)
+        {
+        case 2:
+            BinFrame<T, 2>(frame, width, height, factor, mode, maxValue, acc);
+            break;
+        case 4:
+            BinFrame<T, 4>(frame, width, height, factor, mode, maxValue, acc);
+            break;
+        default:
+            BinFrame<T, 0>(frame, width, height, factor, mode, maxValue, acc);
+            break;
+        }
+    }
+}
+
+void HostBinning::Bin(uint8_t* frame, unsigned width, unsigned height, unsigned bytesPerPixel,
+    unsigned bitDepth, unsigned factor, Mode mode, std::vector<uint32_t>& scratch)
+{
+    if (factor <= 1)
+        return;
+
+    // only grows when the frame gets wider, not per frame
+    if (scratch.size() < width)
+        scratch.resize(width);
+
+    const unsigned bits = std::min(bitDepth, 8 * bytesPerPixel);
+    const uint32_t maxValue = (1u << bits) - 1;
+    if (bytesPerPixel == 2)
+        BinFrame<uint16_t>(frame, width, height, factor, mode, maxValue, scratch.data());
+    else
+        BinFrame<uint8_t>(frame, width, height, factor, mode, maxValue, scratch.data());
+}
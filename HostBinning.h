@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* Software binning on the host, for any integer factor.
+* Each output row is built by adding factor input rows into a 32 bit
+* accumulator row, then reducing each group of factor columns; factors 2
+* and 4 have their own reductions with the group size fixed. Sums
+* saturate at the largest value of bitDepth bits; averages round to
+* nearest.
+*
+* Binning works in place: output row y only overwrites data from input
+* rows before y * factor, which have already been consumed.
+*/
+namespace HostBinning
+{
+    enum class Mode
+    {
+        Sum,
+        Average,
+    };
+
+    void Bin(uint8_t* frame, unsigned width, unsigned height, unsigned bytesPerPixel,
+        unsigned bitDepth, unsigned factor, Mode mode, std::vector<uint32_t>& scratch);
+}
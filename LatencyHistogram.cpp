@@ -0,0 +1,101 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const double MIN_LATENCY_MS = 0.01;
+    // bucket width ratio, 1024 buckets of 2% span 10 us to about 1000 s
+    const double BUCKET_RATIO = 1.02;
+}
+
+LatencyHistogram::LatencyHistogram() :
+    m_count(0),
+    m_sumUs(0),
+    m_maxUs(0)
+{
+    for (auto& bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::BucketOf(double latencyMs)
+{
+    if (latencyMs <= MIN_LATENCY_MS)
+        return 0;
+    const double bucket = std::ceil(std::log(latencyMs / MIN_LATENCY_MS) / std::log(BUCKET_RATIO));
+    return std::min(static_cast<size_t>(bucket), BUCKETS - 1);
+}
+
+double LatencyHistogram::BucketUpperMs(size_t bucket)
+{
+    return MIN_LATENCY_MS * std::pow(BUCKET_RATIO, static_cast<double>(bucket));
+}
+
+void LatencyHistogram::Add(double latencyMs)
+{
+    const auto us = static_cast<uint64_t>(std::max(latencyMs, 0.0) * 1000.0);
+    m_buckets[BucketOf(latencyMs)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sumUs.fetch_add(us, std::memory_order_relaxed);
+
+    uint64_t max = m_maxUs.load(std::memory_order_relaxed);
+    while (us > max && !m_maxUs.compare_exchange_weak(max, us, std::memory_order_relaxed))
+        ;
+}
+
+/**
+* Not atomic as a whole; meant for the start of a run, before samples come in.
+*/
+void LatencyHistogram::Reset()
+{
+    for (auto& bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_relaxed);
+    m_sumUs.store(0, std::memory_order_relaxed);
+    m_maxUs.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetCount() const
+{
+    return m_count.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::GetSumMs() const
+{
+    return m_sumUs.load(std::memory_order_relaxed) / 1000.0;
+}
+
+double LatencyHistogram::GetMaxMs() const
+{
+    return m_maxUs.load(std::memory_order_relaxed) / 1000.0;
+}
+
+/**
+* Upper edge of the bucket holding the percentile, capped at the maximum.
+* Counts from the buckets themselves, so a sample added while reading
+* can't push the rank past the end.
+*/
+double LatencyHistogram::GetPercentileMs(double percentile) const
+{
+    std::array<uint64_t, BUCKETS> snapshot;
+    uint64_t count = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket)
+    {
+        snapshot[bucket] = m_buckets[bucket].load(std::memory_order_relaxed);
+        count += snapshot[bucket];
+    }
+    if (count == 0)
+        return 0.0;
+
+    const double maxMs = GetMaxMs();
+    const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * count)));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket)
+    {
+        seen += snapshot[bucket];
+        if (seen >= rank)
+            return std::min(BucketUpperMs(bucket), maxMs);
+    }
+    return maxMs;
+}
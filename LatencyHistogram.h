@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+* Lock-free latency histogram for the acquisition hot path.
+* Buckets are log-spaced about 2% apart from 10 us to about 1000 s, so
+* percentiles keep that relative precision over any number of samples in
+* constant memory. Add() is a few relaxed atomic increments; readers on
+* other threads see a consistent enough snapshot for monitoring, never a
+* torn value.
+*/
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void Add(double latencyMs);
+    void Reset();
+
+    uint64_t GetCount() const;
+    double GetSumMs() const;
+    double GetMaxMs() const;
+    double GetPercentileMs(double percentile) const;
+
+private:
+    static const size_t BUCKETS = 1024;
+
+    static size_t BucketOf(double latencyMs);
+    static double BucketUpperMs(size_t bucket);
+
+    std::array<std::atomic<uint64_t>, BUCKETS> m_buckets;
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sumUs;
+    std::atomic<uint64_t> m_maxUs;
+};
@@ -0,0 +1,263 @@
+#include "MetricsExporter.h"
+#include "LatencyHistogram.h"
+#include "ThreadScheduling.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const intptr_t INVALID_SOCK = -1;
+    const char* UNIX_PREFIX = "unix:";
+
+    const double SUMMARY_QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    std::string FormatValue(double value)
+    {
+        if (std::isnan(value))
+            return "NaN";
+        if (std::isinf(value))
+            return value > 0 ? "+Inf" : "-Inf";
+        return std::format("{}", value);
+    }
+}
+
+PrometheusText::PrometheusText(const std::string& commonLabels) :
+    m_commonLabels(commonLabels)
+{
+}
+
+/**
+* Formats name="value" with the value escaped as the format requires.
+*/
+std::string PrometheusText::Label(const std::string& name, const std::string& value)
+{
+    std::string escaped;
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+            escaped += '\\';
+        if (c == '\n')
+        {
+            escaped += "\\n";
+            continue;
+        }
+        escaped += c;
+    }
+    return std::format("{}=\"{}\"", name, escaped);
+}
+
+void PrometheusText::Header(const std::string& name, const std::string& help, const char* type)
+{
+    if (!m_described.insert(name).second)
+        return;
+    m_text += std::format("# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+}
+
+void PrometheusText::Sample(const std::string& name, const std::string& labels, double value)
+{
+    std::string all = m_commonLabels;
+    if (!labels.empty())
+        all += (all.empty() ? "" : ",") + labels;
+    m_text += all.empty() ? std::format("{} {}\n", name, FormatValue(value))
+        : std::format("{}{{{}}} {}\n", name, all, FormatValue(value));
+}
+
+void PrometheusText::Counter(const std::string& name, const std::string& help, double value, const std::string& labels)
+{
+    Header(name, help, "counter");
+    Sample(name, labels, value);
+}
+
+void PrometheusText::Gauge(const std::string& name, const std::string& help, double value, const std::string& labels)
+{
+    Header(name, help, "gauge");
+    Sample(name, labels, value);
+}
+
+void PrometheusText::Summary(const std::string& name, const std::string& help, const LatencyHistogram& histogram,
+    const std::string& labels)
+{
+    Header(name, help, "summary");
+    for (double quantile : SUMMARY_QUANTILES)
+    {
+        const std::string q = Label("quantile", std::format("{}", quantile));
+        Sample(name, labels.empty() ? q : labels + "," + q, histogram.GetPercentileMs(quantile * 100.0));
+    }
+    Sample(name + "_sum", labels, histogram.GetSumMs());
+    Sample(name + "_count", labels, static_cast<double>(histogram.GetCount()));
+}
+
+MetricsExporter::MetricsExporter() :
+    m_listenSocket(INVALID_SOCK),
+    m_intervalS(5.0),
+    m_running(false),
+    m_exports(0),
+    m_failures(0)
+{
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    Stop();
+}
+
+/**
+* Starts exporting to target, a file path or "unix:/path".
+*/
+bool MetricsExporter::Start(const std::string& target, double intervalS, Collector collect)
+{
+    Stop();
+    if (target.empty() || !collect)
+        return false;
+
+    if (target.rfind(UNIX_PREFIX, 0) == 0)
+    {
+#ifdef _WIN32
+        return false;
+#else
+        const std::string path = target.substr(std::strlen(UNIX_PREFIX));
+        sockaddr_un addr{};
+        if (path.empty() || path.size() >= sizeof(addr.sun_path))
+            return false;
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, path.c_str());
+        unlink(path.c_str());
+
+        const int s = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s < 0)
+            return false;
+        const int flags = fcntl(s, F_GETFL, 0);
+        if (bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(s, 8) != 0
+            || flags < 0 || fcntl(s, F_SETFL, flags | O_NONBLOCK) != 0)
+        {
+            close(s);
+            return false;
+        }
+        m_listenSocket = s;
+        m_path = path;
+#endif
+    }
+    else
+    {
+        m_path = target;
+    }
+
+    m_intervalS = intervalS;
+    m_collect = std::move(collect);
+    m_exports = 0;
+    m_failures = 0;
+    m_running = true;
+    m_thread = std::thread(&MetricsExporter::ExportLoop, this);
+    return true;
+}
+
+void MetricsExporter::Stop()
+{
+    if (!m_thread.joinable())
+        return;
+
+    m_running = false;
+    m_thread.join();
+
+#ifndef _WIN32
+    if (m_listenSocket != INVALID_SOCK)
+    {
+        close(static_cast<int>(m_listenSocket));
+        unlink(m_path.c_str());
+    }
+#endif
+    m_listenSocket = INVALID_SOCK;
+    m_path.clear();
+    m_collect = nullptr;
+}
+
+/**
+* Collects a snapshot every interval. Socket clients are served between
+* snapshots with the latest one.
+*/
+void MetricsExporter::ExportLoop()
+{
+    ThreadPolicy policy;
+    policy.schedClass = ThreadPolicy::Class::Low;
+    std::string error;
+    ApplyThreadPolicy(policy, error);
+
+    const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(m_intervalS));
+    auto next = std::chrono::steady_clock::now();
+    std::string snapshot;
+    while (m_running)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= next)
+        {
+            next = now + interval;
+            snapshot = m_collect();
+            if (m_listenSocket != INVALID_SOCK || WriteFile(snapshot))
+                ++m_exports;
+            else
+                ++m_failures;
+        }
+
+        if (m_listenSocket != INVALID_SOCK)
+            ServeClients(snapshot);
+        std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+    }
+}
+
+bool MetricsExporter::WriteFile(const std::string& text)
+{
+    const std::string temp = m_path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out.write(text.data(), text.size()))
+            return false;
+    }
+#ifdef _WIN32
+    // rename doesn't replace an existing file on Windows
+    return MoveFileExA(temp.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(temp.c_str(), m_path.c_str()) == 0;
+#endif
+}
+
+/**
+* Hands the snapshot to every waiting client. A snapshot is a few kB and
+* fits in the socket buffer, so the send doesn't wait on a slow reader.
+*/
+void MetricsExporter::ServeClients(const std::string& text)
+{
+#ifndef _WIN32
+    for (;;)
+    {
+        const int client = accept(static_cast<int>(m_listenSocket), nullptr, nullptr);
+        if (client < 0)
+            return;
+
+        const int flags = fcntl(client, F_GETFL, 0);
+        if (flags >= 0)
+            fcntl(client, F_SETFL, flags | O_NONBLOCK);
+#ifdef MSG_NOSIGNAL
+        send(client, text.data(), text.size(), MSG_NOSIGNAL);
+#else
+        send(client, text.data(), text.size(), 0);
+#endif
+        close(client);
+    }
+#endif
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <thread>
+
+class LatencyHistogram;
+
+/**
+* Builds a snapshot in the Prometheus text exposition format.
+* Every sample carries the common labels given to the constructor; the
+* HELP and TYPE lines are written once per metric name.
+*/
+class PrometheusText
+{
+public:
+    explicit PrometheusText(const std::string& commonLabels);
+
+    void Counter(const std::string& name, const std::string& help, double value, const std::string& labels = "");
+    void Gauge(const std::string& name, const std::string& help, double value, const std::string& labels = "");
+    void Summary(const std::string& name, const std::string& help, const LatencyHistogram& histogram,
+        const std::string& labels = "");
+
+    const std::string& Text() const { return m_text; }
+
+    static std::string Label(const std::string& name, const std::string& value);
+
+private:
+    void Header(const std::string& name, const std::string& help, const char* type);
+    void Sample(const std::string& name, const std::string& labels, double value);
+
+    std::string m_commonLabels;
+    std::set<std::string> m_described;
+    std::string m_text;
+};
+
+/**
+* Publishes metrics snapshots from its own low priority thread.
+* Every interval the thread calls the collector and publishes the text:
+* - to a file: written to a temporary file and renamed over the target, so
+*   a reader (node_exporter's textfile collector, say) never sees half a
+*   snapshot;
+* - to "unix:/path" on POSIX: a Unix domain socket that sends the latest
+*   snapshot to every client that connects, then closes the connection.
+* The collector runs on the exporter thread, so it must only read state
+* the acquisition publishes without locks.
+*/
+class MetricsExporter
+{
+public:
+    using Collector = std::function<std::string()>;
+
+    MetricsExporter();
+    ~MetricsExporter();
+
+    bool Start(const std::string& target, double intervalS, Collector collect);
+    void Stop();
+    bool IsRunning() const { return m_running; }
+
+    uint64_t GetExports() const { return m_exports; }
+    uint64_t GetFailures() const { return m_failures; }
+
+private:
+    static constexpr int POLL_INTERVAL_MS = 50;
+
+    void ExportLoop();
+    bool WriteFile(const std::string& text);
+    void ServeClients(const std::string& text);
+
+    std::string m_path;
+    intptr_t m_listenSocket;
+    double m_intervalS;
+    Collector m_collect;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<uint64_t> m_exports;
+    std::atomic<uint64_t> m_failures;
+};
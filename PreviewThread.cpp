@@ -0,0 +1,45 @@
+#include "AbiCamera.h"
+
+PreviewThread::PreviewThread(AbiCamera* pCam)
+	:m_camera(pCam),
+	m_stop(true),
+	m_refreshMs(250.0)
+{};
+
+PreviewThread::~PreviewThread() {};
+
+void PreviewThread::Stop() {
+	m_stop = true;
+}
+
+void PreviewThread::Start(double refreshMs)
+{
+	m_refreshMs = refreshMs;
+	m_stop = false;
+	activate();
+}
+
+bool PreviewThread::IsStopped() {
+	return m_stop;
+}
+
+/**
+* Publishes the rows received so far every refresh interval.
+* Sleeps in short steps so Stop() doesn't wait a whole interval.
+*/
+int PreviewThread::svc(void) throw()
+{
+	auto next = std::chrono::steady_clock::now();
+	while (!m_stop)
+	{
+		CDeviceUtils::SleepMs(STOP_POLL_MS);
+
+		const auto now = std::chrono::steady_clock::now();
+		if (now < next)
+			continue;
+		next = now + std::chrono::microseconds(static_cast<long long>(m_refreshMs * 1000.0));
+
+		m_camera->PublishPartialFrame();
+	}
+	return DEVICE_OK;
+}
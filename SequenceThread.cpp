@@ -1,11 +1,12 @@
 #include "AbiCamera.h"
 
 SequenceThread::SequenceThread(AbiCamera* pCam)
-	:m_intervalMs(100.0),
+	:m_camera(pCam),
+	m_stop(true),
+	m_stopOnOverflow(false),
 	m_numImages(0),
 	m_imageCounter(0),
-	m_stop(true),
-	m_camera(pCam)
+	m_intervalMs(100.0)
 {};
 
 SequenceThread::~SequenceThread() {};
@@ -14,8 +15,9 @@ void SequenceThread::Stop() {
 	m_stop = true;
 }
 
-void SequenceThread::Start(long numImages, double intervalMs)
+void SequenceThread::Start(long numImages, double intervalMs, bool stopOnOverflow)
 {
+	m_stopOnOverflow = stopOnOverflow;
 	m_numImages = numImages;
 	m_intervalMs = intervalMs;
 	m_imageCounter = 0;
@@ -27,8 +29,55 @@ bool SequenceThread::IsStopped() {
 	return m_stop;
 }
 
+/**
+* Acquisition loop: applies settings queued since the last frame, snaps,
+* inserts into the core and waits out the rest of the interval.
+*/
 int SequenceThread::svc(void) throw()
 {
 	int ret = DEVICE_ERR;
+	m_camera->ApplyReaderPolicy();
+	try
+	{
+		while (!m_stop && m_imageCounter < m_numImages)
+		{
+			const auto frameStart = std::chrono::steady_clock::now();
+
+			ret = m_camera->ApplyPendingSettings();
+			if (ret != DEVICE_OK)
+				break;
+
+			ret = m_camera->SnapImage();
+			if (ret != DEVICE_OK)
+			{
+				// a triggered wait gives up when the sequence is stopped
+				if (m_stop)
+					ret = DEVICE_OK;
+				break;
+			}
+
+			ret = m_camera->InsertImage();
+			if (ret != DEVICE_OK)
+				break;
+
+			++m_imageCounter;
+			m_camera->RecordDelivery();
+
+			const auto frameEnd = frameStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double, std::milli>(m_intervalMs));
+			if (!m_stop && std::chrono::steady_clock::now() < frameEnd)
+				m_camera->SleepUntil(frameEnd);
+		}
+	}
+	catch (...)
+	{
+		m_camera->LogMessage("Exception in the sequence thread", false);
+	}
+
+	if (ret != DEVICE_OK)
+		m_camera->LogMessageCode(ret, true);
+
+	m_stop = true;
+	m_camera->OnThreadExiting(ret == DEVICE_BUFFER_OVERFLOW ? ret : DEVICE_OK);
 	return ret;
 }
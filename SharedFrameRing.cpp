@@ -0,0 +1,187 @@
+#include "SharedFrameRing.h"
+
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace SharedFrameRingLayout;
+
+namespace
+{
+    size_t AlignUp(size_t v, size_t a)
+    {
+        return (v + a - 1) / a * a;
+    }
+}
+
+SharedFrameRing::SharedFrameRing() :
+    m_header(nullptr),
+    m_size(0),
+    m_frameNumber(0),
+#ifdef _WIN32
+    m_mapping(nullptr)
+#else
+    m_fd(-1)
+#endif
+{
+}
+
+SharedFrameRing::~SharedFrameRing()
+{
+    Destroy();
+}
+
+/**
+* Creates (or recreates) the named region and initializes the header.
+* maxFrameBytes should be the largest frame of any configuration, so the
+* ring does not have to be recreated when binning or ROI change.
+*/
+bool SharedFrameRing::Create(const std::string& name, unsigned slotCount, size_t maxFrameBytes)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    Unmap();
+    if (slotCount == 0 || name.empty())
+        return false;
+
+    const size_t stride = AlignUp(SLOT_DATA_OFFSET + maxFrameBytes, 64);
+    const size_t size = sizeof(RingHeader) + stride * slotCount;
+
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), name.c_str());
+    if (!mapping)
+        return false;
+    void* mem = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!mem)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    m_mapping = mapping;
+#else
+    // POSIX shared memory names must start with a single slash
+    m_name = name[0] == '/' ? name : "/" + name;
+    shm_unlink(m_name.c_str());
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        return false;
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        close(fd);
+        shm_unlink(m_name.c_str());
+        return false;
+    }
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED)
+    {
+        close(fd);
+        shm_unlink(m_name.c_str());
+        return false;
+    }
+    m_fd = fd;
+#endif
+
+    std::memset(mem, 0, size);
+    m_header = new (mem) RingHeader();
+    m_header->magic = MAGIC;
+    m_header->version = VERSION;
+    m_header->slotCount = slotCount;
+    m_header->slotStride = stride;
+    m_header->maxFrameBytes = maxFrameBytes;
+    for (unsigned i = 0; i < slotCount; ++i)
+        new (Slot(i)) SlotHeader();
+    m_header->published.store(0, std::memory_order_release);
+
+#ifdef _WIN32
+    m_name = name;
+#endif
+    m_size = size;
+    m_frameNumber = 0;
+    return true;
+}
+
+void SharedFrameRing::Destroy()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    Unmap();
+}
+
+bool SharedFrameRing::IsOpen() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_header != nullptr;
+}
+
+void SharedFrameRing::Unmap()
+{
+    if (!m_header)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_header);
+    CloseHandle(static_cast<HANDLE>(m_mapping));
+    m_mapping = nullptr;
+#else
+    munmap(m_header, m_size);
+    close(m_fd);
+    shm_unlink(m_name.c_str());
+    m_fd = -1;
+#endif
+    m_header = nullptr;
+    m_size = 0;
+}
+
+/**
+* Copies the frame into the next slot and publishes it.
+* Never waits for consumers; a consumer that is more than slotCount frames
+* behind sees the sequence change under it and skips ahead.
+*/
+bool SharedFrameRing::Publish(const uint8_t* pixels, unsigned width, unsigned height,
+    unsigned bytesPerPixel, unsigned bitDepth, uint64_t timestampUs)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_header)
+        return false;
+
+    const size_t dataSize = static_cast<size_t>(width) * height * bytesPerPixel;
+    if (dataSize > m_header->maxFrameBytes)
+        return false;
+
+    const uint64_t n = m_frameNumber++;
+    SlotHeader* slot = Slot(n % m_header->slotCount);
+
+    slot->seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->frameNumber = n;
+    slot->timestampUs = timestampUs;
+    slot->width = width;
+    slot->height = height;
+    slot->bytesPerPixel = bytesPerPixel;
+    slot->bitDepth = bitDepth;
+    slot->dataSize = dataSize;
+    std::memcpy(reinterpret_cast<uint8_t*>(slot) + SLOT_DATA_OFFSET, pixels, dataSize);
+
+    slot->seq.store(2 * (n + 1), std::memory_order_release);
+    m_header->published.store(n + 1, std::memory_order_release);
+    return true;
+}
+
+uint64_t SharedFrameRing::GetPublished() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_header ? m_header->published.load(std::memory_order_relaxed) : 0;
+}
+
+SlotHeader* SharedFrameRing::Slot(uint64_t index) const
+{
+    return reinterpret_cast<SlotHeader*>(reinterpret_cast<uint8_t*>(m_header)
+        + sizeof(RingHeader) + index * m_header->slotStride);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/**
+* Layout of the shared-memory frame ring, shared with external consumers.
+*
+* The region starts with a RingHeader followed by slotCount slots of
+* slotStride bytes each. A slot is a SlotHeader followed by the pixels at
+* SLOT_DATA_OFFSET. Publication is lock-free: the producer makes the slot's
+* seq odd while it writes, then stores the even value 2 * (frameNumber + 1)
+* and bumps the ring's published counter. A consumer reads seq, uses the
+* pixels in place and reads seq again; the frame is valid if both reads are
+* equal and even. Tools/SharedRingReader is a consumer that does so.
+*/
+namespace SharedFrameRingLayout
+{
+    const uint32_t MAGIC = 0x52494241; // "ABIR"
+    const uint32_t VERSION = 1;
+    const size_t SLOT_DATA_OFFSET = 64;
+
+    struct alignas(64) RingHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slotCount;
+        uint32_t reserved;
+        uint64_t slotStride;
+        uint64_t maxFrameBytes;
+        std::atomic<uint64_t> published;
+    };
+
+    struct alignas(64) SlotHeader
+    {
+        std::atomic<uint64_t> seq;
+        uint64_t frameNumber;
+        uint64_t timestampUs;
+        uint32_t width;
+        uint32_t height;
+        uint32_t bytesPerPixel;
+        uint32_t bitDepth;
+        uint64_t dataSize;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring counters must be lock-free");
+    static_assert(sizeof(SlotHeader) <= SLOT_DATA_OFFSET, "slot header overlaps pixel data");
+}
+
+/**
+* Producer side of the shared-memory frame ring.
+* Uses POSIX shm_open/mmap, or a named file mapping on Windows. Consumers
+* map the same name read-only.
+*
+* Create and Destroy may be called while another thread publishes; they
+* wait for a Publish in progress, so the region is never unmapped under it.
+*/
+class SharedFrameRing
+{
+public:
+    SharedFrameRing();
+    ~SharedFrameRing();
+
+    bool Create(const std::string& name, unsigned slotCount, size_t maxFrameBytes);
+    void Destroy();
+    bool IsOpen() const;
+
+    bool Publish(const uint8_t* pixels, unsigned width, unsigned height,
+        unsigned bytesPerPixel, unsigned bitDepth, uint64_t timestampUs);
+
+    uint64_t GetPublished() const;
+    const std::string& GetName() const { return m_name; }
+
+private:
+    void Unmap();
+    SharedFrameRingLayout::SlotHeader* Slot(uint64_t index) const;
+
+    mutable std::mutex m_lock;  // guards the mapping
+
+    std::string m_name;
+    SharedFrameRingLayout::RingHeader* m_header;
+    size_t m_size;
+    uint64_t m_frameNumber;
+#ifdef _WIN32
+    void* m_mapping;
+#else
+    int m_fd;
+#endif
+};
@@ -0,0 +1,196 @@
+#include "SoakMonitor.h"
+
+#include <format>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#pragma comment(lib, "Psapi.lib")
+#else
+#include <fstream>
+#endif
+
+SoakMonitor::SoakMonitor(double sampleIntervalS) :
+    m_start(Clock::now()),
+    m_lastSample(),
+    m_lastReport(m_start),
+    m_sampleIntervalS(sampleIntervalS),
+    m_threads(0)
+{
+}
+
+void SoakMonitor::Reset()
+{
+    m_latency.Reset();
+
+    std::lock_guard<std::mutex> g(m_lock);
+    m_start = Clock::now();
+    m_lastSample = Clock::time_point();
+    m_lastReport = m_start;
+    m_samples.clear();
+}
+
+void SoakMonitor::RecordFrame(double latencyMs)
+{
+    m_latency.Add(latencyMs);
+}
+
+/**
+* Samples memory and threads if the sample interval has passed since the
+* last sample. Returns whether it sampled.
+*/
+bool SoakMonitor::SampleProcess(Clock::time_point now)
+{
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        if (m_lastSample != Clock::time_point() &&
+            std::chrono::duration<double>(now - m_lastSample).count() < m_sampleIntervalS)
+            return false;
+        m_lastSample = now;
+    }
+
+    size_t rssBytes = 0;
+    unsigned threads = 0;
+    if (!ReadProcessStats(rssBytes, threads))
+        return false;
+
+    std::lock_guard<std::mutex> g(m_lock);
+    // a run longer than the sample buffer keeps every other sample
+    if (m_samples.size() == MAX_PROCESS_SAMPLES)
+    {
+        for (size_t i = 0; i < MAX_PROCESS_SAMPLES / 2; ++i)
+            m_samples[i] = m_samples[2 * i];
+        m_samples.resize(MAX_PROCESS_SAMPLES / 2);
+        m_sampleIntervalS *= 2.0;
+    }
+    m_samples.push_back({ std::chrono::duration<double>(now - m_start).count() / 3600.0,
+        rssBytes / (1024.0 * 1024.0) });
+    m_threads = threads;
+    return true;
+}
+
+/**
+* True once per intervalS since the run started, for periodic summaries.
+*/
+bool SoakMonitor::ReportDue(Clock::time_point now, double intervalS)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (std::chrono::duration<double>(now - m_lastReport).count() < intervalS)
+        return false;
+    m_lastReport = now;
+    return true;
+}
+
+unsigned long long SoakMonitor::GetFrames() const
+{
+    return m_latency.GetCount();
+}
+
+double SoakMonitor::GetLatencyPercentileMs(double percentile) const
+{
+    return m_latency.GetPercentileMs(percentile);
+}
+
+double SoakMonitor::GetLatencyMaxMs() const
+{
+    return m_latency.GetMaxMs();
+}
+
+double SoakMonitor::GetRssMB() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_samples.empty() ? 0.0 : m_samples.back().rssMB;
+}
+
+double SoakMonitor::GetRssTrendMBPerHour() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    const size_t n = m_samples.size();
+    if (n < 2)
+        return 0.0;
+
+    double meanT = 0.0;
+    double meanM = 0.0;
+    for (const auto& s : m_samples)
+    {
+        meanT += s.hours;
+        meanM += s.rssMB;
+    }
+    meanT /= n;
+    meanM /= n;
+
+    double sTT = 0.0;
+    double sTM = 0.0;
+    for (const auto& s : m_samples)
+    {
+        sTT += (s.hours - meanT) * (s.hours - meanT);
+        sTM += (s.hours - meanT) * (s.rssMB - meanM);
+    }
+    return sTT > 0.0 ? sTM / sTT : 0.0;
+}
+
+unsigned SoakMonitor::GetThreads() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_threads;
+}
+
+std::string SoakMonitor::GetSummary() const
+{
+    return std::format("{} frames, latency p50 {:.2f} ms p99 {:.2f} ms p99.9 {:.2f} ms max {:.2f} ms, "
+        "RSS {:.1f} MB trend {:+.2f} MB/h, {} threads",
+        m_latency.GetCount(), m_latency.GetPercentileMs(50.0), m_latency.GetPercentileMs(99.0),
+        m_latency.GetPercentileMs(99.9), m_latency.GetMaxMs(), GetRssMB(), GetRssTrendMBPerHour(), GetThreads());
+}
+
+bool SoakMonitor::ReadProcessStats(size_t& rssBytes, unsigned& threads)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return false;
+    rssBytes = counters.WorkingSetSize;
+
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot == INVALID_HANDLE_VALUE)
+        return false;
+    threads = 0;
+    const DWORD pid = GetCurrentProcessId();
+    THREADENTRY32 entry{};
+    entry.dwSize = sizeof(entry);
+    for (BOOL more = Thread32First(snapshot, &entry); more; more = Thread32Next(snapshot, &entry))
+    {
+        if (entry.th32OwnerProcessID == pid)
+            ++threads;
+    }
+    CloseHandle(snapshot);
+    return true;
+#else
+    std::ifstream status("/proc/self/status");
+    if (!status)
+        return false;
+
+    bool haveRss = false;
+    bool haveThreads = false;
+    std::string key;
+    while (status >> key)
+    {
+        if (key == "VmRSS:")
+        {
+            size_t kB = 0;
+            status >> kB;
+            rssBytes = kB * 1024;
+            haveRss = true;
+        }
+        else if (key == "Threads:")
+        {
+            status >> threads;
+            haveThreads = true;
+        }
+        status.ignore(256, '\n');
+    }
+    return haveRss && haveThreads;
+#endif
+}
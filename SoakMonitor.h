@@ -0,0 +1,62 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+* Long-run health of an acquisition: the latency distribution of delivered
+* frames and the growth of the process over time.
+* Latencies go into a lock-free LatencyHistogram, so tail percentiles like
+* p99.9 cost constant memory over any number of frames and recording one
+* never waits for a reader. The resident set size and the thread count are
+* sampled at most once per sample interval; the memory trend is the least
+* squares slope of those samples, so a steady per-frame leak shows up as a
+* positive MB/h long before it runs the machine out of memory.
+*/
+class SoakMonitor
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit SoakMonitor(double sampleIntervalS = 10.0);
+
+    void Reset();
+    void RecordFrame(double latencyMs);
+    bool SampleProcess(Clock::time_point now);
+    bool ReportDue(Clock::time_point now, double intervalS);
+
+    unsigned long long GetFrames() const;
+    const LatencyHistogram& GetLatency() const { return m_latency; }
+    double GetLatencyPercentileMs(double percentile) const;
+    double GetLatencyMaxMs() const;
+    double GetRssMB() const;
+    double GetRssTrendMBPerHour() const;
+    unsigned GetThreads() const;
+    std::string GetSummary() const;
+
+    static bool ReadProcessStats(size_t& rssBytes, unsigned& threads);
+
+private:
+    static const size_t MAX_PROCESS_SAMPLES = 4096;
+
+    struct ProcessSample
+    {
+        double hours;
+        double rssMB;
+    };
+
+    LatencyHistogram m_latency;
+
+    mutable std::mutex m_lock;
+    Clock::time_point m_start;
+    Clock::time_point m_lastSample;
+    Clock::time_point m_lastReport;
+    double m_sampleIntervalS;
+    std::vector<ProcessSample> m_samples;
+    unsigned m_threads;
+};
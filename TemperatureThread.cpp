@@ -0,0 +1,47 @@
+#include "AbiCamera.h"
+
+TemperatureThread::TemperatureThread(AbiCamera* pCam)
+	:m_camera(pCam),
+	m_stop(true),
+	m_intervalMs(1000.0)
+{};
+
+TemperatureThread::~TemperatureThread() {};
+
+void TemperatureThread::Stop() {
+	m_stop = true;
+}
+
+void TemperatureThread::Start(double intervalMs)
+{
+	m_intervalMs = intervalMs;
+	m_stop = false;
+	activate();
+}
+
+bool TemperatureThread::IsStopped() {
+	return m_stop;
+}
+
+/**
+* Samples the sensor temperature, and the process health during a
+* sequence, every interval.
+* Sleeps in short steps so Stop() doesn't wait a whole interval.
+*/
+int TemperatureThread::svc(void) throw()
+{
+	auto next = std::chrono::steady_clock::now();
+	while (!m_stop)
+	{
+		CDeviceUtils::SleepMs(STOP_POLL_MS);
+
+		const auto now = std::chrono::steady_clock::now();
+		if (now < next)
+			continue;
+		next = now + std::chrono::microseconds(static_cast<long long>(m_intervalMs * 1000.0));
+
+		m_camera->SampleTemperature();
+		m_camera->SampleHealth();
+	}
+	return DEVICE_OK;
+}
@@ -0,0 +1,131 @@
+#include "TemperatureTracker.h"
+
+#include <algorithm>
+#include <format>
+
+TemperatureTracker::TemperatureTracker(size_t capacity) :
+    m_samples(std::max<size_t>(capacity, 2)),
+    m_next(0),
+    m_count(0),
+    m_toleranceC(0.5),
+    m_windowS(60.0)
+{
+}
+
+void TemperatureTracker::Configure(double toleranceC, double windowS)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    m_toleranceC = toleranceC;
+    m_windowS = windowS;
+}
+
+void TemperatureTracker::Add(Clock::time_point t, double tempC)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    m_samples[m_next] = { t, tempC };
+    m_next = (m_next + 1) % m_samples.size();
+    m_count = std::min(m_count + 1, m_samples.size());
+}
+
+void TemperatureTracker::Clear()
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    m_next = 0;
+    m_count = 0;
+}
+
+bool TemperatureTracker::IsStable() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    const size_t n = WindowSamples();
+    if (n < 2)
+        return false;
+
+    // the oldest sample in the window must reach back a full window
+    const double coveredS = std::chrono::duration<double>(At(0).t - At(n - 1).t).count();
+    if (n == m_count && coveredS < m_windowS)
+        return false;
+
+    double lo = At(0).tempC, hi = lo;
+    for (size_t i = 1; i < n; ++i)
+    {
+        lo = std::min(lo, At(i).tempC);
+        hi = std::max(hi, At(i).tempC);
+    }
+    return hi - lo <= 2.0 * m_toleranceC;
+}
+
+double TemperatureTracker::GetRatePerMin() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    const size_t n = WindowSamples();
+    if (n < 2)
+        return 0.0;
+
+    const Clock::time_point t0 = At(0).t;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        const double x = std::chrono::duration<double>(At(i).t - t0).count() / 60.0;
+        const double y = At(i).tempC;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    const double d = n * sxx - sx * sx;
+    return d != 0.0 ? (n * sxy - sx * sy) / d : 0.0;
+}
+
+double TemperatureTracker::GetToleranceC() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_toleranceC;
+}
+
+double TemperatureTracker::GetWindowS() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_windowS;
+}
+
+/**
+* The newest samples, oldest first, as "seconds:temperature" pairs
+* separated by ';' with times relative to the newest sample.
+*/
+std::string TemperatureTracker::GetHistory(size_t maxSamples) const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    const size_t n = std::min(maxSamples, m_count);
+    std::string out;
+    for (size_t i = n; i-- > 0;)
+    {
+        const double ageS = std::chrono::duration<double>(At(i).t - At(0).t).count();
+        out += std::format("{}{:.1f}:{:.2f}", out.empty() ? "" : ";", ageS, At(i).tempC);
+    }
+    return out;
+}
+
+/**
+* Sample age steps back from the newest one (age 0).
+*/
+const TemperatureTracker::Sample& TemperatureTracker::At(size_t age) const
+{
+    return m_samples[(m_next + m_samples.size() - 1 - age) % m_samples.size()];
+}
+
+/**
+* Number of newest samples that fall inside the window, plus the first one
+* before it so the window is measured across its whole length.
+*/
+size_t TemperatureTracker::WindowSamples() const
+{
+    if (m_count == 0)
+        return 0;
+
+    const Clock::time_point newest = At(0).t;
+    size_t n = 1;
+    while (n < m_count && std::chrono::duration<double>(newest - At(n).t).count() <= m_windowS)
+        ++n;
+    return std::min(n + 1, m_count);
+}
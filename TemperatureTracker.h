@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+* Ring buffer of sensor temperature samples with settling detection.
+* The sensor counts as stable once the samples of the last window stay
+* within +-tolerance of each other and the window is fully covered, so a
+* single quiet reading right after switching the cooler on doesn't count.
+* The rate of change is the least squares slope over the same window.
+*/
+class TemperatureTracker
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TemperatureTracker(size_t capacity = 3600);
+
+    void Configure(double toleranceC, double windowS);
+    void Add(Clock::time_point t, double tempC);
+    void Clear();
+
+    bool IsStable() const;
+    double GetRatePerMin() const;
+    double GetToleranceC() const;
+    double GetWindowS() const;
+    std::string GetHistory(size_t maxSamples) const;
+
+private:
+    struct Sample
+    {
+        Clock::time_point t;
+        double tempC;
+    };
+
+    const Sample& At(size_t age) const;
+    size_t WindowSamples() const;
+
+    mutable std::mutex m_lock;
+    std::vector<Sample> m_samples;
+    size_t m_next;
+    size_t m_count;
+    double m_toleranceC;
+    double m_windowS;
+};
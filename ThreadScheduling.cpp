@@ -0,0 +1,218 @@
+#include "ThreadScheduling.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <sstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const int MAX_CPUS = 64;
+
+    const char* g_ClassNames[] = { "Low", "Normal", "High", "Real-Time" };
+}
+
+bool ThreadPolicy::ParseClass(const std::string& name, Class& schedClass)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        if (name == g_ClassNames[i])
+        {
+            schedClass = static_cast<Class>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* ThreadPolicy::ClassName(Class schedClass)
+{
+    return g_ClassNames[static_cast<int>(schedClass)];
+}
+
+/**
+* Parses a CPU list like "2" or "0,4-7". An empty list is an empty mask.
+*/
+bool ThreadPolicy::ParseCpuList(const std::string& list, uint64_t& mask)
+{
+    uint64_t parsed = 0;
+    std::istringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ','))
+    {
+        item.erase(std::remove(item.begin(), item.end(), ' '), item.end());
+        if (item.empty())
+            continue;
+
+        int first = 0;
+        int last = 0;
+        char dash = 0;
+        std::istringstream range(item);
+        if (!(range >> first))
+            return false;
+        last = first;
+        if (range >> dash && (dash != '-' || !(range >> last)))
+            return false;
+        if (first < 0 || last < first || last >= MAX_CPUS)
+            return false;
+
+        for (int cpu = first; cpu <= last; ++cpu)
+            parsed |= uint64_t(1) << cpu;
+    }
+    mask = parsed;
+    return true;
+}
+
+std::string ThreadPolicy::FormatCpuList(uint64_t mask)
+{
+    std::string list;
+    for (int cpu = 0; cpu < MAX_CPUS; ++cpu)
+    {
+        if (!(mask >> cpu & 1))
+            continue;
+        int last = cpu;
+        while (last + 1 < MAX_CPUS && (mask >> (last + 1) & 1))
+            ++last;
+
+        if (!list.empty())
+            list += ",";
+        list += last == cpu ? std::to_string(cpu) : std::format("{}-{}", cpu, last);
+        cpu = last;
+    }
+    return list;
+}
+
+bool ApplyThreadPolicy(const ThreadPolicy& policy, std::string& error)
+{
+    error.clear();
+#ifdef _WIN32
+    int priority = THREAD_PRIORITY_NORMAL;
+    if (policy.schedClass == ThreadPolicy::Class::Low)
+        priority = THREAD_PRIORITY_LOWEST;
+    else if (policy.schedClass == ThreadPolicy::Class::High)
+        priority = THREAD_PRIORITY_HIGHEST;
+    else if (policy.schedClass == ThreadPolicy::Class::RealTime)
+        priority = THREAD_PRIORITY_TIME_CRITICAL;
+    if (!SetThreadPriority(GetCurrentThread(), priority))
+        error = std::format("SetThreadPriority failed ({})", GetLastError());
+
+    // an empty mask gives the thread every CPU the process may use back
+    DWORD_PTR threadMask = static_cast<DWORD_PTR>(policy.cpuMask);
+    DWORD_PTR systemMask = 0;
+    if (threadMask == 0 && !GetProcessAffinityMask(GetCurrentProcess(), &threadMask, &systemMask))
+        error += std::format("{}GetProcessAffinityMask failed ({})", error.empty() ? "" : ", ", GetLastError());
+    else if (!SetThreadAffinityMask(GetCurrentThread(), threadMask))
+        error += std::format("{}SetThreadAffinityMask failed ({})", error.empty() ? "" : ", ", GetLastError());
+#else
+    int schedPolicy = SCHED_OTHER;
+    sched_param param{};
+    if (policy.schedClass == ThreadPolicy::Class::Low)
+    {
+#ifdef SCHED_IDLE
+        schedPolicy = SCHED_IDLE;
+#endif
+    }
+    else if (policy.schedClass != ThreadPolicy::Class::Normal)
+    {
+        schedPolicy = policy.schedClass == ThreadPolicy::Class::RealTime ? SCHED_FIFO : SCHED_RR;
+        param.sched_priority = std::clamp(policy.priority,
+            sched_get_priority_min(schedPolicy), sched_get_priority_max(schedPolicy));
+    }
+    int ret = pthread_setschedparam(pthread_self(), schedPolicy, &param);
+    if (ret != 0)
+        error = std::format("{} scheduling not permitted ({})", ThreadPolicy::ClassName(policy.schedClass), strerror(ret));
+
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (policy.cpuMask == 0)
+    {
+        // an empty mask gives the thread every CPU the process may use back,
+        // as set for the main thread (by taskset or a cgroup, say), which is
+        // never pinned here
+        if (sched_getaffinity(getpid(), sizeof(cpus), &cpus) != 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                CPU_SET(cpu, &cpus);
+        }
+    }
+    else
+    {
+        for (int cpu = 0; cpu < MAX_CPUS; ++cpu)
+        {
+            if (policy.cpuMask >> cpu & 1)
+                CPU_SET(cpu, &cpus);
+        }
+    }
+    ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (ret != 0)
+        error += std::format("{}CPU pinning failed ({})", error.empty() ? "" : ", ", strerror(ret));
+#else
+    if (policy.cpuMask != 0)
+        error += std::format("{}CPU pinning isn't supported on this platform", error.empty() ? "" : ", ");
+#endif
+#endif
+    return error.empty();
+}
+
+JitterStats::JitterStats() :
+    m_count(0),
+    m_mean(0.0),
+    m_m2(0.0),
+    m_max(0.0)
+{
+}
+
+void JitterStats::Add(double lateMs)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    ++m_count;
+    const double delta = lateMs - m_mean;
+    m_mean += delta / m_count;
+    m_m2 += delta * (lateMs - m_mean);
+    m_max = std::max(m_max, lateMs);
+}
+
+void JitterStats::Reset()
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    m_count = 0;
+    m_mean = 0.0;
+    m_m2 = 0.0;
+    m_max = 0.0;
+}
+
+unsigned long long JitterStats::GetCount() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_count;
+}
+
+double JitterStats::GetMeanMs() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_mean;
+}
+
+double JitterStats::GetStdDevMs() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_count > 1 ? std::sqrt(m_m2 / (m_count - 1)) : 0.0;
+}
+
+double JitterStats::GetMaxMs() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_max;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/**
+* Scheduling class, priority and CPU set for one thread.
+* RealTime is SCHED_FIFO on POSIX and time critical priority on Windows,
+* High is SCHED_RR and highest priority, Low is SCHED_IDLE where available
+* and lowest priority, for background work. The priority is the POSIX
+* real-time priority, Windows has no levels inside a class and ignores it.
+* An empty cpu mask lets the thread run on every CPU the process may use.
+*/
+struct ThreadPolicy
+{
+    enum class Class { Low, Normal, High, RealTime };
+
+    Class schedClass = Class::Normal;
+    int priority = 50;
+    uint64_t cpuMask = 0;
+
+    static bool ParseClass(const std::string& name, Class& schedClass);
+    static const char* ClassName(Class schedClass);
+    static bool ParseCpuList(const std::string& list, uint64_t& mask);
+    static std::string FormatCpuList(uint64_t mask);
+
+    bool operator==(const ThreadPolicy&) const = default;
+};
+
+/**
+* Applies the policy to the calling thread. Scheduling and pinning are set
+* independently; whatever the OS refuses (usually real-time scheduling for
+* an unprivileged user) is described in error and the thread keeps running
+* with its previous setting.
+*/
+bool ApplyThreadPolicy(const ThreadPolicy& policy, std::string& error);
+
+/**
+* Running statistics of how late a thread woke up after a timed wait.
+*/
+class JitterStats
+{
+public:
+    JitterStats();
+
+    void Add(double lateMs);
+    void Reset();
+
+    unsigned long long GetCount() const;
+    double GetMeanMs() const;
+    double GetStdDevMs() const;
+    double GetMaxMs() const;
+
+private:
+    mutable std::mutex m_lock;
+    unsigned long long m_count;
+    double m_mean;
+    double m_m2;
+    double m_max;
+};
@@ -0,0 +1,526 @@
+#include "TiffStackWriter.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+namespace
+{
+    enum TiffType : uint16_t
+    {
+        TIFF_ASCII = 2,
+        TIFF_SHORT = 3,
+        TIFF_LONG = 4,
+        TIFF_LONG8 = 16,
+    };
+
+    const uint64_t BIGTIFF_HEADER_SIZE = 16;
+    const uint16_t TIFF_COMPRESSION_DEFLATE = 8;
+    const uint16_t TIFF_PREDICTOR_HORIZONTAL = 2;
+    const uint64_t PAGE_ALIGNMENT = 16;
+
+    void Put16(std::vector<uint8_t>& out, uint16_t v)
+    {
+        out.push_back(static_cast<uint8_t>(v));
+        out.push_back(static_cast<uint8_t>(v >> 8));
+    }
+
+    void Put64(std::vector<uint8_t>& out, uint64_t v)
+    {
+        for (int i = 0; i < 8; ++i)
+            out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    void PutEntry(std::vector<uint8_t>& out, uint16_t tag, uint16_t type, uint64_t count, uint64_t value)
+    {
+        Put16(out, tag);
+        Put16(out, type);
+        Put64(out, count);
+        Put64(out, value);
+    }
+
+    uint64_t IfdSize(uint64_t numEntries)
+    {
+        return 8 + numEntries * 20 + 8;
+    }
+
+    uint64_t AlignUp(uint64_t v, uint64_t a)
+    {
+        return (v + a - 1) / a * a;
+    }
+
+    /**
+    * TIFF horizontal differencing (Predictor 2): every sample but the first
+    * of a row is replaced by its difference to the one before, modulo the
+    * sample size.
+    */
+    template <typename T>
+    void DifferenceRows(const T* src, unsigned width, unsigned rows, T* dst)
+    {
+        for (unsigned y = 0; y < rows; ++y)
+        {
+            const T* in = src + static_cast<size_t>(y) * width;
+            T* out = dst + static_cast<size_t>(y) * width;
+            out[0] = in[0];
+            for (unsigned x = 1; x < width; ++x)
+                out[x] = static_cast<T>(in[x] - in[x - 1]);
+        }
+    }
+}
+
+TiffStackWriter::TiffStackWriter(size_t maxQueuedFrames, size_t batchBytes) :
+    m_maxQueuedFrames(maxQueuedFrames),
+    m_batchBytes(batchBytes),
+    m_omeXml(false),
+    m_open(false),
+    m_failed(false),
+    m_stop(false),
+    m_queuedWidth(0),
+    m_queuedHeight(0),
+    m_queuedBytesPerPixel(0),
+    m_files(0),
+    m_pool(nullptr),
+    m_batchFileOffset(0),
+    m_nextPageOffset(0),
+    m_lastNextIfdField(0),
+    m_descriptionOffset(0),
+    m_fileIndex(0),
+    m_filePages(0),
+    m_firstWidth(0),
+    m_firstHeight(0),
+    m_firstBytesPerPixel(0),
+    m_maxBitDepth(0),
+    m_written(0),
+    m_dropped(0),
+    m_rawBytes(0),
+    m_storedBytes(0),
+    m_backlog(0)
+{
+}
+
+TiffStackWriter::~TiffStackWriter()
+{
+    Close();
+}
+
+/**
+* Creates the stack file and starts the writer thread.
+*/
+bool TiffStackWriter::Open(const std::string& path, bool omeXml)
+{
+    Close();
+
+    m_path = path;
+    m_omeXml = omeXml;
+    m_fileIndex = 0;
+    if (!OpenFile(path))
+        return false;
+
+    m_failed = false;
+    m_written = 0;
+    m_dropped = 0;
+    m_rawBytes = 0;
+    m_storedBytes = 0;
+
+    {
+        std::lock_guard<std::mutex> g(m_queueLock);
+        // frames left from a writer that failed go back to the free list
+        for (auto& frame : m_queue)
+            m_freeFrames.push_back(std::move(frame));
+        m_queue.clear();
+        m_backlog = 0;
+        m_queuedWidth = m_queuedHeight = m_queuedBytesPerPixel = 0;
+        m_files = 1;
+        m_stop = false;
+        m_open = true;
+    }
+    m_thread = std::thread(&TiffStackWriter::WriterLoop, this);
+    return true;
+}
+
+/**
+* Path of the given file of the stack: the first is the one opened, the
+* others get their number before the extension.
+*/
+std::string TiffStackWriter::PathOf(unsigned file) const
+{
+    if (file == 0)
+        return m_path;
+    const size_t name = m_path.find_last_of("/\\");
+    size_t dot = m_path.find('.', name == std::string::npos ? 0 : name + 1);
+    if (dot == std::string::npos)
+        dot = m_path.size();
+    return m_path.substr(0, dot) + "_" + std::to_string(file) + m_path.substr(dot);
+}
+
+/**
+* The file Push() is currently filling.
+*/
+std::string TiffStackWriter::GetPath() const
+{
+    const unsigned files = m_files;
+    return PathOf(files ? files - 1 : 0);
+}
+
+/**
+* Creates one file of the stack. The BigTIFF header goes into the batch
+* buffer; nothing is written to disk until the first batch fills up.
+*/
+bool TiffStackWriter::OpenFile(const std::string& path)
+{
+    m_file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!m_file)
+        return false;
+
+    m_filePages = 0;
+    m_firstWidth = m_firstHeight = m_firstBytesPerPixel = m_maxBitDepth = 0;
+
+    m_batch.clear();
+    m_batch.reserve(m_batchBytes + WRITE_ALIGNMENT);
+    m_batch.push_back('I');
+    m_batch.push_back('I');
+    Put16(m_batch, 43);
+    Put16(m_batch, 8);
+    Put16(m_batch, 0);
+    Put64(m_batch, BIGTIFF_HEADER_SIZE);
+
+    m_batchFileOffset = 0;
+    m_nextPageOffset = BIGTIFF_HEADER_SIZE;
+    m_lastNextIfdField = 0;
+    m_descriptionOffset = 0;
+    return true;
+}
+
+/**
+* Drains the queue, writes the remaining batch and finalizes the file.
+* Blocks until the writer thread has exited.
+*/
+void TiffStackWriter::Close()
+{
+    if (!m_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> g(m_queueLock);
+        m_open = false;
+        m_stop = true;
+    }
+    m_queueCv.notify_one();
+    m_thread.join();
+
+    m_file.close();
+}
+
+/**
+* Queues a copy of the frame for writing.
+* Returns false if the writer is closed or has failed, or if the frame was
+* dropped because the queue is full. A frame whose size or pixel type
+* differs from the file being filled starts the next file.
+*/
+bool TiffStackWriter::Push(const uint8_t* pixels, unsigned width, unsigned height,
+    unsigned bytesPerPixel, unsigned bitDepth)
+{
+    std::unique_lock<std::mutex> g(m_queueLock);
+    if (!m_open || m_failed)
+        return false;
+    if (m_queue.size() >= m_maxQueuedFrames)
+    {
+        ++m_dropped;
+        return false;
+    }
+
+    Frame frame;
+    if (!m_freeFrames.empty())
+    {
+        frame = std::move(m_freeFrames.back());
+        m_freeFrames.pop_back();
+    }
+    g.unlock();
+
+    const size_t size = static_cast<size_t>(width) * height * bytesPerPixel;
+    frame.pixels.resize(size);
+    std::memcpy(frame.pixels.data(), pixels, size);
+    frame.width = width;
+    frame.height = height;
+    frame.bytesPerPixel = bytesPerPixel;
+    frame.bitDepth = bitDepth;
+
+    g.lock();
+    // decided here rather than above, so files follow the order of the queue
+    frame.startsFile = m_queuedWidth != 0 && (width != m_queuedWidth || height != m_queuedHeight
+        || bytesPerPixel != m_queuedBytesPerPixel);
+    if (frame.startsFile)
+        ++m_files;
+    m_queuedWidth = width;
+    m_queuedHeight = height;
+    m_queuedBytesPerPixel = bytesPerPixel;
+    m_queue.push_back(std::move(frame));
+    ++m_backlog;
+    g.unlock();
+    m_queueCv.notify_one();
+    return true;
+}
+
+/**
+* Frames queued or being written. Lock free, so monitoring never competes
+* with Push() for the queue.
+*/
+size_t TiffStackWriter::GetBacklog() const
+{
+    return m_backlog;
+}
+
+double TiffStackWriter::GetCompressionRatio() const
+{
+    const uint64_t stored = m_storedBytes;
+    return stored ? static_cast<double>(m_rawBytes) / stored : 1.0;
+}
+
+void TiffStackWriter::WriterLoop()
+{
+    std::deque<Frame> pending;
+    for (;;)
+    {
+        bool stop;
+        {
+            std::unique_lock<std::mutex> g(m_queueLock);
+            m_queueCv.wait(g, [this] { return m_stop || !m_queue.empty(); });
+            pending.swap(m_queue);
+            stop = m_stop;
+        }
+
+        while (!pending.empty())
+        {
+            if (!m_failed && pending.front().startsFile)
+            {
+                Finalize();
+                m_file.close();
+                if (!OpenFile(PathOf(++m_fileIndex)))
+                    m_failed = true;
+            }
+            if (!m_failed)
+            {
+                EncodePage(pending.front());
+                if (m_batch.size() >= m_batchBytes)
+                    FlushBatch(false);
+            }
+
+            std::lock_guard<std::mutex> g(m_queueLock);
+            m_freeFrames.push_back(std::move(pending.front()));
+            pending.pop_front();
+            --m_backlog;
+        }
+
+        if (stop)
+            break;
+    }
+
+    Finalize();
+}
+
+/**
+* Deflates the frame strip by strip on the worker pool, each strip after
+* horizontal differencing. Strips don't depend on each other, so readers
+* can decode them independently as well.
+*/
+void TiffStackWriter::CompressStrips(const Frame& frame)
+{
+    const size_t numStrips = (frame.height + STRIP_ROWS - 1) / STRIP_ROWS;
+    const size_t stripBytes = static_cast<size_t>(frame.width) * STRIP_ROWS * frame.bytesPerPixel;
+    m_strips.resize(numStrips);
+    m_stripSizes.resize(numStrips);
+    m_differenced.resize(numStrips);
+    m_encoders.resize(numStrips);
+
+    m_pool->ParallelFor(numStrips, [&](size_t i)
+    {
+        const unsigned rows = std::min<unsigned>(STRIP_ROWS, frame.height - static_cast<unsigned>(i) * STRIP_ROWS);
+        const size_t bytes = static_cast<size_t>(frame.width) * rows * frame.bytesPerPixel;
+        const uint8_t* src = frame.pixels.data() + i * stripBytes;
+        auto& differenced = m_differenced[i];
+        differenced.resize(stripBytes);
+        if (frame.bytesPerPixel == 2)
+        {
+            DifferenceRows(reinterpret_cast<const uint16_t*>(src), frame.width, rows,
+                reinterpret_cast<uint16_t*>(differenced.data()));
+        }
+        else
+        {
+            DifferenceRows(src, frame.width, rows, differenced.data());
+        }
+
+        auto& strip = m_strips[i];
+        strip.resize(DeflateEncoder::MaxEncodedSize(stripBytes));
+        m_stripSizes[i] = m_encoders[i].Encode(differenced.data(), bytes, strip.data());
+    });
+}
+
+/**
+* Appends one page to the batch: a fixed-size IFD (preallocated so the next
+* page offset is known in advance), the reserved OME-XML block on the first
+* page, the strip offset/size tables of a compressed page, then the strips
+* padded to PAGE_ALIGNMENT.
+*/
+void TiffStackWriter::EncodePage(const Frame& frame)
+{
+    const bool first = m_filePages == 0;
+    const bool description = first && m_omeXml;
+    const uint64_t numEntries = 11 + (description ? 1 : 0) + (m_pool ? 1 : 0);
+    if (first)
+    {
+        m_firstWidth = frame.width;
+        m_firstHeight = frame.height;
+        m_firstBytesPerPixel = frame.bytesPerPixel;
+    }
+    m_maxBitDepth = std::max(m_maxBitDepth, frame.bitDepth);
+
+    const uint64_t rawSize = static_cast<uint64_t>(frame.width) * frame.height * frame.bytesPerPixel;
+    uint64_t numStrips = 1;
+    uint64_t dataSize = rawSize;
+    if (m_pool)
+    {
+        CompressStrips(frame);
+        numStrips = m_strips.size();
+        dataSize = 0;
+        for (size_t i = 0; i < numStrips; ++i)
+            dataSize += m_stripSizes[i];
+    }
+    const uint64_t tableSize = numStrips > 1 ? numStrips * 8 : 0;
+
+    const uint64_t pageOffset = m_nextPageOffset;
+    const uint64_t descriptionOffset = pageOffset + IfdSize(numEntries);
+    const uint64_t offsetsTable = descriptionOffset + (description ? OME_XML_RESERVED : 0);
+    const uint64_t countsTable = offsetsTable + tableSize;
+    const uint64_t dataOffset = countsTable + tableSize;
+    const uint64_t nextPage = AlignUp(dataOffset + dataSize, PAGE_ALIGNMENT);
+
+    Put64(m_batch, numEntries);
+    PutEntry(m_batch, 256, TIFF_LONG, 1, frame.width);
+    PutEntry(m_batch, 257, TIFF_LONG, 1, frame.height);
+    PutEntry(m_batch, 258, TIFF_SHORT, 1, frame.bytesPerPixel * 8);
+    PutEntry(m_batch, 259, TIFF_SHORT, 1, m_pool ? TIFF_COMPRESSION_DEFLATE : 1);
+    PutEntry(m_batch, 262, TIFF_SHORT, 1, 1);
+    if (description)
+        PutEntry(m_batch, 270, TIFF_ASCII, OME_XML_RESERVED, descriptionOffset);
+    PutEntry(m_batch, 273, TIFF_LONG8, numStrips, numStrips > 1 ? offsetsTable : dataOffset);
+    PutEntry(m_batch, 277, TIFF_SHORT, 1, 1);
+    PutEntry(m_batch, 278, TIFF_LONG, 1, m_pool ? STRIP_ROWS : frame.height);
+    PutEntry(m_batch, 279, TIFF_LONG8, numStrips, numStrips > 1 ? countsTable : dataSize);
+    PutEntry(m_batch, 281, TIFF_SHORT, 1, (1u << frame.bitDepth) - 1);
+    if (m_pool)
+        PutEntry(m_batch, 317, TIFF_SHORT, 1, TIFF_PREDICTOR_HORIZONTAL);
+    PutEntry(m_batch, 339, TIFF_SHORT, 1, 1);
+
+    m_lastNextIfdField = m_batchFileOffset + m_batch.size();
+    Put64(m_batch, nextPage);
+
+    if (description)
+    {
+        m_descriptionOffset = descriptionOffset;
+        m_batch.resize(m_batch.size() + OME_XML_RESERVED, ' ');
+    }
+
+    if (m_pool)
+    {
+        if (numStrips > 1)
+        {
+            uint64_t offset = dataOffset;
+            for (size_t i = 0; i < numStrips; ++i)
+            {
+                Put64(m_batch, offset);
+                offset += m_stripSizes[i];
+            }
+            for (size_t i = 0; i < numStrips; ++i)
+                Put64(m_batch, m_stripSizes[i]);
+        }
+        for (size_t i = 0; i < numStrips; ++i)
+            m_batch.insert(m_batch.end(), m_strips[i].begin(), m_strips[i].begin() + m_stripSizes[i]);
+    }
+    else
+    {
+        m_batch.insert(m_batch.end(), frame.pixels.begin(), frame.pixels.end());
+    }
+    m_batch.resize(static_cast<size_t>(nextPage - m_batchFileOffset), 0);
+
+    m_nextPageOffset = nextPage;
+    m_rawBytes += rawSize;
+    m_storedBytes += dataSize;
+    ++m_filePages;
+    ++m_written;
+}
+
+/**
+* Writes the batch to disk. Unless all is set, only whole multiples of
+* WRITE_ALIGNMENT are written and the tail is kept for the next batch, so
+* every write starts at an aligned file offset.
+*/
+void TiffStackWriter::FlushBatch(bool all)
+{
+    const size_t toWrite = all ? m_batch.size() : m_batch.size() / WRITE_ALIGNMENT * WRITE_ALIGNMENT;
+    if (toWrite == 0)
+        return;
+
+    m_file.write(reinterpret_cast<const char*>(m_batch.data()), toWrite);
+    if (!m_file)
+    {
+        m_failed = true;
+        return;
+    }
+
+    m_batch.erase(m_batch.begin(), m_batch.begin() + toWrite);
+    m_batchFileOffset += toWrite;
+}
+
+/**
+* Terminates the IFD chain at the last page of the file and fills in the
+* OME-XML block now that the number of planes is known.
+*/
+void TiffStackWriter::Finalize()
+{
+    if (m_filePages == 0)
+    {
+        // header only, point it at no IFD at all
+        m_batch.resize(8);
+        Put64(m_batch, 0);
+    }
+
+    FlushBatch(true);
+    if (m_failed)
+        return;
+
+    if (m_filePages > 0)
+    {
+        std::vector<uint8_t> zero;
+        Put64(zero, 0);
+        m_file.seekp(static_cast<std::streamoff>(m_lastNextIfdField));
+        m_file.write(reinterpret_cast<const char*>(zero.data()), zero.size());
+    }
+
+    if (m_omeXml && m_descriptionOffset != 0)
+    {
+        std::string xml = BuildOmeXml();
+        xml.resize(OME_XML_RESERVED - 1, ' ');
+        xml.push_back('\0');
+        m_file.seekp(static_cast<std::streamoff>(m_descriptionOffset));
+        m_file.write(xml.data(), xml.size());
+    }
+
+    m_file.flush();
+    if (!m_file)
+        m_failed = true;
+}
+
+std::string TiffStackWriter::BuildOmeXml() const
+{
+    const char* type = m_firstBytesPerPixel == 2 ? "uint16" : "uint8";
+    return std::format(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<OME xmlns=\"http://www.openmicroscopy.org/Schemas/OME/2016-06\">"
+        "<Image ID=\"Image:0\"><Pixels ID=\"Pixels:0\" DimensionOrder=\"XYZCT\" Type=\"{}\" "
+        "SignificantBits=\"{}\" SizeX=\"{}\" SizeY=\"{}\" SizeZ=\"1\" SizeC=\"1\" SizeT=\"{}\">"
+        "<Channel ID=\"Channel:0:0\" SamplesPerPixel=\"1\"/>"
+        "<TiffData IFD=\"0\" PlaneCount=\"{}\"/>"
+        "</Pixels></Image></OME>",
+        type, m_maxBitDepth, m_firstWidth, m_firstHeight, m_filePages, m_filePages);
+}
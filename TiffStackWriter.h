@@ -0,0 +1,123 @@
+#pragma once
+
+#include "DeflateEncoder.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class WorkerPool;
+
+/**
+* Asynchronous multi-page BigTIFF / OME-TIFF stack writer.
+* Frames are copied into recycled buffers and handed to a background thread
+* through a bounded queue, so Push() never touches the disk. The writer
+* thread encodes each page (fixed-size IFD followed by the pixel strip) into
+* a batch buffer and writes it out in multiples of WRITE_ALIGNMENT bytes.
+* When the queue is full the frame is dropped and counted instead of
+* blocking acquisition.
+*
+* All pages of a file share the size and pixel type of its first one. A
+* frame that differs closes the file and starts the next one, named after
+* the first with "_1", "_2"... before the extension. Every page records its
+* bit depth as MaxSampleValue, the OME-XML as SignificantBits.
+*
+* With compression enabled every page is split into strips of STRIP_ROWS
+* rows that are deflated independently on a worker pool, after horizontal
+* differencing (TIFF Compression 8, Predictor 2), so ImageJ/Fiji,
+* Bio-Formats and libtiff read the stacks as they are.
+*/
+class TiffStackWriter
+{
+public:
+    TiffStackWriter(size_t maxQueuedFrames = 64, size_t batchBytes = 8 << 20);
+    ~TiffStackWriter();
+
+    void SetCompression(WorkerPool* pool) { m_pool = pool; }
+    bool IsCompressing() const { return m_pool != nullptr; }
+
+    bool Open(const std::string& path, bool omeXml);
+    void Close();
+    bool IsOpen() const { return m_open; }
+
+    bool Push(const uint8_t* pixels, unsigned width, unsigned height,
+        unsigned bytesPerPixel, unsigned bitDepth);
+
+    size_t GetBacklog() const;
+    uint64_t GetWrittenFrames() const { return m_written; }
+    uint64_t GetDroppedFrames() const { return m_dropped; }
+    bool HasFailed() const { return m_failed; }
+    double GetCompressionRatio() const;
+    unsigned GetFileCount() const { return m_files; }
+    std::string GetPath() const;
+
+private:
+    struct Frame
+    {
+        std::vector<uint8_t> pixels;
+        unsigned width = 0;
+        unsigned height = 0;
+        unsigned bytesPerPixel = 1;
+        unsigned bitDepth = 8;
+        bool startsFile = false;    // first page of the next file
+    };
+
+    static const size_t WRITE_ALIGNMENT = 4096;
+    static const size_t OME_XML_RESERVED = 4096;
+    static constexpr unsigned STRIP_ROWS = 32;
+
+    std::string PathOf(unsigned file) const;
+    bool OpenFile(const std::string& path);
+    void WriterLoop();
+    void EncodePage(const Frame& frame);
+    void CompressStrips(const Frame& frame);
+    void FlushBatch(bool all);
+    void Finalize();
+    std::string BuildOmeXml() const;
+
+    const size_t m_maxQueuedFrames;
+    const size_t m_batchBytes;
+
+    std::string m_path;
+    bool m_omeXml;
+    std::ofstream m_file;
+    std::atomic<bool> m_open;
+    std::atomic<bool> m_failed;
+
+    mutable std::mutex m_queueLock;
+    std::condition_variable m_queueCv;
+    std::deque<Frame> m_queue;
+    std::vector<Frame> m_freeFrames;
+    bool m_stop;
+    std::thread m_thread;
+    unsigned m_queuedWidth, m_queuedHeight, m_queuedBytesPerPixel;  // of the file Push() is filling
+    std::atomic<unsigned> m_files;
+
+    WorkerPool* m_pool;
+
+    // writer thread state
+    std::vector<std::vector<uint8_t>> m_differenced;
+    std::vector<DeflateEncoder> m_encoders;
+    std::vector<std::vector<uint8_t>> m_strips;
+    std::vector<size_t> m_stripSizes;
+    std::vector<uint8_t> m_batch;
+    uint64_t m_batchFileOffset;
+    uint64_t m_nextPageOffset;
+    uint64_t m_lastNextIfdField;
+    uint64_t m_descriptionOffset;
+    unsigned m_fileIndex;   // of the file being written
+    uint64_t m_filePages;
+    unsigned m_firstWidth, m_firstHeight, m_firstBytesPerPixel, m_maxBitDepth;
+
+    std::atomic<uint64_t> m_written;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_rawBytes;
+    std::atomic<uint64_t> m_storedBytes;
+    std::atomic<size_t> m_backlog;
+};
@@ -0,0 +1,139 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+namespace
+{
+    std::atomic<uint64_t> g_allocations(0);
+    std::atomic<uint64_t> g_frees(0);
+    std::atomic<uint64_t> g_bytes(0);
+    std::atomic<int64_t> g_liveBytes(0);
+    std::atomic<uint64_t> g_counted(0);
+    std::atomic<uint64_t> g_countedBytes(0);
+    std::atomic<uint64_t> g_countedLarge(0);
+
+    thread_local unsigned t_excluded = 0;
+
+    size_t UsableSize(void* p)
+    {
+#ifdef __APPLE__
+        return malloc_size(p);
+#else
+        return malloc_usable_size(p);
+#endif
+    }
+
+    void* Allocate(std::size_t size, std::size_t alignment) noexcept
+    {
+        if (size == 0)
+            size = 1;
+        void* p = nullptr;
+        if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            p = std::malloc(size);
+        else if (posix_memalign(&p, alignment, size) != 0)
+            p = nullptr;
+        if (!p)
+            return nullptr;
+
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_bytes.fetch_add(size, std::memory_order_relaxed);
+        g_liveBytes.fetch_add(static_cast<int64_t>(UsableSize(p)), std::memory_order_relaxed);
+        if (!t_excluded)
+        {
+            g_counted.fetch_add(1, std::memory_order_relaxed);
+            g_countedBytes.fetch_add(size, std::memory_order_relaxed);
+            if (size >= AllocationCounter::LARGE_BYTES)
+                g_countedLarge.fetch_add(1, std::memory_order_relaxed);
+        }
+        return p;
+    }
+
+    // what operator new must do when out of memory: the new handler, then bad_alloc
+    void* AllocateOrThrow(std::size_t size, std::size_t alignment)
+    {
+        for (;;)
+        {
+            if (void* p = Allocate(size, alignment))
+                return p;
+            std::new_handler handler = std::get_new_handler();
+            if (!handler)
+                throw std::bad_alloc();
+            handler();
+        }
+    }
+
+    void* AllocateOrNull(std::size_t size, std::size_t alignment) noexcept
+    {
+        try
+        {
+            return AllocateOrThrow(size, alignment);
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+
+    void Free(void* p) noexcept
+    {
+        if (!p)
+            return;
+        g_frees.fetch_add(1, std::memory_order_relaxed);
+        g_liveBytes.fetch_sub(static_cast<int64_t>(UsableSize(p)), std::memory_order_relaxed);
+        std::free(p);
+    }
+}
+
+AllocationCounter::Counts AllocationCounter::Get()
+{
+    Counts counts;
+    // frees first, so a block allocated and freed in between can't count as freed but not allocated
+    counts.frees = g_frees.load(std::memory_order_relaxed);
+    counts.allocations = g_allocations.load(std::memory_order_relaxed);
+    counts.bytes = g_bytes.load(std::memory_order_relaxed);
+    counts.liveBytes = g_liveBytes.load(std::memory_order_relaxed);
+    counts.counted = g_counted.load(std::memory_order_relaxed);
+    counts.countedBytes = g_countedBytes.load(std::memory_order_relaxed);
+    counts.countedLarge = g_countedLarge.load(std::memory_order_relaxed);
+    return counts;
+}
+
+AllocationCounter::Excluded::Excluded()
+{
+    ++t_excluded;
+}
+
+AllocationCounter::Excluded::~Excluded()
+{
+    --t_excluded;
+}
+
+void* operator new(std::size_t size) { return AllocateOrThrow(size, 0); }
+void* operator new[](std::size_t size) { return AllocateOrThrow(size, 0); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return AllocateOrNull(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return AllocateOrNull(size, 0); }
+void* operator new(std::size_t size, std::align_val_t al) { return AllocateOrThrow(size, static_cast<std::size_t>(al)); }
+void* operator new[](std::size_t size, std::align_val_t al) { return AllocateOrThrow(size, static_cast<std::size_t>(al)); }
+void* operator new(std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return AllocateOrNull(size, static_cast<std::size_t>(al)); }
+void* operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return AllocateOrNull(size, static_cast<std::size_t>(al)); }
+
+void operator delete(void* p) noexcept { Free(p); }
+void operator delete[](void* p) noexcept { Free(p); }
+void operator delete(void* p, std::size_t) noexcept { Free(p); }
+void operator delete[](void* p, std::size_t) noexcept { Free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { Free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { Free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { Free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { Free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { Free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { Free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { Free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { Free(p); }
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+* Counts the heap allocations of the whole process by replacing the global
+* operator new and delete; linking AllocationCounter.cpp into a program is
+* what installs it. Everything allocated through new is counted, the
+* adapter, the MMDevice base classes and the standard containers alike,
+* while plain malloc() calls and mapped memory are not.
+*
+* The simulated camera and the stand-in core mark their own threads and
+* calls Excluded, so the allocation counts are the adapter's; the live
+* heap is the whole process's, since blocks can change hands.
+*/
+namespace AllocationCounter
+{
+    // blocks this large could hold a frame
+    const size_t LARGE_BYTES = 4096;
+
+    struct Counts
+    {
+        uint64_t allocations = 0;   // operator new calls
+        uint64_t frees = 0;         // operator delete calls on allocated blocks
+        uint64_t bytes = 0;         // bytes requested by the allocations
+        int64_t liveBytes = 0;      // usable size of the blocks not freed yet
+        uint64_t counted = 0;       // allocations outside of Excluded scopes
+        uint64_t countedBytes = 0;
+        uint64_t countedLarge = 0;  // of them LARGE_BYTES or more
+
+        uint64_t LiveBlocks() const { return allocations - frees; }
+    };
+
+    Counts Get();
+
+    /**
+    * Leaves the allocations of the calling thread out of the counted ones
+    * while alive; scopes nest.
+    */
+    class Excluded
+    {
+    public:
+        Excluded();
+        ~Excluded();
+        Excluded(const Excluded&) = delete;
+        Excluded& operator=(const Excluded&) = delete;
+    };
+}
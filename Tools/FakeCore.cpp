@@ -0,0 +1,423 @@
+#include "FakeCore.h"
+
+#include "AllocationCounter.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+SimulatedPort::SimulatedPort(const std::string& name, const std::string& tty) :
+    m_name(name),
+    m_tty(tty),
+    m_fd(-1)
+{
+}
+
+SimulatedPort::~SimulatedPort()
+{
+    Shutdown();
+}
+
+int SimulatedPort::Initialize()
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (m_fd >= 0)
+        return DEVICE_OK;
+
+    m_fd = open(m_tty.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (m_fd < 0)
+        return DEVICE_NOT_CONNECTED;
+
+    termios tio{};
+    tcgetattr(m_fd, &tio);
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(m_fd, TCSANOW, &tio);
+    tcflush(m_fd, TCIOFLUSH);
+    return DEVICE_OK;
+}
+
+int SimulatedPort::Shutdown()
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (m_fd >= 0)
+        close(m_fd);
+    m_fd = -1;
+    return DEVICE_OK;
+}
+
+void SimulatedPort::GetName(char* name) const
+{
+    CDeviceUtils::CopyLimitedString(name, m_name.c_str());
+}
+
+/**
+* Fails every write and read for ms. What the camera sent before is lost.
+*/
+void SimulatedPort::Unplug(double ms)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (m_fd >= 0)
+        tcflush(m_fd, TCIOFLUSH);
+    m_unpluggedUntil = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(ms));
+}
+
+int SimulatedPort::Write(const unsigned char* data, unsigned long bytes)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (m_fd < 0)
+        return DEVICE_NOT_CONNECTED;
+    if (std::chrono::steady_clock::now() < m_unpluggedUntil)
+        return DEVICE_SERIAL_COMMAND_FAILED;
+
+    while (bytes > 0)
+    {
+        const ssize_t n = write(m_fd, data, bytes);
+        if (n > 0)
+        {
+            data += n;
+            bytes -= static_cast<unsigned long>(n);
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR)
+            return DEVICE_SERIAL_COMMAND_FAILED;
+
+        pollfd pfd{ m_fd, POLLOUT, 0 };
+        if (poll(&pfd, 1, WRITE_TIMEOUT_MS) <= 0)
+            return DEVICE_SERIAL_COMMAND_FAILED;
+    }
+    return DEVICE_OK;
+}
+
+int SimulatedPort::Read(unsigned char* data, unsigned long bytes, unsigned long& read)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    read = 0;
+    if (m_fd < 0)
+        return DEVICE_NOT_CONNECTED;
+    if (std::chrono::steady_clock::now() < m_unpluggedUntil)
+        return DEVICE_SERIAL_INVALID_RESPONSE;
+
+    const ssize_t n = ::read(m_fd, data, bytes);
+    if (n > 0)
+        read = static_cast<unsigned long>(n);
+    else if (n < 0 && errno != EAGAIN && errno != EINTR)
+        return DEVICE_SERIAL_INVALID_RESPONSE;
+    return DEVICE_OK;
+}
+
+/**
+* Reads up to the terminator, which isn't returned, byte by byte like the
+* serial manager so nothing after it is consumed.
+*/
+int SimulatedPort::ReadAnswer(char* answer, unsigned long length, const char* term, double timeoutMs)
+{
+    const auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(timeoutMs));
+    const size_t termLength = std::strlen(term);
+
+    std::string received;
+    while (received.size() + 1 < length)
+    {
+        unsigned char c = 0;
+        unsigned long read = 0;
+        int ret = Read(&c, 1, read);
+        if (ret != DEVICE_OK)
+            return ret;
+        if (read == 0)
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+                return DEVICE_SERIAL_TIMEOUT;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        received += static_cast<char>(c);
+        if (termLength > 0 && received.size() >= termLength &&
+            received.compare(received.size() - termLength, termLength, term) == 0)
+        {
+            received.resize(received.size() - termLength);
+            CDeviceUtils::CopyLimitedString(answer, received.c_str());
+            return DEVICE_OK;
+        }
+    }
+    return DEVICE_SERIAL_BUFFER_OVERRUN;
+}
+
+int SimulatedPort::Purge()
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    if (m_fd < 0)
+        return DEVICE_NOT_CONNECTED;
+    tcflush(m_fd, TCIOFLUSH);
+    return DEVICE_OK;
+}
+
+FakeCore::FakeCore() :
+    m_verbose(false),
+    m_start(std::chrono::steady_clock::now()),
+    m_acqFinished(false),
+    m_imagesInserted(0)
+{
+}
+
+void FakeCore::AddPort(SimulatedPort* port)
+{
+    char name[MM::MaxStrLength];
+    port->GetName(name);
+    m_ports[name] = port;
+}
+
+void FakeCore::SetImageHandler(ImageHandler handler)
+{
+    m_imageHandler = std::move(handler);
+}
+
+void FakeCore::SetVerbose(bool verbose)
+{
+    m_verbose = verbose;
+}
+
+void FakeCore::PrintRecentLog(size_t lines) const
+{
+    std::lock_guard<std::mutex> g(m_logLock);
+    const size_t first = m_log.size() > lines ? m_log.size() - lines : 0;
+    for (size_t i = first; i < m_log.size(); ++i)
+        std::fprintf(stderr, "  | %s\n", m_log[i].c_str());
+}
+
+void FakeCore::ClearAcqFinished()
+{
+    std::lock_guard<std::mutex> g(m_acqLock);
+    m_acqFinished = false;
+}
+
+bool FakeCore::WaitForAcqFinished(double timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_acqLock);
+    return m_acqDone.wait_for(lock, std::chrono::duration<double, std::milli>(timeoutMs), [this] { return m_acqFinished; });
+}
+
+unsigned long FakeCore::GetImagesInserted() const
+{
+    std::lock_guard<std::mutex> g(m_acqLock);
+    return m_imagesInserted;
+}
+
+SimulatedPort* FakeCore::FindPort(const char* name) const
+{
+    auto it = m_ports.find(name ? name : "");
+    return it == m_ports.end() ? nullptr : it->second;
+}
+
+int FakeCore::LogMessage(const MM::Device*, const char* msg, bool debugOnly) const
+{
+    AllocationCounter::Excluded excluded;
+    const double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    char line[MM::MaxStrLength + 32];
+    std::snprintf(line, sizeof(line), "%9.3f %s%s", t, debugOnly ? "[debug] " : "", msg);
+
+    std::lock_guard<std::mutex> g(m_logLock);
+    if (m_verbose)
+        std::fprintf(stderr, "%s\n", line);
+    m_log.push_back(line);
+    if (m_log.size() > LOG_HISTORY)
+        m_log.pop_front();
+    return DEVICE_OK;
+}
+
+MM::Device* FakeCore::GetDevice(const MM::Device*, const char* label)
+{
+    return FindPort(label);
+}
+
+int FakeCore::GetDeviceProperty(const char* deviceName, const char* propName, char* value)
+{
+    SimulatedPort* port = FindPort(deviceName);
+    return port ? port->GetProperty(propName, value) : DEVICE_ERR;
+}
+
+int FakeCore::SetDeviceProperty(const char* deviceName, const char* propName, const char* value)
+{
+    SimulatedPort* port = FindPort(deviceName);
+    return port ? port->SetProperty(propName, value) : DEVICE_ERR;
+}
+
+void FakeCore::GetLoadedDeviceOfType(const MM::Device*, MM::DeviceType devType, char* pDeviceName, const unsigned int deviceIterator)
+{
+    pDeviceName[0] = 0;
+    if (devType != MM::SerialDevice || deviceIterator >= m_ports.size())
+        return;
+    auto it = m_ports.begin();
+    std::advance(it, deviceIterator);
+    CDeviceUtils::CopyLimitedString(pDeviceName, it->first.c_str());
+}
+
+int FakeCore::SetSerialProperties(const char*, const char*, const char*, const char*, const char*, const char*, const char*)
+{
+    return DEVICE_OK;
+}
+
+int FakeCore::SetSerialCommand(const MM::Device*, const char* portName, const char* command, const char* term)
+{
+    SimulatedPort* port = FindPort(portName);
+    if (!port)
+        return DEVICE_NOT_CONNECTED;
+    const std::string line = std::string(command) + (term ? term : "");
+    return port->Write(reinterpret_cast<const unsigned char*>(line.data()), static_cast<unsigned long>(line.size()));
+}
+
+int FakeCore::GetSerialAnswer(const MM::Device*, const char* portName, unsigned long ansLength, char* answer, const char* term)
+{
+    SimulatedPort* port = FindPort(portName);
+    return port ? port->ReadAnswer(answer, ansLength, term ? term : "", ANSWER_TIMEOUT_MS) : DEVICE_NOT_CONNECTED;
+}
+
+int FakeCore::WriteToSerial(const MM::Device*, const char* portName, const unsigned char* buf, unsigned long length)
+{
+    SimulatedPort* port = FindPort(portName);
+    return port ? port->Write(buf, length) : DEVICE_NOT_CONNECTED;
+}
+
+int FakeCore::ReadFromSerial(const MM::Device*, const char* portName, unsigned char* buf, unsigned long length, unsigned long& read)
+{
+    SimulatedPort* port = FindPort(portName);
+    read = 0;
+    return port ? port->Read(buf, length, read) : DEVICE_NOT_CONNECTED;
+}
+
+int FakeCore::PurgeSerial(const MM::Device*, const char* portName)
+{
+    SimulatedPort* port = FindPort(portName);
+    return port ? port->Purge() : DEVICE_NOT_CONNECTED;
+}
+
+MM::PortType FakeCore::GetSerialPortType(const char* portName) const
+{
+    return FindPort(portName) ? MM::SerialPort : MM::InvalidPort;
+}
+
+int FakeCore::OnPropertiesChanged(const MM::Device*) { return DEVICE_OK; }
+int FakeCore::OnPropertyChanged(const MM::Device*, const char*, const char*) { return DEVICE_OK; }
+int FakeCore::OnStagePositionChanged(const MM::Device*, double) { return DEVICE_OK; }
+int FakeCore::OnXYStagePositionChanged(const MM::Device*, double, double) { return DEVICE_OK; }
+int FakeCore::OnExposureChanged(const MM::Device*, double) { return DEVICE_OK; }
+int FakeCore::OnSLMExposureChanged(const MM::Device*, double) { return DEVICE_OK; }
+int FakeCore::OnMagnifierChanged(const MM::Device*) { return DEVICE_OK; }
+
+unsigned long FakeCore::GetClockTicksUs(const MM::Device*)
+{
+    return static_cast<unsigned long>(GetCurrentMMTime().getUsec());
+}
+
+MM::MMTime FakeCore::GetCurrentMMTime()
+{
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    return MM::MMTime(static_cast<long>(us / 1000000), static_cast<long>(us % 1000000));
+}
+
+int FakeCore::AcqFinished(const MM::Device*, int)
+{
+    {
+        std::lock_guard<std::mutex> g(m_acqLock);
+        m_acqFinished = true;
+    }
+    m_acqDone.notify_all();
+    return DEVICE_OK;
+}
+
+int FakeCore::PrepareForAcq(const MM::Device*)
+{
+    return DEVICE_OK;
+}
+
+int FakeCore::InsertImage(const MM::Device* caller, const ImgBuffer& buf)
+{
+    return InsertImage(caller, buf.GetPixels(), buf.Width(), buf.Height(), buf.Depth(), 1, "", true);
+}
+
+int FakeCore::InsertImage(const MM::Device*, const unsigned char* buf, unsigned width, unsigned height,
+    unsigned byteDepth, unsigned, const char* serializedMetadata, const bool)
+{
+    AllocationCounter::Excluded excluded;
+    Image image;
+    image.pixels = buf;
+    image.width = width;
+    image.height = height;
+    image.bytesPerPixel = byteDepth;
+    image.insertedMs = GetCurrentMMTime().getMsec();
+    if (serializedMetadata && *serializedMetadata)
+        image.metadata.Restore(serializedMetadata);
+
+    {
+        std::lock_guard<std::mutex> g(m_acqLock);
+        ++m_imagesInserted;
+    }
+    if (m_imageHandler)
+        m_imageHandler(image);
+    return DEVICE_OK;
+}
+
+int FakeCore::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height,
+    unsigned byteDepth, const char* serializedMetadata, const bool doProcess)
+{
+    return InsertImage(caller, buf, width, height, byteDepth, 1, serializedMetadata, doProcess);
+}
+
+int FakeCore::InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height,
+    unsigned byteDepth, const Metadata* md, const bool doProcess)
+{
+    return InsertImage(caller, buf, width, height, byteDepth, 1, md ? md->Serialize().c_str() : "", doProcess);
+}
+
+void FakeCore::ClearImageBuffer(const MM::Device*) {}
+bool FakeCore::InitializeImageBuffer(unsigned, unsigned, unsigned int, unsigned int, unsigned int) { return true; }
+
+int FakeCore::InsertMultiChannel(const MM::Device* caller, const unsigned char* buf, unsigned,
+    unsigned width, unsigned height, unsigned byteDepth, Metadata* md)
+{
+    return InsertImage(caller, buf, width, height, byteDepth, md);
+}
+
+const char* FakeCore::GetImage() { return nullptr; }
+int FakeCore::GetImageDimensions(int& width, int& height, int& depth) { width = height = depth = 0; return DEVICE_ERR; }
+int FakeCore::GetFocusPosition(double& pos) { pos = 0.0; return DEVICE_ERR; }
+int FakeCore::SetFocusPosition(double) { return DEVICE_ERR; }
+int FakeCore::MoveFocus(double) { return DEVICE_ERR; }
+int FakeCore::SetXYPosition(double, double) { return DEVICE_ERR; }
+int FakeCore::GetXYPosition(double& x, double& y) { x = y = 0.0; return DEVICE_ERR; }
+int FakeCore::MoveXYStage(double, double) { return DEVICE_ERR; }
+int FakeCore::SetExposure(double) { return DEVICE_ERR; }
+int FakeCore::GetExposure(double& expMs) { expMs = 0.0; return DEVICE_ERR; }
+int FakeCore::SetConfig(const char*, const char*) { return DEVICE_ERR; }
+int FakeCore::GetCurrentConfig(const char*, int, char* name) { name[0] = 0; return DEVICE_ERR; }
+int FakeCore::GetChannelConfig(char* channelConfigName, const unsigned int) { channelConfigName[0] = 0; return DEVICE_ERR; }
+
+MM::ImageProcessor* FakeCore::GetImageProcessor(const MM::Device*) { return nullptr; }
+MM::AutoFocus* FakeCore::GetAutoFocus(const MM::Device*) { return nullptr; }
+MM::Hub* FakeCore::GetParentHub(const MM::Device*) const { return nullptr; }
+MM::State* FakeCore::GetStateDevice(const MM::Device*, const char*) { return nullptr; }
+MM::SignalIO* FakeCore::GetSignalIODevice(const MM::Device*, const char*) { return nullptr; }
+
+void FakeCore::NextPostedError(int& errorCode, char* pMessage, int, int& messageLength)
+{
+    errorCode = 0;
+    pMessage[0] = 0;
+    messageLength = 0;
+}
+
+void FakeCore::PostError(const int errorCode, const char* pMessage)
+{
+    LogMessage(nullptr, (std::string("Posted error ") + std::to_string(errorCode) + ": " + pMessage).c_str(), false);
+}
+
+void FakeCore::ClearPostedErrors() {}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "DeviceBase.h"
+#include "ImageMetadata.h"
+#include "ImgBuffer.h"
+#include "MMDevice.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+* Serial port device on a tty, under the name the adapter's Port property
+* is set to. Initialize opens the tty and Shutdown closes it, as MMCore's
+* serial ports do. Unplug() makes every write and read fail for a while,
+* like a link dropout the port survives, for the adapter to reconnect.
+*/
+class SimulatedPort : public CGenericBase<SimulatedPort>
+{
+public:
+    SimulatedPort(const std::string& name, const std::string& tty);
+    ~SimulatedPort();
+
+    int Initialize();
+    int Shutdown();
+    void GetName(char* name) const;
+    bool Busy() { return false; }
+
+    void Unplug(double ms);
+
+    int Write(const unsigned char* data, unsigned long bytes);
+    int Read(unsigned char* data, unsigned long bytes, unsigned long& read);
+    int ReadAnswer(char* answer, unsigned long length, const char* term, double timeoutMs);
+    int Purge();
+
+private:
+    static const int WRITE_TIMEOUT_MS = 2000;
+
+    const std::string m_name;
+    const std::string m_tty;
+
+    mutable std::mutex m_lock;
+    int m_fd;
+    std::chrono::steady_clock::time_point m_unpluggedUntil;
+};
+
+/**
+* The parts of MMCore the adapter calls, for driving it outside of
+* Micro-Manager. Serial traffic goes to SimulatedPort devices, inserted
+* images go to the image handler and log messages to a short history that
+* is printed on failure, or to stderr when verbose. Everything else answers
+* as a core without such devices would. What the core does with images and
+* messages is left out of AllocationCounter's counts, as it isn't the
+* adapter's.
+*
+* Methods are declared without override so the class builds against
+* MMDevice versions that have dropped some of them.
+*/
+class FakeCore : public MM::Core
+{
+public:
+    struct Image
+    {
+        const unsigned char* pixels;
+        unsigned width;
+        unsigned height;
+        unsigned bytesPerPixel;
+        double insertedMs;      // MM time of the insertion
+        Metadata metadata;
+    };
+    typedef std::function<void(const Image& image)> ImageHandler;
+
+    FakeCore();
+
+    void AddPort(SimulatedPort* port);
+    void SetImageHandler(ImageHandler handler);
+    void SetVerbose(bool verbose);
+    void PrintRecentLog(size_t lines) const;
+
+    // AcqFinished of the sequence started after ClearAcqFinished()
+    void ClearAcqFinished();
+    bool WaitForAcqFinished(double timeoutMs);
+    unsigned long GetImagesInserted() const;
+
+    // MM::Core
+    int LogMessage(const MM::Device* caller, const char* msg, bool debugOnly) const;
+    MM::Device* GetDevice(const MM::Device* caller, const char* label);
+    int GetDeviceProperty(const char* deviceName, const char* propName, char* value);
+    int SetDeviceProperty(const char* deviceName, const char* propName, const char* value);
+    void GetLoadedDeviceOfType(const MM::Device* caller, MM::DeviceType devType, char* pDeviceName, const unsigned int deviceIterator);
+
+    int SetSerialProperties(const char* portName, const char* answerTimeout, const char* baudRate,
+        const char* delayBetweenCharsMs, const char* handshaking, const char* parity, const char* stopBits);
+    int SetSerialCommand(const MM::Device* caller, const char* portName, const char* command, const char* term);
+    int GetSerialAnswer(const MM::Device* caller, const char* portName, unsigned long ansLength, char* answer, const char* term);
+    int WriteToSerial(const MM::Device* caller, const char* port, const unsigned char* buf, unsigned long length);
+    int ReadFromSerial(const MM::Device* caller, const char* port, unsigned char* buf, unsigned long length, unsigned long& read);
+    int PurgeSerial(const MM::Device* caller, const char* portName);
+    MM::PortType GetSerialPortType(const char* portName) const;
+
+    int OnPropertiesChanged(const MM::Device* caller);
+    int OnPropertyChanged(const MM::Device* caller, const char* propName, const char* propValue);
+    int OnStagePositionChanged(const MM::Device* caller, double pos);
+    int OnXYStagePositionChanged(const MM::Device* caller, double xPos, double yPos);
+    int OnExposureChanged(const MM::Device* caller, double newExposure);
+    int OnSLMExposureChanged(const MM::Device* caller, double newExposure);
+    int OnMagnifierChanged(const MM::Device* caller);
+
+    unsigned long GetClockTicksUs(const MM::Device* caller);
+    MM::MMTime GetCurrentMMTime();
+
+    int AcqFinished(const MM::Device* caller, int statusCode);
+    int PrepareForAcq(const MM::Device* caller);
+    int InsertImage(const MM::Device* caller, const ImgBuffer& buf);
+    int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height,
+        unsigned byteDepth, unsigned nComponents, const char* serializedMetadata, const bool doProcess = true);
+    int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height,
+        unsigned byteDepth, const char* serializedMetadata, const bool doProcess = true);
+    int InsertImage(const MM::Device* caller, const unsigned char* buf, unsigned width, unsigned height,
+        unsigned byteDepth, const Metadata* md = 0, const bool doProcess = true);
+    void ClearImageBuffer(const MM::Device* caller);
+    bool InitializeImageBuffer(unsigned channels, unsigned slices, unsigned int w, unsigned int h, unsigned int pixDepth);
+    int InsertMultiChannel(const MM::Device* caller, const unsigned char* buf, unsigned numChannels,
+        unsigned width, unsigned height, unsigned byteDepth, Metadata* md = 0);
+
+    const char* GetImage();
+    int GetImageDimensions(int& width, int& height, int& depth);
+    int GetFocusPosition(double& pos);
+    int SetFocusPosition(double pos);
+    int MoveFocus(double velocity);
+    int SetXYPosition(double x, double y);
+    int GetXYPosition(double& x, double& y);
+    int MoveXYStage(double vX, double vY);
+    int SetExposure(double expMs);
+    int GetExposure(double& expMs);
+    int SetConfig(const char* group, const char* name);
+    int GetCurrentConfig(const char* group, int bufLen, char* name);
+    int GetChannelConfig(char* channelConfigName, const unsigned int channelConfigIterator);
+
+    MM::ImageProcessor* GetImageProcessor(const MM::Device* caller);
+    MM::AutoFocus* GetAutoFocus(const MM::Device* caller);
+    MM::Hub* GetParentHub(const MM::Device* caller) const;
+    MM::State* GetStateDevice(const MM::Device* caller, const char* deviceName);
+    MM::SignalIO* GetSignalIODevice(const MM::Device* caller, const char* deviceName);
+
+    void NextPostedError(int& errorCode, char* pMessage, int maxlen, int& messageLength);
+    void PostError(const int errorCode, const char* pMessage);
+    void ClearPostedErrors();
+
+private:
+    static const size_t LOG_HISTORY = 200;
+    static const int ANSWER_TIMEOUT_MS = 2000;
+
+    SimulatedPort* FindPort(const char* name) const;
+
+    std::map<std::string, SimulatedPort*> m_ports;
+    ImageHandler m_imageHandler;
+    bool m_verbose;
+    const std::chrono::steady_clock::time_point m_start;
+
+    mutable std::mutex m_logLock;
+    mutable std::deque<std::string> m_log;
+
+    mutable std::mutex m_acqLock;
+    std::condition_variable m_acqDone;
+    bool m_acqFinished;
+    unsigned long m_imagesInserted;
+};
@@ -0,0 +1,377 @@
+#include "FrameCodec.h"
+#include "FrameStreamServer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+/**
+* Viewer-side client for FrameStreamServer.
+*
+*   FrameStreamClient <endpoint> [frames]
+*       Connects to a running adapter ("port", "address:port" or a Unix
+*       socket path), decodes frames and prints rate, skipped frames and
+*       compression ratio.
+*
+*   FrameStreamClient --loopback [frames]
+*       Starts a FrameStreamServer on 127.0.0.1, publishes synthetic frames
+*       for every bit depth / downsample / encoding combination and checks
+*       that each received frame decodes to exactly what was published.
+*       Exits non-zero on the first mismatch.
+*/
+
+namespace
+{
+#ifdef _WIN32
+    typedef SOCKET Socket;
+    const Socket NO_SOCKET = INVALID_SOCKET;
+
+    void CloseSocket(Socket s)
+    {
+        closesocket(s);
+    }
+#else
+    typedef int Socket;
+    const Socket NO_SOCKET = -1;
+
+    void CloseSocket(Socket s)
+    {
+        close(s);
+    }
+#endif
+
+    Socket Connect(const std::string& endpoint)
+    {
+        if (!endpoint.empty() && endpoint[0] == '/')
+        {
+#ifdef _WIN32
+            return NO_SOCKET;
+#else
+            sockaddr_un addr{};
+            if (endpoint.size() >= sizeof(addr.sun_path))
+                return NO_SOCKET;
+            addr.sun_family = AF_UNIX;
+            std::strcpy(addr.sun_path, endpoint.c_str());
+
+            Socket s = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (s != NO_SOCKET && connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+            {
+                CloseSocket(s);
+                return NO_SOCKET;
+            }
+            return s;
+#endif
+        }
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        std::string port = endpoint;
+        const auto colon = endpoint.rfind(':');
+        if (colon != std::string::npos)
+        {
+            port = endpoint.substr(colon + 1);
+            if (inet_pton(AF_INET, endpoint.substr(0, colon).c_str(), &addr.sin_addr) != 1)
+                return NO_SOCKET;
+        }
+        addr.sin_port = htons(static_cast<uint16_t>(std::atoi(port.c_str())));
+
+        Socket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s != NO_SOCKET && connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+        {
+            CloseSocket(s);
+            return NO_SOCKET;
+        }
+        return s;
+    }
+
+    bool ReceiveAll(Socket s, uint8_t* dst, size_t bytes)
+    {
+        while (bytes > 0)
+        {
+            const int chunk = static_cast<int>(std::min<size_t>(bytes, 1 << 20));
+            const auto n = recv(s, reinterpret_cast<char*>(dst), chunk, 0);
+            if (n <= 0)
+                return false;
+            dst += n;
+            bytes -= n;
+        }
+        return true;
+    }
+
+    /**
+    * Reads one message and decodes its pixels. Returns false on a closed
+    * connection or a malformed message.
+    */
+    bool ReceiveFrame(Socket s, FrameStreamHeader& header, std::vector<uint8_t>& payload,
+        std::vector<uint8_t>& pixels)
+    {
+        if (!ReceiveAll(s, reinterpret_cast<uint8_t*>(&header), sizeof(header)))
+            return false;
+        if (header.magic != FrameStreamServer::MAGIC || header.headerSize != sizeof(header)
+            || (header.bytesPerPixel != 1 && header.bytesPerPixel != 2))
+        {
+            std::fprintf(stderr, "bad header\n");
+            return false;
+        }
+
+        payload.resize(header.payloadSize);
+        if (!ReceiveAll(s, payload.data(), payload.size()))
+            return false;
+
+        const size_t rowBytes = static_cast<size_t>(header.width) * header.bytesPerPixel;
+        pixels.resize(rowBytes * header.height);
+
+        if (header.encoding == FrameStreamServer::ENCODING_RAW)
+        {
+            if (payload.size() != pixels.size())
+                return false;
+            std::memcpy(pixels.data(), payload.data(), pixels.size());
+            return true;
+        }
+        if (header.encoding != FrameStreamServer::ENCODING_RICE || payload.size() < 4 || header.stripRows == 0)
+            return false;
+
+        uint32_t numStrips;
+        std::memcpy(&numStrips, payload.data(), 4);
+        if (numStrips != (header.height + header.stripRows - 1) / header.stripRows
+            || payload.size() < 4 + 4 * static_cast<size_t>(numStrips))
+            return false;
+
+        size_t pos = 4 + 4 * static_cast<size_t>(numStrips);
+        for (uint32_t i = 0; i < numStrips; ++i)
+        {
+            uint32_t size;
+            std::memcpy(&size, payload.data() + 4 + 4 * i, 4);
+            if (pos + size > payload.size())
+                return false;
+
+            const unsigned firstRow = i * header.stripRows;
+            const unsigned rows = std::min(header.stripRows, header.height - firstRow);
+            if (!FrameCodec::Decode(payload.data() + pos, size, header.width, rows, header.bytesPerPixel,
+                pixels.data() + firstRow * rowBytes))
+                return false;
+            pos += size;
+        }
+        return pos == payload.size();
+    }
+
+    int Watch(const std::string& endpoint, unsigned frames)
+    {
+        const Socket s = Connect(endpoint);
+        if (s == NO_SOCKET)
+        {
+            std::fprintf(stderr, "couldn't connect to %s\n", endpoint.c_str());
+            return 1;
+        }
+
+        FrameStreamHeader header{};
+        std::vector<uint8_t> payload, pixels;
+        uint64_t received = 0, skipped = 0, wireBytes = 0, pixelBytes = 0;
+        uint64_t lastFrame = 0;
+        const auto start = std::chrono::steady_clock::now();
+        while (received < frames && ReceiveFrame(s, header, payload, pixels))
+        {
+            if (received > 0 && header.frameNumber > lastFrame + 1)
+                skipped += header.frameNumber - lastFrame - 1;
+            lastFrame = header.frameNumber;
+            wireBytes += sizeof(header) + payload.size();
+            pixelBytes += pixels.size();
+            ++received;
+        }
+        CloseSocket(s);
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%llu frames (%ux%u, %u bit), %llu skipped, %.1f fps, %.1f MB/s, ratio %.2f\n",
+            static_cast<unsigned long long>(received), header.width, header.height, header.bitDepth,
+            static_cast<unsigned long long>(skipped), received / seconds, wireBytes / seconds / 1e6,
+            wireBytes ? static_cast<double>(pixelBytes) / wireBytes : 0.0);
+        return received == frames ? 0 : 1;
+    }
+
+    /**
+    * Frame n of the loopback pattern: a gradient with a moving bright bar
+    * and a little pseudo-random noise, so the Rice coder has real work.
+    */
+    template <typename T>
+    void FillPattern(T* dst, unsigned width, unsigned height, unsigned maxValue, uint64_t n)
+    {
+        uint32_t seed = static_cast<uint32_t>(n * 2654435761u + 1);
+        for (unsigned y = 0; y < height; ++y)
+        {
+            for (unsigned x = 0; x < width; ++x)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                unsigned v = (x + y) * maxValue / (width + height) + (seed >> 29);
+                if ((x + n * 7) % width < 16)
+                    v = maxValue - (seed >> 30);
+                dst[static_cast<size_t>(y) * width + x] = static_cast<T>(std::min(v, maxValue));
+            }
+        }
+    }
+
+    template <typename T>
+    void Downsample(const T* src, unsigned width, unsigned height, unsigned factor, std::vector<uint8_t>& out)
+    {
+        const unsigned outWidth = width / factor, outHeight = height / factor;
+        out.resize(static_cast<size_t>(outWidth) * outHeight * sizeof(T));
+        T* dst = reinterpret_cast<T*>(out.data());
+        for (unsigned y = 0; y < outHeight; ++y)
+        {
+            for (unsigned x = 0; x < outWidth; ++x)
+            {
+                uint32_t sum = 0;
+                for (unsigned dy = 0; dy < factor; ++dy)
+                    for (unsigned dx = 0; dx < factor; ++dx)
+                        sum += src[static_cast<size_t>(y * factor + dy) * width + x * factor + dx];
+                dst[static_cast<size_t>(y) * outWidth + x] = static_cast<T>(sum / (factor * factor));
+            }
+        }
+    }
+
+    void MakeFrame(unsigned width, unsigned height, unsigned bytesPerPixel, unsigned bitDepth, uint64_t n,
+        std::vector<uint8_t>& pixels)
+    {
+        pixels.resize(static_cast<size_t>(width) * height * bytesPerPixel);
+        const unsigned maxValue = (1u << bitDepth) - 1;
+        if (bytesPerPixel == 2)
+            FillPattern(reinterpret_cast<uint16_t*>(pixels.data()), width, height, maxValue, n);
+        else
+            FillPattern(pixels.data(), width, height, maxValue, n);
+    }
+
+    bool LoopbackCase(unsigned bytesPerPixel, unsigned bitDepth, unsigned downsample, bool compress, unsigned frames)
+    {
+        // odd height so the last Rice strip is a short one
+        const unsigned width = 320, height = 243;
+
+        FrameStreamServer server;
+        server.SetDownsample(downsample);
+        server.SetCompression(compress);
+
+        std::string endpoint;
+        for (unsigned port = 55355; port < 55455 && !server.IsRunning(); ++port)
+        {
+            endpoint = "127.0.0.1:" + std::to_string(port);
+            server.Start(endpoint);
+        }
+        if (!server.IsRunning())
+        {
+            std::fprintf(stderr, "couldn't start the server\n");
+            return false;
+        }
+
+        const Socket s = Connect(endpoint);
+        if (s == NO_SOCKET)
+        {
+            std::fprintf(stderr, "couldn't connect to %s\n", endpoint.c_str());
+            return false;
+        }
+        while (server.GetClientCount() == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        // the server numbers frames from the first one published with a client attached
+        std::atomic<bool> stop{ false };
+        std::thread publisher([&] {
+            std::vector<uint8_t> pixels;
+            for (uint64_t n = 0; !stop; ++n)
+            {
+                MakeFrame(width, height, bytesPerPixel, bitDepth, n, pixels);
+                server.Publish(pixels.data(), width, height, bytesPerPixel, bitDepth);
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        });
+
+        FrameStreamHeader header{};
+        std::vector<uint8_t> payload, pixels, published, expected;
+        bool ok = true;
+        uint64_t wireBytes = 0, pixelBytes = 0;
+        for (unsigned i = 0; i < frames && ok; ++i)
+        {
+            if (!ReceiveFrame(s, header, payload, pixels))
+            {
+                std::fprintf(stderr, "receive/decode failed\n");
+                ok = false;
+                break;
+            }
+            MakeFrame(width, height, bytesPerPixel, bitDepth, header.frameNumber, published);
+            if (bytesPerPixel == 2)
+                Downsample(reinterpret_cast<const uint16_t*>(published.data()), width, height, downsample, expected);
+            else
+                Downsample(published.data(), width, height, downsample, expected);
+
+            ok = header.width == width / downsample && header.height == height / downsample
+                && header.bitDepth == bitDepth && pixels == expected;
+            if (!ok)
+                std::fprintf(stderr, "frame %llu doesn't match what was published\n",
+                    static_cast<unsigned long long>(header.frameNumber));
+            wireBytes += sizeof(header) + payload.size();
+            pixelBytes += pixels.size();
+        }
+
+        stop = true;
+        publisher.join();
+        CloseSocket(s);
+        server.Stop();
+
+        std::printf("%2u bit, downsample %u, %-4s: %s (ratio %.2f, %llu dropped by the server)\n",
+            bitDepth, downsample, compress ? "rice" : "raw", ok ? "ok" : "FAILED",
+            wireBytes ? static_cast<double>(pixelBytes) / wireBytes : 0.0,
+            static_cast<unsigned long long>(server.GetDroppedFrames()));
+        return ok;
+    }
+
+    int Loopback(unsigned frames)
+    {
+        bool ok = true;
+        for (unsigned bpp : { 1u, 2u })
+            for (unsigned downsample : { 1u, 2u })
+                for (bool compress : { false, true })
+                    ok = LoopbackCase(bpp, bpp == 1 ? 8 : 12, downsample, compress, frames) && ok;
+        return ok ? 0 : 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <endpoint>|--loopback [frames]\n", argv[0]);
+        return 2;
+    }
+
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+
+    const std::string endpoint = argv[1];
+    const unsigned frames = argc > 2 ? static_cast<unsigned>(std::atoi(argv[2])) : 0;
+
+    const int ret = endpoint == "--loopback" ? Loopback(frames ? frames : 50) : Watch(endpoint, frames ? frames : 100);
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return ret;
+}
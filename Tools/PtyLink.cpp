@@ -0,0 +1,128 @@
+#include "PtyLink.h"
+
+#include "AllocationCounter.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+PtyLink::PtyLink(SimulatedAbiCam::Settings settings) :
+    m_master(-1),
+    m_slave(-1),
+    m_stop(false),
+    m_droppedBytes(0)
+{
+    m_camera = std::make_unique<SimulatedAbiCam>(
+        [this](const uint8_t* data, size_t bytes) { Write(data, bytes); }, settings);
+}
+
+PtyLink::~PtyLink()
+{
+    Close();
+    m_camera.reset();
+}
+
+bool PtyLink::Open(std::string& error)
+{
+    m_master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (m_master < 0 || grantpt(m_master) != 0 || unlockpt(m_master) != 0)
+    {
+        error = std::string("Couldn't create a pseudo terminal: ") + std::strerror(errno);
+        Close();
+        return false;
+    }
+    m_portName = ptsname(m_master);
+
+    // the camera talks binary, so no echo and no line discipline
+    m_slave = open(m_portName.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    termios tio{};
+    if (m_slave < 0 || tcgetattr(m_slave, &tio) != 0)
+    {
+        error = "Couldn't open " + m_portName + ": " + std::strerror(errno);
+        Close();
+        return false;
+    }
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(m_slave, TCSANOW, &tio);
+
+    m_stop = false;
+    m_thread = std::thread(&PtyLink::Serve, this);
+    return true;
+}
+
+void PtyLink::Close()
+{
+    m_stop = true;
+    if (m_thread.joinable())
+        m_thread.join();
+    if (m_slave >= 0)
+        close(m_slave);
+    if (m_master >= 0)
+        close(m_master);
+    m_slave = m_master = -1;
+}
+
+const std::string& PtyLink::GetPortName() const
+{
+    return m_portName;
+}
+
+SimulatedAbiCam& PtyLink::GetCamera()
+{
+    return *m_camera;
+}
+
+unsigned long PtyLink::GetDroppedBytes() const
+{
+    return m_droppedBytes.load();
+}
+
+/**
+* Feeds what the host writes to the camera.
+*/
+void PtyLink::Serve()
+{
+    AllocationCounter::Excluded excluded;
+    uint8_t buf[4096];
+    while (!m_stop)
+    {
+        pollfd pfd{ m_master, POLLIN, 0 };
+        if (poll(&pfd, 1, POLL_MS) <= 0)
+            continue;
+
+        const ssize_t n = read(m_master, buf, sizeof(buf));
+        if (n > 0)
+            m_camera->Receive(buf, static_cast<size_t>(n));
+        else if (n < 0 && errno != EAGAIN && errno != EINTR)
+            usleep(POLL_MS * 1000);
+    }
+}
+
+void PtyLink::Write(const uint8_t* data, size_t bytes)
+{
+    while (bytes > 0 && m_master >= 0)
+    {
+        const ssize_t n = write(m_master, data, bytes);
+        if (n > 0)
+        {
+            data += n;
+            bytes -= static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR)
+            break;
+
+        // the tty buffer is full until the host reads
+        pollfd pfd{ m_master, POLLOUT, 0 };
+        if (poll(&pfd, 1, WRITE_TIMEOUT_MS) <= 0)
+            break;
+    }
+    m_droppedBytes += static_cast<unsigned long>(bytes);
+}
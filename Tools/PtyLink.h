@@ -0,0 +1,45 @@
+#pragma once
+
+#include "SimulatedAbiCam.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+/**
+* Serves a SimulatedAbiCam on a pseudo terminal, so the adapter's serial
+* traffic goes through a real tty with its buffering and purging. The
+* slave end, GetPortName(), is opened like any serial port. Bytes the
+* camera sends while nobody reads the port are dropped after a while, as
+* they are on a serial line with the adapter unplugged.
+*/
+class PtyLink
+{
+public:
+    explicit PtyLink(SimulatedAbiCam::Settings settings = SimulatedAbiCam::Settings());
+    ~PtyLink();
+
+    // returns false with the reason in error
+    bool Open(std::string& error);
+    void Close();
+
+    const std::string& GetPortName() const;
+    SimulatedAbiCam& GetCamera();
+    unsigned long GetDroppedBytes() const;
+
+private:
+    static const int POLL_MS = 50;
+    static const int WRITE_TIMEOUT_MS = 500;
+
+    void Serve();
+    void Write(const uint8_t* data, size_t bytes);
+
+    int m_master;
+    int m_slave;    // kept open so the master never sees the tty hang up
+    std::string m_portName;
+    std::atomic<bool> m_stop;
+    std::atomic<unsigned long> m_droppedBytes;
+    std::thread m_thread;
+    std::unique_ptr<SimulatedAbiCam> m_camera;
+};
@@ -0,0 +1,372 @@
+#include "SharedFrameRing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+* Consumer side of SharedFrameRing.
+*
+*   SharedRingReader <name> [frames]
+*       Maps a running adapter's ring read-only, follows it with the
+*       sequence protocol described in SharedFrameRing.h and prints rate,
+*       skipped frames and reads the producer overtook. Exits non-zero if a
+*       frame passes the sequence check with a header that doesn't add up.
+*
+*   SharedRingReader --loopback [frames]
+*       Publishes numbered pattern frames into a small ring as fast as it
+*       can while reading them back, and checks every frame that passes the
+*       sequence check against what was published, so a torn frame fails.
+*       Then creates and destroys the ring under a publishing thread.
+*/
+
+using namespace SharedFrameRingLayout;
+
+namespace
+{
+    /**
+    * Read-only mapping of a ring created by another SharedFrameRing.
+    */
+    class RingView
+    {
+    public:
+        ~RingView()
+        {
+            if (!m_base)
+                return;
+#ifdef _WIN32
+            UnmapViewOfFile(m_base);
+            CloseHandle(m_mapping);
+#else
+            munmap(const_cast<uint8_t*>(m_base), m_size);
+#endif
+        }
+
+        bool Open(const std::string& name)
+        {
+#ifdef _WIN32
+            m_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+            if (!m_mapping)
+                return false;
+            const void* mem = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+            if (!mem)
+                return false;
+            MEMORY_BASIC_INFORMATION info;
+            VirtualQuery(mem, &info, sizeof(info));
+            m_size = info.RegionSize;
+#else
+            const std::string path = name[0] == '/' ? name : "/" + name;
+            const int fd = shm_open(path.c_str(), O_RDONLY, 0);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(RingHeader)))
+            {
+                close(fd);
+                return false;
+            }
+            m_size = static_cast<size_t>(st.st_size);
+            void* mem = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (mem == MAP_FAILED)
+                return false;
+#endif
+            m_base = static_cast<const uint8_t*>(mem);
+
+            const RingHeader* header = Header();
+            if (header->magic != MAGIC || header->version != VERSION || header->slotCount == 0
+                || header->slotStride < SLOT_DATA_OFFSET + header->maxFrameBytes
+                || sizeof(RingHeader) + header->slotStride * header->slotCount > m_size)
+            {
+                std::fprintf(stderr, "%s isn't a version %u frame ring\n", name.c_str(), VERSION);
+                return false;
+            }
+            return true;
+        }
+
+        const RingHeader* Header() const
+        {
+            return reinterpret_cast<const RingHeader*>(m_base);
+        }
+
+        const SlotHeader* Slot(uint64_t frameNumber) const
+        {
+            return reinterpret_cast<const SlotHeader*>(m_base + sizeof(RingHeader)
+                + frameNumber % Header()->slotCount * Header()->slotStride);
+        }
+
+    private:
+        const uint8_t* m_base = nullptr;
+        size_t m_size = 0;
+#ifdef _WIN32
+        HANDLE m_mapping = nullptr;
+#endif
+    };
+
+    struct Frame
+    {
+        uint64_t frameNumber;
+        uint64_t timestampUs;
+        unsigned width;
+        unsigned height;
+        unsigned bytesPerPixel;
+        unsigned bitDepth;
+        std::vector<uint8_t> pixels;
+    };
+
+    enum class ReadResult
+    {
+        Ok,
+        NotYet,     // not published yet, or being written
+        Overtaken   // the producer reused the slot before or while it was read
+    };
+
+    /**
+    * Copies frame n out of its slot: reads seq, copies, and reads seq again.
+    * Frame n is in its slot while seq is 2 * (n + 1).
+    */
+    ReadResult ReadFrame(const RingView& ring, uint64_t n, Frame& frame)
+    {
+        const SlotHeader* slot = ring.Slot(n);
+        const uint64_t expected = 2 * (n + 1);
+        const uint64_t before = slot->seq.load(std::memory_order_acquire);
+        if (before != expected)
+            return before > expected ? ReadResult::Overtaken : ReadResult::NotYet;
+
+        frame.frameNumber = slot->frameNumber;
+        frame.timestampUs = slot->timestampUs;
+        frame.width = slot->width;
+        frame.height = slot->height;
+        frame.bytesPerPixel = slot->bytesPerPixel;
+        frame.bitDepth = slot->bitDepth;
+        const size_t dataSize = static_cast<size_t>(std::min<uint64_t>(slot->dataSize, ring.Header()->maxFrameBytes));
+        frame.pixels.resize(dataSize);
+        std::memcpy(frame.pixels.data(), reinterpret_cast<const uint8_t*>(slot) + SLOT_DATA_OFFSET, dataSize);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->seq.load(std::memory_order_relaxed) != before)
+            return ReadResult::Overtaken;
+        return ReadResult::Ok;
+    }
+
+    /**
+    * Whether a frame that passed the sequence check is self-consistent.
+    */
+    bool Consistent(const Frame& frame, uint64_t n)
+    {
+        return frame.frameNumber == n && (frame.bytesPerPixel == 1 || frame.bytesPerPixel == 2)
+            && frame.pixels.size() == static_cast<size_t>(frame.width) * frame.height * frame.bytesPerPixel;
+    }
+
+    struct ReadStats
+    {
+        uint64_t received = 0;
+        uint64_t skipped = 0;     // published frames never seen
+        uint64_t overtaken = 0;   // reads the producer overwrote, also skipped
+        uint64_t inconsistent = 0;
+    };
+
+    /**
+    * Follows the ring from its newest frame until frames were received,
+    * handing each frame read to check.
+    */
+    template <typename Check>
+    ReadStats Follow(const RingView& ring, uint64_t frames, Check check)
+    {
+        ReadStats stats;
+        Frame frame;
+        const RingHeader* header = ring.Header();
+        uint64_t next = header->published.load(std::memory_order_acquire);
+        while (stats.received < frames)
+        {
+            const uint64_t published = header->published.load(std::memory_order_acquire);
+            if (published >= next + header->slotCount)
+            {
+                // too far behind, the oldest frame left is published - slotCount + 1
+                const uint64_t oldest = published - header->slotCount + 1;
+                stats.skipped += oldest - next;
+                next = oldest;
+            }
+
+            switch (ReadFrame(ring, next, frame))
+            {
+            case ReadResult::NotYet:
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                break;
+            case ReadResult::Overtaken:
+                ++stats.overtaken;
+                ++stats.skipped;
+                ++next;
+                break;
+            case ReadResult::Ok:
+                if (!Consistent(frame, next) || !check(frame))
+                {
+                    if (stats.inconsistent++ < 5)
+                        std::fprintf(stderr, "frame %llu is torn\n", static_cast<unsigned long long>(next));
+                }
+                ++stats.received;
+                ++next;
+                break;
+            }
+        }
+        return stats;
+    }
+
+    int Watch(const std::string& name, uint64_t frames)
+    {
+        RingView ring;
+        if (!ring.Open(name))
+        {
+            std::fprintf(stderr, "couldn't map %s\n", name.c_str());
+            return 1;
+        }
+
+        unsigned width = 0, height = 0, bitDepth = 0;
+        const auto start = std::chrono::steady_clock::now();
+        const ReadStats stats = Follow(ring, frames, [&](const Frame& frame) {
+            width = frame.width;
+            height = frame.height;
+            bitDepth = frame.bitDepth;
+            return true;
+        });
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%llu frames (%ux%u, %u bit), %llu skipped (%llu overtaken while reading), %llu torn, %.1f fps\n",
+            static_cast<unsigned long long>(stats.received), width, height, bitDepth,
+            static_cast<unsigned long long>(stats.skipped), static_cast<unsigned long long>(stats.overtaken),
+            static_cast<unsigned long long>(stats.inconsistent), stats.received / seconds);
+        return stats.inconsistent ? 1 : 0;
+    }
+
+    // a name of this process's own, so a running adapter's ring is left alone
+    std::string LoopbackName()
+    {
+        return "AbiRingCheck" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+
+    // byte i of loopback frame n
+    uint8_t PatternByte(uint64_t n, size_t i)
+    {
+        return static_cast<uint8_t>(n * 131 + i * 7 + (i >> 8));
+    }
+
+    bool LoopbackRead(uint64_t frames)
+    {
+        const std::string name = LoopbackName();
+        const unsigned width = 256, height = 192;
+        SharedFrameRing producer;
+        // two slots, so the producer keeps overtaking the reader
+        if (!producer.Create(name, 2, static_cast<size_t>(width) * height))
+        {
+            std::fprintf(stderr, "couldn't create %s\n", name.c_str());
+            return false;
+        }
+        RingView ring;
+        if (!ring.Open(name))
+        {
+            std::fprintf(stderr, "couldn't map %s\n", name.c_str());
+            return false;
+        }
+
+        std::atomic<bool> stop{ false };
+        // the pattern repeats every 256 frames; made up front, publishing is little more than the copy
+        const size_t frameBytes = static_cast<size_t>(width) * height;
+        std::vector<uint8_t> patterns(256 * frameBytes);
+        for (size_t n = 0; n < 256; ++n)
+            for (size_t i = 0; i < frameBytes; ++i)
+                patterns[n * frameBytes + i] = PatternByte(n, i);
+
+        std::thread publisher([&] {
+            for (uint64_t n = 0; !stop; ++n)
+                producer.Publish(&patterns[n % 256 * frameBytes], width, height, 1, 8, n);
+        });
+
+        const ReadStats stats = Follow(ring, frames, [&](const Frame& frame) {
+            if (frame.timestampUs != frame.frameNumber || frame.width != width || frame.height != height)
+                return false;
+            for (size_t i = 0; i < frame.pixels.size(); ++i)
+                if (frame.pixels[i] != PatternByte(frame.frameNumber, i))
+                    return false;
+            return true;
+        });
+
+        stop = true;
+        publisher.join();
+        producer.Destroy();
+
+        const bool ok = stats.inconsistent == 0 && stats.received == frames;
+        std::printf("reading:  %s (%llu frames checked, %llu skipped, %llu overtaken while reading, %llu torn)\n",
+            ok ? "ok" : "FAILED", static_cast<unsigned long long>(stats.received),
+            static_cast<unsigned long long>(stats.skipped), static_cast<unsigned long long>(stats.overtaken),
+            static_cast<unsigned long long>(stats.inconsistent));
+        return ok;
+    }
+
+    /**
+    * Publishes from one thread while another creates and destroys the
+    * ring, the way disabling the ring during a sequence does.
+    */
+    bool LoopbackTeardown(unsigned cycles)
+    {
+        const std::string name = LoopbackName();
+        const unsigned width = 640, height = 480;
+        SharedFrameRing producer;
+
+        std::atomic<bool> stop{ false };
+        std::atomic<uint64_t> published{ 0 };
+        std::thread publisher([&] {
+            std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 2, 0x5a);
+            while (!stop)
+                if (producer.Publish(pixels.data(), width, height, 2, 16, 0))
+                    ++published;
+        });
+
+        bool ok = true;
+        for (unsigned i = 0; i < cycles && ok; ++i)
+        {
+            ok = producer.Create(name, 4, static_cast<size_t>(width) * height * 2);
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            producer.Destroy();
+        }
+        stop = true;
+        publisher.join();
+
+        std::printf("teardown: %s (%u create/destroy cycles, %llu frames published in between)\n",
+            ok ? "ok" : "FAILED", cycles, static_cast<unsigned long long>(published.load()));
+        return ok;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <name>|--loopback [frames]\n", argv[0]);
+        return 2;
+    }
+
+    const std::string name = argv[1];
+    const uint64_t frames = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 0;
+    if (name != "--loopback")
+        return Watch(name, frames ? frames : 100);
+
+    const bool read = LoopbackRead(frames ? frames : 2000);
+    const bool teardown = LoopbackTeardown(500);
+    return read && teardown ? 0 : 1;
+}
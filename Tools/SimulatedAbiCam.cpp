@@ -0,0 +1,465 @@
+#include "SimulatedAbiCam.h"
+
+#include "AllocationCounter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+namespace
+{
+    const double COOLED_C = -10.0;
+    const double AMBIENT_C = 25.0;
+    const double ADC_V = 330.0;
+    const size_t FRAME_CHUNK_BYTES = 16384;
+    const int CHECKER_CELL = 8;
+
+    const char* const VERSION = "AbiCam firmware 1.2\r\n";
+    const char* const HELP =
+        "AbiCam firmware 1.2\r\n"
+        "ver - firmware version\r\n"
+        "hlp - this listing\r\n"
+        "chp - sensor temperature\r\n"
+        "cld <0|1> - cooler off or on\r\n"
+        "sht <ms> - expose\r\n"
+        "rid <binning> <depth> - send the frame\r\n"
+        "trg <0-3> [ms] [frames] - 0 internal, 1 edge, 2 gate, 3 burst\r\n"
+        "bin 1 2 4 8\r\n"
+        "bit 4 6 8\r\n"
+        "baud 921600\r\n";
+    const char* const PACKED_HELP = "rid packs samples of depths under 8\r\n";
+    const char* const HELP_END = "\r\n\r\n";
+
+    std::vector<std::string> Split(const std::string& command)
+    {
+        std::vector<std::string> tokens;
+        std::istringstream ss(command);
+        std::string token;
+        while (ss >> token)
+            tokens.push_back(token);
+        return tokens;
+    }
+
+    long Arg(const std::vector<std::string>& tokens, size_t i, long fallback)
+    {
+        return i < tokens.size() ? std::strtol(tokens[i].c_str(), nullptr, 10) : fallback;
+    }
+}
+
+SimulatedAbiCam::SimulatedAbiCam(Output output, Settings settings) :
+    m_output(std::move(output)),
+    m_settings(settings),
+    m_stop(false),
+    m_silent(false),
+    m_mode(Mode::Internal),
+    m_triggerExposureMs(0.0),
+    m_burstLeft(0),
+    m_exposing(false),
+    m_gateOpen(false),
+    m_readyPending(false),
+    m_frameReady(false),
+    m_transferring(false),
+    m_frameTriggered(false),
+    m_frameExposureMs(0.0),
+    m_cold(0),
+    m_heatLoad(0.0),
+    m_tempFrom(AMBIENT_C),
+    m_tempTarget(AMBIENT_C),
+    m_tempSince(Clock::now()),
+    m_random(12345)
+{
+    m_thread = std::thread(&SimulatedAbiCam::Run, this);
+}
+
+SimulatedAbiCam::~SimulatedAbiCam()
+{
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+}
+
+void SimulatedAbiCam::Receive(const uint8_t* data, size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        if (m_silent)
+            return;
+        m_input.append(reinterpret_cast<const char*>(data), bytes);
+        m_lastInput = Clock::now();
+    }
+    m_wake.notify_all();
+}
+
+/**
+* Edge input: starts an exposure if the camera is armed for edges and not
+* busy with the previous frame, otherwise the pulse is lost.
+*/
+void SimulatedAbiCam::Pulse()
+{
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        if (m_mode != Mode::Edge || !IsIdle())
+        {
+            ++m_stats.missedTriggers;
+            return;
+        }
+        StartExposure(m_triggerExposureMs, true);
+    }
+    m_wake.notify_all();
+}
+
+/**
+* Gate input: the exposure lasts while the gate is high. A rising gate
+* that finds the camera busy or not in gate mode is lost, and so is the
+* falling edge that belongs to it.
+*/
+void SimulatedAbiCam::SetGate(bool high)
+{
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        const auto now = Clock::now();
+        if (high)
+        {
+            if (m_mode != Mode::Gate || !IsIdle())
+            {
+                ++m_stats.missedTriggers;
+                return;
+            }
+            m_gateOpen = true;
+            m_exposing = true;
+            m_frameTriggered = true;
+            m_exposureStart = now;
+        }
+        else if (m_gateOpen)
+        {
+            m_gateOpen = false;
+            m_frameExposureMs = std::chrono::duration<double, std::milli>(now - m_exposureStart).count();
+            m_readyAt = now + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double, std::milli>(m_settings.overheadMs));
+            m_readyPending = true;
+        }
+    }
+    m_wake.notify_all();
+}
+
+void SimulatedAbiCam::SetSilent(bool silent)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    m_silent = silent;
+    m_input.clear();
+}
+
+void SimulatedAbiCam::SetHeatLoad(double degrees)
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    m_heatLoad = degrees;
+    UpdateTarget();
+}
+
+double SimulatedAbiCam::GetTemperature() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return TemperatureAt(Clock::now());
+}
+
+/**
+* Dark counts per pixel at the current temperature, what a background
+* taken now subtracts.
+*/
+double SimulatedAbiCam::GetDarkLevel() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_settings.darkLevel + m_settings.darkPerC * std::max(0.0, TemperatureAt(Clock::now()) - COOLED_C);
+}
+
+/**
+* Mean counts the pattern adds to a frame of the given exposure, what a
+* frame with a current background shows after subtraction.
+*/
+double SimulatedAbiCam::GetSignalMean(double exposureMs) const
+{
+    return m_settings.signalPer100Ms * exposureMs / 100.0;
+}
+
+std::string SimulatedAbiCam::GetMode() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    switch (m_mode)
+    {
+    case Mode::Edge:
+        return "edge";
+    case Mode::Gate:
+        return "gate";
+    case Mode::Burst:
+        return "burst";
+    default:
+        return "internal";
+    }
+}
+
+SimulatedAbiCam::Stats SimulatedAbiCam::GetStats() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_stats;
+}
+
+/**
+* Firmware loop: runs commands as they complete and sends the frame
+* confirmation when an exposure plus the readout overhead is over.
+*/
+void SimulatedAbiCam::Run()
+{
+    AllocationCounter::Excluded excluded;
+    const auto gap = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(m_settings.commandGapMs));
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (!m_stop)
+    {
+        const auto now = Clock::now();
+        const auto newline = m_input.find('\n');
+        if (newline != std::string::npos || (!m_input.empty() && now - m_lastInput >= gap))
+        {
+            std::string command;
+            if (newline != std::string::npos)
+            {
+                command = m_input.substr(0, newline);
+                m_input.erase(0, newline + 1);
+            }
+            else
+            {
+                command.swap(m_input);
+            }
+            Execute(command, lock);
+            continue;
+        }
+
+        if (m_readyPending && now >= m_readyAt)
+        {
+            m_readyPending = false;
+            m_exposing = false;
+            m_frameReady = true;
+            const uint8_t confirmation[2] = { 'O', 'K' };
+            Send(confirmation, sizeof(confirmation), lock);
+            continue;
+        }
+
+        auto until = now + std::chrono::milliseconds(100);
+        if (!m_input.empty())
+            until = std::min(until, m_lastInput + gap);
+        if (m_readyPending)
+            until = std::min(until, m_readyAt);
+        m_wake.wait_until(lock, until);
+    }
+}
+
+void SimulatedAbiCam::Execute(const std::string& command, std::unique_lock<std::mutex>& lock)
+{
+    const auto tokens = Split(command);
+    if (tokens.empty())
+        return;
+    ++m_stats.commands;
+
+    const std::string& name = tokens[0];
+    const uint8_t ack = 0x06;
+    if (name == "ver")
+    {
+        SendText(VERSION, lock);
+    }
+    else if (name == "hlp")
+    {
+        SendText(std::string(HELP) + (m_settings.packed ? PACKED_HELP : "") + HELP_END, lock);
+    }
+    else if (name == "chp")
+    {
+        const auto adc = static_cast<unsigned>((TemperatureAt(Clock::now()) + 273.15) * 4096.0 / ADC_V);
+        const uint8_t answer[4] = { static_cast<uint8_t>(adc & 0xff), static_cast<uint8_t>(adc >> 8), 0, 0 };
+        Send(answer, sizeof(answer), lock);
+    }
+    else if (name == "cld")
+    {
+        m_cold = Arg(tokens, 1, 0);
+        UpdateTarget();
+        Send(&ack, 1, lock);
+    }
+    else if (name == "sht")
+    {
+        // a shot is taken in any mode, the host uses it for backgrounds
+        StartExposure(static_cast<double>(Arg(tokens, 1, 0)), false);
+    }
+    else if (name == "rid")
+    {
+        if (!m_frameReady)
+        {
+            ++m_stats.protocolErrors;
+            return;
+        }
+        SendFrame(static_cast<int>(Arg(tokens, 1, 1)), static_cast<int>(Arg(tokens, 2, 8)), lock);
+    }
+    else if (name == "trg")
+    {
+        // arming drops whatever the sensor was doing
+        m_exposing = m_gateOpen = m_readyPending = m_frameReady = false;
+        m_triggerExposureMs = static_cast<double>(Arg(tokens, 2, 0));
+        switch (Arg(tokens, 1, 0))
+        {
+        case 1:
+            m_mode = Mode::Edge;
+            break;
+        case 2:
+            m_mode = Mode::Gate;
+            break;
+        case 3:
+            m_mode = Mode::Burst;
+            m_burstLeft = Arg(tokens, 3, 1);
+            break;
+        default:
+            m_mode = Mode::Internal;
+            break;
+        }
+        if (m_mode != Mode::Internal)
+            ++m_stats.arms;
+        Send(&ack, 1, lock);
+        if (m_mode == Mode::Burst && m_burstLeft > 0)
+            StartExposure(m_triggerExposureMs, true);
+    }
+    else
+    {
+        ++m_stats.protocolErrors;
+    }
+}
+
+bool SimulatedAbiCam::IsIdle() const
+{
+    return !m_exposing && !m_gateOpen && !m_readyPending && !m_frameReady && !m_transferring;
+}
+
+void SimulatedAbiCam::StartExposure(double exposureMs, bool triggered)
+{
+    const auto now = Clock::now();
+    m_exposing = true;
+    m_frameTriggered = triggered;
+    m_exposureStart = now;
+    m_frameExposureMs = exposureMs;
+    m_readyAt = now + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(exposureMs + m_settings.overheadMs));
+    m_readyPending = true;
+}
+
+/**
+* Streams the exposed frame at the link throughput, a byte per pixel with
+* the counts scaled to the requested depth, or with packed transfer and a
+* depth under 8 the samples of every row packed most significant bit first.
+* A burst goes on with its next exposure once the frame is out.
+*/
+void SimulatedAbiCam::SendFrame(int binning, int bitDepth, std::unique_lock<std::mutex>& lock)
+{
+    binning = std::clamp(binning, 1, SENSOR_WIDTH);
+    bitDepth = std::clamp(bitDepth, 1, 8);
+    const int width = SENSOR_WIDTH / binning;
+    const int height = SENSOR_HEIGHT / binning;
+    const int shift = 8 - bitDepth;
+    const int maxValue = (1 << bitDepth) - 1;
+
+    const double dark = m_settings.darkLevel +
+        m_settings.darkPerC * std::max(0.0, TemperatureAt(m_exposureStart) - COOLED_C);
+    const double signal = GetSignalMean(m_frameExposureMs);
+    m_frame.resize(static_cast<size_t>(width) * height);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const bool bright = ((x * binning / CHECKER_CELL + y * binning / CHECKER_CELL) & 1) != 0;
+            const double noise = static_cast<double>(m_random() % 5) - 2.0;
+            const double counts = dark + (bright ? 1.5 : 0.5) * signal + noise;
+            const int value = static_cast<int>(std::lround(std::max(counts, 0.0))) >> shift;
+            m_frame[static_cast<size_t>(y) * width + x] = static_cast<uint8_t>(std::min(value, maxValue));
+        }
+    }
+
+    if (m_settings.packed && bitDepth < 8)
+    {
+        // in place, a packed row never reaches past the row it came from
+        size_t out = 0;
+        for (int y = 0; y < height; ++y)
+        {
+            uint32_t acc = 0;
+            int accBits = 0;
+            for (int x = 0; x < width; ++x)
+            {
+                acc = (acc << bitDepth) | m_frame[static_cast<size_t>(y) * width + x];
+                accBits += bitDepth;
+                while (accBits >= 8)
+                {
+                    accBits -= 8;
+                    m_frame[out++] = static_cast<uint8_t>(acc >> accBits);
+                }
+            }
+            if (accBits > 0)
+                m_frame[out++] = static_cast<uint8_t>(acc << (8 - accBits));
+        }
+        m_frame.resize(out);
+    }
+
+    m_frameReady = false;
+    m_transferring = true;
+    ++m_stats.frames;
+    m_stats.frameBytes += m_frame.size();
+    if (m_frameTriggered)
+        ++m_stats.triggeredFrames;
+
+    // the lock is released for the whole transfer, trigger inputs that come
+    // meanwhile see the camera busy
+    lock.unlock();
+    const auto start = Clock::now();
+    for (size_t sent = 0; sent < m_frame.size();)
+    {
+        const size_t chunk = std::min(FRAME_CHUNK_BYTES, m_frame.size() - sent);
+        m_output(m_frame.data() + sent, chunk);
+        sent += chunk;
+        std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(sent / m_settings.bytesPerSec)));
+    }
+    lock.lock();
+    m_transferring = false;
+
+    if (m_mode == Mode::Burst)
+    {
+        if (--m_burstLeft > 0)
+            StartExposure(m_triggerExposureMs, true);
+        else
+            m_mode = Mode::Internal;
+    }
+}
+
+void SimulatedAbiCam::Send(const uint8_t* data, size_t bytes, std::unique_lock<std::mutex>& lock)
+{
+    if (m_silent)
+        return;
+    lock.unlock();
+    m_output(data, bytes);
+    lock.lock();
+}
+
+void SimulatedAbiCam::SendText(const std::string& text, std::unique_lock<std::mutex>& lock)
+{
+    Send(reinterpret_cast<const uint8_t*>(text.data()), text.size(), lock);
+}
+
+double SimulatedAbiCam::TemperatureAt(Clock::time_point t) const
+{
+    const double s = std::chrono::duration<double>(t - m_tempSince).count();
+    return m_tempTarget + (m_tempFrom - m_tempTarget) * std::exp(-std::max(s, 0.0) / m_settings.coolTauS);
+}
+
+void SimulatedAbiCam::UpdateTarget()
+{
+    const auto now = Clock::now();
+    m_tempFrom = TemperatureAt(now);
+    m_tempSince = now;
+    m_tempTarget = (m_cold ? COOLED_C : AMBIENT_C) + m_heatLoad;
+}
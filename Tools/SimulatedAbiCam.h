@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* Model of the camera firmware, for running the adapter without hardware.
+* Speaks the protocol the adapter assumes (ver, hlp, chp, cld, sht, rid and
+* trg) on a byte stream: bytes from the host go to Receive(), bytes for the
+* host come out of the output callback. Commands sent without a terminator
+* end when the host pauses, which it always does to wait for the answer.
+*
+* The trigger inputs are driven by the caller with Pulse() and SetGate().
+* Frames are a checkerboard over a dark level that rises with the sensor
+* temperature, so a stale background shows up in the subtracted mean.
+*/
+class SimulatedAbiCam
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void(const uint8_t* data, size_t bytes)> Output;
+
+    static const int SENSOR_WIDTH = 512;
+    static const int SENSOR_HEIGHT = 512;
+
+    struct Settings
+    {
+        double bytesPerSec = 4.0e6;    // link throughput for frame data
+        double overheadMs = 2.0;        // readout before the confirmation
+        double commandGapMs = 3.0;      // host pause that ends a command
+        double darkLevel = 20.0;        // dark counts at the cooled temperature
+        double darkPerC = 2.0;          // extra dark counts per degree above it
+        double signalPer100Ms = 80.0;   // mean signal counts of a 100 ms exposure
+        double coolTauS = 1.0;          // time constant of the temperature
+        bool packed = false;            // rid below 8 bits sends packed samples
+    };
+
+    struct Stats
+    {
+        unsigned long commands = 0;
+        unsigned long protocolErrors = 0;  // unknown commands, rid without a frame
+        unsigned long frames = 0;          // frames sent to the host
+        unsigned long long frameBytes = 0; // of frame data
+        unsigned long triggeredFrames = 0; // of them exposed on a trigger input
+        unsigned long missedTriggers = 0;  // pulses and gates while busy or disarmed
+        unsigned long arms = 0;
+    };
+
+    SimulatedAbiCam(Output output, Settings settings);
+    ~SimulatedAbiCam();
+
+    void Receive(const uint8_t* data, size_t bytes);
+
+    // trigger inputs
+    void Pulse();
+    void SetGate(bool high);
+
+    // faults: a hung firmware ignores everything, a heat load warms the sensor
+    void SetSilent(bool silent);
+    void SetHeatLoad(double degrees);
+
+    double GetTemperature() const;
+    double GetDarkLevel() const;
+    double GetSignalMean(double exposureMs) const;
+    std::string GetMode() const;
+    Stats GetStats() const;
+
+private:
+    enum class Mode { Internal, Edge, Gate, Burst };
+
+    void Run();
+    void Execute(const std::string& command, std::unique_lock<std::mutex>& lock);
+    bool IsIdle() const;
+    void StartExposure(double exposureMs, bool triggered);
+    void SendFrame(int binning, int bitDepth, std::unique_lock<std::mutex>& lock);
+    void Send(const uint8_t* data, size_t bytes, std::unique_lock<std::mutex>& lock);
+    void SendText(const std::string& text, std::unique_lock<std::mutex>& lock);
+    double TemperatureAt(Clock::time_point t) const;
+    void UpdateTarget();
+
+    const Output m_output;
+    const Settings m_settings;
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_wake;
+    bool m_stop;
+    std::thread m_thread;
+
+    std::string m_input;
+    Clock::time_point m_lastInput;
+    bool m_silent;
+
+    Mode m_mode;
+    double m_triggerExposureMs;
+    long m_burstLeft;
+    bool m_exposing;        // exposure running, ends at m_readyAt - overhead
+    bool m_gateOpen;        // gate exposure running until the gate falls
+    bool m_readyPending;    // confirmation due at m_readyAt
+    bool m_frameReady;      // confirmation sent, waiting for rid
+    bool m_transferring;
+    bool m_frameTriggered;
+    Clock::time_point m_exposureStart;
+    Clock::time_point m_readyAt;
+    double m_frameExposureMs;
+
+    // the temperature relaxes from m_tempFrom towards m_tempTarget
+    long m_cold;
+    double m_heatLoad;
+    double m_tempFrom;
+    double m_tempTarget;
+    Clock::time_point m_tempSince;
+
+    std::minstd_rand m_random;
+    std::vector<uint8_t> m_frame;
+    Stats m_stats;
+};
@@ -0,0 +1,123 @@
+#include "SimulatedRig.h"
+
+#include "ModuleInterface.h"
+
+#include <cstdio>
+
+#include <unistd.h>
+
+const char* const SimulatedRig::PORT_NAME = "SimulatedPort";
+
+SimulatedRig::SimulatedRig(SimulatedAbiCam::Settings settings) :
+    m_link(settings),
+    m_camera(nullptr)
+{
+}
+
+SimulatedRig::~SimulatedRig()
+{
+    Stop();
+}
+
+bool SimulatedRig::Start(std::string& error)
+{
+    if (!m_link.Open(error))
+        return false;
+
+    m_port = std::make_unique<SimulatedPort>(PORT_NAME, m_link.GetPortName());
+    if (m_port->Initialize() != DEVICE_OK)
+    {
+        error = "Couldn't open " + m_link.GetPortName();
+        return false;
+    }
+    m_core.AddPort(m_port.get());
+
+    InitializeModuleData();
+    m_camera = static_cast<MM::Camera*>(CreateDevice("AbiCam"));
+    if (!m_camera)
+    {
+        error = "The module has no AbiCam device";
+        return false;
+    }
+    m_camera->SetCallback(&m_core);
+    m_camera->SetLabel("AbiCam");
+
+    // a capability cache of its own, so runs don't see each other's
+    m_capsCachePath = "/tmp/AbiCamSimulatedCaps-" + std::to_string(getpid()) + ".txt";
+    if (!Set(MM::g_Keyword_Port, PORT_NAME) || !Set("Capability Cache", m_capsCachePath))
+    {
+        error = "Couldn't set the pre-init properties";
+        return false;
+    }
+
+    int ret = m_camera->Initialize();
+    if (ret != DEVICE_OK)
+    {
+        error = "Initialize failed: " + ErrorText(ret);
+        return false;
+    }
+    return true;
+}
+
+void SimulatedRig::Stop()
+{
+    if (m_camera)
+    {
+        m_camera->Shutdown();
+        DeleteDevice(m_camera);
+        m_camera = nullptr;
+    }
+    if (m_port)
+        m_port->Shutdown();
+    m_link.Close();
+    if (!m_capsCachePath.empty())
+        std::remove(m_capsCachePath.c_str());
+}
+
+MM::Camera& SimulatedRig::GetCamera()
+{
+    return *m_camera;
+}
+
+SimulatedAbiCam& SimulatedRig::GetFirmware()
+{
+    return m_link.GetCamera();
+}
+
+SimulatedPort& SimulatedRig::GetPort()
+{
+    return *m_port;
+}
+
+FakeCore& SimulatedRig::GetCore()
+{
+    return m_core;
+}
+
+PtyLink& SimulatedRig::GetLink()
+{
+    return m_link;
+}
+
+bool SimulatedRig::Set(const char* property, const std::string& value)
+{
+    int ret = m_camera->SetProperty(property, value.c_str());
+    if (ret != DEVICE_OK)
+        std::fprintf(stderr, "Setting \"%s\" to \"%s\" failed: %s\n", property, value.c_str(), ErrorText(ret).c_str());
+    return ret == DEVICE_OK;
+}
+
+std::string SimulatedRig::Get(const char* property) const
+{
+    char value[MM::MaxStrLength] = "";
+    m_camera->GetProperty(property, value);
+    return value;
+}
+
+std::string SimulatedRig::ErrorText(int ret) const
+{
+    char text[MM::MaxStrLength] = "";
+    if (!m_camera || !m_camera->GetErrorText(ret, text))
+        return "error " + std::to_string(ret);
+    return text;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "FakeCore.h"
+#include "PtyLink.h"
+#include "SimulatedAbiCam.h"
+
+#include <memory>
+#include <string>
+
+/**
+* The adapter loaded on a simulated camera: the firmware served on a pty,
+* a port device opening its tty and a core routing the adapter's serial
+* calls to it, set up in the order MMCore would. The adapter is created
+* through its module interface, like MMCore loads it.
+*/
+class SimulatedRig
+{
+public:
+    static const char* const PORT_NAME;
+
+    explicit SimulatedRig(SimulatedAbiCam::Settings settings = SimulatedAbiCam::Settings());
+    ~SimulatedRig();
+
+    // loads and initializes the adapter, false with the reason in error
+    bool Start(std::string& error);
+    void Stop();
+
+    MM::Camera& GetCamera();
+    SimulatedAbiCam& GetFirmware();
+    SimulatedPort& GetPort();
+    FakeCore& GetCore();
+    PtyLink& GetLink();
+
+    // property access that reports failures with the adapter's error text
+    bool Set(const char* property, const std::string& value);
+    std::string Get(const char* property) const;
+    std::string ErrorText(int ret) const;
+
+private:
+    PtyLink m_link;
+    FakeCore m_core;
+    std::unique_ptr<SimulatedPort> m_port;
+    MM::Camera* m_camera;
+    std::string m_capsCachePath;
+};
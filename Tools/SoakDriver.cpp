@@ -0,0 +1,943 @@
+#include "AllocationCounter.h"
+#include "LatencyHistogram.h"
+#include "SimulatedRig.h"
+#include "SoakMonitor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+/**
+* Soaks the adapter on the simulated camera: snaps and sequences run back
+* to back for the whole duration while a seeded random schedule changes
+* settings and injects faults, as hours of use at a rig would.
+*
+*   SoakDriver [--duration 1h] [--report 1m] [--seed N] [-v]
+*
+* Durations take s, m or h. The settings changed are exposure, binning,
+* pixel type, bit depth, background subtraction, ROI, cooling, trigger
+* mode, progressive live view and the stream server; the faults are
+* firmware that stops answering, a port that vanishes, heat on the sensor,
+* trigger inputs held back and the adapter's fault injection on the link.
+*
+* Every frame's latency from the end of its exposure to its insertion is
+* recorded, and the process's RSS, threads and live heap (counted by
+* AllocationCounter) are sampled every few seconds. A progress line is
+* printed per report interval and a summary at the end with latency
+* p99.9, the memory trends and the adapter's heap allocations per frame in
+* the quietest stretch of the run. Exits non-zero for a frame stall, a
+* call into the adapter that doesn't return, a snap or sequence failing
+* away from the injected faults, frames copied through the heap or no
+* stretch quiet enough to tell, threads left behind, or, on runs of ten
+* minutes or more, memory that keeps growing. -v prints the adapter's log.
+*/
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const double SAMPLE_INTERVAL_S = 5.0;
+    const double STALL_S = 10.0;            // capturing without a frame, away from faults
+    const double FAULT_GRACE_S = 15.0;      // for the adapter to recover after a fault
+    const double SLOW_STOP_MS = 5000.0;
+    const double STEADY_MIN_FRAMES = 20.0;  // in a sample window, to measure the heap per frame
+    const double WATCHDOG_S = 60.0;         // a call into the adapter this long never returns
+    const double TREND_MIN_S = 600.0;       // shortest run to judge leaks on
+    const double LEAK_HEAP_MB_PER_H = 1.0;
+    const double LEAK_RSS_MB_PER_H = 20.0;
+    const double MB = 1024.0 * 1024.0;
+
+    double Seconds(Clock::duration d)
+    {
+        return std::chrono::duration<double>(d).count();
+    }
+
+    Clock::duration FromSeconds(double s)
+    {
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(s));
+    }
+
+    std::string FormatTime(double s)
+    {
+        const long t = static_cast<long>(s);
+        char text[32];
+        std::snprintf(text, sizeof(text), "%ld:%02ld:%02ld", t / 3600, t / 60 % 60, t % 60);
+        return text;
+    }
+
+    // "90", "90s", "30m" or "2h"
+    bool ParseDuration(const char* text, double& seconds)
+    {
+        char* end = nullptr;
+        const double value = std::strtod(text, &end);
+        if (end == text || value <= 0.0)
+            return false;
+        double scale = 0.0;
+        if (!*end || !std::strcmp(end, "s"))
+            scale = 1.0;
+        else if (!std::strcmp(end, "m"))
+            scale = 60.0;
+        else if (!std::strcmp(end, "h"))
+            scale = 3600.0;
+        seconds = value * scale;
+        return scale > 0.0;
+    }
+
+    struct Options
+    {
+        double durationS = 3600.0;
+        double reportS = 60.0;
+        unsigned long seed = 0;
+        bool verbose = false;
+    };
+
+    /**
+    * Ends the run when a call into the adapter doesn't return, naming the
+    * call and printing the adapter's last messages, so an unbounded wait
+    * fails the soak instead of hanging it.
+    */
+    class Watchdog
+    {
+    public:
+        explicit Watchdog(FakeCore& core) :
+            m_core(core),
+            m_call(nullptr),
+            m_since(0),
+            m_stop(false)
+        {
+            m_thread = std::thread([this] { Run(); });
+        }
+
+        ~Watchdog()
+        {
+            m_stop = true;
+            m_thread.join();
+        }
+
+        template <typename F>
+        auto Call(const char* call, F f)
+        {
+            m_since = Clock::now().time_since_epoch().count();
+            m_call = call;
+            struct Leave
+            {
+                std::atomic<const char*>& call;
+                ~Leave() { call = nullptr; }
+            } leave{ m_call };
+            return f();
+        }
+
+    private:
+        void Run()
+        {
+            while (!m_stop)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+                const char* call = m_call;
+                if (!call)
+                    continue;
+                const double s = Seconds(Clock::now().time_since_epoch() - Clock::duration(m_since.load()));
+                if (s > WATCHDOG_S)
+                {
+                    std::printf("FAIL %s hasn't returned in %.0f s, last adapter messages:\n", call, s);
+                    m_core.PrintRecentLog(30);
+                    std::fflush(stdout);
+                    std::_Exit(3);
+                }
+            }
+        }
+
+        FakeCore& m_core;
+        std::atomic<const char*> m_call;
+        std::atomic<Clock::rep> m_since;
+        std::atomic<bool> m_stop;
+        std::thread m_thread;
+    };
+
+    /**
+    * Trigger inputs of the firmware during triggered runs: edge pulses, or
+    * gates of a width, at a period. A fault can hold them back for a while.
+    */
+    class Inputs
+    {
+    public:
+        explicit Inputs(SimulatedAbiCam& firmware) :
+            m_firmware(firmware),
+            m_stop(false),
+            m_heldUntil(0)
+        {
+        }
+
+        ~Inputs()
+        {
+            Stop();
+        }
+
+        // gateMs 0 for edge pulses
+        void Start(double periodMs, double gateMs)
+        {
+            Stop();
+            m_stop = false;
+            m_thread = std::thread([this, periodMs, gateMs] {
+                AllocationCounter::Excluded excluded;
+                auto next = Clock::now();
+                while (!m_stop)
+                {
+                    next += FromSeconds(periodMs / 1000.0);
+                    if (Clock::now().time_since_epoch().count() >= m_heldUntil)
+                    {
+                        if (gateMs > 0.0)
+                        {
+                            m_firmware.SetGate(true);
+                            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(gateMs));
+                            m_firmware.SetGate(false);
+                        }
+                        else
+                        {
+                            m_firmware.Pulse();
+                        }
+                    }
+                    std::this_thread::sleep_until(next);
+                }
+            });
+        }
+
+        void Hold(double s)
+        {
+            m_heldUntil = (Clock::now() + FromSeconds(s)).time_since_epoch().count();
+        }
+
+        void Stop()
+        {
+            m_stop = true;
+            if (m_thread.joinable())
+                m_thread.join();
+        }
+
+    private:
+        SimulatedAbiCam& m_firmware;
+        std::atomic<bool> m_stop;
+        std::atomic<Clock::rep> m_heldUntil;
+        std::thread m_thread;
+    };
+
+    struct Sample
+    {
+        double s;               // since the start
+        double rssMB;
+        double heapMB;          // live operator new blocks
+        double heapBlocks;
+        double threads;
+        uint64_t frames;
+        uint64_t allocations;   // the adapter's, see AllocationCounter
+        uint64_t allocatedBytes;
+        uint64_t largeAllocations;
+    };
+
+    // heap allocations per frame in a sample window
+    struct HeapPerFrame
+    {
+        bool measured = false;
+        double allocations = 0.0;
+        double bytes = 0.0;
+        double large = 0.0;     // of AllocationCounter::LARGE_BYTES or more
+    };
+
+    // least squares slope per hour of a field, over the samples from fromS on
+    double TrendPerHour(const std::vector<Sample>& samples, double fromS, double Sample::* field)
+    {
+        double n = 0.0;
+        double meanT = 0.0;
+        double meanV = 0.0;
+        for (const Sample& sample : samples)
+        {
+            if (sample.s < fromS)
+                continue;
+            n += 1.0;
+            meanT += sample.s / 3600.0;
+            meanV += sample.*field;
+        }
+        if (n < 2.0)
+            return 0.0;
+        meanT /= n;
+        meanV /= n;
+
+        double sTT = 0.0;
+        double sTV = 0.0;
+        for (const Sample& sample : samples)
+        {
+            if (sample.s < fromS)
+                continue;
+            sTT += (sample.s / 3600.0 - meanT) * (sample.s / 3600.0 - meanT);
+            sTV += (sample.s / 3600.0 - meanT) * (sample.*field - meanV);
+        }
+        return sTT > 0.0 ? sTV / sTT : 0.0;
+    }
+
+    enum Fault
+    {
+        FAULT_SILENCE,
+        FAULT_UNPLUG,
+        FAULT_LINK_NOISE,
+        FAULT_HEAT,
+        FAULT_HELD_INPUTS,
+        FAULT_KINDS
+    };
+
+    const char* const FAULT_NAMES[FAULT_KINDS] = {
+        "firmware silences", "unplugs", "link noise bursts", "heat steps", "held inputs"
+    };
+
+    class Soak
+    {
+    public:
+        Soak(SimulatedRig& rig, const Options& options) :
+            m_rig(rig),
+            m_camera(rig.GetCamera()),
+            m_firmware(rig.GetFirmware()),
+            m_options(options),
+            m_random(options.seed),
+            m_watchdog(rig.GetCore()),
+            m_inputs(rig.GetFirmware()),
+            m_frames(0),
+            m_frameBytes(0),
+            m_lastFrame(0)
+        {
+        }
+
+        void Setup();
+        void Run();
+        bool Finish();
+
+    private:
+        double Uniform(double lo, double hi) { return std::uniform_real_distribution<double>(lo, hi)(m_random); }
+        long RandomInt(long lo, long hi) { return std::uniform_int_distribution<long>(lo, hi)(m_random); }
+        bool Coin(double p = 0.5) { return Uniform(0.0, 1.0) < p; }
+
+        template <typename T>
+        const T& Pick(const std::vector<T>& values) { return values[RandomInt(0, static_cast<long>(values.size()) - 1)]; }
+
+        std::vector<std::string> AllowedValues(const char* property) const;
+        bool Set(const char* property, const std::string& value);
+        void SetRandom(const char* property);
+
+        void OnImage(const FakeCore::Image& image);
+        void ChangeSetting();
+        void StartFault(Clock::time_point now);
+        void EndFault(Clock::time_point now);
+        void StartRun(Clock::time_point now);
+        void WatchRun(Clock::time_point now);
+        void StopRun();
+        void EndRun();
+        bool NearFault(Clock::time_point now) const;
+        void RunFailed(const char* what, const std::string& detail);
+        void Quiesce();
+        Sample TakeSample();
+        void Report(Clock::time_point now);
+
+        SimulatedRig& m_rig;
+        MM::Camera& m_camera;
+        SimulatedAbiCam& m_firmware;
+        const Options m_options;
+        std::mt19937_64 m_random;
+        Watchdog m_watchdog;
+        Inputs m_inputs;
+
+        // from the adapter's sequence thread
+        LatencyHistogram m_latency;
+        std::atomic<uint64_t> m_frames;
+        std::atomic<uint64_t> m_frameBytes;
+        std::atomic<Clock::rep> m_lastFrame;
+
+        Clock::time_point m_start;
+        Clock::time_point m_end;
+        Clock::time_point m_nextSetting;
+        Clock::time_point m_nextFault;
+        Clock::time_point m_faultEnd;
+        Clock::time_point m_graceUntil;
+        Clock::time_point m_nextRun;
+        Clock::time_point m_runStart;
+        Clock::time_point m_runStop;
+        Clock::time_point m_nextSample;
+        Clock::time_point m_nextReport;
+
+        unsigned m_sensorSize = 0;
+        bool m_running = false;
+        bool m_continuous = false;
+        long m_runFrames = 0;
+        uint64_t m_runFirstFrame = 0;
+        bool m_faultActive = false;
+        Fault m_fault = FAULT_SILENCE;
+        std::string m_triggerMode;
+
+        unsigned long m_settings = 0;
+        unsigned long m_refused = 0;
+        unsigned long m_sequences = 0;
+        unsigned long m_faultErrors = 0;       // snaps and sequences failing near a fault
+        unsigned long m_unexpectedErrors = 0;  // and away from them
+        unsigned long m_snaps = 0;
+        unsigned long m_stalls = 0;
+        unsigned long m_faults[FAULT_KINDS] = {};
+        double m_slowestStopMs = 0.0;
+
+        std::vector<Sample> m_samples;
+        HeapPerFrame m_steady;
+        uint64_t m_reportFrames = 0;
+        unsigned m_idleThreads = 0;
+    };
+
+    std::vector<std::string> Soak::AllowedValues(const char* property) const
+    {
+        std::vector<std::string> values;
+        const unsigned count = m_camera.GetNumberOfPropertyValues(property);
+        for (unsigned i = 0; i < count; ++i)
+        {
+            char value[MM::MaxStrLength] = "";
+            if (m_camera.GetPropertyValueAt(property, i, value))
+                values.push_back(value);
+        }
+        return values;
+    }
+
+    /**
+    * Sets a property as a user would; refusals, like changes the adapter
+    * doesn't take while capturing, are counted rather than reported.
+    */
+    bool Soak::Set(const char* property, const std::string& value)
+    {
+        ++m_settings;
+        const int ret = m_watchdog.Call(property, [&] { return m_camera.SetProperty(property, value.c_str()); });
+        if (ret != DEVICE_OK)
+            ++m_refused;
+        return ret == DEVICE_OK;
+    }
+
+    void Soak::SetRandom(const char* property)
+    {
+        const std::vector<std::string> values = AllowedValues(property);
+        if (!values.empty())
+            Set(property, Pick(values));
+    }
+
+    void Soak::OnImage(const FakeCore::Image& image)
+    {
+        if (image.metadata.HasTag("ExposureEnd-ms"))
+        {
+            const double exposureEndMs = std::atof(image.metadata.GetSingleTag("ExposureEnd-ms").GetValue().c_str());
+            m_latency.Add(std::max(0.0, image.insertedMs - exposureEndMs));
+        }
+        m_frameBytes += static_cast<uint64_t>(image.width) * image.height * image.bytesPerPixel;
+        ++m_frames;
+        m_lastFrame = Clock::now().time_since_epoch().count();
+    }
+
+    void Soak::Setup()
+    {
+        m_rig.GetCore().SetImageHandler([this](const FakeCore::Image& image) { OnImage(image); });
+
+        m_rig.Set("Auto Reconnect", "1");
+        m_rig.Set("Trigger Timeout ms", "2000");
+        // a port of its own, so runs don't collide on the default
+        m_rig.Set("Stream Endpoint", "127.0.0.1:" + std::to_string(20000 + getpid() % 20000));
+        m_camera.ClearROI();
+        m_sensorSize = m_camera.GetImageWidth() * m_camera.GetBinning();
+
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        size_t rssBytes = 0;
+        SoakMonitor::ReadProcessStats(rssBytes, m_idleThreads);
+
+        m_start = Clock::now();
+        m_end = m_start + FromSeconds(m_options.durationS);
+        m_nextSetting = m_start + FromSeconds(Uniform(1.0, 5.0));
+        m_nextFault = m_start + FromSeconds(Uniform(5.0, 30.0));
+        m_nextRun = m_start;
+        m_nextSample = m_start;
+        m_nextReport = m_start + FromSeconds(m_options.reportS);
+    }
+
+    void Soak::Run()
+    {
+        for (Clock::time_point now = Clock::now(); now < m_end; now = Clock::now())
+        {
+            if (now >= m_nextSetting)
+            {
+                ChangeSetting();
+                m_nextSetting = now + FromSeconds(Uniform(1.0, 5.0));
+            }
+            if (m_faultActive && now >= m_faultEnd)
+                EndFault(now);
+            else if (!m_faultActive && now >= m_nextFault)
+                StartFault(now);
+
+            if (m_running)
+                WatchRun(now);
+            else if (now >= m_nextRun)
+                StartRun(now);
+
+            if (now >= m_nextSample)
+            {
+                const Sample sample = TakeSample();
+                if (!m_samples.empty())
+                {
+                    // the window with the least heap traffic per frame is the steady state
+                    const Sample& last = m_samples.back();
+                    const double frames = static_cast<double>(sample.frames - last.frames);
+                    if (frames >= STEADY_MIN_FRAMES)
+                    {
+                        HeapPerFrame window;
+                        window.measured = true;
+                        window.allocations = (sample.allocations - last.allocations) / frames;
+                        window.bytes = (sample.allocatedBytes - last.allocatedBytes) / frames;
+                        window.large = (sample.largeAllocations - last.largeAllocations) / frames;
+                        if (!m_steady.measured || window.bytes < m_steady.bytes)
+                            m_steady = window;
+                    }
+                }
+                m_samples.push_back(sample);
+                m_nextSample = now + FromSeconds(SAMPLE_INTERVAL_S);
+            }
+            if (now >= m_nextReport)
+            {
+                Report(now);
+                m_nextReport = now + FromSeconds(m_options.reportS);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    void Soak::ChangeSetting()
+    {
+        switch (RandomInt(0, 10))
+        {
+        case 0:
+        {
+            const double exposureMs = Uniform(1.0, 60.0);
+            ++m_settings;
+            m_watchdog.Call("SetExposure", [&] { m_camera.SetExposure(exposureMs); return 0; });
+            break;
+        }
+        case 1:
+            SetRandom(MM::g_Keyword_Binning);
+            break;
+        case 2:
+            SetRandom("Binning Mode");
+            break;
+        case 3:
+            SetRandom(MM::g_Keyword_PixelType);
+            break;
+        case 4:
+            SetRandom("BitDepth");
+            break;
+        case 5:
+            Set(Coin() ? "Adaptive Bit Depth" : "Subtract Background", Coin() ? "1" : "0");
+            break;
+        case 6:
+        {
+            ++m_settings;
+            int ret = DEVICE_OK;
+            const unsigned size = m_sensorSize / std::max(1, m_camera.GetBinning());
+            if (Coin() || size < 8)
+            {
+                ret = m_watchdog.Call("ClearROI", [&] { return m_camera.ClearROI(); });
+            }
+            else
+            {
+                const unsigned width = static_cast<unsigned>(RandomInt(size / 8, size));
+                const unsigned height = static_cast<unsigned>(RandomInt(size / 8, size));
+                const unsigned x = static_cast<unsigned>(RandomInt(0, size - width));
+                const unsigned y = static_cast<unsigned>(RandomInt(0, size - height));
+                ret = m_watchdog.Call("SetROI", [&] { return m_camera.SetROI(x, y, width, height); });
+            }
+            if (ret != DEVICE_OK)
+                ++m_refused;
+            break;
+        }
+        case 7:
+            Set("Cool camera", Coin(0.8) ? "1" : "0");
+            break;
+        case 8:
+            Set("Stream Server", Coin() ? "1" : "0");
+            break;
+        case 9:
+            Set("Progressive Live View", Coin(0.3) ? "1" : "0");
+            break;
+        default:
+            Set("Trigger Background Refresh s", Pick(std::vector<std::string>{ "0", "0.5", "5" }));
+            break;
+        }
+    }
+
+    void Soak::StartFault(Clock::time_point now)
+    {
+        m_fault = static_cast<Fault>(RandomInt(0, FAULT_KINDS - 1));
+        ++m_faults[m_fault];
+
+        double s = 0.0;
+        switch (m_fault)
+        {
+        case FAULT_SILENCE:
+            s = Uniform(0.2, 3.0);
+            m_firmware.SetSilent(true);
+            break;
+        case FAULT_UNPLUG:
+            s = Uniform(0.2, 3.0);
+            m_rig.GetPort().Unplug(s * 1000.0);
+            break;
+        case FAULT_LINK_NOISE:
+            s = Uniform(2.0, 15.0);
+            Set("Fault Drop Probability", std::to_string(Uniform(0.0, 0.02)));
+            Set("Fault Delay Probability", std::to_string(Uniform(0.0, 0.02)));
+            Set("Fault Corrupt Probability", std::to_string(Uniform(0.0, 0.02)));
+            Set("Fault Truncate Probability", std::to_string(Uniform(0.0, 0.02)));
+            Set("Fault Delay ms", std::to_string(Uniform(10.0, 300.0)));
+            Set("Fault Injection", "1");
+            break;
+        case FAULT_HEAT:
+            m_firmware.SetHeatLoad(Uniform(0.0, 10.0));
+            break;
+        case FAULT_HELD_INPUTS:
+            s = Uniform(1.0, 4.0);
+            m_inputs.Hold(s);
+            break;
+        case FAULT_KINDS:
+            break;
+        }
+        m_faultActive = true;
+        m_faultEnd = now + FromSeconds(s);
+        if (m_options.verbose)
+            std::printf("fault: %s for %.1f s\n", FAULT_NAMES[m_fault], s);
+    }
+
+    void Soak::EndFault(Clock::time_point now)
+    {
+        if (m_fault == FAULT_SILENCE)
+            m_firmware.SetSilent(false);
+        else if (m_fault == FAULT_LINK_NOISE)
+            Set("Fault Injection", "0");
+        m_faultActive = false;
+        m_graceUntil = now + FromSeconds(FAULT_GRACE_S);
+        m_nextFault = now + FromSeconds(Uniform(5.0, 30.0));
+    }
+
+    /**
+    * Starts the next run in a random trigger mode: a few snaps, a sequence
+    * of some frames, or a continuous sequence until a random stop.
+    */
+    void Soak::StartRun(Clock::time_point now)
+    {
+        // the trigger mode only changes between runs
+        const std::vector<std::string> modes = AllowedValues(MM::g_Keyword_Trigger);
+        m_triggerMode = Coin() || modes.empty() ? std::string("Internal") : Pick(modes);
+        Set(MM::g_Keyword_Trigger, m_triggerMode);
+        if (m_triggerMode == "External Edge")
+            m_inputs.Start(Uniform(20.0, 150.0), 0.0);
+        else if (m_triggerMode == "External Gate")
+            m_inputs.Start(Uniform(60.0, 200.0), Uniform(5.0, 40.0));
+
+        if (Coin(0.2))
+        {
+            for (long i = RandomInt(1, 5); i > 0; --i)
+            {
+                ++m_snaps;
+                const int ret = m_watchdog.Call("SnapImage", [&] { return m_camera.SnapImage(); });
+                if (ret != DEVICE_OK)
+                    RunFailed("snap", m_rig.ErrorText(ret));
+                else
+                    m_camera.GetImageBuffer();
+            }
+            m_inputs.Stop();
+            m_nextRun = Clock::now() + FromSeconds(Uniform(0.2, 2.0));
+            return;
+        }
+
+        m_continuous = Coin();
+        m_runFrames = m_continuous ? LONG_MAX : RandomInt(10, 500);
+        m_runFirstFrame = m_frames;
+        const int ret = m_watchdog.Call("StartSequenceAcquisition",
+            [&] { return m_camera.StartSequenceAcquisition(m_runFrames, 0.0, false); });
+        if (ret != DEVICE_OK)
+        {
+            RunFailed("sequence start", m_rig.ErrorText(ret));
+            m_inputs.Stop();
+            m_nextRun = now + FromSeconds(1.0);
+            return;
+        }
+        ++m_sequences;
+        m_running = true;
+        m_runStart = Clock::now();
+        m_runStop = m_runStart + FromSeconds(Uniform(5.0, 60.0));
+    }
+
+    void Soak::WatchRun(Clock::time_point now)
+    {
+        if (!m_camera.IsCapturing())
+        {
+            // a sequence only ends on its own before its last frame after an error
+            const uint64_t frames = m_frames - m_runFirstFrame;
+            if (m_continuous || frames < static_cast<uint64_t>(m_runFrames))
+                RunFailed("sequence", std::to_string(frames) + " of " +
+                    (m_continuous ? std::string("continuous") : std::to_string(m_runFrames)) + " frames");
+            EndRun();
+            return;
+        }
+        if (now >= m_runStop)
+        {
+            StopRun();
+            return;
+        }
+
+        const Clock::time_point lastFrame(Clock::duration(m_lastFrame.load()));
+        const Clock::time_point since = std::max({ lastFrame, m_runStart, m_graceUntil });
+        if (!m_faultActive && Seconds(now - since) > STALL_S)
+        {
+            ++m_stalls;
+            std::printf("%s  stall: no frame for %.0f s in a %s sequence, last adapter messages:\n",
+                FormatTime(Seconds(now - m_start)).c_str(), Seconds(now - since), m_triggerMode.c_str());
+            m_rig.GetCore().PrintRecentLog(15);
+            StopRun();
+        }
+    }
+
+    void Soak::StopRun()
+    {
+        const auto start = Clock::now();
+        m_watchdog.Call("StopSequenceAcquisition", [&] { return m_camera.StopSequenceAcquisition(); });
+        const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (ms > SLOW_STOP_MS)
+            std::printf("%s  stopping a %s sequence took %.0f ms\n", FormatTime(Seconds(start - m_start)).c_str(),
+                m_triggerMode.c_str(), ms);
+        m_slowestStopMs = std::max(m_slowestStopMs, ms);
+        EndRun();
+    }
+
+    void Soak::EndRun()
+    {
+        m_inputs.Stop();
+        m_running = false;
+        m_nextRun = Clock::now() + FromSeconds(Uniform(0.2, 2.0));
+    }
+
+    /**
+    * Whether a fault is injected, or ended recently enough that the adapter
+    * may still be recovering from it.
+    */
+    bool Soak::NearFault(Clock::time_point now) const
+    {
+        return m_faultActive || now < m_graceUntil;
+    }
+
+    /**
+    * Counts a failed snap or sequence: expected near an injected fault, a
+    * failure of the soak away from them.
+    */
+    void Soak::RunFailed(const char* what, const std::string& detail)
+    {
+        const auto now = Clock::now();
+        if (NearFault(now))
+        {
+            ++m_faultErrors;
+            return;
+        }
+        ++m_unexpectedErrors;
+        std::printf("%s  %s in %s mode failed away from faults (%s), last adapter messages:\n",
+            FormatTime(Seconds(now - m_start)).c_str(), what, m_triggerMode.c_str(), detail.c_str());
+        m_rig.GetCore().PrintRecentLog(10);
+    }
+
+    /**
+    * Stops everything started during the soak, for the threads to be
+    * compared with those at the start.
+    */
+    void Soak::Quiesce()
+    {
+        if (m_running)
+            StopRun();
+        if (m_faultActive)
+            EndFault(Clock::now());
+        m_firmware.SetHeatLoad(0.0);
+        Set("Stream Server", "0");
+        Set("Progressive Live View", "0");
+        Set(MM::g_Keyword_Trigger, "Internal");
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+    }
+
+    Sample Soak::TakeSample()
+    {
+        size_t rssBytes = 0;
+        unsigned threads = 0;
+        SoakMonitor::ReadProcessStats(rssBytes, threads);
+        const AllocationCounter::Counts heap = AllocationCounter::Get();
+
+        Sample sample;
+        sample.s = Seconds(Clock::now() - m_start);
+        sample.rssMB = rssBytes / MB;
+        sample.heapMB = heap.liveBytes / MB;
+        sample.heapBlocks = static_cast<double>(heap.LiveBlocks());
+        sample.threads = threads;
+        sample.frames = m_frames;
+        sample.allocations = heap.counted;
+        sample.allocatedBytes = heap.countedBytes;
+        sample.largeAllocations = heap.countedLarge;
+        return sample;
+    }
+
+    void Soak::Report(Clock::time_point now)
+    {
+        const Sample& sample = m_samples.back();
+        const uint64_t frames = m_frames;
+        std::printf("%s  %9llu frames %6.1f fps  p99.9 %7.1f ms  RSS %6.1f MB  heap %6.2f MB in %7.0f blocks  "
+            "%2.0f threads  %s reconnects\n",
+            FormatTime(Seconds(now - m_start)).c_str(), static_cast<unsigned long long>(frames),
+            (frames - m_reportFrames) / m_options.reportS, m_latency.GetPercentileMs(99.9), sample.rssMB,
+            sample.heapMB, sample.heapBlocks, sample.threads, m_rig.Get("Reconnects").c_str());
+        std::fflush(stdout);
+        m_reportFrames = frames;
+    }
+
+    /**
+    * Prints the summary; returns whether the soak passed.
+    */
+    bool Soak::Finish()
+    {
+        const double runS = Seconds(Clock::now() - m_start);
+        Quiesce();
+        const Sample last = TakeSample();
+        m_samples.push_back(last);
+        const Sample& first = m_samples.front();
+
+        const double warmupS = std::max(60.0, 0.1 * runS);
+        const double rssTrend = TrendPerHour(m_samples, warmupS, &Sample::rssMB);
+        const double heapTrend = TrendPerHour(m_samples, warmupS, &Sample::heapMB);
+        const double blockTrend = TrendPerHour(m_samples, warmupS, &Sample::heapBlocks);
+        double maxThreads = 0.0;
+        for (const Sample& sample : m_samples)
+            maxThreads = std::max(maxThreads, sample.threads);
+        const uint64_t frames = m_frames;
+        const double meanFrameBytes = frames ? static_cast<double>(m_frameBytes) / frames : 0.0;
+        const auto firmware = m_firmware.GetStats();
+
+        std::printf("\nsoak of %s, seed %lu\n", FormatTime(runS).c_str(), m_options.seed);
+        std::printf("runs:     %lu sequences, %lu snaps; %lu failed near faults, %lu away from them\n",
+            m_sequences, m_snaps, m_faultErrors, m_unexpectedErrors);
+        std::printf("frames:   %llu, latency p50 %.2f ms p99 %.2f ms p99.9 %.2f ms max %.2f ms\n",
+            static_cast<unsigned long long>(frames), m_latency.GetPercentileMs(50.0), m_latency.GetPercentileMs(99.0),
+            m_latency.GetPercentileMs(99.9), m_latency.GetMaxMs());
+        std::printf("adapter:  %s\n", m_rig.Get("Soak Summary").c_str());
+        std::printf("settings: %lu changes, %lu refused\n", m_settings, m_refused);
+        std::printf("faults: ");
+        for (int i = 0; i < FAULT_KINDS; ++i)
+            std::printf(" %lu %s%s", m_faults[i], FAULT_NAMES[i], i + 1 < FAULT_KINDS ? "," : "");
+        std::printf("; %s reconnects\n", m_rig.Get("Reconnects").c_str());
+        std::printf("firmware: %lu commands, %lu frames (%lu triggered), %lu triggers missed, %lu protocol errors\n",
+            firmware.commands, firmware.frames, firmware.triggeredFrames, firmware.missedTriggers, firmware.protocolErrors);
+        std::printf("RSS:      %.1f MB at the start, %.1f MB at the end, trend %+.2f MB/h\n",
+            first.rssMB, last.rssMB, rssTrend);
+        std::printf("heap:     %.2f MB in %.0f blocks at the start, %.2f MB in %.0f blocks at the end, "
+            "trend %+.3f MB/h %+.0f blocks/h\n",
+            first.heapMB, first.heapBlocks, last.heapMB, last.heapBlocks, heapTrend, blockTrend);
+        if (m_steady.measured)
+            std::printf("          steady state %.1f allocations of %.0f bytes, %.2f of them large, per frame of %.0f bytes\n",
+                m_steady.allocations, m_steady.bytes, m_steady.large, meanFrameBytes);
+        else
+            std::printf("          steady state not measured, no sample window had %.0f frames\n", STEADY_MIN_FRAMES);
+        std::printf("threads:  %u idle at the start, %.0f at most, %.0f idle at the end\n",
+            m_idleThreads, maxThreads, last.threads);
+        std::printf("stops:    slowest %.0f ms\n", m_slowestStopMs);
+
+        std::vector<std::string> failures;
+        if (m_stalls)
+            failures.push_back(std::to_string(m_stalls) + " frame stalls");
+        if (m_slowestStopMs > SLOW_STOP_MS)
+            failures.push_back("a sequence stop took " + std::to_string(static_cast<long>(m_slowestStopMs)) + " ms");
+        if (m_unexpectedErrors)
+            failures.push_back(std::to_string(m_unexpectedErrors) + " snaps or sequences failed away from faults");
+        if (!m_steady.measured)
+            failures.push_back("heap per frame not measured");
+        else if (m_steady.large >= 0.5)
+            failures.push_back("frames go through the heap");
+        if (last.threads > m_idleThreads)
+            failures.push_back("threads left behind");
+        if (runS - warmupS >= TREND_MIN_S)
+        {
+            if (heapTrend > LEAK_HEAP_MB_PER_H)
+                failures.push_back("the heap keeps growing");
+            if (rssTrend > LEAK_RSS_MB_PER_H)
+                failures.push_back("RSS keeps growing");
+        }
+        else
+        {
+            std::printf("too short to judge the trends, leaks need a run of %s\n",
+                FormatTime(TREND_MIN_S + warmupS).c_str());
+        }
+
+        if (failures.empty())
+        {
+            std::printf("passed\n");
+            return true;
+        }
+        std::printf("FAILED:");
+        for (size_t i = 0; i < failures.size(); ++i)
+            std::printf("%s %s", i ? "," : "", failures[i].c_str());
+        std::printf("\n");
+        return false;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.seed = std::random_device()();
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(argv[i], "-v"))
+            options.verbose = true;
+        else if (!std::strcmp(argv[i], "--duration") && hasValue && ParseDuration(argv[i + 1], options.durationS))
+            ++i;
+        else if (!std::strcmp(argv[i], "--report") && hasValue && ParseDuration(argv[i + 1], options.reportS))
+            ++i;
+        else if (!std::strcmp(argv[i], "--seed") && hasValue)
+            options.seed = std::strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--duration 1h] [--report 1m] [--seed N] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // a packing camera, so the adaptive bit depth gets soaked too
+    SimulatedAbiCam::Settings settings;
+    settings.packed = true;
+    SimulatedRig rig(settings);
+    rig.GetCore().SetVerbose(options.verbose);
+    std::string error;
+    if (!rig.Start(error))
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        rig.GetCore().PrintRecentLog(20);
+        return 2;
+    }
+    std::printf("simulated camera on %s, soaking for %s with seed %lu\n", rig.GetLink().GetPortName().c_str(),
+        FormatTime(options.durationS).c_str(), options.seed);
+
+    bool passed = false;
+    {
+        Soak soak(rig, options);
+        soak.Setup();
+        soak.Run();
+        passed = soak.Finish();
+        rig.Stop();
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,458 @@
+#include "AbiCamera.h"
+#include "SimulatedRig.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* Runs the adapter's triggered acquisition against the simulated camera
+* on a pty and checks what the firmware and the host see.
+*
+*   TriggerCheck [-v]
+*
+* Edge, gate and burst frames are checked for arrival and content, the
+* armed wait for blocking until the trigger, and the timeout and sequence
+* stop for ending the wait. The last two checks show the background of an
+* arming going stale as the sensor warms, and "Trigger Background Refresh
+* s" keeping it current. The camera packs samples under 8 bits, and a
+* 4-bit snap is checked for arriving in half the bytes and unpacking to
+* the 8-bit counts. -v prints the adapter's log. Exits non-zero if a
+* check fails.
+*/
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const double EXPOSURE_MS = 20.0;
+    const double MEAN_TOLERANCE = 4.0;
+
+    int g_failures = 0;
+
+    void Check(bool ok, const char* name, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+    void Check(bool ok, const char* name, const char* format, ...)
+    {
+        char detail[512];
+        va_list args;
+        va_start(args, format);
+        std::vsnprintf(detail, sizeof(detail), format, args);
+        va_end(args);
+
+        std::printf("%s %s%s%s\n", ok ? "ok  " : "FAIL", name, *detail ? ": " : "", detail);
+        if (!ok)
+            ++g_failures;
+    }
+
+    void Check(bool ok, const char* name)
+    {
+        Check(ok, name, "%s", "");
+    }
+
+    double ElapsedMs(Clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+
+    double Mean(const unsigned char* pixels, size_t count)
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < count; ++i)
+            sum += pixels[i];
+        return count ? sum / count : 0.0;
+    }
+
+    /**
+    * Fires a trigger input after a delay and then every period until
+    * stopped or destroyed.
+    */
+    class InputTrain
+    {
+    public:
+        InputTrain(std::function<void()> fire, double delayMs, double periodMs = 0.0) :
+            m_stop(false)
+        {
+            m_thread = std::thread([this, fire, delayMs, periodMs] {
+                auto next = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double, std::milli>(delayMs));
+                do
+                {
+                    while (!m_stop && Clock::now() < next)
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    if (m_stop)
+                        break;
+                    fire();
+                    next += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(periodMs));
+                } while (periodMs > 0.0);
+            });
+        }
+
+        ~InputTrain()
+        {
+            Stop();
+        }
+
+        void Stop()
+        {
+            m_stop = true;
+            if (m_thread.joinable())
+                m_thread.join();
+        }
+
+    private:
+        std::atomic<bool> m_stop;
+        std::thread m_thread;
+    };
+
+    /**
+    * Means of the frames the adapter inserts.
+    */
+    class FrameMeans
+    {
+    public:
+        explicit FrameMeans(FakeCore& core)
+        {
+            core.SetImageHandler([this](const FakeCore::Image& image) {
+                const double mean = Mean(image.pixels, static_cast<size_t>(image.width) * image.height * image.bytesPerPixel);
+                std::lock_guard<std::mutex> g(m_lock);
+                m_means.push_back(mean);
+            });
+        }
+
+        void Clear()
+        {
+            std::lock_guard<std::mutex> g(m_lock);
+            m_means.clear();
+        }
+
+        size_t Count() const
+        {
+            std::lock_guard<std::mutex> g(m_lock);
+            return m_means.size();
+        }
+
+        // mean of the last n frames
+        double Last(size_t n) const
+        {
+            std::lock_guard<std::mutex> g(m_lock);
+            n = std::min(n, m_means.size());
+            double sum = 0.0;
+            for (size_t i = m_means.size() - n; i < m_means.size(); ++i)
+                sum += m_means[i];
+            return n ? sum / n : 0.0;
+        }
+
+    private:
+        mutable std::mutex m_lock;
+        std::vector<double> m_means;
+    };
+
+    double SnapMean(MM::Camera& camera)
+    {
+        return Mean(camera.GetImageBuffer(),
+            static_cast<size_t>(camera.GetImageWidth()) * camera.GetImageHeight() * camera.GetImageBytesPerPixel());
+    }
+
+    /**
+    * Starts a sequence and waits for the adapter to report it finished.
+    * Returns the time it took, or a negative value if it never finished.
+    */
+    double RunSequence(SimulatedRig& rig, long frames, double waitMs, std::function<void()> during = nullptr)
+    {
+        rig.GetCore().ClearAcqFinished();
+        const auto start = Clock::now();
+        int ret = rig.GetCamera().StartSequenceAcquisition(frames, 0.0, false);
+        if (ret != DEVICE_OK)
+        {
+            std::printf("     sequence didn't start: %s\n", rig.ErrorText(ret).c_str());
+            return -1.0;
+        }
+        if (during)
+            during();
+        if (!rig.GetCore().WaitForAcqFinished(waitMs))
+        {
+            rig.GetCamera().StopSequenceAcquisition();
+            rig.GetCore().WaitForAcqFinished(waitMs);
+            return -1.0;
+        }
+        return ElapsedMs(start);
+    }
+
+    void CheckEdge(SimulatedRig& rig, FrameMeans& means)
+    {
+        MM::Camera& camera = rig.GetCamera();
+        SimulatedAbiCam& firmware = rig.GetFirmware();
+        const double signal = firmware.GetSignalMean(EXPOSURE_MS);
+        rig.Set(MM::g_Keyword_Trigger, "External Edge");
+        rig.Set("Trigger Timeout ms", "2000");
+
+        {
+            InputTrain pulse([&] { firmware.Pulse(); }, 150.0);
+            const auto start = Clock::now();
+            const int ret = camera.SnapImage();
+            const double waited = ElapsedMs(start);
+            Check(ret == DEVICE_OK && waited >= 140.0, "edge snap waits armed for the pulse",
+                "returned %d after %.0f ms", ret, waited);
+            const double mean = SnapMean(camera);
+            Check(std::abs(mean - signal) <= MEAN_TOLERANCE, "edge snap is the exposed frame",
+                "mean %.1f, expected %.1f", mean, signal);
+            Check(firmware.GetMode() == "edge", "edge snap leaves the camera armed", "firmware in %s mode",
+                firmware.GetMode().c_str());
+        }
+
+        rig.Set("Trigger Timeout ms", "400");
+        {
+            const auto start = Clock::now();
+            const int ret = camera.SnapImage();
+            const double waited = ElapsedMs(start);
+            Check(ret == ERR_TRIGGER_TIMEOUT && waited >= 390.0 && waited < 1400.0,
+                "edge snap without a pulse times out", "returned %d after %.0f ms", ret, waited);
+        }
+        {
+            InputTrain pulse([&] { firmware.Pulse(); }, 50.0);
+            const int ret = camera.SnapImage();
+            Check(ret == DEVICE_OK, "edge snap after a timeout gets the next pulse", "returned %d", ret);
+        }
+
+        rig.Set("Trigger Timeout ms", "2000");
+        {
+            const auto before = firmware.GetStats();
+            means.Clear();
+            InputTrain pulses([&] { firmware.Pulse(); }, 50.0, 100.0);
+            const double ms = RunSequence(rig, 10, 5000.0);
+            pulses.Stop();
+            const auto after = firmware.GetStats();
+            Check(ms > 0.0 && means.Count() == 10, "edge sequence takes a frame per pulse",
+                "%zu frames in %.0f ms, %lu pulses missed", means.Count(), ms, after.missedTriggers - before.missedTriggers);
+            Check(after.arms - before.arms == 1, "edge sequence arms once", "armed %lu times",
+                after.arms - before.arms);
+            Check(std::abs(means.Last(10) - signal) <= MEAN_TOLERANCE, "edge sequence frames are exposed",
+                "mean %.1f, expected %.1f", means.Last(10), signal);
+            Check(firmware.GetMode() == "internal", "edge sequence disarms at the end", "firmware in %s mode",
+                firmware.GetMode().c_str());
+        }
+
+        rig.Set("Trigger Timeout ms", "5000");
+        {
+            means.Clear();
+            Clock::time_point stopped;
+            const double ms = RunSequence(rig, 100, 3000.0, [&] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(300));
+                stopped = Clock::now();
+                camera.StopSequenceAcquisition();
+            });
+            const double afterStop = ElapsedMs(stopped);
+            Check(ms > 0.0 && afterStop < 1000.0 && means.Count() == 0, "stopping a sequence ends the armed wait",
+                "finished %.0f ms after the stop, %zu frames", afterStop, means.Count());
+        }
+
+        rig.Set("Trigger Timeout ms", "400");
+        {
+            means.Clear();
+            const double ms = RunSequence(rig, 100, 3000.0);
+            Check(ms >= 390.0 && ms < 1500.0 && means.Count() == 0, "sequence without pulses ends at the timeout",
+                "finished after %.0f ms, %zu frames", ms, means.Count());
+        }
+    }
+
+    void CheckGate(SimulatedRig& rig, FrameMeans& means)
+    {
+        MM::Camera& camera = rig.GetCamera();
+        SimulatedAbiCam& firmware = rig.GetFirmware();
+        rig.Set(MM::g_Keyword_Trigger, "External Gate");
+        rig.Set("Trigger Timeout ms", "2000");
+
+        auto gate = [&](double widthMs) {
+            return [&firmware, widthMs] {
+                firmware.SetGate(true);
+                std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(widthMs));
+                firmware.SetGate(false);
+            };
+        };
+
+        {
+            InputTrain input(gate(40.0), 100.0);
+            const auto start = Clock::now();
+            const int ret = camera.SnapImage();
+            const double waited = ElapsedMs(start);
+            Check(ret == DEVICE_OK && waited >= 135.0, "gate snap waits for the gate to close",
+                "returned %d after %.0f ms", ret, waited);
+            const double mean = SnapMean(camera);
+            const double expected = firmware.GetSignalMean(40.0);
+            Check(std::abs(mean - expected) <= MEAN_TOLERANCE, "gate snap is exposed for the gate",
+                "mean %.1f, expected %.1f", mean, expected);
+        }
+
+        rig.Set("Trigger Timeout ms", "400");
+        {
+            const auto start = Clock::now();
+            const int ret = camera.SnapImage();
+            const double waited = ElapsedMs(start);
+            Check(ret == ERR_TRIGGER_TIMEOUT && waited >= 390.0 && waited < 1400.0,
+                "gate snap without a gate times out", "returned %d after %.0f ms", ret, waited);
+        }
+
+        rig.Set("Trigger Timeout ms", "2000");
+        {
+            means.Clear();
+            InputTrain input(gate(30.0), 50.0, 150.0);
+            const double ms = RunSequence(rig, 5, 5000.0);
+            input.Stop();
+            const double expected = firmware.GetSignalMean(30.0);
+            Check(ms > 0.0 && means.Count() == 5, "gate sequence takes a frame per gate", "%zu frames in %.0f ms",
+                means.Count(), ms);
+            Check(std::abs(means.Last(5) - expected) <= MEAN_TOLERANCE, "gate sequence frames are exposed for the gate",
+                "mean %.1f, expected %.1f", means.Last(5), expected);
+        }
+    }
+
+    void CheckBurst(SimulatedRig& rig, FrameMeans& means)
+    {
+        MM::Camera& camera = rig.GetCamera();
+        SimulatedAbiCam& firmware = rig.GetFirmware();
+        if (!rig.Set(MM::g_Keyword_Trigger, "Software Burst"))
+        {
+            Check(false, "burst mode offered for a firmware listing burst");
+            return;
+        }
+        rig.Set("Trigger Timeout ms", "2000");
+
+        {
+            const int ret = camera.SnapImage();
+            Check(ret == DEVICE_OK, "burst snap", "returned %d", ret);
+        }
+        {
+            const auto before = firmware.GetStats();
+            means.Clear();
+            const double ms = RunSequence(rig, 8, 5000.0);
+            const auto after = firmware.GetStats();
+            Check(ms > 0.0 && means.Count() == 8, "burst sequence takes its frames back to back",
+                "%zu frames in %.0f ms", means.Count(), ms);
+            Check(after.arms - before.arms == 1, "burst sequence arms once", "armed %lu times", after.arms - before.arms);
+            Check(firmware.GetMode() == "internal", "burst ends in internal mode", "firmware in %s mode",
+                firmware.GetMode().c_str());
+        }
+    }
+
+    /**
+    * Warms the sensor during an edge sequence; returns how far the mean of
+    * the last frames is above the signal, and the armings it took.
+    */
+    double WarmDuringSequence(SimulatedRig& rig, FrameMeans& means, unsigned long& arms)
+    {
+        SimulatedAbiCam& firmware = rig.GetFirmware();
+        rig.Set(MM::g_Keyword_Trigger, "External Edge");
+        rig.Set("Trigger Timeout ms", "2000");
+
+        const auto before = firmware.GetStats();
+        means.Clear();
+        InputTrain pulses([&] { firmware.Pulse(); }, 50.0, 100.0);
+        InputTrain warm([&] { firmware.SetHeatLoad(15.0); }, 800.0);
+        RunSequence(rig, 40, 10000.0);
+        pulses.Stop();
+        arms = firmware.GetStats().arms - before.arms;
+
+        // let the sensor cool down for the next check
+        firmware.SetHeatLoad(0.0);
+        std::this_thread::sleep_for(std::chrono::seconds(3));
+        return means.Last(5) - firmware.GetSignalMean(EXPOSURE_MS);
+    }
+
+    void CheckStaleBackground(SimulatedRig& rig, FrameMeans& means)
+    {
+        unsigned long arms = 0;
+        rig.Set("Trigger Background Refresh s", "0");
+        double excess = WarmDuringSequence(rig, means, arms);
+        Check(excess > 15.0 && arms == 1, "background of the arming goes stale as the sensor warms",
+            "%.1f counts above the signal after warming, armed %lu times", excess, arms);
+
+        rig.Set("Trigger Background Refresh s", "0.5");
+        excess = WarmDuringSequence(rig, means, arms);
+        Check(std::abs(excess) <= MEAN_TOLERANCE && arms > 1, "background refresh follows the warming",
+            "%.1f counts off the signal after warming, armed %lu times", excess, arms);
+        rig.Set("Trigger Background Refresh s", "0");
+    }
+
+    // bytes the firmware sent per frame and the mean of a snap at a bit depth
+    double SnapAtDepth(SimulatedRig& rig, const char* depth, double& bytesPerFrame)
+    {
+        rig.Set("BitDepth", depth);
+        const auto before = rig.GetFirmware().GetStats();
+        const int ret = rig.GetCamera().SnapImage();
+        const auto after = rig.GetFirmware().GetStats();
+        const unsigned long frames = after.frames - before.frames;
+        bytesPerFrame = frames ? static_cast<double>(after.frameBytes - before.frameBytes) / frames : 0.0;
+        if (ret != DEVICE_OK)
+            std::printf("     snap at %s bits failed: %s\n", depth, rig.ErrorText(ret).c_str());
+        return ret == DEVICE_OK ? SnapMean(rig.GetCamera()) : -1.0;
+    }
+
+    void CheckPackedReadout(SimulatedRig& rig)
+    {
+        rig.Set(MM::g_Keyword_Trigger, "Internal");
+        rig.Set("Subtract Background", "0");
+        double fullBytes = 0.0;
+        double packedBytes = 0.0;
+        const double full = SnapAtDepth(rig, "8", fullBytes);
+        const double packed = SnapAtDepth(rig, "4", packedBytes);
+        rig.Set("BitDepth", "8");
+        rig.Set("Subtract Background", "1");
+
+        // unpacked 4-bit counts are a 16th of the 8-bit ones, less the dropped bits
+        Check(full > 0.0 && packed >= 0.0 && packedBytes * 2.0 == fullBytes &&
+            std::abs(packed * 16.0 - full) <= 16.0 + MEAN_TOLERANCE, "4-bit frames arrive packed and unpack",
+            "%.0f bytes per frame at 8 bits, %.0f at 4, means %.1f and %.1f", fullBytes, packedBytes, full, packed);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const bool verbose = argc > 1 && std::strcmp(argv[1], "-v") == 0;
+
+    SimulatedAbiCam::Settings settings;
+    settings.bytesPerSec = 16.0e6;
+    settings.coolTauS = 0.5;
+    settings.packed = true;
+    SimulatedRig rig(settings);
+    rig.GetCore().SetVerbose(verbose);
+
+    std::string error;
+    if (!rig.Start(error))
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        rig.GetCore().PrintRecentLog(20);
+        return 2;
+    }
+    std::printf("simulated camera on %s\n", rig.GetLink().GetPortName().c_str());
+
+    FrameMeans means(rig.GetCore());
+    rig.GetCamera().SetExposure(EXPOSURE_MS);
+    rig.Set("Subtract Background", "1");
+
+    CheckEdge(rig, means);
+    CheckGate(rig, means);
+    CheckBurst(rig, means);
+    CheckStaleBackground(rig, means);
+    CheckPackedReadout(rig);
+
+    const auto stats = rig.GetFirmware().GetStats();
+    std::printf("firmware: %lu commands, %lu frames (%lu triggered), %lu triggers missed, %lu protocol errors\n",
+        stats.commands, stats.frames, stats.triggeredFrames, stats.missedTriggers, stats.protocolErrors);
+    if (g_failures)
+    {
+        std::printf("%d checks failed, last adapter messages:\n", g_failures);
+        rig.GetCore().PrintRecentLog(30);
+    }
+    rig.Stop();
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,163 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+/**
+* Creates numThreads - 1 workers (the caller of ParallelFor is the last one).
+* With numThreads == 0 the pool is sized to the machine.
+*/
+WorkerPool::WorkerPool(unsigned numThreads) :
+    m_task(nullptr),
+    m_numTasks(0),
+    m_nextTask(0),
+    m_activeWorkers(0),
+    m_generation(0),
+    m_stop(false),
+    m_policyOwner(nullptr),
+    m_policyGeneration(0)
+{
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned i = 1; i < numThreads; ++i)
+        m_threads.emplace_back(&WorkerPool::WorkerLoop, this);
+}
+
+/**
+* The pool is created for the first user and destroyed with the last one.
+*/
+std::shared_ptr<WorkerPool> WorkerPool::Shared()
+{
+    static std::mutex lock;
+    static std::weak_ptr<WorkerPool> shared;
+
+    std::lock_guard<std::mutex> g(lock);
+    auto pool = shared.lock();
+    if (!pool)
+    {
+        pool = std::make_shared<WorkerPool>();
+        shared = pool;
+    }
+    return pool;
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        m_stop = true;
+    }
+    m_startCv.notify_all();
+    for (auto& t : m_threads)
+        t.join();
+}
+
+void WorkerPool::ParallelFor(size_t numTasks, const std::function<void(size_t)>& task)
+{
+    if (numTasks == 0)
+        return;
+
+    if (numTasks == 1 || m_threads.empty())
+    {
+        for (size_t i = 0; i < numTasks; ++i)
+            task(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> job(m_jobLock);
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        m_task = &task;
+        m_numTasks = numTasks;
+        m_nextTask = 0;
+        m_activeWorkers = m_threads.size();
+        ++m_generation;
+    }
+    m_startCv.notify_all();
+
+    RunTasks();
+
+    std::unique_lock<std::mutex> g(m_lock);
+    m_doneCv.wait(g, [this] { return m_activeWorkers == 0; });
+    m_task = nullptr;
+}
+
+/**
+* Returns false if another owner holds a policy; the default policy from
+* an owner that holds none changes nothing and is always accepted.
+*/
+bool WorkerPool::SetThreadPolicy(const ThreadPolicy& policy, const void* owner)
+{
+    const bool isDefault = policy == ThreadPolicy();
+    {
+        std::lock_guard<std::mutex> g(m_lock);
+        if (m_policyOwner && m_policyOwner != owner)
+            return isDefault;
+        if (!m_policyOwner && isDefault)
+            return true;
+
+        m_policyOwner = isDefault ? nullptr : owner;
+        m_policy = policy;
+        m_policyError.clear();
+        ++m_policyGeneration;
+    }
+    m_startCv.notify_all();
+    return true;
+}
+
+/**
+* Puts the workers back on the default policy if owner holds the current
+* one.
+*/
+void WorkerPool::ReleaseThreadPolicy(const void* owner)
+{
+    SetThreadPolicy(ThreadPolicy(), owner);
+}
+
+/**
+* What the OS refused when the workers applied the last policy, empty if
+* everything was granted.
+*/
+std::string WorkerPool::GetPolicyError() const
+{
+    std::lock_guard<std::mutex> g(m_lock);
+    return m_policyError;
+}
+
+void WorkerPool::WorkerLoop()
+{
+    unsigned long long seen = 0;
+    unsigned long long seenPolicy = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> g(m_lock);
+            m_startCv.wait(g, [&] { return m_stop || m_generation != seen || m_policyGeneration != seenPolicy; });
+            if (m_stop)
+                return;
+
+            if (m_policyGeneration != seenPolicy)
+            {
+                seenPolicy = m_policyGeneration;
+                std::string error;
+                if (!ApplyThreadPolicy(m_policy, error))
+                    m_policyError = error;
+            }
+            if (m_generation == seen)
+                continue;
+            seen = m_generation;
+        }
+
+        RunTasks();
+
+        std::lock_guard<std::mutex> g(m_lock);
+        if (--m_activeWorkers == 0)
+            m_doneCv.notify_one();
+    }
+}
+
+void WorkerPool::RunTasks()
+{
+    for (size_t i = m_nextTask++; i < m_numTasks; i = m_nextTask++)
+        (*m_task)(i);
+}
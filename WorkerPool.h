@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ThreadScheduling.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* Small fixed-size pool of worker threads.
+* ParallelFor splits a job into numTasks independent tasks and blocks until
+* all of them are done; the calling thread works on the job too. Jobs from
+* different callers are run one after another.
+*
+* Shared() returns one process-wide pool sized to the machine, so several
+* cameras in the same process don't oversubscribe the cores.
+*
+* SetThreadPolicy changes the scheduling and pinning of the worker threads;
+* each worker applies it as soon as it wakes up. The first owner to set a
+* policy other than the default holds it: the policies of other owners are
+* refused until it sets the default again or releases it, so one camera
+* can't re-pin the workers of another.
+*/
+class WorkerPool
+{
+public:
+    explicit WorkerPool(unsigned numThreads = 0);
+    ~WorkerPool();
+
+    static std::shared_ptr<WorkerPool> Shared();
+
+    unsigned Size() const { return static_cast<unsigned>(m_threads.size()) + 1; }
+
+    void ParallelFor(size_t numTasks, const std::function<void(size_t)>& task);
+
+    bool SetThreadPolicy(const ThreadPolicy& policy, const void* owner);
+    void ReleaseThreadPolicy(const void* owner);
+    std::string GetPolicyError() const;
+
+private:
+    void WorkerLoop();
+    void RunTasks();
+
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_jobLock;
+    mutable std::mutex m_lock;
+    std::condition_variable m_startCv;
+    std::condition_variable m_doneCv;
+
+    const std::function<void(size_t)>* m_task;
+    size_t m_numTasks;
+    std::atomic<size_t> m_nextTask;
+    size_t m_activeWorkers;
+    unsigned long long m_generation;
+    bool m_stop;
+
+    ThreadPolicy m_policy;
+    const void* m_policyOwner;
+    unsigned long long m_policyGeneration;
+    std::string m_policyError;
+};